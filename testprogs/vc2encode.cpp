@@ -37,6 +37,7 @@
 #include <sstream>
 
 #include <string>
+#include <vector>
 
 #include "tclap/CmdLine.h"
 
@@ -45,6 +46,14 @@
 
 void generateMovingZonePlate(uint8_t *odata, int w, int h, int stride);
 
+/* Sets a padding sample of planar input of either sample size to a bright value */
+static void set_sample(char *data, int bps, int i) {
+  if (bps == 1)
+    ((uint8_t*)data)[i] = 0xFF;
+  else
+    ((uint16_t*)data)[i] = 0x3FF;
+}
+
 void usage() {
   printf("Usage: vc2encode [options] [ input_file [output_file] ]\n");
   printf("  If no input is specified use internal zoneplate generator\n");
@@ -69,6 +78,8 @@ int main (int argc, char *argv[]) {
   bool disable_output         = false;
   bool interlace              = false;
   bool V210                   = false;
+  std::string format_string   = "planar";
+  VC2EncoderInputFormat input_format = VC2ENCODER_INPUT_10P2;
   int width                   = 1920;
   int height                  = 1080;
   int slice_width             = 32;
@@ -78,27 +89,44 @@ int main (int argc, char *argv[]) {
   bool zoneplate              = false;
   int speed                   = VC2ENCODER_SPEED_SLOWEST;
   int fragment_size           = 0;
+  std::string quant_matrix_string;
+  int qindex                  = -1;
+  bool lossless               = false;
+  float rate_buffer           = 0;
+  std::string chroma_string   = "422";
+  int chroma_format           = VC2ENCODER_CDS_422;
+  int bits                    = 10;
+  std::string matrix_string   = "";
+  int color_matrix            = -1;
 
   try {
     TCLAP::CmdLine cmd("VC2 HQ profile Encoder Example\n"
-                       "All input files must be yuv422p10le or v210\n"
+                       "All input files must be yuv422p10le (or yuv420p10le or yuv444p10le, see --chroma, and 8, 12 or 16 bit, see --bits) or one of the packed formats of --input-format\n"
                        "All output files will be vc2 streams\n"
                        "First file is input file, second is output, others are ignored", '=', "0.1", true);
 
     TCLAP::ValueArg<int> num_frames_arg          ("n", "num-frames",     "Number of frames to encode",          false, 1, "integer", cmd);
     TCLAP::ValueArg<float> ratio_arg               ("r", "ratio",          "r:1 compression ratio (float)",               false, 2, "float", cmd);
     TCLAP::ValueArg<int> num_threads_arg         ("t", "threads",        "Number of threads",                   false, 1, "integer", cmd);
-    TCLAP::ValueArg<std::string> wavelet_arg     ("w", "wavelet",        "wavelet kernel: `fidelity', `deslauriers-debuc-9-7', `deslauriers-debuc-13-7', `legall', `haar0', or `haar1'", false, "legall", "string", cmd);
-    TCLAP::ValueArg<int> depth_arg               ("d", "depth",          "wavelet depth",                       false, 3, "integer", cmd);
+    TCLAP::ValueArg<std::string> wavelet_arg     ("w", "wavelet",        "wavelet kernel: `fidelity', `deslauriers-debuc-9-7', `deslauriers-debuc-13-7', `legall', `haar0', `haar1', or `daubechies-9-7'", false, "legall", "string", cmd);
+    TCLAP::ValueArg<int> depth_arg               ("d", "depth",          "wavelet depth (1 to 8)",              false, 3, "integer", cmd);
     TCLAP::ValueArg<int> slice_width_arg         ("", "slicewidth",    "slice width",                         false, 32, "integer", cmd);
     TCLAP::ValueArg<int> slice_height_arg        ("", "sliceheight",   "slice height",                        false, 8, "integer", cmd);
     TCLAP::SwitchArg     disable_output_arg      ("", "disable-output", "disable output",                                           cmd, false);
-    TCLAP::ValueArg<std::string> speed_arg       ("", "speed",          "speed: slowest, slower, slow, medium (default), fast, faster, fastest", false, "medium", "string", cmd);
+    TCLAP::ValueArg<std::string> speed_arg       ("", "speed",          "speed: slowest, slower, slow, medium (default), fast, faster, fastest, rdo", false, "medium", "string", cmd);
     TCLAP::SwitchArg     interlace_arg           ("", "interlace",      "interlaced output",                                        cmd, false);
-    TCLAP::SwitchArg     V210_arg                ("", "V210",           "V210 input",                                               cmd, false);
+    TCLAP::SwitchArg     V210_arg                ("", "V210",           "V210 input (the same as --input-format=v210)",             cmd, false);
+    TCLAP::ValueArg<std::string> format_arg      ("", "input-format",   "input format: `planar' (default), `planar8', `uyvy', `yuy2', `v210', `uyvy10', `p210', `p010', `v410', `y416', `x2rgb10' or `bgra'", false, "planar", "string", cmd);
     TCLAP::ValueArg<int> width_arg               ("", "width",          "frame width",                         false, 1920, "integer", cmd);
     TCLAP::ValueArg<int> height_arg              ("", "height",         "frame height",                        false, 1080, "integer", cmd);
     TCLAP::ValueArg<int> fragments_arg           ("f", "fragment",      "maximum size for picture fragments (default is don't fragment)",  false, 0,  "integer", cmd);
+    TCLAP::ValueArg<int> qindex_arg              ("q", "qindex",        "code every slice at this qindex, 0 to 64, for pictures of variable length (default is to code to the ratio)", false, -1, "integer", cmd);
+    TCLAP::SwitchArg     lossless_arg            ("", "lossless",       "code losslessly, every slice at qindex 0 (LeGall or Haar only)", cmd, false);
+    TCLAP::ValueArg<float> rate_buffer_arg       ("b", "rate-buffer",   "vary picture lengths with their content through a rate control buffer of this many mean pictures (float, default is every picture the same length)", false, 0, "float", cmd);
+    TCLAP::ValueArg<std::string> chroma_arg      ("", "chroma",         "chroma format of planar or RGB input: `420', `422' (default), or `444'", false, "422", "string", cmd);
+    TCLAP::ValueArg<int> bits_arg                ("", "bits",           "active bits of each sample of planar input: 8, 10 (default), 12 or 16", false, 10, "integer", cmd);
+    TCLAP::ValueArg<std::string> matrix_arg      ("", "color-matrix",   "colour matrix to signal, and to convert RGB input with: `hdtv' (default), `sdtv' or `rgb' (RGB coded as RGB, 4:4:4 only)", false, "", "string", cmd);
+    TCLAP::ValueArg<std::string> quant_matrix_arg("", "quant-matrix",   "custom quantisation matrix: LL then HL,LH,HH for each level from the lowest, comma separated (default is the preset)", false, "", "string", cmd);
     
     TCLAP::UnlabeledMultiArg<std::string> file_args("input_file",   "encoded input file",                          false, "string", cmd);
 
@@ -115,9 +143,17 @@ int main (int argc, char *argv[]) {
     speed_string        = speed_arg.getValue();
     interlace           = interlace_arg.getValue();
     V210                = V210_arg.getValue();
+    format_string       = format_arg.getValue();
     width               = width_arg.getValue();
     height              = height_arg.getValue();
     fragment_size       = fragments_arg.getValue();
+    quant_matrix_string = quant_matrix_arg.getValue();
+    qindex              = qindex_arg.getValue();
+    lossless            = lossless_arg.getValue();
+    rate_buffer         = rate_buffer_arg.getValue();
+    chroma_string       = chroma_arg.getValue();
+    bits                = bits_arg.getValue();
+    matrix_string       = matrix_arg.getValue();
 
     std::vector<std::string> filenames = file_args.getValue();
     if (filenames.size() > 0) {
@@ -145,10 +181,112 @@ int main (int argc, char *argv[]) {
       speed = VC2ENCODER_SPEED_FASTER;
     else if (speed_string == "fastest")
       speed = VC2ENCODER_SPEED_FASTEST;
+    else if (speed_string == "rdo")
+      speed = VC2ENCODER_SPEED_RDO;
     else {
       printf("Inavlid speed selected\n\n");
       return 1;
     }
+
+    if (chroma_string == "420")
+      chroma_format = VC2ENCODER_CDS_420;
+    else if (chroma_string == "422")
+      chroma_format = VC2ENCODER_CDS_422;
+    else if (chroma_string == "444")
+      chroma_format = VC2ENCODER_CDS_444;
+    else {
+      printf("Invalid chroma format selected\n\n");
+      return 1;
+    }
+
+    if (V210)
+      format_string = "v210";
+    if (format_string == "planar")
+      input_format = VC2ENCODER_INPUT_10P2;
+    else if (format_string == "planar8")
+      input_format = VC2ENCODER_INPUT_8P2;
+    else if (format_string == "uyvy")
+      input_format = VC2ENCODER_INPUT_UYVY;
+    else if (format_string == "yuy2")
+      input_format = VC2ENCODER_INPUT_YUY2;
+    else if (format_string == "v210")
+      input_format = VC2ENCODER_INPUT_V210;
+    else if (format_string == "uyvy10")
+      input_format = VC2ENCODER_INPUT_UYVY10;
+    else if (format_string == "p210")
+      input_format = VC2ENCODER_INPUT_P210;
+    else if (format_string == "p010")
+      input_format = VC2ENCODER_INPUT_P010;
+    else if (format_string == "v410")
+      input_format = VC2ENCODER_INPUT_V410;
+    else if (format_string == "y416")
+      input_format = VC2ENCODER_INPUT_Y416;
+    else if (format_string == "x2rgb10")
+      input_format = VC2ENCODER_INPUT_X2RGB10;
+    else if (format_string == "bgra")
+      input_format = VC2ENCODER_INPUT_BGRA;
+    else {
+      printf("Invalid input format selected\n\n");
+      return 1;
+    }
+
+    /* The 8 bit formats carry nothing else */
+    if (input_format == VC2ENCODER_INPUT_8P2 || input_format == VC2ENCODER_INPUT_UYVY || input_format == VC2ENCODER_INPUT_YUY2 || input_format == VC2ENCODER_INPUT_BGRA) {
+      if (bits_arg.isSet() && bits != 8) {
+        printf("The input format can only be 8 bit\n\n");
+        return 1;
+      }
+      bits = 8;
+    }
+
+    if (matrix_string == "")
+      color_matrix = -1;
+    else if (matrix_string == "hdtv")
+      color_matrix = VC2ENCODER_CMA_HDTV;
+    else if (matrix_string == "sdtv")
+      color_matrix = VC2ENCODER_CMA_SDTV;
+    else if (matrix_string == "rgb")
+      color_matrix = VC2ENCODER_CMA_RGB;
+    else {
+      printf("Invalid colour matrix selected\n\n");
+      return 1;
+    }
+
+    /* RGB input is matrixed to the chroma format selected, or coded as
+       RGB in 4:4:4 */
+    if (input_format == VC2ENCODER_INPUT_X2RGB10 || input_format == VC2ENCODER_INPUT_BGRA) {
+      if (input_format == VC2ENCODER_INPUT_X2RGB10 && bits_arg.isSet() && bits != 10) {
+        printf("The input format can only be 10 bit\n\n");
+        return 1;
+      }
+      if (input_format == VC2ENCODER_INPUT_X2RGB10)
+        bits = 10;
+      if (color_matrix == VC2ENCODER_CMA_RGB) {
+        if (chroma_arg.isSet() && chroma_format != VC2ENCODER_CDS_444) {
+          printf("RGB can only be coded as RGB in 4:4:4\n\n");
+          return 1;
+        }
+        chroma_format = VC2ENCODER_CDS_444;
+      } else if (chroma_format == VC2ENCODER_CDS_420) {
+        printf("RGB input can only be converted to 4:2:2 or 4:4:4\n\n");
+        return 1;
+      }
+    }
+
+    /* Every format other than planar carries its own chroma format */
+    if (input_format != VC2ENCODER_INPUT_10P2 && input_format != VC2ENCODER_INPUT_8P2 &&
+        input_format != VC2ENCODER_INPUT_X2RGB10 && input_format != VC2ENCODER_INPUT_BGRA) {
+      int format_chroma = VC2ENCODER_CDS_422;
+      if (input_format == VC2ENCODER_INPUT_P010)
+        format_chroma = VC2ENCODER_CDS_420;
+      else if (input_format == VC2ENCODER_INPUT_V410 || input_format == VC2ENCODER_INPUT_Y416)
+        format_chroma = VC2ENCODER_CDS_444;
+      if (chroma_arg.isSet() && chroma_format != format_chroma) {
+        printf("The input format does not carry the chroma format selected\n\n");
+        return 1;
+      }
+      chroma_format = format_chroma;
+    }
   } catch (TCLAP::ArgException &e) {
     std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl; return 1;
   }
@@ -167,11 +305,31 @@ int main (int argc, char *argv[]) {
     wavelet = VC2ENCODER_WFT_HAAR_NO_SHIFT;
   else if (wavelet_string == "haar1")
     wavelet = VC2ENCODER_WFT_HAAR_SINGLE_SHIFT;
+  else if (wavelet_string == "daubechies-9-7")
+    wavelet = VC2ENCODER_WFT_DAUBECHIES_9_7;
   else {
     printf("Inavlid wavelet selected\n\n");
     return 1;
   }
 
+  if (zoneplate && (chroma_format != VC2ENCODER_CDS_422 || bits != 10 || input_format != VC2ENCODER_INPUT_10P2)) {
+    printf("The zoneplate can only be 4:2:2 10 bit planar\n\n");
+    return 1;
+  }
+
+  if (bits != 10 && (input_format == VC2ENCODER_INPUT_V210 || input_format == VC2ENCODER_INPUT_UYVY10 || input_format == VC2ENCODER_INPUT_V410)) {
+    printf("The input format can only be 10 bit\n\n");
+    return 1;
+  }
+
+  if (bits == 8 && (input_format == VC2ENCODER_INPUT_P210 || input_format == VC2ENCODER_INPUT_P010 || input_format == VC2ENCODER_INPUT_Y416)) {
+    printf("The input format can only be 10, 12 or 16 bit\n\n");
+    return 1;
+  }
+
+  const int chroma_width  = (chroma_format == VC2ENCODER_CDS_444)?width:width/2;
+  const int chroma_height = (chroma_format == VC2ENCODER_CDS_420)?height/2:height;
+
   if (threads_number < 1)
     threads_number = 1;
   int stride = width;
@@ -235,18 +393,84 @@ int main (int argc, char *argv[]) {
       params.picture_coding_mode            = VC2ENCODER_PCM_FIELD;
     }
   }
+  if (chroma_format != VC2ENCODER_CDS_422) {
+    params.video_format.custom_color_diff_format_flag = 1;
+    params.video_format.color_diff_format_index       = chroma_format;
+  }
+  if (color_matrix >= 0) {
+    params.video_format.custom_color_spec_flag   = 1;
+    params.video_format.color_spec_index         = VC2ENCODER_CSP_CUSTOM;
+    params.video_format.custom_color_matrix_flag = 1;
+    params.video_format.color_matrix_index       = color_matrix;
+  }
+  switch (bits) {
+  case 8:
+    /* The encoder chooses the range of BGRA from the colour matrix */
+    if (input_format != VC2ENCODER_INPUT_BGRA) {
+      params.video_format.custom_signal_range_flag = 1;
+      params.video_format.signal_range_index       = VC2ENCODER_PSR_8BITVID;
+    }
+    break;
+  case 10:
+    break;
+  case 12:
+    params.video_format.custom_signal_range_flag = 1;
+    params.video_format.signal_range_index       = VC2ENCODER_PSR_12BITVID;
+    break;
+  case 16:
+    params.video_format.custom_signal_range_flag = 1;
+    params.video_format.signal_range_index       = VC2ENCODER_PSR_CUSTOM;
+    params.video_format.luma_offset              = 16 << 8;
+    params.video_format.luma_excursion           = 219 << 8;
+    params.video_format.color_diff_offset        = 128 << 8;
+    params.video_format.color_diff_excursion     = 224 << 8;
+    break;
+  default:
+    printf("Invalid bit depth selected\n\n");
+    return 1;
+  }
   params.transform_params.wavelet_index = wavelet;
   params.transform_params.wavelet_depth = depth;
   params.transform_params.slice_width   = slice_width;
   params.transform_params.slice_height  = slice_height;
+  if (quant_matrix_string != "") {
+    std::vector<uint32_t> values;
+    std::stringstream ss(quant_matrix_string);
+    std::string value;
+    while (std::getline(ss, value, ','))
+      values.push_back(strtoul(value.c_str(), NULL, 10));
+    if ((int)values.size() != 1 + 3*depth) {
+      printf("Custom quantisation matrix needs %d values for depth %d\n\n", 1 + 3*depth, depth);
+      return 1;
+    }
+    params.transform_params.custom_quant_matrix_flag = 1;
+    params.transform_params.quant_matrix_LL = values[0];
+    for (int l = 0; l < depth; l++) {
+      params.transform_params.quant_matrix_HL[l] = values[1 + 3*l];
+      params.transform_params.quant_matrix_LH[l] = values[2 + 3*l];
+      params.transform_params.quant_matrix_HH[l] = values[3 + 3*l];
+    }
+  }
 
   params.n_threads                      = threads_number;
   params.speed                          = speed;
-  if (!V210)
-    params.input_format                   = VC2ENCODER_INPUT_10P2;
-  else
-    params.input_format                   = VC2ENCODER_INPUT_V210;
+  params.input_format                   = input_format;
   params.fragment_size = fragment_size;
+  /* Lossless pictures are coded as fixed qindex pictures at qindex 0 */
+  if (lossless) {
+    params.lossless_flag = 1;
+    if (qindex < 0)
+      qindex = 0;
+  }
+  if (qindex >= 0) {
+    params.fixed_qindex_flag = 1;
+    params.fixed_qindex      = qindex;
+  }
+  int bytes_per_picture = ((width*height + 2*chroma_width*chroma_height)*bits/(8*ratio*(interlace?2:1)));
+  if (rate_buffer > 0) {
+    params.rate_control_flag        = 1;
+    params.rate_control_buffer_size = (int)(rate_buffer*bytes_per_picture);
+  }
 
   r = vc2encode_set_parameters(encoder, params);
   if (r != VC2ENCODER_OK) {
@@ -294,10 +518,27 @@ int main (int argc, char *argv[]) {
   */
   int readframes = 0;
   if (!zoneplate) {
-    if (V210) {
-      /* V210 Input Format */
+    if (input_format == VC2ENCODER_INPUT_V210 ||
+        input_format == VC2ENCODER_INPUT_UYVY10 ||
+        input_format == VC2ENCODER_INPUT_V410 ||
+        input_format == VC2ENCODER_INPUT_Y416 ||
+        input_format == VC2ENCODER_INPUT_UYVY ||
+        input_format == VC2ENCODER_INPUT_YUY2 ||
+        input_format == VC2ENCODER_INPUT_X2RGB10 ||
+        input_format == VC2ENCODER_INPUT_BGRA) {
+      /* Packed Input Formats, all components in one buffer */
+      int linelength;
+      if (input_format == VC2ENCODER_INPUT_V210)
+        linelength = ((width + 47)/48)*128;
+      else if (input_format == VC2ENCODER_INPUT_Y416)
+        linelength = width*8;
+      else if (input_format == VC2ENCODER_INPUT_UYVY || input_format == VC2ENCODER_INPUT_YUY2)
+        linelength = width*2;
+      else
+        linelength = width*4;
+
       pad_top = pad_bot = 8;
-      stride = ((((width + 47)/48)*128 + 4095)/4096)*4096;
+      stride = ((linelength + 4095)/4096)*4096;
 
       int f = open(input_filename.c_str(), O_RDONLY);
       if (!f) {
@@ -306,7 +547,6 @@ int main (int argc, char *argv[]) {
       }
 
       int length = stride*(pad_top + height + pad_bot)*sizeof(uint8_t);
-      int linelength = ((width + 47)/48)*128;
 
       ssize_t s;
       for (int i = 0; i < num_frames; i++) {
@@ -368,22 +608,25 @@ int main (int argc, char *argv[]) {
           ipictures[i][2] = NULL;
         }
       }
-    } else {
-      /* Planar input format */
+    } else if (input_format == VC2ENCODER_INPUT_P210 || input_format == VC2ENCODER_INPUT_P010) {
+      /* Semi-planar input format, a luma plane then an interleaved Cb Cr plane */
       pad_top = pad_bot = 8;
       stride = ((width*2 + 4095)/4096)*2048;
 
       int f = open(input_filename.c_str(), O_RDONLY);
-      int length = stride*(pad_top + height + pad_bot)*2*sizeof(uint16_t);
       int linelength = width*sizeof(uint16_t);
+      int chroma_linelength = 2*chroma_width*sizeof(uint16_t);
 
       int LUMA_SIZE   = stride*(pad_top + height + pad_bot)*sizeof(uint16_t);
-      int CHROMA_SIZE = stride/2*(pad_top + height + pad_bot)*sizeof(uint16_t);
+      int CHROMA_SIZE = stride*(pad_top + chroma_height + pad_bot)*sizeof(uint16_t);
+      int length = LUMA_SIZE + CHROMA_SIZE;
 
       ssize_t s;
       for (int i = 0; i < num_frames; i++) {
         int linesread = 0;
         idata[i] = (char *)malloc(length);
+        for (int x = 0; x < length/2; x++)
+          ((uint16_t*)idata[i])[x] = 0xFFFF;
 
         for (int y = pad_top; y < height + pad_top; y++) {
           s = read(f, idata[i] + y*stride*sizeof(uint16_t), linelength);
@@ -391,19 +634,88 @@ int main (int argc, char *argv[]) {
             break;
           linesread++;
         }
-        for (int y = pad_top; y < height + pad_top; y++) {
-          s = read(f, idata[i] + LUMA_SIZE + y*stride/2*sizeof(uint16_t), linelength/2);
-          if (s < linelength/2)
+        for (int y = pad_top; y < chroma_height + pad_top; y++) {
+          s = read(f, idata[i] + LUMA_SIZE + y*stride*sizeof(uint16_t), chroma_linelength);
+          if (s < chroma_linelength)
             break;
           linesread++;
         }
+        if (linesread < height + chroma_height) {
+          free(idata[i]);
+          idata[i] = NULL;
+          break;
+        }
+
+        readframes = i + 1;
+      }
+
+      close(f);
+      printf("Read %d frames in %dbytes of input data\n", readframes, readframes*(height*linelength + chroma_height*chroma_linelength));
+
+      if (interlace) {
+        istride[0] = stride*2;
+        istride[1] = stride*2;
+        istride[2] = 0;
+
+        for (int i =0; i < readframes; i++) {
+          ipictures[2*i + 0][0] = idata[i] + pad_top*stride*sizeof(uint16_t);
+          ipictures[2*i + 0][1] = idata[i] + LUMA_SIZE + pad_top*stride*sizeof(uint16_t);
+          ipictures[2*i + 0][2] = NULL;
+
+          ipictures[2*i + 1][0] = idata[i] + pad_top*stride*sizeof(uint16_t) + stride*sizeof(uint16_t);
+          ipictures[2*i + 1][1] = idata[i] + LUMA_SIZE + pad_top*stride*sizeof(uint16_t) + stride*sizeof(uint16_t);
+          ipictures[2*i + 1][2] = NULL;
+        }
+      } else {
+        istride[0] = stride;
+        istride[1] = stride;
+        istride[2] = 0;
+
+        for (int i =0; i < readframes; i++) {
+          ipictures[i][0] = idata[i] + pad_top*stride*sizeof(uint16_t);
+          ipictures[i][1] = idata[i] + LUMA_SIZE + pad_top*stride*sizeof(uint16_t);
+          ipictures[i][2] = NULL;
+        }
+      }
+    } else {
+      /* Planar input format, 16 bit words or for 8P2 bytes */
+      const int bps = (input_format == VC2ENCODER_INPUT_8P2)?1:2;
+      pad_top = pad_bot = 8;
+      stride = ((width*2 + 4095)/4096)*2048;
+      const int chroma_stride = (chroma_format == VC2ENCODER_CDS_444)?stride:stride/2;
+
+      int f = open(input_filename.c_str(), O_RDONLY);
+      int linelength = width*bps;
+      int chroma_linelength = chroma_width*bps;
+
+      int LUMA_SIZE   = stride*(pad_top + height + pad_bot)*bps;
+      int CHROMA_SIZE = chroma_stride*(pad_top + chroma_height + pad_bot)*bps;
+      int length = LUMA_SIZE + 2*CHROMA_SIZE;
+
+      ssize_t s;
+      for (int i = 0; i < num_frames; i++) {
+        int linesread = 0;
+        idata[i] = (char *)malloc(length);
+
         for (int y = pad_top; y < height + pad_top; y++) {
-          s = read(f, idata[i] + LUMA_SIZE + CHROMA_SIZE + y*stride/2*sizeof(uint16_t), linelength/2);
-          if (s < linelength/2)
+          s = read(f, idata[i] + y*stride*bps, linelength);
+          if (s < linelength)
+            break;
+          linesread++;
+        }
+        for (int y = pad_top; y < chroma_height + pad_top; y++) {
+          s = read(f, idata[i] + LUMA_SIZE + y*chroma_stride*bps, chroma_linelength);
+          if (s < chroma_linelength)
+            break;
+          linesread++;
+        }
+        for (int y = pad_top; y < chroma_height + pad_top; y++) {
+          s = read(f, idata[i] + LUMA_SIZE + CHROMA_SIZE + y*chroma_stride*bps, chroma_linelength);
+          if (s < chroma_linelength)
             break;
           linesread++;
         }
-        if (linesread < 3*height) {
+        if (linesread < height + 2*chroma_height) {
           free(idata[i]);
           idata[i] = NULL;
           break;
@@ -413,28 +725,29 @@ int main (int argc, char *argv[]) {
       }
 
       close(f);
-      printf("Read %d frames in %dbytes of input data\n", readframes, readframes*height*linelength);
+      printf("Read %d frames in %dbytes of input data\n", readframes, readframes*(height*linelength + 2*chroma_height*chroma_linelength));
 
       for (int i = 0; i < readframes; i++) {
         for (int c = 0; c < 3; c++) {
           int OFFS = (c==0)?(0):((c == 1)?(LUMA_SIZE):(LUMA_SIZE + CHROMA_SIZE));
-          int st = (c==0)?(stride):(stride/2);
-          int w  = (c==0)?(width):(width/2);
+          int st = (c==0)?(stride):(chroma_stride);
+          int w  = (c==0)?(width):(chroma_width);
+          int h  = (c==0)?(height):(chroma_height);
           int y = 0;
           for (y = 0; y < pad_top; y++) {
             for (int x = 0; x < st; x ++) {
-              ((uint16_t*)idata[i])[OFFS/2 + y*st + x] = 0x3FF;
+              set_sample(idata[i], bps, OFFS/bps + y*st + x);
             }
           }
-          for (; y < height + pad_top; y++) {
+          for (; y < h + pad_top; y++) {
             int x;
             for (x = w; x < st; x++) {
-              ((uint16_t*)idata[i])[OFFS/2 + y*st + x] = 0x3FF;
+              set_sample(idata[i], bps, OFFS/bps + y*st + x);
             }
           }
-          for (; y < pad_top + height + pad_bot; y++) {
+          for (; y < pad_top + h + pad_bot; y++) {
             for (int x = 0; x < st; x ++) {
-              ((uint16_t*)idata[i])[OFFS/2 + y*st + x] = 0x3FF;
+              set_sample(idata[i], bps, OFFS/bps + y*st + x);
             }
           }
         }
@@ -442,27 +755,27 @@ int main (int argc, char *argv[]) {
 
       if (interlace) {
         istride[0] = stride*2;
-        istride[1] = stride;
-        istride[2] = stride;
+        istride[1] = chroma_stride*2;
+        istride[2] = chroma_stride*2;
 
         for (int i =0; i < readframes; i++) {
-          ipictures[2*i + 0][0] = idata[i] + pad_top*stride*sizeof(uint16_t);
-          ipictures[2*i + 0][1] = idata[i] + LUMA_SIZE + pad_top*stride/2*sizeof(uint16_t);
-          ipictures[2*i + 0][2] = idata[i] + LUMA_SIZE + CHROMA_SIZE + pad_top*stride/2*sizeof(uint16_t);
+          ipictures[2*i + 0][0] = idata[i] + pad_top*stride*bps;
+          ipictures[2*i + 0][1] = idata[i] + LUMA_SIZE + pad_top*chroma_stride*bps;
+          ipictures[2*i + 0][2] = idata[i] + LUMA_SIZE + CHROMA_SIZE + pad_top*chroma_stride*bps;
 
-          ipictures[2*i + 1][0] = idata[i] + pad_top*stride*sizeof(uint16_t) + stride*sizeof(uint16_t);
-          ipictures[2*i + 1][1] = idata[i] + LUMA_SIZE + pad_top*stride/2*sizeof(uint16_t) + stride/2*sizeof(uint16_t);
-          ipictures[2*i + 1][2] = idata[i] + LUMA_SIZE + CHROMA_SIZE + pad_top*stride/2*sizeof(uint16_t) + stride/2*sizeof(uint16_t);
+          ipictures[2*i + 1][0] = idata[i] + pad_top*stride*bps + stride*bps;
+          ipictures[2*i + 1][1] = idata[i] + LUMA_SIZE + pad_top*chroma_stride*bps + chroma_stride*bps;
+          ipictures[2*i + 1][2] = idata[i] + LUMA_SIZE + CHROMA_SIZE + pad_top*chroma_stride*bps + chroma_stride*bps;
         }
       } else {
         istride[0] = stride;
-        istride[1] = stride/2;
-        istride[2] = stride/2;
+        istride[1] = chroma_stride;
+        istride[2] = chroma_stride;
 
         for (int i =0; i < readframes; i++) {
-          ipictures[i][0] = idata[i] + pad_top*stride*sizeof(uint16_t);
-          ipictures[i][1] = idata[i] + LUMA_SIZE + pad_top*stride/2*sizeof(uint16_t);
-          ipictures[i][2] = idata[i] + LUMA_SIZE + CHROMA_SIZE + pad_top*stride/2*sizeof(uint16_t);
+          ipictures[i][0] = idata[i] + pad_top*stride*bps;
+          ipictures[i][1] = idata[i] + LUMA_SIZE + pad_top*chroma_stride*bps;
+          ipictures[i][2] = idata[i] + LUMA_SIZE + CHROMA_SIZE + pad_top*chroma_stride*bps;
         }
       }
     }
@@ -514,7 +827,6 @@ int main (int argc, char *argv[]) {
   int num_output_pictures = MIN(num_frames, readframes)*(interlace?2:1);
   if (disable_output) /* If output is disabled then only bother with space for one frame */
     num_output_pictures = (interlace?2:1);
-  int bytes_per_picture = (width*height*2*10/(8*ratio*(interlace?2:1)));
   printf("Setting bytes_per_picture=%d\n",bytes_per_picture);
 
   /* Get extra size needed for each frame to allow fragment headers */
@@ -525,7 +837,25 @@ int main (int argc, char *argv[]) {
     return 1;
   }
 
-  char *odata = (char *)malloc(seq_start_size + num_output_pictures*(pic_start_size + bytes_per_picture + pic_frag_size) + seq_end_size);
+  /* At a fixed qindex a picture can be up to the largest the slices allow,
+     and under rate control up to what the buffer allows */
+  uint32_t max_picture_size = pic_start_size + bytes_per_picture + pic_frag_size;
+  if (qindex >= 0) {
+    r = vc2encode_get_max_fixed_qindex_picture_size(encoder, &max_picture_size);
+    if (r != VC2ENCODER_OK) {
+      printf("Error in vc2encode_get_max_fixed_qindex_picture_size\n");
+      return 1;
+    }
+  } else if (rate_buffer > 0) {
+    r = vc2encode_get_max_rate_controlled_picture_size(encoder, bytes_per_picture, &max_picture_size);
+    if (r != VC2ENCODER_OK) {
+      printf("Error in vc2encode_get_max_rate_controlled_picture_size\n");
+      return 1;
+    }
+  }
+
+  char *odata = (char *)malloc(seq_start_size + num_output_pictures*max_picture_size + seq_end_size);
+  size_t output_length = 0;
 
 
 
@@ -554,6 +884,34 @@ int main (int argc, char *argv[]) {
     struct timespec start, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
     for (; n < num_output_pictures && total_frames_encoded < num_frames; n++) {
+      if (qindex >= 0) {
+        uint32_t length;
+        r = vc2encode_encode_fixed_qindex_picture(encoder, ipictures[n], istride, &o, parse_offset, n, &length, &parse_offset);
+        if (r != VC2ENCODER_OK) {
+          printf("Failed to encode picture\n");
+          err = 1;
+          break;
+        }
+
+        if (!interlace || (n%2 == 1))
+          total_frames_encoded++;
+        continue;
+      }
+
+      if (rate_buffer > 0) {
+        uint32_t length;
+        r = vc2encode_encode_rate_controlled_picture(encoder, ipictures[n], istride, &o, parse_offset, n, bytes_per_picture, &length, &parse_offset);
+        if (r != VC2ENCODER_OK) {
+          printf("Failed to encode picture\n");
+          err = 1;
+          break;
+        }
+
+        if (!interlace || (n%2 == 1))
+          total_frames_encoded++;
+        continue;
+      }
+
       /* Start picture */
       r = vc2encode_start_picture(encoder, &o, parse_offset, n, bytes_per_picture, &parse_offset);
       if (r != VC2ENCODER_OK) {
@@ -586,6 +944,7 @@ int main (int argc, char *argv[]) {
         break;
       }
     }
+    output_length = o - odata;
   }
 
   if (!err) {
@@ -597,11 +956,11 @@ int main (int argc, char *argv[]) {
   if (!err && !disable_output) {
     ssize_t s;
     int of = open(output_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 00777);
-    s = write(of, odata, seq_start_size + num_output_pictures*(pic_start_size + bytes_per_picture + pic_frag_size) + seq_end_size);
+    s = write(of, odata, output_length);
     if (s < 0)
       printf("Output error\n");
     else
-      printf("Wrote %d pictures in %d bytes\n", num_output_pictures, seq_start_size + num_output_pictures*(pic_start_size + bytes_per_picture + pic_frag_size) + seq_end_size);
+      printf("Wrote %d pictures in %d bytes\n", num_output_pictures, (int)output_length);
   }
 
   /* Destroy encoder */
@@ -0,0 +1,135 @@
+/*****************************************************************************
+ * bench_codewords.cpp : Codeword generation benchmark
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <cstdio>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "../vc2hqencode/lut.hpp"
+#include "../vc2hqencode/expgolomb.hpp"
+
+/* Reports the cost of making the codeword and wordlength of a quantised value
+   in cycles per value: looked up in CWLUT and WLLUT as the scalar coders do
+   by default, generated with the shift and mask spread as they do when
+   codeword_tables is cleared, and generated with pdep where the processor has
+   BMI2. The values are drawn from a few ranges, the last beyond the tables.
+   This is not run as part of "make check". */
+
+static const int N       = 1 << 16;
+static const int REPEATS = 50;
+
+typedef int (*CodeFunc)(const uint16_t *q, uint16_t *codewords, uint8_t *wordlengths);
+
+static int code_tables(const uint16_t *q, uint16_t *codewords, uint8_t *wordlengths) {
+  int length = 0;
+  for (int n = 0; n < N; n++) {
+    const int l = sample_wordlength<true>(q[n]);
+    codewords[n]   = sample_codeword<true>(q[n]);
+    wordlengths[n] = l;
+    length += l;
+  }
+  return length;
+}
+
+static int code_spread(const uint16_t *q, uint16_t *codewords, uint8_t *wordlengths) {
+  int length = 0;
+  for (int n = 0; n < N; n++) {
+    const int l = sample_wordlength<false>(q[n]);
+    codewords[n]   = sample_codeword<false>(q[n]);
+    wordlengths[n] = l;
+    length += l;
+  }
+  return length;
+}
+
+__attribute__((target("bmi2,lzcnt"))) static int code_pdep(const uint16_t *q, uint16_t *codewords, uint8_t *wordlengths) {
+  int length = 0;
+  for (int n = 0; n < N; n++) {
+    const uint32_t v = q[n] + 1;
+    const int k = 31 - _lzcnt_u32(v);
+    const int l = 2*k + 2 - (q[n] == 0);
+    codewords[n]   = ((_pdep_u32(v ^ (1 << k), 0x55555555) << 2) | 2) >> (q[n] == 0);
+    wordlengths[n] = l;
+    length += l;
+  }
+  return length;
+}
+
+static double time_code(CodeFunc f, const uint16_t *q, uint16_t *codewords, uint8_t *wordlengths, int *length) {
+  uint64_t best = ~(uint64_t)0;
+
+  for (int i = 0; i < REPEATS; i++) {
+    uint64_t start = __rdtsc();
+    *length = f(q, codewords, wordlengths);
+    uint64_t end = __rdtsc();
+    if (end - start < best)
+      best = end - start;
+  }
+
+  return (double)best/(double)N;
+}
+
+int main() {
+  __builtin_cpu_init();
+  const bool HAS_BMI2 = __builtin_cpu_supports("bmi2");
+
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Codeword generation, cycles per value\n");
+  printf("--------------------------------------------------------------------------------\n");
+
+  uint16_t *q           = (uint16_t *)memalign(32, N*sizeof(uint16_t));
+  uint16_t *codewords   = (uint16_t *)memalign(32, N*sizeof(uint16_t));
+  uint8_t  *wordlengths = (uint8_t  *)memalign(32, N*sizeof(uint8_t));
+
+  const int RANGES[] = { 4, 16, 64, 256, 1024 };
+  for (int r = 0; r < (int)(sizeof(RANGES)/sizeof(RANGES[0])); r++) {
+    /* Mostly zeros, as in the high frequency subbands, with the rest spread
+       evenly over the range */
+    for (int n = 0; n < N; n++)
+      q[n] = (rand()%4)?0:(rand()%RANGES[r]);
+
+    int ltables, lspread, lpdep;
+    printf("values below %4d:", RANGES[r]);
+    printf("  tables %5.2f", time_code(code_tables, q, codewords, wordlengths, &ltables));
+    printf("  spread %5.2f", time_code(code_spread, q, codewords, wordlengths, &lspread));
+    if (HAS_BMI2) {
+      printf("  pdep %5.2f", time_code(code_pdep, q, codewords, wordlengths, &lpdep));
+      if (lpdep != ltables)
+        printf("  [ pdep length mismatch ]");
+    }
+    if (lspread != ltables)
+      printf("  [ spread length mismatch ]");
+    printf("\n");
+  }
+
+  free(wordlengths);
+  free(codewords);
+  free(q);
+
+  return 0;
+}
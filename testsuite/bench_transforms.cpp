@@ -0,0 +1,112 @@
+/*****************************************************************************
+ * bench_transforms.cpp : Per-level timing of the horizontal transforms
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <cstdio>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include <vc2hqencode/vc2hqencode.h>
+#include "../vc2transform_c/transform_c.hpp"
+#include "../vc2transform_sse4_2/transform_sse4_2.hpp"
+#include "../vc2transform_avx/transform_avx.hpp"
+#include "../vc2transform_avx2/transform_avx2.hpp"
+
+/* Reports the cost of each horizontal transform level in cycles per
+   coefficient touched, ie. per sample of the subsampled plane the level
+   operates on. This is not run as part of "make check". */
+
+static const int WIDTH      = 1920;
+static const int HEIGHT     = 1088;
+static const int STRIDE     = 2048;
+static const int MAX_LEVEL  = 6;
+static const int REPEATS    = 20;
+
+static double time_htransform(InplaceTransform trans, void *idata, void *tdata, int coef_size, int level) {
+  const int skip = 1 << level;
+  const int length = STRIDE*HEIGHT*coef_size;
+  uint64_t best = ~(uint64_t)0;
+
+  for (int i = 0; i < REPEATS; i++) {
+    memcpy(tdata, idata, length);
+    uint64_t start = __rdtsc();
+    trans(tdata, STRIDE, WIDTH, HEIGHT, skip);
+    uint64_t end = __rdtsc();
+    if (end - start < best)
+      best = end - start;
+  }
+
+  return (double)best/((double)(WIDTH/skip)*(double)(HEIGHT/skip));
+}
+
+int main() {
+  __builtin_cpu_init();
+  const bool HAS_SSE4_2 = __builtin_cpu_supports("sse4.2");
+  const bool HAS_AVX    = __builtin_cpu_supports("avx");
+  const bool HAS_AVX2   = __builtin_cpu_supports("avx2");
+
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  LeGall 5,3 horizontal transform, cycles per coefficient (%dx%d)\n", WIDTH, HEIGHT);
+  printf("--------------------------------------------------------------------------------\n");
+
+  for (int coef_size = 2; coef_size <= 4; coef_size += 2) {
+    const int length = STRIDE*HEIGHT*coef_size;
+    void *idata = memalign(32, length);
+    void *tdata = memalign(32, length);
+    for (int i = 0; i < STRIDE*HEIGHT; i++) {
+      if (coef_size == 2)
+        ((int16_t *)idata)[i] = (rand()&0x3FF) - 512;
+      else
+        ((int32_t *)idata)[i] = (rand()&0x3FF) - 512;
+    }
+
+    for (int level = 0; level < MAX_LEVEL; level++) {
+      printf("%2d-bit level %d:", coef_size*8, level);
+
+      InplaceTransform c = get_htransform_c(VC2ENCODER_WFT_LEGALL_5_3, level, coef_size);
+      printf("  C %7.2f", time_htransform(c, idata, tdata, coef_size, level));
+      if (HAS_SSE4_2) {
+        InplaceTransform t = get_htransform_sse4_2(VC2ENCODER_WFT_LEGALL_5_3, level, coef_size);
+        printf("  SSE4.2 %7.2f", time_htransform(t, idata, tdata, coef_size, level));
+      }
+      if (HAS_AVX) {
+        InplaceTransform t = get_htransform_avx(VC2ENCODER_WFT_LEGALL_5_3, level, coef_size);
+        printf("  AVX %7.2f", time_htransform(t, idata, tdata, coef_size, level));
+      }
+      if (HAS_AVX2) {
+        InplaceTransform t = get_htransform_avx2(VC2ENCODER_WFT_LEGALL_5_3, level, coef_size);
+        printf("  AVX2 %7.2f", time_htransform(t, idata, tdata, coef_size, level));
+      }
+      printf("\n");
+    }
+
+    free(tdata);
+    free(idata);
+  }
+
+  return 0;
+}
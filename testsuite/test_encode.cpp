@@ -0,0 +1,749 @@
+/*****************************************************************************
+ * test_encode.cpp : Slice component coding tests
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <cstdio>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "../vc2hqencode/lut.hpp"
+#include "../vc2hqencode/expgolomb.hpp"
+#include "../vc2hqencode/quantise.hpp"
+#include "../vc2hqencode/encode_simd.hpp"
+#include "../vc2hqencode/ratedistortion.hpp"
+#include "../vc2hqencode/ratecontrol.hpp"
+#include "../vc2hqencode/datastructures.hpp"
+#include "../vc2hqencode/encode_lossless.hpp"
+
+struct encode_test {
+  int w;
+  int h;
+  int d;
+};
+
+/* The slice geometries the encoder has hand unrolled coders for, deeper
+   ones, and some whose sample counts leave partial vectors */
+const encode_test ENCODE_TEST[] = {
+  {  4,  8, 2 },
+  {  8,  8, 2 },
+  { 16,  8, 3 },
+  { 32,  8, 3 },
+  { 16, 16, 4 },
+  { 64, 32, 5 },
+  {  6,  4, 1 },
+  { 12,  8, 2 },
+  { 20,  8, 2 },
+};
+
+/* Checks the generated codewords against the interleaved exp-Golomb code
+   built a bit at a time, and against the tables over their range */
+static int perform_codewordtest() {
+  printf("Codeword generation: ");
+
+  for (uint32_t q = 0; q < 65536; q++) {
+    uint32_t v = q + 1;
+    int k = 0;
+    while (v >> (k + 1))
+      k++;
+    uint64_t cw = 0;
+    int l = 0;
+    for (int b = k - 1; b >= 0; b--) {
+      cw = (cw << 2) | ((v >> b)&0x1);
+      l += 2;
+    }
+    cw = (cw << 1) | 1;
+    l++;
+    if (q != 0) {
+      cw <<= 1;
+      l++;
+    }
+
+    if (exp_golomb_length(q) != l || exp_golomb_codeword(q) != cw) {
+      printf("%u: 0x%08x/%d vs 0x%08x/%d\nFAIL\n", q, (uint32_t)cw, l, exp_golomb_codeword(q), exp_golomb_length(q));
+      return 1;
+    }
+    if (q < 256 && (WLLUT[q] != l || CWLUT[q] != (uint16_t)cw)) {
+      printf("%u: 0x%04x/%d in the tables\nFAIL\n", q, CWLUT[q], WLLUT[q]);
+      return 1;
+    }
+  }
+
+  printf("[ PASS ]\n");
+  return 0;
+}
+
+/* The scalar coder as used by encode_slice_component, over coded order data */
+/* The quantised magnitudes the coding and length kernels should find, divided as
+   udiv<uint16_t> does for 16-bit coefficients, and exactly and saturated at
+   255 for 32-bit ones */
+template<class T> static uint32_t quantised_ref(const int32_t x, const uint16_t qf, const uint16_t m, const uint8_t sh, const uint8_t qshift) {
+  (void)qf;
+  return udiv<uint16_t>(abs(x), m, sh) >> qshift;
+}
+
+template<> uint32_t quantised_ref<int32_t>(const int32_t x, const uint16_t qf, const uint16_t, const uint8_t, const uint8_t qshift) {
+  return std::min<uint32_t>((4*(uint64_t)abs(x)/qf) >> qshift, 255);
+}
+
+template<class T> static void quantise_and_code_ref(const T *coefs, const int N, const uint16_t *qf, const uint16_t *m, const uint8_t *sh, const uint8_t qshift,
+                                                     uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples) {
+  int l = 0;
+  int last = -1;
+  for (int n = 0; n < N; n++) {
+    int32_t x = coefs[n];
+    uint32_t d = quantised_ref<T>(x, qf[n], m[n], sh[n], qshift);
+    codewords[n]   = CWLUT[d] | ((x >> 31)&0x1);
+    wordlengths[n] = WLLUT[d];
+    l += WLLUT[d];
+    if (x != 0)
+      last = n;
+  }
+  l -= (N - 1) - last;
+  *length  = (l + 7)/8;
+  *samples = last + 1;
+}
+
+static int compare_coded(const char *name, const int N, const uint16_t *rcw, const uint8_t *rwl, uint32_t rlength, int rsamples,
+                         const uint16_t *tcw, const uint8_t *twl, uint32_t tlength, int tsamples) {
+  if (rlength != tlength || rsamples != tsamples) {
+    printf("%s: length %u/%u, samples %d/%d\n", name, rlength, tlength, rsamples, tsamples);
+    return 1;
+  }
+  for (int n = 0; n < N; n++) {
+    if (rcw[n] != tcw[n] || rwl[n] != twl[n]) {
+      printf("%s: sample %d: 0x%04x/%d vs 0x%04x/%d\n", name, n, rcw[n], rwl[n], tcw[n], twl[n]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Coefficients and quantisation factors as for perform_codedlengthtest
+   below, with the matrices taken to be in coded order. There is no SSE4.2
+   coder for 32-bit coefficients, so sse4_2 may be NULL. */
+template<class T> static int perform_encodetest(const encode_test &data, const int range, bool HAS_SSE4_2, bool HAS_AVX2,
+                                                void (*sse4_2)(const T *, const int, const int, const int, const int, const typename QuantiserMultipliers<T>::type *, const uint16_t *, const uint8_t, uint16_t *, uint8_t *, uint32_t *, int *),
+                                                void (*avx2)(const T *, const int, const int, const int, const int, const typename QuantiserMultipliers<T>::type *, const uint16_t *, const uint8_t, uint16_t *, uint8_t *, uint32_t *, int *)) {
+  typedef typename QuantiserMultipliers<T>::type MT;
+  const int N = data.w*data.h;
+  const int istride = data.w + 8;
+  int r = 0;
+
+  T        *idata = (T        *)malloc(istride*data.h*sizeof(T));
+  T        *coefs = (T        *)malloc(N*sizeof(T));
+  uint16_t *qf    = (uint16_t *)malloc(N*sizeof(uint16_t));
+  uint16_t *m     = (uint16_t *)malloc(N*sizeof(uint16_t));
+  MT       *tm    = (MT       *)malloc(N*sizeof(MT));
+  uint8_t  *sh    = (uint8_t  *)malloc(N*sizeof(uint8_t));
+  uint16_t *shm   = (uint16_t *)malloc(N*sizeof(uint16_t));
+  uint16_t *rcw   = (uint16_t *)malloc(N*sizeof(uint16_t));
+  uint8_t  *rwl   = (uint8_t  *)malloc(N*sizeof(uint8_t));
+  uint16_t *tcw   = (uint16_t *)malloc(N*sizeof(uint16_t));
+  uint8_t  *twl   = (uint8_t  *)malloc(N*sizeof(uint8_t));
+
+  printf("%2dx%-2d depth %d, %d-bit: ", data.w, data.h, data.d, (int)(8*sizeof(T)));
+
+  for (int trial = 0; !r && trial < 200; trial++) {
+    const int qf_min = (sizeof(T) == 4 && trial%5 == 4)?4:(4*range/255 + 1);
+    for (int n = 0; n < N; n++) {
+      qf[n] = qf_min + rand()%800;
+      Divisor<uint16_t> D(qf[n]);
+      m[n]   = D.m;
+      tm[n]  = Divisor<MT>(qf[n]).m;
+      sh[n]  = D.l - 2;
+      shm[n] = (sh[n] == 0)?0:(1 << (16 - sh[n]));
+    }
+    for (int i = 0; i < istride*data.h; i++)
+      idata[i] = (rand()%(2*range + 1)) - range;
+    if (trial%4 == 1) {
+      for (int i = rand()%(istride*data.h); i < istride*data.h; i++)
+        idata[i] = 0;
+    } else if (trial%4 == 2) {
+      for (int i = 0; i < istride*data.h; i++)
+        if (rand()%3)
+          idata[i] = 0;
+    } else if (trial%4 == 3) {
+      for (int i = 0; i < istride*data.h; i++)
+        idata[i] = 0;
+    }
+    const uint8_t qshift = trial%3;
+
+    slice_coded_order<T>(idata, istride, coefs, data.w, data.h, data.d);
+
+    uint32_t rlength;
+    int rsamples;
+    quantise_and_code_ref<T>(coefs, N, qf, m, sh, qshift, rcw, rwl, &rlength, &rsamples);
+
+    if (HAS_SSE4_2 && sse4_2) {
+      uint32_t tlength;
+      int tsamples;
+      sse4_2(idata, istride, data.w, data.h, data.d, tm, shm, qshift, tcw, twl, &tlength, &tsamples);
+      r |= compare_coded("SSE4.2", N, rcw, rwl, rlength, rsamples, tcw, twl, tlength, tsamples);
+    }
+
+    if (HAS_AVX2) {
+      uint32_t tlength;
+      int tsamples;
+      avx2(idata, istride, data.w, data.h, data.d, tm, shm, qshift, tcw, twl, &tlength, &tsamples);
+      r |= compare_coded("AVX2", N, rcw, rwl, rlength, rsamples, tcw, twl, tlength, tsamples);
+    }
+  }
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("%s%s\n", (HAS_SSE4_2 && sse4_2)?" SSE4.2 [ PASS ]":"", HAS_AVX2?" AVX2 [ PASS ]":"");
+
+  free(twl);
+  free(tcw);
+  free(rwl);
+  free(rcw);
+  free(shm);
+  free(sh);
+  free(tm);
+  free(m);
+  free(qf);
+  free(coefs);
+  free(idata);
+
+  return r;
+}
+
+/* The scalar length as found by coded_length_for_slice, over raster order
+   data and matrices */
+template<class T> static int coded_length_ref(const T *idata, const int istride, const int w, const int h, const int d,
+                                              const uint16_t *qf, const uint16_t *m, const uint8_t *sh, const uint8_t qshift) {
+  int l = 0;
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+      l += WLLUT[quantised_ref<T>(idata[y*istride + x], qf[y*w + x], m[y*w + x], sh[y*w + x], qshift)];
+
+  T coefs[w*h];
+  slice_coded_order<T>(idata, istride, coefs, w, h, d);
+  int last = -1;
+  for (int n = 0; n < w*h; n++)
+    if (coefs[n] != 0)
+      last = n;
+
+  return l - ((w*h - 1) - last);
+}
+
+/* Coefficients up to range in magnitude with quantisation factors from
+   4*range/255 up, so that the quantised values stay within the coding tables.
+   Every fifth trial of 32-bit coefficients uses factors from 4 up instead, so
+   that the quantised values saturate. */
+template<class T> static int perform_codedlengthtest(const encode_test &data, const int range, bool HAS_SSE4_2, bool HAS_AVX2,
+                                                     int (*sse4_2)(const T *, const int, const int, const int, const int, const typename QuantiserMultipliers<T>::type *, const uint16_t *, const uint8_t),
+                                                     int (*avx2)(const T *, const int, const int, const int, const int, const typename QuantiserMultipliers<T>::type *, const uint16_t *, const uint8_t)) {
+  typedef typename QuantiserMultipliers<T>::type MT;
+  const int N = data.w*data.h;
+  const int istride = data.w + 8;
+  int r = 0;
+
+  T        *idata = (T        *)malloc(istride*data.h*sizeof(T));
+  uint16_t *qf    = (uint16_t *)malloc(N*sizeof(uint16_t));
+  uint16_t *m     = (uint16_t *)malloc(N*sizeof(uint16_t));
+  MT       *tm    = (MT       *)malloc(N*sizeof(MT));
+  uint8_t  *sh    = (uint8_t  *)malloc(N*sizeof(uint8_t));
+  uint16_t *shm   = (uint16_t *)malloc(N*sizeof(uint16_t));
+
+  printf("%2dx%-2d depth %d, %d-bit lengths: ", data.w, data.h, data.d, (int)(8*sizeof(T)));
+
+  for (int trial = 0; !r && trial < 200; trial++) {
+    const int qf_min = (sizeof(T) == 4 && trial%5 == 4)?4:(4*range/255 + 1);
+    for (int n = 0; n < N; n++) {
+      qf[n] = qf_min + rand()%800;
+      Divisor<uint16_t> D(qf[n]);
+      m[n]   = D.m;
+      tm[n]  = Divisor<MT>(qf[n]).m;
+      sh[n]  = D.l - 2;
+      shm[n] = (sh[n] == 0)?0:(1 << (16 - sh[n]));
+    }
+    for (int i = 0; i < istride*data.h; i++)
+      idata[i] = (rand()%(2*range + 1)) - range;
+    if (trial%4 == 1) {
+      for (int i = rand()%(istride*data.h); i < istride*data.h; i++)
+        idata[i] = 0;
+    } else if (trial%4 == 2) {
+      for (int i = 0; i < istride*data.h; i++)
+        if (rand()%3)
+          idata[i] = 0;
+    } else if (trial%4 == 3) {
+      for (int i = 0; i < istride*data.h; i++)
+        idata[i] = 0;
+    }
+    const uint8_t qshift = trial%3;
+
+    const int rlength = coded_length_ref<T>(idata, istride, data.w, data.h, data.d, qf, m, sh, qshift);
+
+    if (HAS_SSE4_2) {
+      const int tlength = sse4_2(idata, istride, data.w, data.h, data.d, tm, shm, qshift);
+      if (tlength != rlength) {
+        printf("SSE4.2: length %d/%d\n", rlength, tlength);
+        r = 1;
+      }
+    }
+
+    if (HAS_AVX2) {
+      const int tlength = avx2(idata, istride, data.w, data.h, data.d, tm, shm, qshift);
+      if (tlength != rlength) {
+        printf("AVX2: length %d/%d\n", rlength, tlength);
+        r = 1;
+      }
+    }
+  }
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("%s%s\n", HAS_SSE4_2?" SSE4.2 [ PASS ]":"", HAS_AVX2?" AVX2 [ PASS ]":"");
+
+  free(shm);
+  free(sh);
+  free(tm);
+  free(m);
+  free(qf);
+  free(idata);
+
+  return r;
+}
+
+/* Allocates random convex curves over picture lengths from less than the
+   cheapest points need to more than the dearest, checking that the slices
+   fit, that what is left could not move any slice on a point, and that the
+   extremes take the ends of the curves */
+static int perform_rateallocationtest() {
+  const int N = 500;
+  SliceRDCurve *curves = new SliceRDCurve[N];
+  int r = 0;
+
+  printf("Rate allocation: ");
+
+  for (int trial = 0; !r && trial < 20; trial++) {
+    int min_total = 0;
+    int max_total = 0;
+    for (int i = 0; i < N; i++) {
+      curves[i].n = (trial%5 == 4 && i%7 == 0)?0:(1 + rand()%MAX_RD_POINTS);
+      int rate = 4 + 2*(rand()%50);
+      double slope = 1e6*(1 + rand()%1000);
+      for (int j = 0; j < curves[i].n; j++) {
+        curves[i].qi[j]    = MAX_RD_POINTS - 1 - j;
+        curves[i].rate[j]  = rate;
+        curves[i].slope[j] = (j == 0)?0:slope;
+        rate  += 2*(1 + rand()%40);
+        slope *= 0.2 + 0.79*(rand()%1000)/1000.0;
+      }
+      min_total += (curves[i].n > 0)?curves[i].rate[0]:4;
+      max_total += (curves[i].n > 0)?curves[i].rate[curves[i].n - 1]:4;
+    }
+
+    const int length = (trial == 1)?min_total:(min_total - 1000 + (int)(((int64_t)(max_total - min_total + 2000)*trial)/19));
+    const int used = allocate_slice_rates(curves, N, length);
+
+    int total = 0;
+    for (int i = 0; i < N; i++) {
+      const int j = curves[i].chosen;
+      total += (j >= 0)?curves[i].rate[j]:4;
+      if (j >= 0 && j + 1 < curves[i].n && used + curves[i].rate[j + 1] - curves[i].rate[j] <= length) {
+        printf("slice %d left short at length %d\n", i, length);
+        r = 1;
+      }
+      if (length >= max_total && curves[i].n > 0 && j != curves[i].n - 1) {
+        printf("slice %d not at its dearest point at length %d\n", i, length);
+        r = 1;
+      }
+      if (length == min_total && j > 0) {
+        printf("slice %d beyond its cheapest point at length %d\n", i, length);
+        r = 1;
+      }
+    }
+    if (total != used || used > length) {
+      printf("%d bytes used of %d, %d reported\n", total, length, used);
+      r = 1;
+    }
+  }
+
+  delete[] curves;
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("[ PASS ]\n");
+  return r;
+}
+
+/* Codes slices of coefficients up to range in magnitude losslessly and reads
+   the codewords back a bit at a time in coded order, the bits beyond the
+   length all being ones, checking that they give the coefficients and that
+   the length ends with the last non-zero one. Then codes the largest
+   coefficients into a buffer too short for them, checking that the coder
+   says so and writes nothing past its end. */
+template<class T> static int perform_losslesstest(const encode_test &data, const int range, const int k) {
+  const int N = data.w*data.h;
+  const int istride = data.w + 8;
+  const int olength = lossless_component_length(N, k);
+  int r = 0;
+
+  T       *idata  = (T       *)malloc(istride*data.h*sizeof(T));
+  T       *coefs  = (T       *)malloc(N*sizeof(T));
+  uint8_t *packed = (uint8_t *)malloc(olength + 8);
+
+  printf("%2dx%-2d depth %d lossless %d bit: ", data.w, data.h, data.d, (int)sizeof(T)*8);
+
+  for (int trial = 0; !r && trial < 200; trial++) {
+    for (int i = 0; i < istride*data.h; i++)
+      idata[i] = (rand()%(2*range + 1)) - range;
+    if (trial%4 == 1) {
+      for (int i = rand()%(istride*data.h); i < istride*data.h; i++)
+        idata[i] = 0;
+    } else if (trial%4 == 2) {
+      for (int i = 0; i < istride*data.h; i++)
+        if (rand()%3)
+          idata[i] = 0;
+    } else if (trial%4 == 3) {
+      idata[rand()%(istride*data.h)] = -range;
+    }
+    memset(packed, 0, olength + 8);
+
+    CodedSlice<T> slice;
+    slice.idata[0]   = idata;
+    slice.istride[0] = istride;
+    slice.packed[0]  = packed;
+    slice.packed_length = olength + 8;
+    if (!encode_slice_component_lossless<0,0,0,T>(&slice, 0, data.w, data.h, data.d)) {
+      printf("component did not fit in %d bytes\n", olength + 8);
+      r = 1;
+    }
+
+    slice_coded_order<T>(idata, istride, coefs, data.w, data.h, data.d);
+
+    const int length = slice.length[0];
+    int bit = 0;
+    int end = 0;
+    for (int n = 0; !r && n < N; n++) {
+      int64_t v = 1;
+      for (;;) {
+        const int b = (bit < 8*length)?((packed[bit/8] >> (7 - bit%8))&0x1):1;
+        bit++;
+        if (b)
+          break;
+        v = (v << 1) | ((bit < 8*length)?((packed[bit/8] >> (7 - bit%8))&0x1):1);
+        bit++;
+      }
+      v--;
+      if (v && ((bit < 8*length)?((packed[bit/8] >> (7 - bit%8))&0x1):1))
+        v = -v;
+      if (v) {
+        bit++;
+        end = bit;
+      }
+      if (v != coefs[n]) {
+        printf("coefficient %d coded as %ld not %ld\n", n, (long)v, (long)coefs[n]);
+        r = 1;
+      }
+    }
+    if (!r && (length != (end + 7)/8 || length > olength)) {
+      printf("length %d, last non-zero codeword ending at bit %d\n", length, end);
+      r = 1;
+    }
+  }
+
+  if (!r) {
+    const int short_length = olength/4 + 8;
+    for (int i = 0; i < istride*data.h; i++)
+      idata[i] = -range;
+    memset(packed, 0xA5, olength + 8);
+
+    CodedSlice<T> slice;
+    slice.idata[0]   = idata;
+    slice.istride[0] = istride;
+    slice.packed[0]  = packed;
+    slice.packed_length = short_length;
+    if (encode_slice_component_lossless<0,0,0,T>(&slice, 0, data.w, data.h, data.d)) {
+      printf("component fitted in %d bytes\n", short_length);
+      r = 1;
+    }
+    for (int i = short_length; !r && i < olength + 8; i++) {
+      if (packed[i] != 0xA5) {
+        printf("byte %d written past the end of %d bytes\n", i, short_length);
+        r = 1;
+      }
+    }
+  }
+
+  free(idata);
+  free(coefs);
+  free(packed);
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("[ PASS ]\n");
+  return r;
+}
+
+/* Checks that the matrix of each transform deeper than four levels has the
+   depth four matrix at its four finest levels, all raised by the same
+   amount, with LL the same distance above the coarsest HL and a smallest
+   entry of zero, and that the levels above those keep the offsets between
+   the bands of the coarsest level of the depth four matrix and step all the
+   way in the direction that matrix does */
+static int perform_deepmatrixtest() {
+  int r = 0;
+
+  printf("Deep quantisation matrices: ");
+
+  for (int w = 0; !r && w <= VC2ENCODER_WFT_DAUBECHIES_9_7; w++) {
+    const QuantisationWeightingMatrix &P = preset_quantisation_matrices[w][4];
+    for (int d = 5; !r && d <= MAX_DWT_DEPTH; d++) {
+      const QuantisationWeightingMatrix M = default_quantisation_matrix(w, d);
+      const int offset = M.HL[d - 4] - P.HL[0];
+      int lowest = M.LL;
+      for (int l = 0; l < d; l++) {
+        lowest = std::min(lowest, (int)std::min(M.HL[l], std::min(M.LH[l], M.HH[l])));
+      }
+      for (int l = 0; l < 4; l++) {
+        if (M.HL[d - 4 + l] != P.HL[l] + offset ||
+            M.LH[d - 4 + l] != P.LH[l] + offset ||
+            M.HH[d - 4 + l] != P.HH[l] + offset)
+          r = 1;
+      }
+      for (int l = 0; l < d - 4; l++) {
+        if (M.HL[l] - M.HH[l] != P.HL[0] - P.HH[0] ||
+            M.LH[l] - M.HH[l] != P.LH[0] - P.HH[0] ||
+            (M.HL[l + 1] - M.HL[l])*(P.HL[3] - P.HL[0]) < 0)
+          r = 1;
+      }
+      if (M.LL - M.HL[0] != P.LL - P.HL[0] || lowest != 0)
+        r = 1;
+      if (r)
+        printf("wavelet %d depth %d\n", w, d);
+    }
+  }
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("[ PASS ]\n");
+  return r;
+}
+
+/* Sizes a long sequence of pictures of randomly varying activity, in runs
+   of easy, middling and hard pictures, checking that every length is on the
+   grid, that the virtual buffer neither overflows nor runs dry, and that the
+   first picture of each run of hard pictures is given more than the mean
+   length and the first of each run of easy ones less */
+static int perform_ratecontroltest() {
+  const int SLICES      = 1000;
+  const int MIN_LENGTH  = 4*SLICES;
+  const int MAX_LENGTH  = (4 + 3*255*2)*SLICES;
+  const int DATA_LENGTH = 400000;
+  const int BUFFER_SIZE = 3*DATA_LENGTH/2;
+  const int N_COEFS     = 200000;
+  SequenceRateController rc;
+  uint32_t count[ACTIVITY_BINS];
+  int r = 0;
+
+  printf("Rate control: ");
+
+  rc.reset(BUFFER_SIZE, MIN_LENGTH, MAX_LENGTH, 2);
+  int64_t level = BUFFER_SIZE/2;
+  for (int i = 0; !r && i < 1000; i++) {
+    const int phase = (i/50)%3;
+    const int peak  = (phase == 0)?(20 + rand()%8):(phase == 1)?(60 + rand()%40):(120 + rand()%60);
+    memset(count, 0, sizeof(count));
+    count[0] = N_COEFS;
+    for (int k = 1; k <= peak; k++) {
+      count[k]  = 500 + rand()%500;
+      count[0] -= count[k];
+    }
+
+    const int length = rc.pictureLength(count, DATA_LENGTH);
+    level += length - DATA_LENGTH;
+    if ((length - MIN_LENGTH)%2 || length < MIN_LENGTH || length > MAX_LENGTH) {
+      printf("picture %d given length %d\n", i, length);
+      r = 1;
+    }
+    if (level < 0 || level > BUFFER_SIZE || level != rc.level()) {
+      printf("buffer at %ld after picture %d of length %d\n", (long)level, i, length);
+      r = 1;
+    }
+    if (i > 0 && i%50 == 0 && ((phase == 2 && length <= DATA_LENGTH) || (phase == 0 && length >= DATA_LENGTH))) {
+      printf("picture %d starting run of %s pictures given length %d\n", i, (phase == 0)?"easy":"hard", length);
+      r = 1;
+    }
+  }
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("[ PASS ]\n");
+  return r;
+}
+
+/* Lays out the slices of a job in each chroma format, checking that the
+   planes of every component are the size of its slices and the padding, and
+   that the slices of each component tile its plane below the top padding */
+static int perform_chromaformattest() {
+  const int SX = 4;
+  const int SY = 3;
+  const int SW = 32;
+  const int SH = 16;
+  const int PAD = 16;
+  const int FORMATS[3] = { VC2ENCODER_CDS_420, VC2ENCODER_CDS_422, VC2ENCODER_CDS_444 };
+  const int CW[3] = { SW/2, SW/2, SW };
+  const int CH[3] = { SH/2, SH,   SH };
+  int r = 0;
+
+  printf("Chroma formats: ");
+
+  for (int f = 0; !r && f < 3; f++) {
+    CodedSlices<int16_t> slices(SX, SY, SW, SH, 3, FORMATS[f]);
+    JobData<int16_t> job(0, SX*SW, SY*SH, PAD, PAD, 3, FORMATS[f], SX, SY, 0, 0, &slices, 0, 0, SX);
+
+    for (int c = 0; !r && c < 3; c++) {
+      const int w   = (c == 0)?SW:CW[f];
+      const int h   = (c == 0)?SH:CH[f];
+      const int pad = (c == 0)?PAD:PAD*CH[f]/SH;
+      const VideoPlane<int16_t> *plane = job.video_data[c];
+      if (slices.width[c] != w || slices.height[c] != h ||
+          plane->width != SX*w || plane->height != pad + SY*h + pad ||
+          job.iwidth[c] != SX*w || job.iheight[c] != plane->height) {
+        printf("format %d component %d laid out as %dx%d slices in a %dx%d plane\n", FORMATS[f], c, slices.width[c], slices.height[c], plane->width, plane->height);
+        r = 1;
+      }
+      for (int i = 0; !r && i < SX*SY; i++) {
+        const int X = i%SX;
+        const int Y = i/SX;
+        if (slices.slices[i].idata[c] != &plane->data[(pad + Y*h)*plane->stride + X*w] ||
+            slices.slices[i].istride[c] != plane->stride) {
+          printf("format %d component %d slice %d misplaced\n", FORMATS[f], c, i);
+          r = 1;
+        }
+      }
+    }
+  }
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("[ PASS ]\n");
+  return r;
+}
+
+/* A picture which the slices do not divide is laid out as whole slices, the
+   planes covering the slices at the right and bottom edges and the picture
+   given to the initial transform as the part of them it fills */
+static int perform_edgeslicetest() {
+  const int SX = 5;
+  const int SY = 3;
+  const int SW = 32;
+  const int SH = 8;
+  const int W = SX*SW - 24;
+  const int H = SY*SH - 4;
+  int r = 0;
+
+  printf("Edge slices: ");
+
+  CodedSlices<int16_t> slices(SX, SY, SW, SH, 3, VC2ENCODER_CDS_422);
+  JobData<int16_t> job(0, W, H, 0, 0, 3, VC2ENCODER_CDS_422, SX, SY, 0, 0, &slices, 0, 0, SX);
+
+  for (int c = 0; !r && c < 3; c++) {
+    const int w = (c == 0)?SW:SW/2;
+    const VideoPlane<int16_t> *plane = job.video_data[c];
+    if (plane->width != SX*w || plane->height != SY*SH ||
+        job.iwidth[c] != ((c == 0)?W:W/2) || job.iheight[c] != H) {
+      printf("component %d of a %dx%d picture read as %dx%d into a %dx%d plane\n", c, W, H, job.iwidth[c], job.iheight[c], plane->width, plane->height);
+      r = 1;
+    }
+    for (int i = 0; !r && i < SX*SY; i++) {
+      if (slices.slices[i].idata[c] != &plane->data[(i/SX)*SH*plane->stride + (i%SX)*w]) {
+        printf("component %d slice %d misplaced\n", c, i);
+        r = 1;
+      }
+    }
+  }
+
+  if (r)
+    printf("FAIL\n");
+  else
+    printf("[ PASS ]\n");
+  return r;
+}
+
+int test_encode(bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2) {
+  (void)HAS_AVX;
+  int r = 0;
+
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Testing Slice Component Coding for Consistency\n\n");
+
+  r = perform_codewordtest();
+
+  for (int i = 0; !r && i < (int)(sizeof(ENCODE_TEST)/sizeof(ENCODE_TEST[0])); i++) {
+    r = perform_encodetest<int16_t>(ENCODE_TEST[i], 1023, HAS_SSE4_2, HAS_AVX2, quantise_and_code16_sse4_2, quantise_and_code16_avx2);
+  }
+
+  for (int i = 0; !r && i < (int)(sizeof(ENCODE_TEST)/sizeof(ENCODE_TEST[0])); i++) {
+    r = perform_encodetest<int32_t>(ENCODE_TEST[i], 100000, HAS_SSE4_2, HAS_AVX2, NULL, quantise_and_code32_avx2);
+  }
+
+  for (int i = 0; !r && i < (int)(sizeof(ENCODE_TEST)/sizeof(ENCODE_TEST[0])); i++) {
+    r = perform_codedlengthtest<int16_t>(ENCODE_TEST[i], 1023, HAS_SSE4_2, HAS_AVX2, coded_length16_sse4_2, coded_length16_avx2);
+  }
+
+  for (int i = 0; !r && i < (int)(sizeof(ENCODE_TEST)/sizeof(ENCODE_TEST[0])); i++) {
+    r = perform_codedlengthtest<int32_t>(ENCODE_TEST[i], 100000, HAS_SSE4_2, HAS_AVX2, coded_length32_sse4_2, coded_length32_avx2);
+  }
+
+  for (int i = 0; !r && i < (int)(sizeof(ENCODE_TEST)/sizeof(ENCODE_TEST[0])); i++) {
+    r = perform_losslesstest<int16_t>(ENCODE_TEST[i], 32767, 15);
+  }
+
+  for (int i = 0; !r && i < (int)(sizeof(ENCODE_TEST)/sizeof(ENCODE_TEST[0])); i++) {
+    r = perform_losslesstest<int32_t>(ENCODE_TEST[i], 1 << 26, 26);
+  }
+
+  if (!r)
+    r = perform_deepmatrixtest();
+
+  if (!r)
+    r = perform_rateallocationtest();
+
+  if (!r)
+    r = perform_ratecontroltest();
+
+  if (!r)
+    r = perform_chromaformattest();
+
+  if (!r)
+    r = perform_edgeslicetest();
+
+  printf("--------------------------------------------------------------------------------\n");
+
+  return r;
+}
@@ -0,0 +1,572 @@
+/*****************************************************************************
+ * test_roundtrip.cpp : Whole picture encode and decode tests
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <cstdio>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "../vc2hqencode/vc2hqencode.h"
+#include "../vc2hqencode/quantise.hpp"
+
+/* These tests code whole pictures through the public interface and decode
+   them again with the minimal decoder below, which follows the inverse
+   quantisation and wavelet synthesis of the VC-2 specification directly and
+   shares no code with the encoder. They catch what comparing an optimised
+   kernel with its C counterpart cannot, such as both overflowing. */
+
+struct roundtrip_test {
+  int wavelet;
+  int depth;
+  int slice_width;
+  int slice_height;
+  int width;
+  int height;
+  int bits;
+  int qindex;       /* -1 for lossless coding */
+  double min_psnr;  /* The lowest acceptable PSNR of any component */
+  int fragment_size; /* 0 for whole pictures */
+};
+
+const roundtrip_test ROUNDTRIP_TEST[] = {
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          2,  32,   8, 1920, 1080, 10, 12, 40.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          3,  32,   8, 1920, 1080, 10, 16, 40.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          4,  32,  16, 1920, 1080, 10, 20, 36.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          3,  32,   8, 1920, 1080,  8, 12, 36.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          4,  32,  16, 1920, 1080,  8, 12, 36.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          4,  32,  16, 1920, 1080, 16, 28, 36.0,     0 },
+
+  { VC2ENCODER_WFT_LEGALL_5_3,              2,  32,   8, 1020, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_LEGALL_5_3,              4,  32,  16, 1016, 1080, 12, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_LEGALL_5_3,              4,  32,  16, 1016, 1080, 16, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,           4,  32,  16, 1016, 1080, 12, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,       4,  32,  16, 1016, 1080, 12, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,       4,  32,  16, 1016, 1080, 16, -1,  0.0,     0 },
+
+  /* Fragmented pictures of slice geometries that give fewer runs of slices
+     than the encoder allows for */
+  { VC2ENCODER_WFT_LEGALL_5_3,              3,  16,  16, 1920, 1080, 10, 10, 48.0, 10000 },
+  { VC2ENCODER_WFT_LEGALL_5_3,              3,  64,  16, 1920, 1080, 10, -1,  0.0, 10000 },
+  { VC2ENCODER_WFT_LEGALL_5_3,              3,  64,   8, 1920, 1080, 10, 10, 45.0, 10000 },
+
+  /* Depths 5 to 8, with slices that do not divide the picture */
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,   5,  64,  32, 1920, 1080, 10, 16, 50.0,     0 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,   6, 128,  64, 1920, 1080, 10, 16, 41.0,     0 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,   7, 256, 128, 1920, 1080, 10, 16, 46.0,     0 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,   8, 512, 256, 1920, 1080, 10, 16, 41.0,     0 },
+
+  { VC2ENCODER_WFT_LEGALL_5_3,              5,  64,  32, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_LEGALL_5_3,              6, 128,  64, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_LEGALL_5_3,              7, 256, 128, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_LEGALL_5_3,              8, 512, 256, 1920, 1080, 10, -1,  0.0,     0 },
+
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7,  5,  64,  32, 1920, 1080, 10, 16, 49.0,     0 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7,  6, 128,  64, 1920, 1080, 10, 16, 41.0,     0 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7,  7, 256, 128, 1920, 1080, 10, 16, 45.0,     0 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7,  8, 512, 256, 1920, 1080, 10, 16, 30.0,     0 },
+
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,           5,  64,  32, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,           6, 128,  64, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,           7, 256, 128, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,           8, 512, 256, 1920, 1080, 10, -1,  0.0,     0 },
+
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,       5,  64,  32, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,       6, 128,  64, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,       7, 256, 128, 1920, 1080, 10, -1,  0.0,     0 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,       8, 512, 256, 1920, 1080, 10, -1,  0.0,     0 },
+
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          5,  64,  32, 1920, 1080, 10, 16, 60.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          6, 128,  64, 1920, 1080, 10, 16, 60.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          7, 256, 128, 1920, 1080, 10, 16, 63.0,     0 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,          8, 512, 256, 1920, 1080, 10, 16, 64.0,     0 },
+};
+
+static const char *WAVELET_NAME[] = {
+  "Deslauriers-Dubuc (9,7)",
+  "LeGall (5,3)",
+  "Deslauriers-Dubuc (13,7)",
+  "Haar (no shift)",
+  "Haar (single shift)",
+  "Fidelity",
+  "Daubechies (9,7)",
+};
+
+/* Reads the bits of a bounded block, which read as ones past its end */
+struct BitReader {
+  BitReader(const uint8_t *_data, int _length) : data(_data), length(_length), pos(0), bit(7) {}
+
+  int read_bool() {
+    if (pos >= length)
+      return 1;
+    const int b = (data[pos] >> bit)&0x1;
+    if (bit-- == 0) {
+      bit = 7;
+      pos++;
+    }
+    return b;
+  }
+
+  uint32_t read_uint() {
+    uint32_t v = 1;
+    while (!read_bool()) {
+      v <<= 1;
+      v |= read_bool();
+    }
+    return v - 1;
+  }
+
+  int32_t read_sint() {
+    int32_t v = read_uint();
+    if (v != 0 && read_bool())
+      v = -v;
+    return v;
+  }
+
+  void byte_align() {
+    if (bit != 7) {
+      bit = 7;
+      pos++;
+    }
+  }
+
+  const uint8_t *data;
+  int length;
+  int pos;
+  int bit;
+};
+
+static int32_t inverse_quant_factor(int qi) {
+  const int64_t base = ((int64_t)1) << (qi/4);
+  switch (qi%4) {
+  case 0:  return 4*base;
+  case 1:  return (503829*base + 52958)/105917;
+  case 2:  return (665857*base + 58854)/117708;
+  default: return (440253*base + 32722)/65444;
+  }
+}
+
+static int32_t inverse_quant(int32_t q, int qi) {
+  if (q == 0)
+    return 0;
+  const int64_t qf     = inverse_quant_factor(qi);
+  const int64_t offset = (qi == 0)?1:(qi == 1)?2:(qf*3 + 4)/8;
+  const int64_t m      = (std::abs((int64_t)q)*qf + offset + 2)/4;
+  return (int32_t)((q < 0)?-m:m);
+}
+
+/* One dimensional synthesis of n samples in place, low pass at the even
+   positions, with the edge extension of the lifting stages of the
+   specification */
+static void synthesise(int32_t *a, const int n, const int wavelet) {
+#define E(k) a[std::min(std::max(2*(k), 0), n - 2)]
+#define O(k) a[std::min(std::max(2*(k) + 1, 1), n - 1)]
+  switch (wavelet) {
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
+    for (int k = 0; k < n/2; k++) a[2*k]     -= (O(k - 1) + O(k) + 2) >> 2;
+    for (int k = 0; k < n/2; k++) a[2*k + 1] += (-E(k - 1) + 9*E(k) + 9*E(k + 1) - E(k + 2) + 8) >> 4;
+    break;
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    for (int k = 0; k < n/2; k++) a[2*k]     -= (O(k - 1) + O(k) + 2) >> 2;
+    for (int k = 0; k < n/2; k++) a[2*k + 1] += (E(k) + E(k + 1) + 1) >> 1;
+    break;
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
+    for (int k = 0; k < n/2; k++) a[2*k]     -= (-O(k - 2) + 9*O(k - 1) + 9*O(k) - O(k + 1) + 16) >> 5;
+    for (int k = 0; k < n/2; k++) a[2*k + 1] += (-E(k - 1) + 9*E(k) + 9*E(k + 1) - E(k + 2) + 8) >> 4;
+    break;
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    for (int k = 0; k < n/2; k++) a[2*k]     -= (O(k) + 1) >> 1;
+    for (int k = 0; k < n/2; k++) a[2*k + 1] += E(k);
+    break;
+  case VC2ENCODER_WFT_DAUBECHIES_9_7:
+    for (int k = 0; k < n/2; k++) a[2*k]     -= (int32_t)((1817*((int64_t)O(k - 1) + O(k)) + 2048) >> 12);
+    for (int k = 0; k < n/2; k++) a[2*k + 1] -= (int32_t)((3616*((int64_t)E(k) + E(k + 1)) + 2048) >> 12);
+    for (int k = 0; k < n/2; k++) a[2*k]     += (int32_t)(( 217*((int64_t)O(k - 1) + O(k)) + 2048) >> 12);
+    for (int k = 0; k < n/2; k++) a[2*k + 1] += (int32_t)((6497*((int64_t)E(k) + E(k + 1)) + 2048) >> 12);
+    break;
+  }
+#undef E
+#undef O
+}
+
+static int filter_shift(int wavelet) {
+  return (wavelet == VC2ENCODER_WFT_HAAR_NO_SHIFT || wavelet == VC2ENCODER_WFT_FIDELITY)?0:1;
+}
+
+/* A component of a decoded picture, padded to a multiple of 2^depth each way */
+struct DecodedComponent {
+  int width;
+  int height;
+  std::vector<int32_t> data;
+};
+
+/* Decodes a picture as written by vc2encode_encode_fixed_qindex_picture for a
+   frame of the given luma size, leaving the components offset to be centred
+   on zero. Returns false if the stream is not as expected. */
+static bool decode_picture(const uint8_t *stream, int length, int major_version, int frame_width, int frame_height, int color_diff_format, DecodedComponent comp[3]) {
+  if (length < 17 || memcmp(stream, "BBCD", 4) != 0 || stream[4] != 0xE8)
+    return false;
+
+  BitReader header(stream + 17, length - 17);
+  const int wavelet  = header.read_uint();
+  const int depth    = header.read_uint();
+  if (major_version >= 3 && (header.read_bool() || header.read_bool()))
+    return false;
+  const int slices_x = header.read_uint();
+  const int slices_y = header.read_uint();
+  const int prefix   = header.read_uint();
+  const int scalar   = header.read_uint();
+  if (wavelet >= VC2ENCODER_WFT_NUM || depth > MAX_DWT_DEPTH || slices_x == 0 || slices_y == 0)
+    return false;
+
+  int LL;
+  int HL[MAX_DWT_DEPTH], LH[MAX_DWT_DEPTH], HH[MAX_DWT_DEPTH];
+  if (header.read_bool()) {
+    LL = header.read_uint();
+    for (int l = 0; l < depth; l++) {
+      HL[l] = header.read_uint();
+      LH[l] = header.read_uint();
+      HH[l] = header.read_uint();
+    }
+  } else {
+    if (depth > 4)
+      return false;
+    const QuantisationWeightingMatrix matrix = default_quantisation_matrix(wavelet, depth);
+    LL = matrix.LL;
+    for (int l = 0; l < depth; l++) {
+      HL[l] = matrix.HL[l];
+      LH[l] = matrix.LH[l];
+      HH[l] = matrix.HH[l];
+    }
+  }
+  header.byte_align();
+
+  const int skip = 1 << depth;
+  for (int c = 0; c < 3; c++) {
+    int w = frame_width;
+    int h = frame_height;
+    if (c > 0 && color_diff_format != VC2ENCODER_CDS_444)
+      w /= 2;
+    if (c > 0 && color_diff_format == VC2ENCODER_CDS_420)
+      h /= 2;
+    comp[c].width  = (w + skip - 1)/skip*skip;
+    comp[c].height = (h + skip - 1)/skip*skip;
+    comp[c].data.assign(comp[c].width*comp[c].height, 0);
+  }
+
+  /* Coefficients are placed where the in place transform leaves them, each
+     subband on the grid of its level */
+  const uint8_t *p   = stream + 17 + header.pos;
+  const uint8_t *end = stream + length;
+  for (int sy = 0; sy < slices_y; sy++) {
+    for (int sx = 0; sx < slices_x; sx++) {
+      if (p + prefix + 1 > end)
+        return false;
+      p += prefix;
+      const int qindex = *p++;
+      for (int c = 0; c < 3; c++) {
+        if (p + 1 > end)
+          return false;
+        const int clength = scalar*(*p++);
+        if (p + clength > end)
+          return false;
+        BitReader bits(p, clength);
+        p += clength;
+
+        DecodedComponent &C = comp[c];
+        for (int band = 0; band < 1 + 3*depth; band++) {
+          const int level = (band == 0)?0:((band - 1)/3 + 1);
+          const int orient = (band == 0)?0:((band - 1)%3 + 1);
+          const int s = (level == 0)?skip:(skip >> (level - 1));
+          const int bw = C.width/s;
+          const int bh = C.height/s;
+          const int weight = (band == 0)?LL:(orient == 1)?HL[level - 1]:(orient == 2)?LH[level - 1]:HH[level - 1];
+          const int qi = std::max(qindex - weight, 0);
+          const int ox = (orient&1)?s/2:0;
+          const int oy = (orient&2)?s/2:0;
+          for (int y = bh*sy/slices_y; y < bh*(sy + 1)/slices_y; y++)
+            for (int x = bw*sx/slices_x; x < bw*(sx + 1)/slices_x; x++)
+              C.data[(y*s + oy)*C.width + x*s + ox] = inverse_quant(bits.read_sint(), qi);
+        }
+      }
+    }
+  }
+
+  /* Each level is interleaved in place already, so synthesis works on its
+     grid, columns then rows, followed by the filter shift */
+  const int shift = filter_shift(wavelet);
+  for (int c = 0; c < 3; c++) {
+    DecodedComponent &C = comp[c];
+    for (int s = skip/2; s >= 1; s /= 2) {
+      const int n_x = C.width/s;
+      const int n_y = C.height/s;
+      std::vector<int32_t> line(std::max(n_x, n_y));
+      for (int x = 0; x < n_x; x++) {
+        for (int y = 0; y < n_y; y++)
+          line[y] = C.data[y*s*C.width + x*s];
+        synthesise(&line[0], n_y, wavelet);
+        for (int y = 0; y < n_y; y++)
+          C.data[y*s*C.width + x*s] = line[y];
+      }
+      for (int y = 0; y < n_y; y++) {
+        for (int x = 0; x < n_x; x++)
+          line[x] = C.data[y*s*C.width + x*s];
+        synthesise(&line[0], n_x, wavelet);
+        for (int x = 0; x < n_x; x++)
+          C.data[y*s*C.width + x*s] = (shift > 0)?((line[x] + (1 << (shift - 1))) >> shift):line[x];
+      }
+    }
+  }
+
+  return true;
+}
+
+static uint32_t read_be(const uint8_t *p, int n) {
+  uint32_t v = 0;
+  for (int i = 0; i < n; i++)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+/* Joins the fragments of a picture into the form of an unfragmented one for
+   decode_picture, checking that each fragment's parse offsets chain to the
+   next and that its slices follow on from those before it */
+static bool join_fragments(const uint8_t *stream, int length, int slices_x, uint32_t next_parse_offset, std::vector<uint8_t> &picture) {
+  int pos = 0;
+  int n_slices = 0;
+  uint32_t prev = 0;
+  while (pos < length) {
+    const uint8_t *f = stream + pos;
+    if (length - pos < 21 || memcmp(f, "BBCD", 4) != 0 || f[4] != 0xEC)
+      return false;
+    const uint32_t next        = read_be(f + 5, 4);
+    const int      slice_count = read_be(f + 19, 2);
+    const int      header      = (slice_count > 0)?25:21;
+    if (read_be(f + 9, 4) != prev || next < (uint32_t)header || next > (uint32_t)(length - pos) || read_be(f + 17, 2) != next - header)
+      return false;
+
+    if (pos == 0) {
+      if (slice_count != 0)
+        return false;
+      picture.assign(f, f + 17);
+      picture[4] = 0xE8;
+    } else {
+      if (slice_count == 0 || (int)(read_be(f + 23, 2)*slices_x + read_be(f + 21, 2)) != n_slices)
+        return false;
+      n_slices += slice_count;
+    }
+    picture.insert(picture.end(), f + header, f + next);
+
+    prev = next;
+    pos += next;
+  }
+  return pos == length && prev == next_parse_offset;
+}
+
+/* A picture with large flat areas at either end of the range, which drive the
+   low bands of every level to their extremes, sharp edges between them, and
+   detail */
+static uint16_t test_sample(int x, int y, int c, int bits) {
+  const int max = (1 << bits) - 1;
+  switch (((x >> 8) + (y >> 8) + c)%4) {
+  case 0:
+    return max;
+  case 1:
+    return 0;
+  case 2: {
+    uint32_t h = (x*73856093u) ^ (y*19349663u) ^ (c*83492791u);
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return h&max;
+  }
+  default:
+    return (((x >> 3) + (y >> 3))%2)?((x*max)/1920):max - ((y*max)/1080);
+  }
+}
+
+static int perform_roundtriptest(const roundtrip_test &data) {
+  const int color_diff_format = VC2ENCODER_CDS_422;
+  int r = 0;
+
+  printf("%-24s depth %d, %dx%d slices, %dx%d %2d-bit, ", WAVELET_NAME[data.wavelet], data.depth, data.slice_width, data.slice_height,
+         data.width, data.height, data.bits);
+  if (data.fragment_size)
+    printf("%d byte fragments, ", data.fragment_size);
+  if (data.qindex < 0)
+    printf("lossless: ");
+  else
+    printf("qindex %2d: ", data.qindex);
+
+  VC2EncoderHandle encoder = vc2encode_create();
+
+  VC2EncoderParams params;
+  memset(&params, 0, sizeof(params));
+  params.video_format.base_video_format       = VC2ENCODER_BVF_HD1080P_50;
+  params.video_format.custom_dimensions_flag  = 1;
+  params.video_format.frame_width             = data.width;
+  params.video_format.frame_height            = data.height;
+  params.picture_coding_mode                  = VC2ENCODER_PCM_FRAME;
+  switch (data.bits) {
+  case 8:
+    params.video_format.custom_signal_range_flag = 1;
+    params.video_format.signal_range_index       = VC2ENCODER_PSR_8BITVID;
+    break;
+  case 12:
+    params.video_format.custom_signal_range_flag = 1;
+    params.video_format.signal_range_index       = VC2ENCODER_PSR_12BITVID;
+    break;
+  case 16:
+    params.video_format.custom_signal_range_flag = 1;
+    params.video_format.signal_range_index       = VC2ENCODER_PSR_CUSTOM;
+    params.video_format.luma_offset              = 16 << 8;
+    params.video_format.luma_excursion           = 219 << 8;
+    params.video_format.color_diff_offset        = 128 << 8;
+    params.video_format.color_diff_excursion     = 224 << 8;
+    break;
+  }
+  params.transform_params.wavelet_index = data.wavelet;
+  params.transform_params.wavelet_depth = data.depth;
+  params.transform_params.slice_width   = data.slice_width;
+  params.transform_params.slice_height  = data.slice_height;
+  params.n_threads    = 4;
+  params.speed        = VC2ENCODER_SPEED_MEDIUM;
+  params.input_format = VC2ENCODER_INPUT_10P2;
+  params.fragment_size = data.fragment_size;
+  if (data.qindex < 0) {
+    params.lossless_flag = 1;
+  } else {
+    params.fixed_qindex_flag = 1;
+    params.fixed_qindex      = data.qindex;
+  }
+
+  if (vc2encode_set_parameters(encoder, params) != VC2ENCODER_OK) {
+    printf("could not configure encoder\nFAIL\n");
+    vc2encode_destroy(encoder);
+    return 1;
+  }
+  vc2encode_get_parameters(encoder, &params);
+
+  /* Each plane is allocated to its exact size so that reads outside it are
+     caught by a memory checker */
+  const int cw = data.width/2;
+  uint16_t *planes[3];
+  for (int c = 0; c < 3; c++) {
+    const int w = (c == 0)?data.width:cw;
+    planes[c] = (uint16_t *)malloc(w*data.height*sizeof(uint16_t));
+    for (int y = 0; y < data.height; y++)
+      for (int x = 0; x < w; x++)
+        planes[c][y*w + x] = test_sample(x, y, c, data.bits);
+  }
+
+  uint32_t size;
+  vc2encode_get_max_fixed_qindex_picture_size(encoder, &size);
+  char *stream = (char *)malloc(size);
+  char *idata[3] = { (char *)planes[0], (char *)planes[1], (char *)planes[2] };
+  int istride[3] = { data.width, cw, cw };
+  char *o = stream;
+  uint32_t length, next_parse_offset;
+  if (vc2encode_encode_fixed_qindex_picture(encoder, idata, istride, &o, 0, 0, &length, &next_parse_offset) != VC2ENCODER_OK) {
+    printf("encode failed\n");
+    r = 1;
+  }
+
+  std::vector<uint8_t> joined;
+  const uint8_t *picture = (uint8_t *)stream;
+  if (!r && data.fragment_size) {
+    const int slices_x = (params.video_format.frame_width + data.slice_width - 1)/data.slice_width;
+    if (!join_fragments((uint8_t *)stream, length, slices_x, next_parse_offset, joined)) {
+      printf("fragments do not chain\n");
+      r = 1;
+    } else {
+      picture = &joined[0];
+      length  = joined.size();
+    }
+  }
+
+  DecodedComponent comp[3];
+  if (!r && !decode_picture(picture, length, (data.fragment_size)?3:2, params.video_format.frame_width, params.video_format.frame_height, color_diff_format, comp)) {
+    printf("could not decode picture\n");
+    r = 1;
+  }
+
+  double psnr[3] = { 0, 0, 0 };
+  for (int c = 0; !r && c < 3; c++) {
+    const int w = (c == 0)?data.width:cw;
+    const int max = (1 << data.bits) - 1;
+    double sse = 0;
+    int mismatches = 0;
+    for (int y = 0; y < data.height; y++) {
+      for (int x = 0; x < w; x++) {
+        const int v = std::min(std::max(comp[c].data[y*comp[c].width + x] + (1 << (data.bits - 1)), 0), max);
+        const double e = v - planes[c][y*w + x];
+        sse += e*e;
+        mismatches += (e != 0);
+      }
+    }
+    psnr[c] = (sse == 0)?INFINITY:10*log10((double)max*max*w*data.height/sse);
+    if (data.qindex < 0 && mismatches) {
+      printf("component %d has %d samples changed\n", c, mismatches);
+      r = 1;
+    } else if (psnr[c] < data.min_psnr) {
+      printf("component %d at %.1fdB\n", c, psnr[c]);
+      r = 1;
+    }
+  }
+
+  if (r)
+    printf("FAIL\n");
+  else if (data.qindex < 0)
+    printf("[ PASS ]\n");
+  else
+    printf("%.1f/%.1f/%.1fdB [ PASS ]\n", psnr[0], psnr[1], psnr[2]);
+
+  free(stream);
+  for (int c = 0; c < 3; c++)
+    free(planes[c]);
+  vc2encode_destroy(encoder);
+
+  return r;
+}
+
+int test_roundtrip() {
+  int r = 0;
+
+  printf("--------------------------------------------------------------------------------\n");
+  printf("  Testing Whole Pictures Through a Reference Decoder\n\n");
+
+  vc2encode_init();
+
+  for (int i = 0; !r && i < (int)(sizeof(ROUNDTRIP_TEST)/sizeof(ROUNDTRIP_TEST[0])); i++) {
+    r = perform_roundtriptest(ROUNDTRIP_TEST[i]);
+  }
+
+  printf("--------------------------------------------------------------------------------\n");
+
+  return r;
+}
@@ -50,6 +50,16 @@ const char *VC2EncoderWaveletFilterTypeString[] = { "Deslauriers-Dubuc 9,7",
 const char *VC2EncoderInputFormatString[] = {
   "10P2",
   "V210",
+  "UYVY10",
+  "P210",
+  "P010",
+  "V410",
+  "Y416",
+  "8P2",
+  "UYVY",
+  "YUY2",
+  "X2RGB10",
+  "BGRA",
 };
 
 const char *ComponentString[] = {
@@ -72,6 +82,21 @@ const transforminitial_test TRANSFORMINITIAL_TEST[] = {
   { VC2ENCODER_WFT_HAAR_NO_SHIFT,     10, 4, VC2ENCODER_INPUT_10P2 },
   { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT, 10, 4, VC2ENCODER_INPUT_10P2 },
   { VC2ENCODER_WFT_LEGALL_5_3,        10, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    10, 2, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    10, 4, VC2ENCODER_INPUT_10P2 },
+
+  { VC2ENCODER_WFT_LEGALL_5_3,         8, 2, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,     12, 2, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT, 12, 2, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_LEGALL_5_3,        12, 2, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    12, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,     12, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT, 12, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_LEGALL_5_3,        12, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,     16, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT, 16, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_LEGALL_5_3,        16, 4, VC2ENCODER_INPUT_10P2 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    16, 4, VC2ENCODER_INPUT_10P2 },
 
   { VC2ENCODER_WFT_HAAR_NO_SHIFT,     10, 2, VC2ENCODER_INPUT_V210 },
   { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT, 10, 2, VC2ENCODER_INPUT_V210 },
@@ -79,6 +104,12 @@ const transforminitial_test TRANSFORMINITIAL_TEST[] = {
   { VC2ENCODER_WFT_HAAR_NO_SHIFT,     10, 4, VC2ENCODER_INPUT_V210 },
   { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT, 10, 4, VC2ENCODER_INPUT_V210 },
   { VC2ENCODER_WFT_LEGALL_5_3,        10, 4, VC2ENCODER_INPUT_V210 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,  10, 2, VC2ENCODER_INPUT_V210 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7, 10, 2, VC2ENCODER_INPUT_V210 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    10, 2, VC2ENCODER_INPUT_V210 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,  10, 4, VC2ENCODER_INPUT_V210 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7, 10, 4, VC2ENCODER_INPUT_V210 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    10, 4, VC2ENCODER_INPUT_V210 },
 };
 
 struct transform_test {
@@ -93,6 +124,65 @@ const transform_test TRANSFORM_TEST[] = {
   { VC2ENCODER_WFT_HAAR_NO_SHIFT,     4 },
   { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT, 4 },
   { VC2ENCODER_WFT_LEGALL_5_3,        4 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    2 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,    4 },
+};
+
+struct packedinput_test {
+  int wavelet_index;
+  int active_bits;
+  int coef_size;
+  VC2EncoderInputFormat fmt;
+};
+
+const packedinput_test PACKEDINPUT_TEST[] = {
+  { VC2ENCODER_WFT_LEGALL_5_3,            10, 2, VC2ENCODER_INPUT_UYVY10 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,     10, 2, VC2ENCODER_INPUT_UYVY10 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7, 10, 2, VC2ENCODER_INPUT_UYVY10 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,        10, 4, VC2ENCODER_INPUT_UYVY10 },
+
+  { VC2ENCODER_WFT_LEGALL_5_3,            10, 2, VC2ENCODER_INPUT_P210 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,         12, 2, VC2ENCODER_INPUT_P210 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,        10, 2, VC2ENCODER_INPUT_P010 },
+  { VC2ENCODER_WFT_LEGALL_5_3,            12, 2, VC2ENCODER_INPUT_P010 },
+  { VC2ENCODER_WFT_LEGALL_5_3,            16, 4, VC2ENCODER_INPUT_P010 },
+
+  { VC2ENCODER_WFT_LEGALL_5_3,            10, 2, VC2ENCODER_INPUT_V410 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,     10, 2, VC2ENCODER_INPUT_V410 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7, 10, 4, VC2ENCODER_INPUT_V410 },
+
+  { VC2ENCODER_WFT_LEGALL_5_3,            10, 2, VC2ENCODER_INPUT_Y416 },
+  { VC2ENCODER_WFT_LEGALL_5_3,            12, 2, VC2ENCODER_INPUT_Y416 },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,        12, 4, VC2ENCODER_INPUT_Y416 },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,         16, 4, VC2ENCODER_INPUT_Y416 },
+
+  { VC2ENCODER_WFT_LEGALL_5_3,             8, 2, VC2ENCODER_INPUT_8P2 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,  8, 2, VC2ENCODER_INPUT_8P2 },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,      8, 4, VC2ENCODER_INPUT_8P2 },
+  { VC2ENCODER_WFT_LEGALL_5_3,             8, 2, VC2ENCODER_INPUT_UYVY },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,         8, 2, VC2ENCODER_INPUT_UYVY },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,          8, 2, VC2ENCODER_INPUT_YUY2 },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7, 8, 4, VC2ENCODER_INPUT_YUY2 },
+};
+
+struct rgbinput_test {
+  int wavelet_index;
+  int coef_size;
+  VC2EncoderInputFormat fmt;
+  int color_diff_format;
+  int color_matrix;
+};
+
+const rgbinput_test RGBINPUT_TEST[] = {
+  { VC2ENCODER_WFT_LEGALL_5_3,             2, VC2ENCODER_INPUT_X2RGB10, VC2ENCODER_CDS_444, VC2ENCODER_CMA_RGB  },
+  { VC2ENCODER_WFT_LEGALL_5_3,             2, VC2ENCODER_INPUT_X2RGB10, VC2ENCODER_CDS_444, VC2ENCODER_CMA_HDTV },
+  { VC2ENCODER_WFT_LEGALL_5_3,             2, VC2ENCODER_INPUT_X2RGB10, VC2ENCODER_CDS_422, VC2ENCODER_CMA_HDTV },
+  { VC2ENCODER_WFT_HAAR_SINGLE_SHIFT,      2, VC2ENCODER_INPUT_X2RGB10, VC2ENCODER_CDS_422, VC2ENCODER_CMA_SDTV },
+  { VC2ENCODER_WFT_DAUBECHIES_9_7,         4, VC2ENCODER_INPUT_X2RGB10, VC2ENCODER_CDS_422, VC2ENCODER_CMA_HDTV },
+  { VC2ENCODER_WFT_LEGALL_5_3,             2, VC2ENCODER_INPUT_BGRA,    VC2ENCODER_CDS_444, VC2ENCODER_CMA_RGB  },
+  { VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7,  2, VC2ENCODER_INPUT_BGRA,    VC2ENCODER_CDS_444, VC2ENCODER_CMA_SDTV },
+  { VC2ENCODER_WFT_LEGALL_5_3,             2, VC2ENCODER_INPUT_BGRA,    VC2ENCODER_CDS_422, VC2ENCODER_CMA_HDTV },
+  { VC2ENCODER_WFT_HAAR_NO_SHIFT,          4, VC2ENCODER_INPUT_BGRA,    VC2ENCODER_CDS_422, VC2ENCODER_CMA_SDTV },
 };
 
 int perform_transforminitialtest(const transforminitial_test &data, void *idata_pre, bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2) {
@@ -114,7 +204,7 @@ int perform_transforminitialtest(const transforminitial_test &data, void *idata_
     idata_length = istride*height*sizeof(uint16_t);
     idata = malloc(idata_length);
     for (int i = 0; i < istride*height; i++) {
-      ((uint16_t*)idata)[i] = ((uint16_t*)idata_pre)[i]&0x3FF;
+      ((uint16_t*)idata)[i] = ((uint16_t*)idata_pre)[i]&((1 << data.active_bits) - 1);
     }
   } else if (data.fmt == VC2ENCODER_INPUT_V210) {
     comps = 1;
@@ -138,7 +228,7 @@ int perform_transforminitialtest(const transforminitial_test &data, void *idata_
   }
 
   for (int c = 0; c < comps; c++) {
-    printf("%-20s: H 0/*  %-4s (%s) ", VC2EncoderWaveletFilterTypeString[data.wavelet_index], VC2EncoderInputFormatString[data.fmt], ComponentString[c]);
+    printf("%-20s: H 0/*  %-4s %2d-bit (%s) ", VC2EncoderWaveletFilterTypeString[data.wavelet_index], VC2EncoderInputFormatString[data.fmt], data.active_bits, ComponentString[c]);
     if (data.coef_size == 2)
       printf("16-bit ");
     else
@@ -148,7 +238,7 @@ int perform_transforminitialtest(const transforminitial_test &data, void *idata_
     InplaceTransformInitial chtrans = NULL;
     InplaceTransform        cvtrans = NULL;
     try {
-      chtrans = get_htransforminitial_c(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt);
+      chtrans = get_htransforminitial_c(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt, VC2ENCODER_CDS_422, VC2ENCODER_CMA_HDTV);
       cvtrans = get_vtransform_c(data.wavelet_index, 0, data.coef_size, data.fmt);
     } catch (...) {
       printf(" ????  ]\n:");
@@ -173,7 +263,7 @@ int perform_transforminitialtest(const transforminitial_test &data, void *idata_
     if (HAS_SSE4_2) {
       printf(" SSE4.2 [ ");
       try {
-        sse42htrans = get_htransforminitial_sse4_2(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt);
+        sse42htrans = get_htransforminitial_sse4_2(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt, VC2ENCODER_CDS_422, VC2ENCODER_CMA_HDTV);
         sse42vtrans = get_vtransform_sse4_2(data.wavelet_index, 0, data.coef_size, data.fmt);
       } catch (...) {
         printf(" ????  ]\n");
@@ -225,7 +315,7 @@ int perform_transforminitialtest(const transforminitial_test &data, void *idata_
     if (HAS_AVX) {
       printf(" AVX [ ");
       try {
-        avxhtrans = get_htransforminitial_avx(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt);
+        avxhtrans = get_htransforminitial_avx(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt, VC2ENCODER_CDS_422, VC2ENCODER_CMA_HDTV);
         avxvtrans = get_vtransform_avx(data.wavelet_index, 0, data.coef_size, data.fmt);
       } catch (...) {
         printf(" ????  ]\n");
@@ -277,7 +367,7 @@ int perform_transforminitialtest(const transforminitial_test &data, void *idata_
     if (HAS_AVX2) {
       printf(" AVX2 [ ");
       try {
-        avx2htrans = get_htransforminitial_avx2(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt);
+        avx2htrans = get_htransforminitial_avx2(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt, VC2ENCODER_CDS_422, VC2ENCODER_CMA_HDTV);
         avx2vtrans = get_vtransform_avx2(data.wavelet_index, 0, data.coef_size, data.fmt);
       } catch (...) {
         printf(" ????  ]\n");
@@ -333,27 +423,336 @@ int perform_transforminitialtest(const transforminitial_test &data, void *idata_
   return r;
 }
 
+/* Runs the level zero transforms of one implementation on the given input
+   and returns the coefficients of the three planes */
+static void *run_packedinput_transform(GetHTransformInitial gethtrans, GetVTransform getvtrans, const packedinput_test &data,
+                                       int color_diff_format, int color_matrix,
+                                       char **idata, const int *istride, const int *ostride, const int *width, const int *height) {
+  int plane_length[3];
+  for (int c = 0; c < 3; c++)
+    plane_length[c] = ostride[c]*height[c]*data.coef_size;
+  uint8_t *odata = (uint8_t *)memalign(32, plane_length[0] + plane_length[1] + plane_length[2]);
+  memset(odata, 0, plane_length[0] + plane_length[1] + plane_length[2]);
+  void *planes[3] = { odata, odata + plane_length[0], odata + plane_length[0] + plane_length[1] };
+
+  for (int c = 0; c < 3; c++) {
+    InplaceTransformInitial htrans = gethtrans(data.wavelet_index, data.active_bits, data.coef_size, c, data.fmt, color_diff_format, color_matrix);
+    if (htrans)
+      htrans(idata[c], istride[c], planes + c, ostride[c], width[c], height[c], width[c], height[c]);
+  }
+  InplaceTransform vtrans = getvtrans(data.wavelet_index, 0, data.coef_size, data.fmt);
+  if (vtrans) {
+    for (int c = 0; c < 3; c++)
+      vtrans(planes[c], ostride[c], width[c], height[c], 1);
+  }
+
+  return odata;
+}
+
+int perform_packedinputtest(const packedinput_test &data, void *idata_pre, bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2) {
+  int r = 0;
+
+  const int width  = 480;
+  const int height = 272;
+  const int cwidth  = (data.fmt == VC2ENCODER_INPUT_V410 || data.fmt == VC2ENCODER_INPUT_Y416)?width:width/2;
+  const int cheight = (data.fmt == VC2ENCODER_INPUT_P010)?height/2:height;
+  const int color_diff_format = (cwidth == width)?VC2ENCODER_CDS_444:((cheight == height)?VC2ENCODER_CDS_422:VC2ENCODER_CDS_420);
+  const int ostride  = ((width + 8 + 15)/16)*16;
+  const int costride = (cwidth == width)?ostride:ostride/2;
+  const int widths[3]   = { width, cwidth, cwidth };
+  const int heights[3]  = { height, cheight, cheight };
+  const int ostrides[3] = { ostride, costride, costride };
+  const int shift = 16 - data.active_bits;
+
+  /* The same samples as planar input and as the packed format under test,
+     the spare bits of the packing filled with noise */
+  const uint16_t *R = (const uint16_t *)idata_pre;
+  uint16_t *planar[3];
+  int pistride[3];
+  for (int c = 0; c < 3; c++) {
+    planar[c] = (uint16_t *)malloc(widths[c]*heights[c]*sizeof(uint16_t));
+    pistride[c] = widths[c];
+    for (int i = 0; i < widths[c]*heights[c]; i++)
+      planar[c][i] = R[c*width*height + i]&((1 << data.active_bits) - 1);
+  }
+  R += 3*width*height;
+
+  char *packed[3] = { NULL, NULL, NULL };
+  int istride[3] = { 0, 0, 0 };
+  switch (data.fmt) {
+  case VC2ENCODER_INPUT_UYVY10:
+    istride[0] = width*4;
+    packed[0] = (char *)malloc(istride[0]*height);
+    for (int y = 0; y < height; y++) {
+      uint16_t *D = (uint16_t *)&packed[0][y*istride[0]];
+      for (int x = 0; x < width; x += 2) {
+        D[2*x + 0] = planar[1][y*cwidth + x/2];
+        D[2*x + 1] = planar[0][y*width  + x];
+        D[2*x + 2] = planar[2][y*cwidth + x/2];
+        D[2*x + 3] = planar[0][y*width  + x + 1];
+      }
+    }
+    break;
+  case VC2ENCODER_INPUT_V410:
+    istride[0] = width*4;
+    packed[0] = (char *)malloc(istride[0]*height);
+    for (int y = 0; y < height; y++) {
+      uint32_t *D = (uint32_t *)&packed[0][y*istride[0]];
+      for (int x = 0; x < width; x++)
+        D[x] = (planar[1][y*width + x] << 2) | (planar[0][y*width + x] << 12) | (planar[2][y*width + x] << 22) | (R[y*width + x]&0x3);
+    }
+    break;
+  case VC2ENCODER_INPUT_Y416:
+    istride[0] = width*8;
+    packed[0] = (char *)malloc(istride[0]*height);
+    for (int y = 0; y < height; y++) {
+      uint16_t *D = (uint16_t *)&packed[0][y*istride[0]];
+      for (int x = 0; x < width; x++) {
+        const uint16_t noise = R[y*width + x]&((1 << shift) - 1);
+        D[4*x + 0] = (planar[1][y*width + x] << shift) | noise;
+        D[4*x + 1] = (planar[0][y*width + x] << shift) | noise;
+        D[4*x + 2] = (planar[2][y*width + x] << shift) | noise;
+        D[4*x + 3] = R[y*width + x];
+      }
+    }
+    break;
+  case VC2ENCODER_INPUT_P210:
+  case VC2ENCODER_INPUT_P010:
+    istride[0] = width;
+    istride[1] = 2*cwidth;
+    packed[0] = (char *)malloc(istride[0]*height*sizeof(uint16_t));
+    packed[1] = (char *)malloc(istride[1]*cheight*sizeof(uint16_t));
+    for (int i = 0; i < width*height; i++)
+      ((uint16_t *)packed[0])[i] = (planar[0][i] << shift) | (R[i]&((1 << shift) - 1));
+    for (int i = 0; i < cwidth*cheight; i++) {
+      ((uint16_t *)packed[1])[2*i + 0] = (planar[1][i] << shift) | (R[i]&((1 << shift) - 1));
+      ((uint16_t *)packed[1])[2*i + 1] = (planar[2][i] << shift) | (R[i]&((1 << shift) - 1));
+    }
+    break;
+  case VC2ENCODER_INPUT_8P2:
+    for (int c = 0; c < 3; c++) {
+      istride[c] = widths[c];
+      packed[c] = (char *)malloc(istride[c]*heights[c]);
+      for (int i = 0; i < widths[c]*heights[c]; i++)
+        ((uint8_t *)packed[c])[i] = planar[c][i];
+    }
+    break;
+  case VC2ENCODER_INPUT_UYVY:
+  case VC2ENCODER_INPUT_YUY2:
+    istride[0] = width*2;
+    packed[0] = (char *)malloc(istride[0]*height);
+    for (int y = 0; y < height; y++) {
+      uint8_t *D = (uint8_t *)&packed[0][y*istride[0]];
+      const int l = (data.fmt == VC2ENCODER_INPUT_UYVY)?1:0;
+      for (int x = 0; x < width; x += 2) {
+        D[2*x + 1 - l] = planar[1][y*cwidth + x/2];
+        D[2*x + l    ] = planar[0][y*width  + x];
+        D[2*x + 3 - l] = planar[2][y*cwidth + x/2];
+        D[2*x + 2 + l] = planar[0][y*width  + x + 1];
+      }
+    }
+    break;
+  default:
+    printf("INVALID INPUT FORMAT\n\n");
+    return 1;
+  }
+
+  printf("%-20s: H 0/*  %-6s %2d-bit ", VC2EncoderWaveletFilterTypeString[data.wavelet_index], VC2EncoderInputFormatString[data.fmt], data.active_bits);
+  if (data.coef_size == 2)
+    printf("16-bit ");
+  else
+    printf("32-bit ");
+
+  /* Every implementation must give the coefficients of planar input */
+  packedinput_test planar_data = data;
+  planar_data.fmt = VC2ENCODER_INPUT_10P2;
+  void *cdata = NULL;
+  try {
+    cdata = run_packedinput_transform(get_htransforminitial_c, get_vtransform_c, planar_data, color_diff_format, VC2ENCODER_CMA_HDTV, (char **)planar, pistride, ostrides, widths, heights);
+  } catch (...) {
+    printf(" 10P2 [ ????  ]\n");
+    r = 1;
+  }
+
+  const char *names[4] = { "C", "SSE4.2", "AVX", "AVX2" };
+  GetHTransformInitial hgetters[4] = { get_htransforminitial_c, get_htransforminitial_sse4_2, get_htransforminitial_avx, get_htransforminitial_avx2 };
+  GetVTransform vgetters[4] = { get_vtransform_c, get_vtransform_sse4_2, get_vtransform_avx, get_vtransform_avx2 };
+  const bool available[4] = { true, HAS_SSE4_2, HAS_AVX, HAS_AVX2 };
+  for (int n = 0; !r && n < 4; n++) {
+    if (!available[n])
+      continue;
+    printf(" %s [ ", names[n]);
+    void *tdata = NULL;
+    try {
+      tdata = run_packedinput_transform(hgetters[n], vgetters[n], data, color_diff_format, VC2ENCODER_CMA_HDTV, packed, istride, ostrides, widths, heights);
+    } catch (...) {
+      printf(" ????  ]\n");
+      r = 1;
+      break;
+    }
+
+    int cmp = 0;
+    int offset = 0;
+    for (int c = 0; c < 3; c++) {
+      for (int y = 0; y < heights[c]; y++)
+        cmp |= memcmp((uint8_t *)cdata + offset + y*ostrides[c]*data.coef_size, (uint8_t *)tdata + offset + y*ostrides[c]*data.coef_size, widths[c]*data.coef_size);
+      offset += ostrides[c]*heights[c]*data.coef_size;
+    }
+    free(tdata);
+    if (cmp) {
+      printf(" FAIL  ]\n");
+      r = 1;
+      break;
+    }
+    printf("  OK   ] ");
+  }
+  if (!r)
+    printf("\n");
+
+  free(cdata);
+  for (int c = 0; c < 3; c++) {
+    free(planar[c]);
+    free(packed[c]);
+  }
+  return r;
+}
+
+int perform_rgbinputtest(const rgbinput_test &data, void *idata_pre, bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2) {
+  int r = 0;
+
+  const char *ColorMatrixString[] = { "HDTV", "SDTV", "REV", "RGB" };
+  const int active_bits = (data.fmt == VC2ENCODER_INPUT_X2RGB10)?10:8;
+  const int width  = 480;
+  const int height = 272;
+  const int cwidth = (data.color_diff_format == VC2ENCODER_CDS_444)?width:width/2;
+  const int ostride  = ((width + 8 + 15)/16)*16;
+  const int costride = (cwidth == width)?ostride:ostride/2;
+  const int widths[3]   = { width, cwidth, cwidth };
+  const int heights[3]  = { height, height, height };
+  const int ostrides[3] = { ostride, costride, costride };
+  packedinput_test pdata = { data.wavelet_index, active_bits, data.coef_size, data.fmt };
+
+  /* G, B and R planes, and the same samples packed with noise in the spare
+     bits */
+  const uint16_t *R = (const uint16_t *)idata_pre;
+  uint16_t *planar[3];
+  int pistride[3] = { width, width, width };
+  for (int c = 0; c < 3; c++) {
+    planar[c] = (uint16_t *)malloc(width*height*sizeof(uint16_t));
+    for (int i = 0; i < width*height; i++)
+      planar[c][i] = R[c*width*height + i]&((1 << active_bits) - 1);
+  }
+  R += 3*width*height;
+
+  char *packed[3] = { NULL, NULL, NULL };
+  int istride[3] = { width*4, 0, 0 };
+  packed[0] = (char *)malloc(istride[0]*height);
+  for (int i = 0; i < width*height; i++) {
+    if (data.fmt == VC2ENCODER_INPUT_X2RGB10) {
+      ((uint32_t *)packed[0])[i] = (planar[1][i] << 0) | (planar[0][i] << 10) | (planar[2][i] << 20) | ((uint32_t)R[i] << 30);
+    } else {
+      ((uint8_t *)packed[0])[4*i + 0] = planar[1][i];
+      ((uint8_t *)packed[0])[4*i + 1] = planar[0][i];
+      ((uint8_t *)packed[0])[4*i + 2] = planar[2][i];
+      ((uint8_t *)packed[0])[4*i + 3] = R[i];
+    }
+  }
+
+  printf("%-20s: H 0/*  %-7s %s %s ", VC2EncoderWaveletFilterTypeString[data.wavelet_index], VC2EncoderInputFormatString[data.fmt],
+         ColorMatrixString[data.color_matrix], (data.color_diff_format == VC2ENCODER_CDS_444)?"4:4:4":"4:2:2");
+  if (data.coef_size == 2)
+    printf("16-bit ");
+  else
+    printf("32-bit ");
+
+  /* RGB coded as RGB must give the coefficients of planar input; there is no
+     planar equivalent of the matrixed input, so the C kernels are the
+     reference for that */
+  void *cdata = NULL;
+  try {
+    if (data.color_matrix == VC2ENCODER_CMA_RGB) {
+      packedinput_test planar_data = pdata;
+      planar_data.fmt = VC2ENCODER_INPUT_10P2;
+      cdata = run_packedinput_transform(get_htransforminitial_c, get_vtransform_c, planar_data, data.color_diff_format, data.color_matrix, (char **)planar, pistride, ostrides, widths, heights);
+    } else {
+      cdata = run_packedinput_transform(get_htransforminitial_c, get_vtransform_c, pdata, data.color_diff_format, data.color_matrix, packed, istride, ostrides, widths, heights);
+    }
+  } catch (...) {
+    printf(" C [ ????  ]\n");
+    r = 1;
+  }
+
+  const char *names[4] = { "C", "SSE4.2", "AVX", "AVX2" };
+  GetHTransformInitial hgetters[4] = { get_htransforminitial_c, get_htransforminitial_sse4_2, get_htransforminitial_avx, get_htransforminitial_avx2 };
+  GetVTransform vgetters[4] = { get_vtransform_c, get_vtransform_sse4_2, get_vtransform_avx, get_vtransform_avx2 };
+  const bool available[4] = { true, HAS_SSE4_2, HAS_AVX, HAS_AVX2 };
+  for (int n = (data.color_matrix == VC2ENCODER_CMA_RGB)?0:1; !r && n < 4; n++) {
+    if (!available[n])
+      continue;
+    printf(" %s [ ", names[n]);
+    void *tdata = NULL;
+    try {
+      tdata = run_packedinput_transform(hgetters[n], vgetters[n], pdata, data.color_diff_format, data.color_matrix, packed, istride, ostrides, widths, heights);
+    } catch (...) {
+      printf(" ????  ]\n");
+      r = 1;
+      break;
+    }
+
+    int cmp = 0;
+    int offset = 0;
+    for (int c = 0; c < 3; c++) {
+      for (int y = 0; y < heights[c]; y++)
+        cmp |= memcmp((uint8_t *)cdata + offset + y*ostrides[c]*data.coef_size, (uint8_t *)tdata + offset + y*ostrides[c]*data.coef_size, widths[c]*data.coef_size);
+      offset += ostrides[c]*heights[c]*data.coef_size;
+    }
+    free(tdata);
+    if (cmp) {
+      printf(" FAIL  ]\n");
+      r = 1;
+      break;
+    }
+    printf("  OK   ] ");
+  }
+  if (!r)
+    printf("\n");
+
+  free(cdata);
+  for (int c = 0; c < 3; c++) {
+    free(planar[c]);
+    free(packed[c]);
+  }
+  return r;
+}
+
 int perform_transformtest(const transform_test &data, void *idata_pre, bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2) {
   (void)HAS_AVX;(void)HAS_AVX2;
   int r = 0;
 
-  const int width   = 480;
-  const int height  = 272;
-  int stride = 1024;
+  /* The levels beyond the fourth are run on a larger picture, so that the
+     longer filters still have enough samples at their coarse spacing */
+  const int max_stride = 2048;
+  const int max_height = 1024;
   void *idata;
-  int idata_length = stride*height*data.coef_size;
-  idata = memalign(32, idata_length);
+  idata = memalign(32, max_stride*max_height*data.coef_size);
   if (data.coef_size == 2) {
-    for (int i = 0; i < stride*height; i++) {
+    for (int i = 0; i < max_stride*max_height; i++) {
       ((uint16_t*)idata)[i] = ((uint16_t*)idata_pre)[i]&0x3FF;
     }
   } else {
-    for (int i = 0; i < stride*height; i++) {
-      ((uint32_t*)idata)[i] = ((uint32_t*)idata_pre)[i]&0x3FF;
+    /* Signed samples of up to twenty bits, so that the Daubechies lifting
+       products need more than 32 bits */
+    for (int i = 0; i < max_stride*max_height; i++) {
+      ((int32_t*)idata)[i] = ((int32_t*)idata_pre)[i] >> 12;
     }
   }
 
-  for (int level = 1; level < 4; level++) {
+  for (int level = 1; level < MAX_DWT_DEPTH; level++) {
+    const int width   = (level < 4)?480:1792;
+    const int height  = (level < 4)?272:max_height;
+    const int stride  = (level < 4)?1024:max_stride;
+    const int idata_length = stride*height*data.coef_size;
+
     printf("%-20s: H %d/* ", VC2EncoderWaveletFilterTypeString[data.wavelet_index], level);
     if (data.coef_size == 2)
       printf("16-bit ");
@@ -557,6 +956,14 @@ int test_transforms(bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2) {
     r = perform_transforminitialtest(TRANSFORMINITIAL_TEST[i], idata, HAS_SSE4_2, HAS_AVX, HAS_AVX2);
   }
 
+  for (int i = 0; !r && i < (int)(sizeof(PACKEDINPUT_TEST)/sizeof(PACKEDINPUT_TEST[0])); i++) {
+    r = perform_packedinputtest(PACKEDINPUT_TEST[i], idata, HAS_SSE4_2, HAS_AVX, HAS_AVX2);
+  }
+
+  for (int i = 0; !r && i < (int)(sizeof(RGBINPUT_TEST)/sizeof(RGBINPUT_TEST[0])); i++) {
+    r = perform_rgbinputtest(RGBINPUT_TEST[i], idata, HAS_SSE4_2, HAS_AVX, HAS_AVX2);
+  }
+
   for (int i = 0; !r && i < (int)(sizeof(TRANSFORM_TEST)/sizeof(TRANSFORM_TEST[0])); i++) {
     r = perform_transformtest(TRANSFORM_TEST[i], idata, HAS_SSE4_2, HAS_AVX, HAS_AVX2);
   }
@@ -30,8 +30,10 @@ static bool HAS_AVX    = false;
 static bool HAS_AVX2   = false;
 
 int test_transforms(bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2);
+int test_encode(bool HAS_SSE4_2, bool HAS_AVX, bool HAS_AVX2);
+int test_roundtrip();
 
-void detect_cpu_features() {
+static void detect_cpu_features() {
   __builtin_cpu_init();
 
   HAS_SSE4_2 = __builtin_cpu_supports("sse4.2");
@@ -69,5 +71,11 @@ int main() {
   r = test_transforms(HAS_SSE4_2, HAS_AVX, HAS_AVX2);
   if (r) return r;
 
+  r = test_encode(HAS_SSE4_2, HAS_AVX, HAS_AVX2);
+  if (r) return r;
+
+  r = test_roundtrip();
+  if (r) return r;
+
   return r;
 }
@@ -27,6 +27,7 @@
 #include "logger.hpp"
 
 #include <functional>
+#include <algorithm>
 
 #include <stdio.h>
 
@@ -53,6 +54,8 @@ using std::bind;
 #include "vc2transform_avx/transform_avx.hpp"
 #include "vc2transform_avx2/transform_avx2.hpp"
 #endif
+#include "encode_simd.hpp"
+#include "encode_lossless.hpp"
 
 #ifdef DEBUG_P_BLOCK
 static int DEBUG_P_JOB;
@@ -101,12 +104,19 @@ void detect_cpu_features() {
   get_htransforminitial = get_htransforminitial_c;
   get_htransform = get_htransform_c;
   get_vtransform = get_vtransform_c;
+  quantise_and_code16 = NULL;
+  quantise_and_code32 = NULL;
+  coded_length16 = NULL;
+  coded_length32 = NULL;
 
 #ifndef NO_SIMD
   if (HAS_SSE4_2) {
     get_htransforminitial = get_htransforminitial_sse4_2;
     get_htransform = get_htransform_sse4_2;
     get_vtransform = get_vtransform_sse4_2;
+    quantise_and_code16 = quantise_and_code16_sse4_2;
+    coded_length16 = coded_length16_sse4_2;
+    coded_length32 = coded_length32_sse4_2;
   }
 
 #ifndef NO_AVX
@@ -120,12 +130,33 @@ void detect_cpu_features() {
     get_htransforminitial = get_htransforminitial_avx2;
     get_htransform = get_htransform_avx2;
     get_vtransform = get_vtransform_avx2;
+    quantise_and_code16 = quantise_and_code16_avx2;
+    quantise_and_code32 = quantise_and_code32_avx2;
+    coded_length16 = coded_length16_avx2;
+    coded_length32 = coded_length32_avx2;
   }
 #endif
 #endif
 }
 
 void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
+  /* The 8 bit input formats signal the matching video range unless the
+     caller has chosen one, or the full range for RGB coded as RGB */
+  if ((params.input_format == VC2ENCODER_INPUT_8P2 ||
+       params.input_format == VC2ENCODER_INPUT_UYVY ||
+       params.input_format == VC2ENCODER_INPUT_YUY2 ||
+       params.input_format == VC2ENCODER_INPUT_BGRA) &&
+      !params.video_format.custom_signal_range_flag) {
+    params.video_format.custom_signal_range_flag = 1;
+    params.video_format.signal_range_index       = VC2ENCODER_PSR_8BITVID;
+    if (params.input_format == VC2ENCODER_INPUT_BGRA &&
+        params.video_format.custom_color_spec_flag &&
+        params.video_format.color_spec_index == VC2ENCODER_CSP_CUSTOM &&
+        params.video_format.custom_color_matrix_flag &&
+        params.video_format.color_matrix_index == VC2ENCODER_CMA_RGB)
+      params.video_format.signal_range_index     = VC2ENCODER_PSR_8BITFULL;
+  }
+
   mParams = params;
 
   if (mEncoderData)
@@ -142,10 +173,6 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     delete mPool;
   }
 
-  mCoefSize = 2;
-  if (params.transform_params.wavelet_depth > 4)
-    mCoefSize = 4;
-
   mVideoFormat = vc2::preset_formats[params.video_format.base_video_format];
 
   if(params.video_format.custom_dimensions_flag) {
@@ -188,7 +215,21 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     mVideoFormat.top_offset   = params.video_format.top_offset;
   }
 
-  if (params.video_format.custom_signal_range_flag) {
+  if (params.video_format.custom_signal_range_flag && params.video_format.signal_range_index == VC2ENCODER_PSR_CUSTOM) {
+    if (params.video_format.luma_offset > 65534 || params.video_format.luma_excursion > 65534 ||
+        params.video_format.color_diff_offset > 65534 || params.video_format.color_diff_excursion > 65534) {
+      writelog(LOG_ERROR, "%s:%d: Custom signal range too wide to code\n", __FILE__, __LINE__);
+      throw VC2ENCODER_BADPARAMS;
+    }
+    mVideoFormat.luma_offset                 = params.video_format.luma_offset;
+    mVideoFormat.luma_excursion              = params.video_format.luma_excursion;
+    mVideoFormat.luma_active_bits            = vc2::signal_range_active_bits(params.video_format.luma_excursion);
+    mVideoFormat.luma_bytes_per_sample       = (mVideoFormat.luma_active_bits + 7)/8;
+    mVideoFormat.color_diff_offset           = params.video_format.color_diff_offset;
+    mVideoFormat.color_diff_excursion        = params.video_format.color_diff_excursion;
+    mVideoFormat.color_diff_active_bits      = vc2::signal_range_active_bits(params.video_format.color_diff_excursion);
+    mVideoFormat.color_diff_bytes_per_sample = (mVideoFormat.color_diff_active_bits + 7)/8;
+  } else if (params.video_format.custom_signal_range_flag) {
     mVideoFormat.luma_offset                 = vc2::preset_signal_ranges[params.video_format.signal_range_index].luma_offset;
     mVideoFormat.luma_excursion              = vc2::preset_signal_ranges[params.video_format.signal_range_index].luma_excursion;
     mVideoFormat.luma_bytes_per_sample       = vc2::preset_signal_ranges[params.video_format.signal_range_index].luma_bytes_per_sample;
@@ -237,7 +278,109 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     color_diff_height_factor = 2;
   case VC2ENCODER_CDS_422:
     color_diff_width_factor = 2;
+  case VC2ENCODER_CDS_444:
     break;
+  default:
+    writelog(LOG_ERROR, "%s:%d: Invalid chroma format %d\n", __FILE__, __LINE__, mVideoFormat.color_diff_format_index);
+    throw VC2ENCODER_BADPARAMS;
+  }
+  mColorDiffFormat = mVideoFormat.color_diff_format_index;
+
+  /* Every input format other than planar carries a single chroma format, and
+     the packed formats one sample depth for all three components */
+  {
+    int input_color_diff_format = -1;
+    bool input_bits_ok = true;
+    const int lbits = mVideoFormat.luma_active_bits;
+    const int cbits = mVideoFormat.color_diff_active_bits;
+    switch (params.input_format) {
+    case VC2ENCODER_INPUT_10P2:
+      input_color_diff_format = mColorDiffFormat;
+      break;
+    case VC2ENCODER_INPUT_V210:
+    case VC2ENCODER_INPUT_UYVY10:
+      input_color_diff_format = VC2ENCODER_CDS_422;
+      input_bits_ok = (lbits == 10 && cbits == 10);
+      break;
+    case VC2ENCODER_INPUT_V410:
+      input_color_diff_format = VC2ENCODER_CDS_444;
+      input_bits_ok = (lbits == 10 && cbits == 10);
+      break;
+    case VC2ENCODER_INPUT_Y416:
+      input_color_diff_format = VC2ENCODER_CDS_444;
+      input_bits_ok = (lbits == cbits && (lbits == 10 || lbits == 12 || lbits == 16));
+      break;
+    case VC2ENCODER_INPUT_P210:
+    case VC2ENCODER_INPUT_P010:
+      input_color_diff_format = (params.input_format == VC2ENCODER_INPUT_P210)?VC2ENCODER_CDS_422:VC2ENCODER_CDS_420;
+      input_bits_ok = ((lbits == 10 || lbits == 12 || lbits == 16) &&
+                       (cbits == 10 || cbits == 12 || cbits == 16));
+      break;
+    case VC2ENCODER_INPUT_8P2:
+      input_color_diff_format = mColorDiffFormat;
+      input_bits_ok = (lbits == 8 && cbits == 8);
+      break;
+    case VC2ENCODER_INPUT_UYVY:
+    case VC2ENCODER_INPUT_YUY2:
+      input_color_diff_format = VC2ENCODER_CDS_422;
+      input_bits_ok = (lbits == 8 && cbits == 8);
+      break;
+    case VC2ENCODER_INPUT_X2RGB10:
+    case VC2ENCODER_INPUT_BGRA:
+      {
+        const int bits = (params.input_format == VC2ENCODER_INPUT_X2RGB10)?10:8;
+        input_bits_ok = (lbits == bits && cbits == bits);
+
+        /* RGB is coded as it is or matrixed to the video range of its depth */
+        if (mVideoFormat.color_matrix == VC2ENCODER_CMA_RGB) {
+          input_color_diff_format = VC2ENCODER_CDS_444;
+        } else if (mVideoFormat.color_matrix == VC2ENCODER_CMA_HDTV || mVideoFormat.color_matrix == VC2ENCODER_CMA_SDTV) {
+          if (mColorDiffFormat == VC2ENCODER_CDS_444 || mColorDiffFormat == VC2ENCODER_CDS_422)
+            input_color_diff_format = mColorDiffFormat;
+          if (mVideoFormat.luma_offset          != (uint32_t)(16  << (bits - 8)) ||
+              mVideoFormat.luma_excursion       != (uint32_t)(219 << (bits - 8)) ||
+              mVideoFormat.color_diff_offset    != (uint32_t)(128 << (bits - 8)) ||
+              mVideoFormat.color_diff_excursion != (uint32_t)(224 << (bits - 8))) {
+            writelog(LOG_ERROR, "%s:%d: RGB input can only be converted to the video signal range\n", __FILE__, __LINE__);
+            throw VC2ENCODER_BADPARAMS;
+          }
+        } else {
+          writelog(LOG_ERROR, "%s:%d: RGB input can not be converted with this colour matrix\n", __FILE__, __LINE__);
+          throw VC2ENCODER_BADPARAMS;
+        }
+      }
+      break;
+    default:
+      writelog(LOG_ERROR, "%s:%d: Unknown input format %d\n", __FILE__, __LINE__, params.input_format);
+      throw VC2ENCODER_BADPARAMS;
+    }
+
+    if (input_color_diff_format != mColorDiffFormat) {
+      writelog(LOG_ERROR, "%s:%d: Input format does not carry this chroma format\n", __FILE__, __LINE__);
+      throw VC2ENCODER_BADPARAMS;
+    }
+
+    if (!input_bits_ok) {
+      writelog(LOG_ERROR, "%s:%d: Input format does not carry this bit depth\n", __FILE__, __LINE__);
+      throw VC2ENCODER_BADPARAMS;
+    }
+  }
+
+  if (params.transform_params.wavelet_index >= VC2ENCODER_WFT_NUM) {
+    writelog(LOG_ERROR, "%s:%d: Unknown wavelet %d\n", __FILE__, __LINE__, params.transform_params.wavelet_index);
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+  if (params.transform_params.wavelet_depth < 1 || params.transform_params.wavelet_depth > MAX_DWT_DEPTH) {
+    writelog(LOG_ERROR, "%s:%d: Transform depth %d out of range\n", __FILE__, __LINE__, params.transform_params.wavelet_depth);
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+  /* Sixteen bit coefficients are used wherever the widest samples cannot
+     overflow them in the transform */
+  {
+    const int active_bits = (mVideoFormat.luma_active_bits > mVideoFormat.color_diff_active_bits)?mVideoFormat.luma_active_bits:mVideoFormat.color_diff_active_bits;
+    mCoefSize = transform_coef_size(params.transform_params.wavelet_index, active_bits, params.transform_params.wavelet_depth);
   }
 
   if (mJobData) {
@@ -263,14 +406,136 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     throw VC2ENCODER_BADPARAMS;
   }
 
+  /* The slices of a VC-2 picture divide each subband evenly, so a slice size
+     which does not divide the padded picture is met by coding a frame a whole
+     number of slices across and down, with the picture as its clean area.
+     The slices at the right and bottom edges then hold the extension the
+     initial transform pads the picture with, and every slice keeps the
+     geometry of the specialised slice encoders. */
   if ((mPaddedWidth%params.transform_params.slice_width != 0) ||
       (mPaddedHeight%params.transform_params.slice_height != 0)) {
-    writelog(LOG_ERROR, "%s:%d: Support for slice sizes (%dx%d) which do not divide the padded picture size (%dx%d) is not implemented.\n", __FILE__, __LINE__,
-            params.transform_params.slice_width, params.transform_params.slice_height,
-            mPaddedWidth, mPaddedHeight);
+    mPaddedWidth  = (mPaddedWidth  + params.transform_params.slice_width  - 1)/params.transform_params.slice_width*params.transform_params.slice_width;
+    mPaddedHeight = (mPaddedHeight + params.transform_params.slice_height - 1)/params.transform_params.slice_height*params.transform_params.slice_height;
+
+    if (!mParams.video_format.custom_clean_area_flag) {
+      mParams.video_format.custom_clean_area_flag = 1;
+      if (mParams.video_format.custom_dimensions_flag) {
+        mVideoFormat.clean_width  = mVideoFormat.frame_width;
+        mVideoFormat.clean_height = mVideoFormat.frame_height;
+        mVideoFormat.left_offset  = 0;
+        mVideoFormat.top_offset   = 0;
+      }
+      mParams.video_format.clean_width  = mVideoFormat.clean_width;
+      mParams.video_format.clean_height = mVideoFormat.clean_height;
+      mParams.video_format.left_offset  = mVideoFormat.left_offset;
+      mParams.video_format.top_offset   = mVideoFormat.top_offset;
+    }
+
+    mVideoFormat.frame_width  = mPaddedWidth;
+    mVideoFormat.frame_height = mPaddedHeight*(mInterlaced?2:1);
+    mParams.video_format.custom_dimensions_flag = 1;
+    mParams.video_format.frame_width  = mVideoFormat.frame_width;
+    mParams.video_format.frame_height = mVideoFormat.frame_height;
+
+    writelog(LOG_INFO, "%s:%d: Slice size %dx%d does not divide the picture, coding a %dx%d frame with a %dx%d clean area\n", __FILE__, __LINE__,
+             params.transform_params.slice_width, params.transform_params.slice_height,
+             mVideoFormat.frame_width, mVideoFormat.frame_height, mVideoFormat.clean_width, mVideoFormat.clean_height);
+  }
+
+  if (params.transform_params.custom_quant_matrix_flag) {
+    bool valid = (params.transform_params.quant_matrix_LL <= 255);
+    for (int l = 0; l < (int)params.transform_params.wavelet_depth; l++)
+      valid = valid && (params.transform_params.quant_matrix_HL[l] <= 255) &&
+                       (params.transform_params.quant_matrix_LH[l] <= 255) &&
+                       (params.transform_params.quant_matrix_HH[l] <= 255);
+    if (!valid) {
+      writelog(LOG_ERROR, "%s:%d: Custom quantisation matrix entries above 255 are not supported\n", __FILE__, __LINE__);
+      throw VC2ENCODER_BADPARAMS;
+    }
+  }
+
+  /* There are no default matrices for a transform deeper than four levels,
+     so the matrix it is coded with is signalled as a custom one */
+  if (params.transform_params.wavelet_depth > 4 && !params.transform_params.custom_quant_matrix_flag) {
+    const QuantisationWeightingMatrix matrix = default_quantisation_matrix(params.transform_params.wavelet_index, params.transform_params.wavelet_depth);
+    mParams.transform_params.custom_quant_matrix_flag = 1;
+    mParams.transform_params.quant_matrix_LL = matrix.LL;
+    for (int l = 0; l < MAX_DWT_DEPTH; l++) {
+      mParams.transform_params.quant_matrix_HL[l] = matrix.HL[l];
+      mParams.transform_params.quant_matrix_LH[l] = matrix.LH[l];
+      mParams.transform_params.quant_matrix_HH[l] = matrix.HH[l];
+    }
+  }
+
+  if (params.fixed_qindex_flag && (params.fixed_qindex < 0 || params.fixed_qindex > MAX_QI)) {
+    writelog(LOG_ERROR, "%s:%d: Fixed qindex %d out of range 0 to %d\n", __FILE__, __LINE__, params.fixed_qindex, MAX_QI);
     throw VC2ENCODER_BADPARAMS;
   }
 
+  if (params.rate_control_flag && params.fixed_qindex_flag) {
+    writelog(LOG_ERROR, "%s:%d: Rate control cannot be used with a fixed qindex\n", __FILE__, __LINE__);
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+  if (params.rate_control_flag && params.rate_control_buffer_size < 0) {
+    writelog(LOG_ERROR, "%s:%d: Rate control buffer size %d out of range\n", __FILE__, __LINE__, params.rate_control_buffer_size);
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+  /* No component of a slice can be longer than 255 times the slice size
+     scalar. A scalar of two leaves the usual small slices plenty of room,
+     but the large slices that transforms deeper than four levels need would
+     be starved by it, with every coefficient costing at least a bit, so for
+     those the scalar grows to give the largest component room for four bits
+     a coefficient. Shallower transforms keep the scalar of two, and with it
+     the bitstream they have always been coded to. */
+  mSliceSizeScalar = 2;
+  if (params.transform_params.wavelet_depth > 4) {
+    mSliceSizeScalar = (params.transform_params.slice_width*params.transform_params.slice_height + 509)/510;
+    if (mSliceSizeScalar < 2)
+      mSliceSizeScalar = 2;
+  }
+
+  /* Lossless pictures are fixed qindex pictures at qindex 0 */
+  if (params.lossless_flag) {
+    if (params.transform_params.wavelet_index != VC2ENCODER_WFT_LEGALL_5_3 &&
+        params.transform_params.wavelet_index != VC2ENCODER_WFT_HAAR_NO_SHIFT &&
+        params.transform_params.wavelet_index != VC2ENCODER_WFT_HAAR_SINGLE_SHIFT) {
+      writelog(LOG_ERROR, "%s:%d: Lossless coding needs the LeGall or a Haar wavelet\n", __FILE__, __LINE__);
+      throw VC2ENCODER_BADPARAMS;
+    }
+
+    if (params.rate_control_flag || (params.fixed_qindex_flag && params.fixed_qindex != 0)) {
+      writelog(LOG_ERROR, "%s:%d: Lossless coding cannot be used with rate control or a non-zero fixed qindex\n", __FILE__, __LINE__);
+      throw VC2ENCODER_BADPARAMS;
+    }
+
+    mParams.fixed_qindex_flag = 1;
+    mParams.fixed_qindex      = 0;
+  }
+
+  /* A fixed qindex picture has no length to fit, so rather than have a
+     slice's qindex raised past the one asked for its scalar is sized for the
+     longest component there can be. The worst case growth of the transform,
+     from which the coefficient size is also chosen, bounds the magnitude of
+     every coefficient by 2^k, and with it the longest a component can be at
+     qindex 0, and so at any qindex. The slice size scalar is chosen to make
+     room for that in the slice header, and the slices are given packed
+     buffers of that length, which the packer checks it stays within, for
+     the slices whose codewords are too long for the codeword arrays. */
+  int packed_length = 0;
+  if (mParams.fixed_qindex_flag) {
+    const int active_bits = (mVideoFormat.luma_active_bits > mVideoFormat.color_diff_active_bits)?mVideoFormat.luma_active_bits:mVideoFormat.color_diff_active_bits;
+    int k = transform_coef_bits(params.transform_params.wavelet_index, active_bits, params.transform_params.wavelet_depth);
+    if (k > 8*mCoefSize - 1)
+      k = 8*mCoefSize - 1;
+    const int length = lossless_component_length(params.transform_params.slice_width*params.transform_params.slice_height, k);
+    mSliceSizeScalar = (length + 254)/255;
+    packed_length = length + 8;
+
+    writelog(LOG_INFO, "%s:%d: Coding at a fixed qindex with a slice size scalar of %d\n", __FILE__, __LINE__, mSliceSizeScalar);
+  }
+
 
 #ifndef DEBUG_SINGLE_JOB
   mThreads = params.n_threads;
@@ -300,10 +565,10 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     delete mSlices32;
   if (mCoefSize == 2) {
     mSlices16 = new CodedSlices<int16_t>(mSlicesPerLine, mSlicesPerPicture/mSlicesPerLine,
-                                         params.transform_params.slice_width, params.transform_params.slice_height, mDepth);
+                                         params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat, packed_length);
   } else if (mCoefSize == 4) {
     mSlices32 = new CodedSlices<int32_t>(mSlicesPerLine, mSlicesPerPicture/mSlicesPerLine,
-                                         params.transform_params.slice_width, params.transform_params.slice_height, mDepth);
+                                         params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat, packed_length);
   }
 
   mJobData = new JobBase*[mJobs];
@@ -315,8 +580,10 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
       int w     == width of picture portion represented
       int h     == height (not including padding)
       int pt    == pad top (in pixels)    -- This padding will contain data from the picture but is not part of the coded output, and must be a whole number of slices
-      int pb    == pad bottom (in pixels)
+      int pb    == pad bottom (in pixels) -- The lines of picture below the job that are read, which stop at the bottom of the picture and are made up to
+                                             a whole number of slices by padding
       int d     == depth
+      int cf    == chroma format
       int sx    == slices_x
       int sy    == slices_y (not including padding)
       int off_x == not used
@@ -327,29 +594,41 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
       int slice_offset_y,           == the offset in slice-lines to the first OUTPUT slice of this job, apparently
       int slice_stride              == how many slices accross the picture
    */
-  const int slice_overlap = (TRANSFORM_OVERLAP[mParams.transform_params.wavelet_index][mParams.transform_params.wavelet_depth - 1] + params.transform_params.slice_height - 1)/params.transform_params.slice_height;
+  /* The overlap is needed in every component, so is counted in slices of the
+     shortest */
+  const int overlap_slice_height = color_diff_height(mColorDiffFormat, params.transform_params.slice_height);
+  const int slice_rows = mSlicesPerPicture/mSlicesPerLine;
+  const int slice_overlap = std::min((TRANSFORM_OVERLAP[mParams.transform_params.wavelet_index][mParams.transform_params.wavelet_depth - 1] + overlap_slice_height - 1)/overlap_slice_height,
+                                     slice_rows);
+  /* The first job is at least as tall as the overlap, so a picture no taller than that is coded as a single job, and the lines the
+     first job reads below itself stop at the bottom of the picture */
+  int first_slices_y = (slice_rows + mJobs - 1)/mJobs;
+  if (first_slices_y < slice_overlap)
+    first_slices_y = slice_overlap;
+  if (first_slices_y >= slice_rows)
+    mJobs = 1;
+  const int first_pad_b = std::min(slice_overlap*params.transform_params.slice_height,
+                                   mLumaHeight - first_slices_y*params.transform_params.slice_height);
   if (mCoefSize == 2) {
     if (mJobs == 1) {
       mJobData[0] = new JobData<int16_t>(0,
                                          mLumaWidth, mLumaHeight,
                                          0, 0,
-                                         mDepth,
+                                         mDepth, mColorDiffFormat,
                                          mSlicesPerLine, mSlicesPerPicture/mSlicesPerLine,
                                          0, 0,
                                          mSlices16,
                                          0, 0,
                                          mSlicesPerLine);
     } else {
-      int slices_y = ((mSlicesPerPicture/mSlicesPerLine) + mJobs - 1)/mJobs;
-      if (slices_y < slice_overlap)
-        slices_y = slice_overlap;
+      int slices_y = first_slices_y;
       int slices_already = 0;
       int i = 0;
       {
         mJobData[i] = new JobData<int16_t>(i,
                                            mLumaWidth, slices_y*params.transform_params.slice_height,
-                                           0, slice_overlap*params.transform_params.slice_height,
-                                           mDepth,
+                                           0, first_pad_b,
+                                           mDepth, mColorDiffFormat,
                                            mSlicesPerLine, slices_y,
                                            0, 0,
                                            mSlices16,
@@ -363,7 +642,7 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
         mJobData[i] = new JobData<int16_t>(i,
                                            mLumaWidth, slices_y*params.transform_params.slice_height,
                                            slice_overlap*params.transform_params.slice_height, slice_overlap*params.transform_params.slice_height,
-                                           mDepth,
+                                           mDepth, mColorDiffFormat,
                                            mSlicesPerLine, slices_y,
                                            0, (slices_already - slice_overlap)*params.transform_params.slice_height,
                                            mSlices16,
@@ -376,7 +655,7 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
         mJobData[i] = new JobData<int16_t>(i,
                                            mLumaWidth, mLumaHeight - slices_already*params.transform_params.slice_height,
                                            slice_overlap*params.transform_params.slice_height, 0,
-                                           mDepth,
+                                           mDepth, mColorDiffFormat,
                                            mSlicesPerLine, mSlicesPerPicture/mSlicesPerLine - slices_already,
                                            0, (slices_already - slice_overlap)*params.transform_params.slice_height,
                                            mSlices16,
@@ -391,23 +670,21 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
       mJobData[0] = new JobData<int32_t>(0,
                                          mLumaWidth, mLumaHeight,
                                          0, 0,
-                                         mDepth,
+                                         mDepth, mColorDiffFormat,
                                          mSlicesPerLine, mSlicesPerPicture/mSlicesPerLine,
                                          0, 0,
                                          mSlices32,
                                          0, 0,
                                          mSlicesPerLine);
     } else {
-      int slices_y = ((mSlicesPerPicture/mSlicesPerLine) + mJobs - 1)/mJobs;
-      if (slices_y < slice_overlap)
-        slices_y = slice_overlap;
+      int slices_y = first_slices_y;
       int slices_already = 0;
       int i = 0;
       {
-        mJobData[0] = new JobData<int32_t>(i,
+        mJobData[i] = new JobData<int32_t>(i,
                                            mLumaWidth, slices_y*params.transform_params.slice_height,
-                                           0, slice_overlap*params.transform_params.slice_height,
-                                           mDepth,
+                                           0, first_pad_b,
+                                           mDepth, mColorDiffFormat,
                                            mSlicesPerLine, slices_y,
                                            0, 0,
                                            mSlices32,
@@ -417,11 +694,11 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
         slices_y = ((mSlicesPerPicture/mSlicesPerLine - slices_already) + mJobs - i - 1)/(mJobs - i);
       }
       i++;
-      for (int i = 1; i < mJobs - 1 && slices_already + slices_y  + slice_overlap < mSlicesPerPicture/mSlicesPerLine; i++) {
+      for (; i < mJobs - 1 && slices_already + slices_y  + slice_overlap < mSlicesPerPicture/mSlicesPerLine; i++) {
         mJobData[i] = new JobData<int32_t>(i,
                                            mLumaWidth, slices_y*params.transform_params.slice_height,
                                            slice_overlap*params.transform_params.slice_height, slice_overlap*params.transform_params.slice_height,
-                                           mDepth,
+                                           mDepth, mColorDiffFormat,
                                            mSlicesPerLine, slices_y,
                                            0, (slices_already - slice_overlap)*params.transform_params.slice_height,
                                            mSlices32,
@@ -434,7 +711,7 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
         mJobData[i] = new JobData<int32_t>(i,
                                            mLumaWidth, mLumaHeight - slices_already*params.transform_params.slice_height,
                                            slice_overlap*params.transform_params.slice_height, 0,
-                                           mDepth,
+                                           mDepth, mColorDiffFormat,
                                            mSlicesPerLine, mSlicesPerPicture/mSlicesPerLine - slices_already,
                                            0, (slices_already - slice_overlap)*params.transform_params.slice_height,
                                            mSlices32,
@@ -456,15 +733,29 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     DEBUG_P_JOB++;
   }
 
-  DEBUG_P_SLICE_W = (DEBUG_P_COMP == 0)?params.transform_params.slice_width:params.transform_params.slice_width/2;
-  DEBUG_P_SLICE_H = params.transform_params.slice_height;
+  DEBUG_P_SLICE_W = (DEBUG_P_COMP == 0)?params.transform_params.slice_width:color_diff_width(mColorDiffFormat, params.transform_params.slice_width);
+  DEBUG_P_SLICE_H = (DEBUG_P_COMP == 0)?params.transform_params.slice_height:color_diff_height(mColorDiffFormat, params.transform_params.slice_height);
 #endif
 
-  if (mQuantisationMatrices)
-    delete mQuantisationMatrices;
+  {
+    QuantisationWeightingMatrix matrix = default_quantisation_matrix(params.transform_params.wavelet_index, mDepth);
+    if (mParams.transform_params.custom_quant_matrix_flag) {
+      matrix.LL = mParams.transform_params.quant_matrix_LL;
+      for (int l = 0; l < mDepth; l++) {
+        matrix.HL[l] = mParams.transform_params.quant_matrix_HL[l];
+        matrix.LH[l] = mParams.transform_params.quant_matrix_LH[l];
+        matrix.HH[l] = mParams.transform_params.quant_matrix_HH[l];
+      }
+    }
 
-  mQuantisationMatrices = new QuantisationMatrices(params.transform_params.slice_width, params.transform_params.slice_height,
-                                                   mDepth, params.transform_params.wavelet_index, 0, 32);
+    /* Acquired before the old set is released so that reconfiguring with the
+       same matrix keeps the tables already generated */
+    QuantisationMatrices *matrices = acquire_quantisation_matrices(params.transform_params.slice_width, params.transform_params.slice_height,
+                                                                   mDepth, mColorDiffFormat, matrix, 0, 32);
+    if (mQuantisationMatrices)
+      release_quantisation_matrices(mQuantisationMatrices);
+    mQuantisationMatrices = matrices;
+  }
 
   if (mSequenceHeader)
     delete mSequenceHeader;
@@ -473,9 +764,9 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     delete mPictureHeader;
   mPictureHeader  = new PictureHeader(mParams, mSlicesPerLine, mSlicesPerPicture/mSlicesPerLine, mSliceSizeScalar);
 
-  transform_initial[0] = get_htransforminitial(mParams.transform_params.wavelet_index, 10, mCoefSize, 0, mParams.input_format);
-  transform_initial[1] = get_htransforminitial(mParams.transform_params.wavelet_index, 10, mCoefSize, 1, mParams.input_format);
-  transform_initial[2] = get_htransforminitial(mParams.transform_params.wavelet_index, 10, mCoefSize, 2, mParams.input_format);
+  transform_initial[0] = get_htransforminitial(mParams.transform_params.wavelet_index, mVideoFormat.luma_active_bits,       mCoefSize, 0, mParams.input_format, mColorDiffFormat, mVideoFormat.color_matrix);
+  transform_initial[1] = get_htransforminitial(mParams.transform_params.wavelet_index, mVideoFormat.color_diff_active_bits, mCoefSize, 1, mParams.input_format, mColorDiffFormat, mVideoFormat.color_matrix);
+  transform_initial[2] = get_htransforminitial(mParams.transform_params.wavelet_index, mVideoFormat.color_diff_active_bits, mCoefSize, 2, mParams.input_format, mColorDiffFormat, mVideoFormat.color_matrix);
 
   if (transforms_h)
     delete[] transforms_h;
@@ -517,10 +808,38 @@ void VC2Encoder::setParams(VC2EncoderParams &params) throw(VC2EncoderResult){
     QUANTISER_SELECTION_QUALITY = QUANTISER_SELECTION_EIGHTHSEARCH;
     passes = 1;
     break;
+  case VC2ENCODER_SPEED_RDO:
+    /* The slices are coded by code_slices at the quantisers the picture-wide
+       allocation chooses, so the search encoders go unused */
+    QUANTISER_SELECTION_QUALITY = QUANTISER_SELECTION_FULLSEARCH;
+    passes = 1;
+    break;
   }
 
-  slice_encoder_func16 = get_slice_encoder16(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, QUANTISER_SELECTION_QUALITY, passes);
-  slice_encoder_func32 = get_slice_encoder32(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, QUANTISER_SELECTION_QUALITY, passes);
+  slice_encoder_func16 = get_slice_encoder16(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat, QUANTISER_SELECTION_QUALITY, passes);
+  slice_encoder_func32 = get_slice_encoder32(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat, QUANTISER_SELECTION_QUALITY, passes);
+  slice_refiner_func16 = get_slice_refiner16(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat, QUANTISER_SELECTION_QUALITY);
+  slice_refiner_func32 = get_slice_refiner32(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat, QUANTISER_SELECTION_QUALITY);
+  mRefinePasses = passes - 1;
+
+  slice_coder_func16 = get_slice_coder16(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat);
+  slice_coder_func32 = get_slice_coder32(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat);
+  mRateDistortion = (mParams.speed == VC2ENCODER_SPEED_RDO) && !mParams.fixed_qindex_flag;
+  if (mRDCurves)
+    delete[] mRDCurves;
+  mRDCurves = NULL;
+  if (mRateDistortion)
+    mRDCurves = new SliceRDCurve[mSlicesPerPicture];
+
+  if (params.lossless_flag) {
+    fixed_slice_coder_func16 = get_lossless_slice_coder16(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat);
+    fixed_slice_coder_func32 = get_lossless_slice_coder32(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat);
+  } else {
+    fixed_slice_coder_func16 = get_fixed_slice_coder16(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat);
+    fixed_slice_coder_func32 = get_fixed_slice_coder32(params.transform_params.slice_width, params.transform_params.slice_height, mDepth, mColorDiffFormat);
+  }
+
+  mRateController.reset(mParams.rate_control_buffer_size, 4*mSlicesPerPicture, (4 + 3*255*mSliceSizeScalar)*mSlicesPerPicture, mSliceSizeScalar);
 }
 
 uint32_t VC2Encoder::startSequence(char **data) {
@@ -539,6 +858,7 @@ uint32_t VC2Encoder::repeatSequenceStart(char **data, uint32_t prev_parse_offset
 
 
 uint32_t VC2Encoder::startPicture(char **data, uint32_t prev_parse_offset, uint32_t picture_number, int data_length) {
+  mPictureNumber = picture_number;
   if (mParams.fragment_size == 0) {
     mPictureHeader->setNextParseOffset(data_length + mPictureHeader->length);
     mPictureHeader->setPrevParseOffset(prev_parse_offset);
@@ -632,6 +952,7 @@ uint32_t VC2Encoder::getExtraLengthForFragmentHeaders(uint32_t data_length) {
 bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int length, uint32_t *prev_parse_offset) {
   int coded_length = length;
   char *odata = *_odata;
+  int written = length + getExtraLengthForFragmentHeaders(length);
 
   ++mJobsInFlight;
 
@@ -640,8 +961,8 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
     for (int i = 0; i < mJobs; i++) {
       if (mJobData[i]) {
         mJobData[i]->idata[0] = &idata[0][2*(mJobData[i]->offset_y*istride[0] + mJobData[i]->offset_x)];
-        mJobData[i]->idata[1] = &idata[1][2*(mJobData[i]->offset_y*istride[1] + mJobData[i]->offset_x/2)];
-        mJobData[i]->idata[2] = &idata[2][2*(mJobData[i]->offset_y*istride[2] + mJobData[i]->offset_x/2)];
+        mJobData[i]->idata[1] = &idata[1][2*(color_diff_height(mColorDiffFormat, mJobData[i]->offset_y)*istride[1] + color_diff_width(mColorDiffFormat, mJobData[i]->offset_x))];
+        mJobData[i]->idata[2] = &idata[2][2*(color_diff_height(mColorDiffFormat, mJobData[i]->offset_y)*istride[2] + color_diff_width(mColorDiffFormat, mJobData[i]->offset_x))];
 
         mJobData[i]->istride[0] = istride[0];
         mJobData[i]->istride[1] = istride[1];
@@ -654,7 +975,34 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
     if (mJobData[mJobs - 1]) {
       mJobData[mJobs - 1]->olength = (coded_length/mSliceSizeScalar*mSliceSizeScalar) - (mJobs - 1)*l;
     }
-  } else if (mParams.input_format == VC2ENCODER_INPUT_V210) {
+  } else if (mParams.input_format == VC2ENCODER_INPUT_8P2) {
+    for (int i = 0; i < mJobs; i++) {
+      if (mJobData[i]) {
+        mJobData[i]->idata[0] = &idata[0][mJobData[i]->offset_y*istride[0] + mJobData[i]->offset_x];
+        mJobData[i]->idata[1] = &idata[1][color_diff_height(mColorDiffFormat, mJobData[i]->offset_y)*istride[1] + color_diff_width(mColorDiffFormat, mJobData[i]->offset_x)];
+        mJobData[i]->idata[2] = &idata[2][color_diff_height(mColorDiffFormat, mJobData[i]->offset_y)*istride[2] + color_diff_width(mColorDiffFormat, mJobData[i]->offset_x)];
+        mJobData[i]->istride[0] = istride[0];
+        mJobData[i]->istride[1] = istride[1];
+        mJobData[i]->istride[2] = istride[2];
+      }
+    }
+  } else if (mParams.input_format == VC2ENCODER_INPUT_P210 || mParams.input_format == VC2ENCODER_INPUT_P010) {
+    for (int i = 0; i < mJobs; i++) {
+      if (mJobData[i]) {
+        mJobData[i]->idata[0] = &idata[0][2*(mJobData[i]->offset_y*istride[0] + mJobData[i]->offset_x)];
+        mJobData[i]->idata[1] = &idata[1][2*(color_diff_height(mColorDiffFormat, mJobData[i]->offset_y)*istride[1] + 2*color_diff_width(mColorDiffFormat, mJobData[i]->offset_x))];
+        mJobData[i]->istride[0] = istride[0];
+        mJobData[i]->istride[1] = istride[1];
+      }
+    }
+  } else if (mParams.input_format == VC2ENCODER_INPUT_V210 ||
+             mParams.input_format == VC2ENCODER_INPUT_UYVY10 ||
+             mParams.input_format == VC2ENCODER_INPUT_V410 ||
+             mParams.input_format == VC2ENCODER_INPUT_Y416 ||
+             mParams.input_format == VC2ENCODER_INPUT_UYVY ||
+             mParams.input_format == VC2ENCODER_INPUT_YUY2 ||
+             mParams.input_format == VC2ENCODER_INPUT_X2RGB10 ||
+             mParams.input_format == VC2ENCODER_INPUT_BGRA) {
     for (int i = 0; i < mJobs; i++) {
       if (mJobData[i]) {
         mJobData[i]->idata[0] = &idata[0][mJobData[i]->offset_y*istride[0]];
@@ -691,6 +1039,22 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
   }
 #endif
 
+  /* Under sequence rate control the length of the picture is only chosen
+     once its activity can be measured from the transformed picture */
+  if (mParams.rate_control_flag) {
+    if (mCoefSize == 2)
+      coded_length = MeasurePicture<int16_t>(mSlices16->slices, length);
+    else if (mCoefSize == 4)
+      coded_length = MeasurePicture<int32_t>(mSlices32->slices, length);
+    written = coded_length + getExtraLengthForFragmentHeaders(coded_length);
+  }
+
+  for (int k = 0; k < NFACTOR; k++) {
+    mEncoderData[k].qi_stats.searches  = 0;
+    mEncoderData[k].qi_stats.predicted = 0;
+  }
+
+  int n_runs = 0;
   if (mCoefSize == 2) {
     INIT_MT;
     CodedSlice<int16_t> *slices = mSlices16->slices;
@@ -753,6 +1117,7 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
       mEncoderData[k].sy = sy;
       MT_JOB(bind(&VC2Encoder::EncodePartial<int16_t>, this,
                   &mEncoderData[k]));
+      n_runs = k + 1;
     }
     if (EXEC_MT)
       throw VC2ENCODER_ENCODE_FAILED;
@@ -779,7 +1144,7 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
       mEncoderData[k].odata = odata;
       mEncoderData[k].olength = olength*mSliceSizeScalar + 4*n_slices;
       mEncoderData[k].N = k;
-      mEncoderData[k].n_samples = mSlices16->width[0]*mSlices16->height[0];
+      mEncoderData[k].n_samples = mSlices32->width[0]*mSlices32->height[0];
       mEncoderData[k].slices_per_frag = slices_per_frag;
       mEncoderData[k].full_length = olength*mSliceSizeScalar + 4*n_slices + frag_hdr_size;
       mEncoderData[k].final_offset = 0;
@@ -789,8 +1154,8 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
                   &mEncoderData[k]));
       sx += n_slices;
       if (sx >= mSlicesPerLine) {
-        sx -= mSlicesPerLine;
-        sy++;
+        sy += (sx/mSlicesPerLine);
+        sx %= mSlicesPerLine;
       }
       slices += n_slices;
       remaining_slices -= n_slices;
@@ -810,7 +1175,7 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
       mEncoderData[k].odata = odata;
       mEncoderData[k].olength = remaining_length*mSliceSizeScalar + 4*remaining_slices;
       mEncoderData[k].N = k;
-      mEncoderData[k].n_samples = mSlices16->width[0]*mSlices16->height[0];
+      mEncoderData[k].n_samples = mSlices32->width[0]*mSlices32->height[0];
       mEncoderData[k].slices_per_frag = slices_per_frag;
       mEncoderData[k].full_length = remaining_length*mSliceSizeScalar + 4*remaining_slices + frag_hdr_size;
       mEncoderData[k].final_offset = 0;
@@ -818,11 +1183,29 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
       mEncoderData[k].sy = sy;
       MT_JOB(bind(&VC2Encoder::EncodePartial<int32_t>, this,
                   &mEncoderData[k]));
+      n_runs = k + 1;
     }
     if (EXEC_MT)
       throw VC2ENCODER_ENCODE_FAILED;
   }
 
+  if (mParams.fixed_qindex_flag) {
+    if (mCoefSize == 2)
+      written = FixPicture<int16_t>(n_runs);
+    else if (mCoefSize == 4)
+      written = FixPicture<int32_t>(n_runs);
+  } else if (mRateDistortion) {
+    if (mCoefSize == 2)
+      AllocatePicture<int16_t>(n_runs);
+    else if (mCoefSize == 4)
+      AllocatePicture<int32_t>(n_runs);
+  } else if (mRefinePasses) {
+    if (mCoefSize == 2)
+      RefinePicture<int16_t>(n_runs);
+    else if (mCoefSize == 4)
+      RefinePicture<int32_t>(n_runs);
+  }
+
   if (mParams.fragment_size) {
     if (prev_parse_offset) {
       mEncoderData[0].odata[ 9] = ((*prev_parse_offset) >> 24)&0xFF;
@@ -830,19 +1213,30 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
       mEncoderData[0].odata[11] = ((*prev_parse_offset) >>  8)&0xFF;
       mEncoderData[0].odata[12] = ((*prev_parse_offset) >>  0)&0xFF;
     }
-    for (int k = 0; k < NFACTOR - 1; k++) {
+    for (int k = 0; k < n_runs - 1; k++) {
       mEncoderData[k+1].odata[ 9] = (mEncoderData[k].final_offset >> 24)&0xFF;
       mEncoderData[k+1].odata[10] = (mEncoderData[k].final_offset >> 16)&0xFF;
       mEncoderData[k+1].odata[11] = (mEncoderData[k].final_offset >>  8)&0xFF;
       mEncoderData[k+1].odata[12] = (mEncoderData[k].final_offset >>  0)&0xFF;
     }
     if (prev_parse_offset) {
-      *prev_parse_offset = mEncoderData[NFACTOR-1].final_offset;
+      *prev_parse_offset = mEncoderData[n_runs-1].final_offset;
     }
   }
 
 #ifdef DEBUG_PRINT_STATS
-  accumulate_encoded_statistics(mSlices16->slices, mSlicesPerPicture);
+  if (mCoefSize == 2)
+    accumulate_encoded_statistics(mSlices16->slices, mSlicesPerPicture);
+
+  {
+    QuantiserSearchStats qi_stats = { 0, 0 };
+    for (int k = 0; k < n_runs; k++) {
+      qi_stats.searches  += mEncoderData[k].qi_stats.searches;
+      qi_stats.predicted += mEncoderData[k].qi_stats.predicted;
+    }
+    printf("Quantiser prediction hit %d of %d slice searches (%d%%)\n", qi_stats.predicted, qi_stats.searches,
+           (qi_stats.searches)?(100*qi_stats.predicted/qi_stats.searches):0);
+  }
 #endif
 
   /* Clean Up */
@@ -928,11 +1322,73 @@ bool VC2Encoder::encodeData(char **idata, int *istride, char **_odata, int lengt
   }
 #endif /*DEBUG_P_BLOCK*/
 
-  *_odata += length + getExtraLengthForFragmentHeaders(length);
+  *_odata += written;
 
   return true;
 }
 
+uint32_t VC2Encoder::getMaxFixedQindexPictureSize() {
+  const int MAX_SLICE = 4 + 3*255*mSliceSizeScalar;
+  return mPictureHeader->length + mSlicesPerPicture*MAX_SLICE + ((mParams.fragment_size)?(mSlicesPerPicture*25):0);
+}
+
+uint32_t VC2Encoder::getMaxRateControlledPictureSize(int data_length) {
+  const int MAX_SLICE = 4 + 3*255*mSliceSizeScalar;
+  int64_t length = (int64_t)data_length + mParams.rate_control_buffer_size;
+  if (length > (int64_t)mSlicesPerPicture*MAX_SLICE)
+    length = (int64_t)mSlicesPerPicture*MAX_SLICE;
+  return mPictureHeader->length + length + getExtraLengthForFragmentHeaders(length);
+}
+
+/* Codes a picture whose length is only known once it is coded. The picture
+   header is written with no length for encodeData to lay the slices out
+   after, and written again once the length is known. Returns the length of
+   the picture, header included. */
+uint32_t VC2Encoder::encodeVariableLengthPicture(char **idata, int *istride, char **_odata, uint32_t prev_parse_offset, uint32_t picture_number, int data_length, uint32_t *next_parse_offset) {
+  char *start = *_odata;
+  char *odata  = *_odata;
+  uint32_t offset = startPicture(&odata, prev_parse_offset, picture_number, 0);
+
+  char *data = odata;
+  encodeData(idata, istride, &odata, data_length, &offset);
+
+  if (mParams.fragment_size == 0) {
+    char *header = start;
+    offset = startPicture(&header, prev_parse_offset, picture_number, odata - data);
+  }
+
+  *next_parse_offset = offset;
+  *_odata = odata;
+  return odata - start;
+}
+
+/* At the fixed qindex the slices are laid out for encodeData as though
+   empty, and take whatever length they code to */
+uint32_t VC2Encoder::encodeFixedQindexPicture(char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, uint32_t *next_parse_offset) {
+  if (!mParams.fixed_qindex_flag) {
+    writelog(LOG_ERROR, "%s:%d: Encoder not configured for a fixed qindex\n", __FILE__, __LINE__);
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+  return encodeVariableLengthPicture(idata, istride, odata, prev_parse_offset, picture_number, 4*mSlicesPerPicture, next_parse_offset);
+}
+
+/* Under rate control data_length is the mean length of the pictures, and
+   the length of this one is chosen by the rate controller */
+uint32_t VC2Encoder::encodeRateControlledPicture(char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, int data_length, uint32_t *next_parse_offset) {
+  if (!mParams.rate_control_flag) {
+    writelog(LOG_ERROR, "%s:%d: Encoder not configured for rate control\n", __FILE__, __LINE__);
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+  if (data_length < 4*mSlicesPerPicture) {
+    writelog(LOG_ERROR, "%s:%d: Data length %d too short for %d slices\n", __FILE__, __LINE__, data_length, mSlicesPerPicture);
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+  return encodeVariableLengthPicture(idata, istride, odata, prev_parse_offset, picture_number, data_length, next_parse_offset);
+}
+
 void VC2Encoder::endSequence(char **_data, uint32_t prev_parse_offset) {
   int length = 0;
   char *data = *_data;
@@ -968,8 +1424,23 @@ template<class T> void VC2Encoder::EncodePartial(partial_encode_data *data) {
   uint32_t *final_offset = &data->final_offset;
   int sx = data->sx;
   int sy = data->sy;
+
+  /* For the rate-distortion optimised speed this only finds the curves of
+     the slices, which are coded once the whole picture has been allocated */
+  if (mRateDistortion) {
+    Analyse<T>(slices, n_slices, &mRDCurves[sy*mSlicesPerLine + sx]);
+    return;
+  }
+
+  /* At a fixed qindex there is nothing to search for, and the slices are
+     serialised once the lengths of all the runs are known */
+  if (mParams.fixed_qindex_flag) {
+    CodeFixed<T>(slices, n_slices, &data->budget);
+    return;
+  }
+
   /* First Encode Pass */
-  Encode<T>(slices, n_slices, olength);
+  Encode<T>(slices, n_slices, olength, &data->qi_stats);
 
 #ifdef DEBUG_OP_QI
   {
@@ -983,10 +1454,217 @@ template<class T> void VC2Encoder::EncodePartial(partial_encode_data *data) {
   }
 #endif
 
+  /* With further passes to come the slices are serialised only once the
+     whole picture has been refined */
+  if (mRefinePasses) {
+    pool_slice_padding<T>(slices, n_slices, olength, mSliceSizeScalar, &data->budget);
+    return;
+  }
+
   /* Serialise */
   Serialise<T>(slices, n_slices, odata, olength, n_samples, slices_per_frag, final_offset, sx, sy);
 }
 
+template<class T> void VC2Encoder::RefinePartial(partial_encode_data *data, int spare, int total) {
+  QuantiserSearchStats stats;
+  Refine<T>((CodedSlice<T>*)data->slices, data->n_slices, &data->budget, spare, data->first_starved, total, &stats);
+  data->qi_stats.searches  += stats.searches;
+  data->qi_stats.predicted += stats.predicted;
+}
+
+template<class T> void VC2Encoder::SerialisePartial(partial_encode_data *data) {
+  CodedSlice<T> *slices = (CodedSlice<T>*)data->slices;
+  place_slice_padding<T>(slices, data->n_slices, data->budget.spare, mSliceSizeScalar);
+  Serialise<T>(slices, data->n_slices, data->odata, data->olength, data->n_samples, data->slices_per_frag, &data->final_offset, data->sx, data->sy);
+}
+
+/* Picture-wide rate control for the slower speeds. Every run of slices has
+   been coded once with an equal share of the picture, pooling the bytes its
+   slices did not use. On each further pass the pools of all the runs are
+   shared out over the starved slices of the whole picture, numbered by a
+   prefix sum of the runs' counts, and the runs code their starved slices
+   again in parallel. What is left over at the end is placed as padding by
+   SerialisePicture. */
+template<class T> void VC2Encoder::RefinePicture(int n_runs) {
+  for (int pass = 0; pass < mRefinePasses; pass++) {
+    int spare = 0;
+    int total = 0;
+    for (int k = 0; k < n_runs; k++) {
+      mEncoderData[k].first_starved = total;
+      spare += mEncoderData[k].budget.spare;
+      total += mEncoderData[k].budget.starved;
+    }
+    if (total == 0 || spare < mSliceSizeScalar)
+      break;
+
+    INIT_MT;
+    for (int k = 0; k < n_runs; k++)
+      MT_JOB(bind(&VC2Encoder::RefinePartial<T>, this, &mEncoderData[k], spare, total));
+    if (EXEC_MT)
+      throw VC2ENCODER_ENCODE_FAILED;
+  }
+
+  SerialisePicture<T>(n_runs);
+}
+
+template<class T> void VC2Encoder::CodePartial(partial_encode_data *data) {
+  CodedSlice<T> *slices = (CodedSlice<T>*)data->slices;
+  Code<T>(slices, data->n_slices, &mRDCurves[data->sy*mSlicesPerLine + data->sx], &data->budget);
+}
+
+/* Picture-wide rate-distortion optimisation for VC2ENCODER_SPEED_RDO. Every
+   run of slices has found the rate-distortion curves of its slices, and the
+   slice bytes of all the runs together are allocated over the curves of the
+   whole picture. The runs then code their slices in parallel, and the bytes
+   left over are placed and the runs serialised as for RefinePicture. */
+template<class T> void VC2Encoder::AllocatePicture(int n_runs) {
+  int length = 0;
+  for (int k = 0; k < n_runs; k++)
+    length += mEncoderData[k].olength;
+
+  allocate_slice_rates(mRDCurves, mSlicesPerPicture, length);
+  for (int i = 0; i < mSlicesPerPicture; i++) {
+    if (mRDCurves[i].chosen < 0)
+      writelog(LOG_ERROR, "%s:%d:  Slice Length cannot be brought sane via quantisation, blanking slice\n", __FILE__, __LINE__);
+  }
+
+  {
+    INIT_MT;
+    for (int k = 0; k < n_runs; k++)
+      MT_JOB(bind(&VC2Encoder::CodePartial<T>, this, &mEncoderData[k]));
+    if (EXEC_MT)
+      throw VC2ENCODER_ENCODE_FAILED;
+  }
+
+  int used = 0;
+  for (int k = 0; k < n_runs; k++)
+    used += mEncoderData[k].budget.used;
+  if (used > length) {
+    writelog(LOG_ERROR, "%s:%d: Allocated slices overrun the picture!\n", __FILE__, __LINE__);
+    throw VC2ENCODER_CODEROVERRUN;
+  }
+  mEncoderData[0].budget.spare = length - used;
+
+  SerialisePicture<T>(n_runs);
+}
+
+/* Lays out the runs of a picture coded at a fixed qindex. Each run is given
+   its coded length with nothing spare and fragments sized for its mean
+   slice, and SerialisePicture serialises the runs at offsets given by a
+   prefix sum of their lengths. Returns the length of the picture with its
+   fragment headers. */
+template<class T> int VC2Encoder::FixPicture(int n_runs) {
+  int length = 0;
+  for (int k = 0; k < n_runs; k++) {
+    partial_encode_data *data = &mEncoderData[k];
+    int slices_per_frag = 0;
+    if (mParams.fragment_size) {
+      const int mean_slice_size = data->budget.used/data->n_slices;
+      slices_per_frag = mParams.fragment_size/mean_slice_size;
+      if (!slices_per_frag) {
+        writelog(LOG_ERROR, "%s:%d: slices of size %d don't fit in fragment of size %d", __FILE__, __LINE__, mean_slice_size, mParams.fragment_size);
+        slices_per_frag = 1;
+      }
+    }
+
+    data->budget.spare    = 0;
+    data->slices_per_frag = slices_per_frag;
+    data->olength         = data->budget.used;
+    data->full_length     = data->budget.used + ((slices_per_frag)?((data->n_slices + slices_per_frag - 1)/slices_per_frag)*25:0);
+    length += data->full_length;
+  }
+
+  SerialisePicture<T>(n_runs);
+  return length;
+}
+
+template<class T> void VC2Encoder::MeasurePartial(partial_encode_data *data) {
+  CodedSlice<T> *slices = (CodedSlice<T>*)data->slices;
+  uint8_t weights[1 << (2*mDepth)];
+  activity_weights(mQuantisationMatrices->weighting(), weights, mDepth);
+
+  memset(data->activity, 0, sizeof(data->activity));
+  int sx = data->sx;
+  int sy = data->sy;
+  for (int i = 0; i < data->n_slices; i++) {
+    if (((sx + sy)&1) == 0)
+      accumulate_slice_activity<T>(&slices[i], weights, data->activity, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth, mColorDiffFormat);
+    if (++sx == mSlicesPerLine) {
+      sx = 0;
+      sy++;
+    }
+  }
+}
+
+/* Measures the activity of a transformed picture over runs of slices in
+   parallel, and returns the data length the rate controller gives the
+   picture for a mean of data_length. Only the slices on one colour of a
+   checkerboard are measured, which is as good a sample of the picture for
+   half the cost, and their counts are doubled. */
+template<class T> int VC2Encoder::MeasurePicture(CodedSlice<T> *slices, int data_length) {
+  const int n_slices = (mSlicesPerPicture + NFACTOR - 1)/NFACTOR;
+  int n_runs = 0;
+  {
+    INIT_MT;
+    for (int first = 0; first < mSlicesPerPicture; first += n_slices, n_runs++) {
+      mEncoderData[n_runs].slices   = &slices[first];
+      mEncoderData[n_runs].n_slices = (mSlicesPerPicture - first < n_slices)?(mSlicesPerPicture - first):n_slices;
+      mEncoderData[n_runs].sx       = first%mSlicesPerLine;
+      mEncoderData[n_runs].sy       = first/mSlicesPerLine;
+      MT_JOB(bind(&VC2Encoder::MeasurePartial<T>, this, &mEncoderData[n_runs]));
+    }
+    if (EXEC_MT)
+      throw VC2ENCODER_ENCODE_FAILED;
+  }
+
+  uint32_t activity[ACTIVITY_BINS];
+  memset(activity, 0, sizeof(activity));
+  for (int k = 0; k < n_runs; k++)
+    for (int b = 0; b < ACTIVITY_BINS; b++)
+      activity[b] += 2*mEncoderData[k].activity[b];
+
+  return mRateController.pictureLength(activity, data_length);
+}
+
+/* Places the bytes left in budget.spare of each run as padding, in the run
+   itself where there is room or else in the first runs which have some, and
+   serialises the runs in parallel at offsets given by a prefix sum of their
+   final lengths. The fragment headers depend only on the number of slices in
+   each run, so their total is unchanged. */
+template<class T> void VC2Encoder::SerialisePicture(int n_runs) {
+  int excess = 0;
+  for (int k = 0; k < n_runs; k++) {
+    if (mEncoderData[k].budget.spare > mEncoderData[k].budget.room) {
+      excess += mEncoderData[k].budget.spare - mEncoderData[k].budget.room;
+      mEncoderData[k].budget.spare = mEncoderData[k].budget.room;
+    }
+  }
+  char *odata = mEncoderData[0].odata;
+  for (int k = 0; k < n_runs; k++) {
+    int p = mEncoderData[k].budget.room - mEncoderData[k].budget.spare;
+    if (p > excess)
+      p = excess;
+    excess -= p;
+    mEncoderData[k].budget.spare += p;
+
+    const int frag_hdr_size = mEncoderData[k].full_length - mEncoderData[k].olength;
+    mEncoderData[k].odata = odata;
+    mEncoderData[k].olength = mEncoderData[k].budget.used + mEncoderData[k].budget.spare;
+    mEncoderData[k].full_length = mEncoderData[k].olength + frag_hdr_size;
+    odata += mEncoderData[k].full_length;
+  }
+  if (excess > 0) {
+    writelog(LOG_ERROR, "%s:%d: Cannot reassign available padding!\n", __FILE__, __LINE__);
+    throw VC2ENCODER_CODEROVERRUN;
+  }
+
+  INIT_MT;
+  for (int k = 0; k < n_runs; k++)
+    MT_JOB(bind(&VC2Encoder::SerialisePartial<T>, this, &mEncoderData[k]));
+  if (EXEC_MT)
+    throw VC2ENCODER_ENCODE_FAILED;
+}
+
 template <class T> void VC2Encoder::Transform(JobBase *_job) {
   JobData<T> *job = dynamic_cast<JobData<T> *>(_job);
   char **idata = job->idata;
@@ -1109,12 +1787,44 @@ template <class T> void VC2Encoder::Transform(JobBase *_job) {
   }
 }
 
-template<> void VC2Encoder::Encode(CodedSlice<int16_t> *slices, int n_slices, int olength) {
-  slice_encoder_func16(slices, n_slices, mQuantisationMatrices, olength, mParams.transform_params.wavelet_index, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth);
+template<> void VC2Encoder::Encode(CodedSlice<int16_t> *slices, int n_slices, int olength, QuantiserSearchStats *stats) {
+  slice_encoder_func16(slices, n_slices, mQuantisationMatrices, olength, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth, stats);
+}
+
+template<> void VC2Encoder::Encode(CodedSlice<int32_t> *slices, int n_slices, int olength, QuantiserSearchStats *stats) {
+  slice_encoder_func32(slices, n_slices, mQuantisationMatrices, olength, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth, stats);
+}
+
+template<> void VC2Encoder::Refine(CodedSlice<int16_t> *slices, int n_slices, SliceRunBudget *budget, int spare, int first, int total, QuantiserSearchStats *stats) {
+  slice_refiner_func16(slices, n_slices, mQuantisationMatrices, budget, spare, first, total, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth, stats);
+}
+
+template<> void VC2Encoder::Refine(CodedSlice<int32_t> *slices, int n_slices, SliceRunBudget *budget, int spare, int first, int total, QuantiserSearchStats *stats) {
+  slice_refiner_func32(slices, n_slices, mQuantisationMatrices, budget, spare, first, total, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth, stats);
+}
+
+template<> void VC2Encoder::Analyse(CodedSlice<int16_t> *slices, int n_slices, SliceRDCurve *curves) {
+  analyse_slices16(slices, n_slices, mQuantisationMatrices, curves, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth, mColorDiffFormat);
+}
+
+template<> void VC2Encoder::Analyse(CodedSlice<int32_t> *slices, int n_slices, SliceRDCurve *curves) {
+  analyse_slices32(slices, n_slices, mQuantisationMatrices, curves, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth, mColorDiffFormat);
+}
+
+template<> void VC2Encoder::Code(CodedSlice<int16_t> *slices, int n_slices, const SliceRDCurve *curves, SliceRunBudget *budget) {
+  slice_coder_func16(slices, n_slices, mQuantisationMatrices, curves, budget, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth);
+}
+
+template<> void VC2Encoder::Code(CodedSlice<int32_t> *slices, int n_slices, const SliceRDCurve *curves, SliceRunBudget *budget) {
+  slice_coder_func32(slices, n_slices, mQuantisationMatrices, curves, budget, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth);
+}
+
+template<> void VC2Encoder::CodeFixed(CodedSlice<int16_t> *slices, int n_slices, SliceRunBudget *budget) {
+  fixed_slice_coder_func16(slices, n_slices, mQuantisationMatrices, mParams.fixed_qindex, budget, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth);
 }
 
-template<> void VC2Encoder::Encode(CodedSlice<int32_t> *slices, int n_slices, int olength) {
-  slice_encoder_func32(slices, n_slices, mQuantisationMatrices, olength, mParams.transform_params.wavelet_index, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth);
+template<> void VC2Encoder::CodeFixed(CodedSlice<int32_t> *slices, int n_slices, SliceRunBudget *budget) {
+  fixed_slice_coder_func32(slices, n_slices, mQuantisationMatrices, mParams.fixed_qindex, budget, mSliceSizeScalar, mParams.transform_params.slice_width, mParams.transform_params.slice_height, mDepth);
 }
 
 template<class T> void VC2Encoder::Serialise(CodedSlice<T> *slices, int n_slices, char *odata, int length, int n_samples, int slices_per_frag, uint32_t *final_offset, int sx, int sy) {
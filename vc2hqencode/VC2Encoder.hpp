@@ -33,6 +33,7 @@
 #include "encode.hpp"
 #include "serialise.hpp"
 #include "quantise.hpp"
+#include "ratecontrol.hpp"
 #include "transform.hpp"
 
 #include "ThreadPool.hpp"
@@ -64,6 +65,15 @@ public:
     transforms_v = NULL;
     slice_encoder_func16 = NULL;
     slice_encoder_func32 = NULL;
+    slice_refiner_func16 = NULL;
+    slice_refiner_func32 = NULL;
+    mRefinePasses = 0;
+    slice_coder_func16 = NULL;
+    slice_coder_func32 = NULL;
+    mRateDistortion = false;
+    mRDCurves = NULL;
+    fixed_slice_coder_func16 = NULL;
+    fixed_slice_coder_func32 = NULL;
 
     mEncoderData = NULL;
 
@@ -86,9 +96,11 @@ public:
     if (mSlices32)
       delete mSlices32;
     if (mQuantisationMatrices)
-      delete mQuantisationMatrices;
+      release_quantisation_matrices(mQuantisationMatrices);
     if (mEncoderData)
       delete[] mEncoderData;
+    if (mRDCurves)
+      delete[] mRDCurves;
   }
 
   void setParams(VC2EncoderParams &params) throw(VC2EncoderResult);
@@ -104,6 +116,10 @@ public:
   uint32_t repeatSequenceStart(char **data, uint32_t prev_parse_offset);
   uint32_t startPicture(char **data, uint32_t prev_parse_offset, uint32_t picture_number, int data_length);
   bool encodeData(char **idata, int *istride, char **odata, int length, uint32_t *prev_parse_offset);
+  uint32_t getMaxFixedQindexPictureSize();
+  uint32_t encodeFixedQindexPicture(char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, uint32_t *next_parse_offset);
+  uint32_t getMaxRateControlledPictureSize(int data_length);
+  uint32_t encodeRateControlledPicture(char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, int data_length, uint32_t *next_parse_offset);
   uint32_t startAuxiliaryData(char **data, uint32_t prev_parse_offset, int data_length);
   void endSequence(char **data, uint32_t prev_parse_offset);
 
@@ -122,11 +138,29 @@ protected:
     uint32_t final_offset;
     int sx;
     int sy;
+    QuantiserSearchStats qi_stats;
+    SliceRunBudget budget;
+    int first_starved;
+    uint32_t activity[ACTIVITY_BINS];
   };
+  uint32_t encodeVariableLengthPicture(char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, int data_length, uint32_t *next_parse_offset);
   template<class T> void EncodePartial(partial_encode_data *data);
+  template<class T> void RefinePartial(partial_encode_data *data, int spare, int total);
+  template<class T> void SerialisePartial(partial_encode_data *data);
+  template<class T> void RefinePicture(int n_runs);
+  template<class T> void CodePartial(partial_encode_data *data);
+  template<class T> void AllocatePicture(int n_runs);
+  template<class T> int FixPicture(int n_runs);
+  template<class T> void MeasurePartial(partial_encode_data *data);
+  template<class T> int MeasurePicture(CodedSlice<T> *slices, int data_length);
+  template<class T> void SerialisePicture(int n_runs);
 
   template<class T> void Transform(JobBase *);
-  template<class T> void Encode(CodedSlice<T> *slices, int n_slices, int olength);
+  template<class T> void Encode(CodedSlice<T> *slices, int n_slices, int olength, QuantiserSearchStats *stats);
+  template<class T> void Refine(CodedSlice<T> *slices, int n_slices, SliceRunBudget *budget, int spare, int first, int total, QuantiserSearchStats *stats);
+  template<class T> void Analyse(CodedSlice<T> *slices, int n_slices, SliceRDCurve *curves);
+  template<class T> void Code(CodedSlice<T> *slices, int n_slices, const SliceRDCurve *curves, SliceRunBudget *budget);
+  template<class T> void CodeFixed(CodedSlice<T> *slices, int n_slices, SliceRunBudget *budget);
   template<class T> void Serialise(CodedSlice<T> *slices, int n_slices, char *odata, int length, int n_samples, int slices_per_frag, uint32_t *final_offset, int sx, int sy);
 
   VC2EncoderParams mParams;
@@ -138,6 +172,7 @@ protected:
   int mPaddedWidth;
   int mColorDiffWidth;
   int mColorDiffHeight;
+  int mColorDiffFormat;
 
   bool mInterlaced;
 
@@ -168,6 +203,16 @@ protected:
 
   SliceEncoderFunc16 slice_encoder_func16;
   SliceEncoderFunc32 slice_encoder_func32;
+  SliceRefinerFunc16 slice_refiner_func16;
+  SliceRefinerFunc32 slice_refiner_func32;
+  int mRefinePasses;
+  SliceCoderFunc16 slice_coder_func16;
+  SliceCoderFunc32 slice_coder_func32;
+  bool mRateDistortion;
+  SliceRDCurve *mRDCurves;
+  FixedSliceCoderFunc16 fixed_slice_coder_func16;
+  FixedSliceCoderFunc32 fixed_slice_coder_func32;
+  SequenceRateController mRateController;
 
   int mSliceSizeScalar;
 
@@ -164,6 +164,15 @@ namespace vc2 {
     }
   };
 
+  /* The active bits of a component with a custom signal range, which the
+     specification takes to be intlog2(excursion + 1) */
+  inline uint32_t signal_range_active_bits(uint32_t excursion) {
+    uint32_t bits = 0;
+    while ((1ULL << bits) < (uint64_t)excursion + 1)
+      bits++;
+    return bits;
+  }
+
   struct ColorSpec {
     uint32_t color_primaries;
     uint32_t color_matrix;
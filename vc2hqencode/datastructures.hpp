@@ -32,6 +32,18 @@
 
 #include <stdio.h>
 
+#include "internal.h"
+
+/* The dimensions of the colour difference components of an area of w by h
+   luma samples in chroma format cf, one of the VC2ENCODER_CDS values */
+constexpr int color_diff_width(int cf, int w) {
+  return (cf == VC2ENCODER_CDS_444)?w:w/2;
+}
+
+constexpr int color_diff_height(int cf, int h) {
+  return (cf == VC2ENCODER_CDS_420)?h/2:h;
+}
+
 template<class T> struct CodedSlice {
 public:
   uint32_t length[3];
@@ -41,29 +53,38 @@ public:
   int istride[3];
   uint16_t *codewords[3];
   uint8_t  *wordlengths[3];
+  uint8_t  *packed[3];
+  int packed_length;
+  bool packed_coded;
   int padding;
   int y;
   int x;
 };
 
+/* The slices of a picture and the codewords of their components. With
+   packed_length non-zero each component of each slice also has that many
+   bytes set aside for coders that pack its codewords as they go, which the
+   lossless and fixed qindex coders do, marking the slices they code that way
+   as packed_coded. */
 template<class T> class CodedSlices {
 public:
-  CodedSlices(int slices_x, int slices_y, int w, int h, int d) {
+  CodedSlices(int slices_x, int slices_y, int w, int h, int d, int cf, int packed_length = 0) {
     int n = slices_x * slices_y;
     n_slices = n;
     slices = new CodedSlice<T>[n];
 
     mCodeWords   = (uint16_t *)memalign(64, w*h*sizeof(uint16_t)*n*3);
     mWordLengths = (uint8_t  *)memalign(64, w*h*sizeof(uint8_t)*n*3);
+    mPacked      = (packed_length)?(uint8_t *)memalign(64, packed_length*n*3):NULL;
 
     width[0]  = w;
     height[0] = h;
 
-    width[1]  = w/2;
-    height[1] = h;
+    width[1]  = color_diff_width(cf, w);
+    height[1] = color_diff_height(cf, h);
 
-    width[2]  = w/2;
-    height[2] = h;
+    width[2]  = color_diff_width(cf, w);
+    height[2] = color_diff_height(cf, h);
     depth  = d;
 
     for (int y = 0; y < slices_y; y++) {
@@ -83,6 +104,11 @@ public:
         slices[i].wordlengths[1] = &mWordLengths[w*h*(3*i + 1)];
         slices[i].codewords[2]   = &mCodeWords[w*h*(3*i + 2)];
         slices[i].wordlengths[2] = &mWordLengths[w*h*(3*i + 2)];
+        slices[i].packed[0]      = (mPacked)?&mPacked[packed_length*(3*i + 0)]:NULL;
+        slices[i].packed[1]      = (mPacked)?&mPacked[packed_length*(3*i + 1)]:NULL;
+        slices[i].packed[2]      = (mPacked)?&mPacked[packed_length*(3*i + 2)]:NULL;
+        slices[i].packed_length  = packed_length;
+        slices[i].packed_coded   = false;
         slices[i].y = y;
         slices[i].x = x;
       }
@@ -93,6 +119,7 @@ public:
     delete[] slices;
     free(mCodeWords);
     free(mWordLengths);
+    free(mPacked);
   }
 
   int width[3];
@@ -105,6 +132,7 @@ public:
 private:
   uint16_t *mCodeWords;
   uint8_t  *mWordLengths;
+  uint8_t  *mPacked;
 };
 
 template<class T> struct VideoPlane {
@@ -132,6 +160,7 @@ public:
   int   width;
   int   height;
   int   depth;
+  int   chroma_format;
   int   offset_x;
   int   offset_y;
 
@@ -149,10 +178,11 @@ public:
   int job;
 
   JobBase(int j,
-          int w, int h, int pt, int pb, int d, int off_x, int off_y)
+          int w, int h, int pt, int pb, int d, int cf, int off_x, int off_y)
     : width(w)
     , height(h)
     , depth(d)
+    , chroma_format(cf)
     , offset_x(off_x)
     , offset_y(off_y)
     , pad_t(pt)
@@ -170,8 +200,9 @@ public:
     istride[2] = 0;
 
     iwidth[0] = w;
-    iwidth[1] = iwidth[2] = iwidth[0]/2;
-    iheight[0] = iheight[1] = iheight[2] = pad_t + h + pad_b;
+    iwidth[1] = iwidth[2] = color_diff_width(cf, iwidth[0]);
+    iheight[0] = pad_t + h + pad_b;
+    iheight[1] = iheight[2] = color_diff_height(cf, iheight[0]);
   }
 
   virtual ~JobBase() {};
@@ -180,20 +211,25 @@ public:
 template<class T> class JobData : public JobBase {
 public:
   JobData(int j,
-          int w, int h, int pt, int pb, int d, int sx, int sy, int off_x, int off_y,
+          int w, int h, int pt, int pb, int d, int cf, int sx, int sy, int off_x, int off_y,
           CodedSlices<T> *coded_slices, int slice_offset_x, int slice_offset_y, int slice_stride)
-    : JobBase(j, w, h, pt, pb, d, off_x, off_y) {
+    : JobBase(j, w, h, pt, pb, d, cf, off_x, off_y) {
 
     int W = sx*coded_slices->width[0];
     int H = sy*coded_slices->height[0];
-    video_data[0] = new VideoPlane<T>(W,     pt + H + pb);
-    video_data[1] = new VideoPlane<T>((W)/2, pt + H + pb);
-    video_data[2] = new VideoPlane<T>((W)/2, pt + H + pb);
+    int CW = sx*coded_slices->width[1];
+    int CH = sy*coded_slices->height[1];
+    int PB = (pb + coded_slices->height[0] - 1)/coded_slices->height[0]*coded_slices->height[0];
+    int cpt = color_diff_height(cf, pt);
+    int cpb = color_diff_height(cf, PB);
+    video_data[0] = new VideoPlane<T>(W,  pt  + H  + PB);
+    video_data[1] = new VideoPlane<T>(CW, cpt + CH + cpb);
+    video_data[2] = new VideoPlane<T>(CW, cpt + CH + cpb);
 
     int is[3] = { video_data[0]->stride, video_data[1]->stride, video_data[2]->stride };
     T *id[3] = { &video_data[0]->data[pt*is[0]],
-                 &video_data[1]->data[pt*is[1]],
-                 &video_data[2]->data[pt*is[2]] };
+                 &video_data[1]->data[cpt*is[1]],
+                 &video_data[2]->data[cpt*is[2]] };
     for (int Y = 0; Y < sy; Y++) {
       for (int X = 0; X < sx; X++) {
         CodedSlice<T> *slice = &coded_slices->slices[(slice_offset_y + Y)*slice_stride + (slice_offset_x + X)];
@@ -201,8 +237,8 @@ public:
         slice->istride[1]     = is[1];
         slice->istride[2]     = is[2];
         slice->idata[0]       = &id[0][Y*(H/sy)*is[0] + X*(W/sx)];
-        slice->idata[1]       = &id[1][Y*(H/sy)*is[1] + X*(W/sx/2)];
-        slice->idata[2]       = &id[2][Y*(H/sy)*is[2] + X*(W/sx/2)];
+        slice->idata[1]       = &id[1][Y*(CH/sy)*is[1] + X*(CW/sx)];
+        slice->idata[2]       = &id[2][Y*(CH/sy)*is[2] + X*(CW/sx)];
       }
     }
   }
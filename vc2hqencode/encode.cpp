@@ -32,10 +32,7 @@
 #include <x86intrin.h>
 
 #include "encode_slice_component_optimised.hpp"
-
-//#define FIXED_QI 30
-#define MIN_QI 0
-#define MAX_QI 64
+#include "encode_lossless.hpp"
 
 #define likely(x)   __builtin_expect((x),1)
 #define unlikely(x) __builtin_expect((x),0)
@@ -45,6 +42,20 @@
 
 #include "quantiserselection.hpp"
 
+QuantiseAndCode16 quantise_and_code16 = NULL;
+QuantiseAndCode32 quantise_and_code32 = NULL;
+CodedLength16 coded_length16 = NULL;
+CodedLength32 coded_length32 = NULL;
+bool codeword_tables = true;
+
+template<int SW, int SH, int SD, int CF, class T> inline void encode_slice_components(CodedSlice<T> *slice, QuantisationMatrices *matrices, int w, int h, int d) {
+  const int CW = color_diff_width(CF, SW);
+  const int CH = color_diff_height(CF, SH);
+  encode_slice_component<SW,SH,SD,T>(slice, 0, matrices, w, h, d);
+  encode_slice_component<CW,CH,SD,T>(slice, 1, matrices, color_diff_width(CF, w), color_diff_height(CF, h), d);
+  encode_slice_component<CW,CH,SD,T>(slice, 2, matrices, color_diff_width(CF, w), color_diff_height(CF, h), d);
+}
+
 
 // This is a very noddy implementation used for coding the header parameters, it is *never* used for coded coefficients
 //   it returns the length of the coded string, and places the coded string itself at the location pointed to by output
@@ -55,16 +66,9 @@ uint8_t encode_uint(uint16_t x, uint32_t *output, uint8_t *lengthout) {
     return 1;
   }
 
-  uint32_t y = x+1;
-  int l = ((32 - __builtin_clz(y)) - 1)*2 + 1;
-  y = (y | (y << 8)) & 0x00FF00FF;
-  y = (y | (y << 4)) & 0x0F0F0F0F;
-  y = (y | (y << 2)) & 0x33333333;
-  y = (y | (y << 1)) & 0x55555555;
-  y <<= 1;
-  y |= 1;
-  y &= ((1 << l) - 1);
-  *output    = y;
+  /* The slice codeword without its sign bit */
+  int l = exp_golomb_length(x) - 1;
+  *output    = exp_golomb_codeword(x) >> 1;
   *lengthout = l;
   return l;
 }
@@ -78,25 +82,34 @@ template<class T> inline void zero_slice(CodedSlice<T> *slice) {
   slice->samples[2] = 0;
 }
 
-template<int w, int h, int d, int QUAL, int passes, class T> void encode_slices(CodedSlice<T> *slices, int n, QuantisationMatrices *matrices, int encode_length, int wavelet_index, int slice_size_scalar, int, int, int) {
+/* Chooses quantisers for and codes a run of slices. With a single pass each
+   slice is given an equal share of what remains of encode_length and keeps
+   what it does not use as its padding. When further passes are to refine the
+   picture the bytes a slice does not use are instead left for the slices
+   after it, and a slice which used all it was offered is marked as starved
+   for pool_slice_padding. SW, SH, SD and CF fix the slice geometry and chroma
+   format at compile time for the geometries in SLICE_GEOMETRIES. For any other
+   geometry SW, SH and SD are zero and it is given by w, h and d, with CF
+   still fixed. */
+template<int SW, int SH, int SD, int CF, int QUAL, bool REFINED, class T> void encode_slices(CodedSlice<T> *slices, int n, QuantisationMatrices *matrices, int encode_length, int slice_size_scalar, int w, int h, int d, QuantiserSearchStats *stats) {
 #ifdef DEBUG
   uint32_t samples[64];
   for (int i = 0; i < 64; i++)
     samples[i] = 0;
 #endif
 
-  int n_tgt_slices[passes];
-  CodedSlice<T> *tgt_slices[passes][n];
-
+  const int MAX_SLICE = 4 + 3*255*slice_size_scalar;
   int remaining_length = encode_length;
-  n_tgt_slices[0] = 0;
+  stats->searches  = 0;
+  stats->predicted = 0;
   for (int i = 0; i < n; i++) {
-    int coded_size = ( ( remaining_length / slice_size_scalar )/( n - i ) ) * slice_size_scalar;
+    /* Every slice has its four header bytes on top of whole units of
+       slice_size_scalar */
+    int coded_size = 4 + ( ( ( remaining_length - 4*( n - i ) ) / slice_size_scalar )/( n - i ) ) * slice_size_scalar;
 
-    choose_quantiser<w,h,d,QUAL,T>(&slices[i], coded_size, wavelet_index, slice_size_scalar, matrices);
-    encode_slice_component<w,h,d,T>(&slices[i], 0, matrices);
-    encode_slice_component<w/2,h,d,T>(&slices[i], 1, matrices);
-    encode_slice_component<w/2,h,d,T>(&slices[i], 2, matrices);
+    stats->predicted += choose_quantiser<SW,SH,SD,CF,QUAL,T>(&slices[i], coded_size, slice_size_scalar, matrices, w, h, d);
+    stats->searches++;
+    encode_slice_components<SW,SH,SD,CF,T>(&slices[i], matrices, w, h, d);
     int length[3];
     length[0] = (slices[i].length[0] + slice_size_scalar - 1)/slice_size_scalar;
     length[1] = (slices[i].length[1] + slice_size_scalar - 1)/slice_size_scalar;
@@ -107,16 +120,12 @@ template<int w, int h, int d, int QUAL, int passes, class T> void encode_slices(
       zero_slice<T>(&slices[i]);
       cl = 4;
     }
-    if (passes == 1) {
+    if (!REFINED) {
       remaining_length -= coded_size;
       slices[i].padding = coded_size - cl;
     } else {
       remaining_length -= cl;
-      slices[i].padding = 0;
-
-      if (coded_size == cl) {
-        tgt_slices[0][n_tgt_slices[0]++] = &slices[i];
-      }
+      slices[i].padding = (coded_size == cl && cl < MAX_SLICE)?-1:0;
     }
 
 #ifdef DEBUG
@@ -124,55 +133,7 @@ template<int w, int h, int d, int QUAL, int passes, class T> void encode_slices(
 #endif
   }
 
-  for (int pass = 1; pass < passes; pass++) {
-    n_tgt_slices[pass] = 0;
-    for (int i = 0; i < n_tgt_slices[pass - 1]; i++) {
-      int length[3];
-      length[0] = (tgt_slices[pass - 1][i]->length[0] + slice_size_scalar - 1)/slice_size_scalar;
-      length[1] = (tgt_slices[pass - 1][i]->length[1] + slice_size_scalar - 1)/slice_size_scalar;
-      length[2] = (tgt_slices[pass - 1][i]->length[2] + slice_size_scalar - 1)/slice_size_scalar;
-      int old_cl = 4 + length[0]*slice_size_scalar + length[1]*slice_size_scalar + length[2]*slice_size_scalar;
-      int coded_size = old_cl + ((remaining_length/slice_size_scalar)/(n_tgt_slices[pass - 1] - i)*slice_size_scalar);
-
-      choose_quantiser<w,h,d,QUAL,T>(tgt_slices[pass - 1][i], coded_size, wavelet_index, slice_size_scalar, matrices);
-      encode_slice_component<w,h,d,T>(tgt_slices[pass - 1][i], 0, matrices);
-      encode_slice_component<w/2,h,d,T>(tgt_slices[pass - 1][i], 1, matrices);
-      encode_slice_component<w/2,h,d,T>(tgt_slices[pass - 1][i], 2, matrices);
-      length[0] = (tgt_slices[pass - 1][i]->length[0] + slice_size_scalar - 1)/slice_size_scalar;
-      length[1] = (tgt_slices[pass - 1][i]->length[1] + slice_size_scalar - 1)/slice_size_scalar;
-      length[2] = (tgt_slices[pass - 1][i]->length[2] + slice_size_scalar - 1)/slice_size_scalar;
-      int cl = 4 + length[0]*slice_size_scalar + length[1]*slice_size_scalar + length[2]*slice_size_scalar;
-      if (cl > coded_size || length[0] > 255 || length[1] > 255 || length[2] > 255) {
-        writelog(LOG_ERROR, "%s:%d:  Slice Length cannot be brought sane via quantisation, blanking slice\n", __FILE__, __LINE__);
-        zero_slice<T>(tgt_slices[pass - 1][i]);
-        cl = 4;
-      }
-      remaining_length -= cl - old_cl;
-      tgt_slices[pass - 1][i]->padding = 0;
-
-      if (coded_size == cl) {
-        tgt_slices[pass][n_tgt_slices[pass]++] = tgt_slices[pass - 1][i];
-      }
-    }
-  }
-
-  if (passes > 1) {
-    for (int i = 0; i < n && remaining_length > 0; i++) {
-      int length[3];
-      length[0] = (slices[i].length[0] + slice_size_scalar - 1)/slice_size_scalar;
-      length[1] = (slices[i].length[1] + slice_size_scalar - 1)/slice_size_scalar;
-      length[2] = (slices[i].length[2] + slice_size_scalar - 1)/slice_size_scalar;
-      int cl = 4 + length[0]*slice_size_scalar + length[1]*slice_size_scalar + length[2]*slice_size_scalar;
-      int p = (4 + 3*255*slice_size_scalar) - cl;
-      if (p > remaining_length) {
-        p = remaining_length;
-      }
-      slices[i].padding = p;
-      remaining_length -= p;
-    }
-  }
-
-  if (remaining_length > 0) {
+  if (!REFINED && remaining_length > 0) {
     writelog(LOG_ERROR, "%s:%d: Cannot reassign available padding!\n", __FILE__, __LINE__);
     throw VC2ENCODER_CODEROVERRUN;
   }
@@ -187,264 +148,408 @@ template<int w, int h, int d, int QUAL, int passes, class T> void encode_slices(
 #endif
 }
 
-template<class T> void encode_slices_fallback(CodedSlice<T> *slices, int n, QuantisationMatrices *matrices, int encode_length, int wavelet_index, int slice_size_scalar, int w, int h, int d) {
-#ifdef DEBUG
-  uint32_t samples[64];
-  for (int i = 0; i < 64; i++)
-    samples[i] = 0;
-#endif
-
-  int remaining_length = encode_length;
+/* One pass of picture-wide rate control over a run of slices left by
+   pool_slice_padding or a previous pass. The starved slices of the whole
+   picture are numbered in raster order, total of them with those of this run
+   starting from first, and the run is given the units of slice_size_scalar
+   between the marks of its first and last starved slices in the spare bytes
+   pooled across the picture, so each run can work out its share of the pool
+   independently of the others. Within the run the share is spent as the
+   slices are coded again, each starved slice being offered an equal part of
+   what remains on top of its current length, and whatever the run does not
+   use goes back to its pool. */
+template<int SW, int SH, int SD, int CF, int QUAL, class T> void refine_slices(CodedSlice<T> *slices, int n, QuantisationMatrices *matrices, SliceRunBudget *budget, int spare, int first, int total, int slice_size_scalar, int w, int h, int d, QuantiserSearchStats *stats) {
+  const int MAX_SLICE = 4 + 3*255*slice_size_scalar;
+  const int starved = budget->starved;
+  const int64_t units = spare/slice_size_scalar;
+
+  int remaining_length = (int)((units*(first + starved))/total - (units*first)/total)*slice_size_scalar;
+  if (first == 0)
+    remaining_length += spare - (int)units*slice_size_scalar;
+
+  budget->spare   = 0;
+  budget->starved = 0;
+  budget->used    = 0;
+  budget->room    = 0;
+  stats->searches  = 0;
+  stats->predicted = 0;
+  int j = 0;
   for (int i = 0; i < n; i++) {
-    int coded_size = ( ( remaining_length / slice_size_scalar )/( n - i ) ) * slice_size_scalar;
+    int cl = slice_coded_length<T>(&slices[i], slice_size_scalar);
+
+    if (slices[i].padding < 0) {
+      int coded_size = cl + ((remaining_length/slice_size_scalar)/(starved - j))*slice_size_scalar;
+      if (coded_size > MAX_SLICE)
+        coded_size = MAX_SLICE;
+      j++;
+
+      const int old_cl = cl;
+      stats->predicted += choose_quantiser<SW,SH,SD,CF,QUAL,T>(&slices[i], coded_size, slice_size_scalar, matrices, w, h, d);
+      stats->searches++;
+      encode_slice_components<SW,SH,SD,CF,T>(&slices[i], matrices, w, h, d);
+      cl = slice_coded_length<T>(&slices[i], slice_size_scalar);
+      if (cl > coded_size ||
+          (int)slices[i].length[0] > 255*slice_size_scalar ||
+          (int)slices[i].length[1] > 255*slice_size_scalar ||
+          (int)slices[i].length[2] > 255*slice_size_scalar) {
+        writelog(LOG_ERROR, "%s:%d:  Slice Length cannot be brought sane via quantisation, blanking slice\n", __FILE__, __LINE__);
+        zero_slice<T>(&slices[i]);
+        cl = 4;
+      }
+      remaining_length -= cl - old_cl;
 
-    choose_quantiser_fallback<T>(&slices[i], coded_size, wavelet_index, slice_size_scalar, matrices, w, h, d);
-    encode_slice_component_fallback<T>(&slices[i], 0, matrices, w,  h,d);
-    encode_slice_component_fallback<T>(&slices[i], 1, matrices, w/2,h,d);
-    encode_slice_component_fallback<T>(&slices[i], 2, matrices, w/2,h,d);
-    int length[3];
-    length[0] = (slices[i].length[0] + slice_size_scalar - 1)/slice_size_scalar;
-    length[1] = (slices[i].length[1] + slice_size_scalar - 1)/slice_size_scalar;
-    length[2] = (slices[i].length[2] + slice_size_scalar - 1)/slice_size_scalar;
-    int cl = 4 + length[0]*slice_size_scalar + length[1]*slice_size_scalar + length[2]*slice_size_scalar;
-    if (cl > coded_size || length[0] > 255 || length[1] > 255 || length[2] > 255) {
-      writelog(LOG_ERROR, "%s:%d:  Slice Length cannot be brought sane via quantisation, blanking slice\n", __FILE__, __LINE__);
-      zero_slice<T>(&slices[i]);
-      cl = 4;
+      if (cl == coded_size && cl < MAX_SLICE) {
+        slices[i].padding = -1;
+        budget->starved++;
+      } else {
+        slices[i].padding = 0;
+      }
     }
-    remaining_length -= coded_size;
-    slices[i].padding = coded_size - cl;
 
-#ifdef DEBUG
-    samples[slices[i].qindex]++;
-#endif
+    budget->used += cl;
+    budget->room += MAX_SLICE - cl;
   }
+  budget->spare = remaining_length;
+}
 
-  if (remaining_length > 0) {
-    writelog(LOG_ERROR, "%s:%d: Cannot reassign available padding!\n", __FILE__, __LINE__);
-    throw VC2ENCODER_CODEROVERRUN;
-  }
+template<class T> void analyse_slices(CodedSlice<T> *slices, int n, QuantisationMatrices *matrices, SliceRDCurve *curves, int slice_size_scalar, int w, int h, int d, int cf) {
+  const QuantisationWeightingMatrix &matrix = matrices->weighting();
+  for (int i = 0; i < n; i++)
+    slice_rate_distortion<T>(&slices[i], &curves[i], matrix, matrices, slice_size_scalar, w, h, d, cf);
+}
 
-#ifdef DEBUG_PRINT_QUANTISERS
-  printf("------------------------------------\n");
-  printf("    Slice Quantiser Frequencies\n");
-  printf("------------------------------------\n");
-  for (int i = 0; i < 64; i++)
-    printf("  %2d : %4d\n", i, samples[i]);
-  printf("------------------------------------\n");
-#endif
+void analyse_slices16(CodedSlice<int16_t> *slices, int n, QuantisationMatrices *matrices, SliceRDCurve *curves, int slice_size_scalar, int w, int h, int d, int cf) {
+  analyse_slices<int16_t>(slices, n, matrices, curves, slice_size_scalar, w, h, d, cf);
 }
 
-SliceEncoderFunc32 get_slice_encoder32(int w, int h, int d, int QUAL, int passes) {
-  if (d > 4 || w % (1 << d) || h % (1 << d)) {
-    throw VC2ENCODER_BADPARAMS;
-  }
+void analyse_slices32(CodedSlice<int32_t> *slices, int n, QuantisationMatrices *matrices, SliceRDCurve *curves, int slice_size_scalar, int w, int h, int d, int cf) {
+  analyse_slices<int32_t>(slices, n, matrices, curves, slice_size_scalar, w, h, d, cf);
+}
 
-  switch (passes) {
-  case 1:
-    switch(d) {
-    case 2:
-      if (w == 8 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_FULLSEARCH, 1, int32_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_HALFSEARCH, 1, int32_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_QUARTERSEARCH, 1, int32_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_EIGHTHSEARCH, 1, int32_t>;
-        }
-      }
-      break;
-    case 3:
-      if (w == 32 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_FULLSEARCH, 1, int32_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_HALFSEARCH, 1, int32_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_QUARTERSEARCH, 1, int32_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_EIGHTHSEARCH, 1, int32_t>;
-        }
-      }
-      break;
-    }
-    break;
-  case 2:
-    switch(d) {
-    case 2:
-      if (w == 8 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_FULLSEARCH, 2, int32_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_HALFSEARCH, 2, int32_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_QUARTERSEARCH, 2, int32_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_EIGHTHSEARCH, 2, int32_t>;
-        }
-      }
-      break;
-    case 3:
-      if (w == 32 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_FULLSEARCH, 2, int32_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_HALFSEARCH, 2, int32_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_QUARTERSEARCH, 2, int32_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_EIGHTHSEARCH, 2, int32_t>;
-        }
+/* Codes a run of slices at the points allocate_slice_rates chose on their
+   curves, leaving in budget the length of the run and its room for padding
+   with nothing spare. The curves give the coded lengths exactly, so a slice
+   coming out any different is an error. */
+template<int SW, int SH, int SD, int CF, class T> void code_slices(CodedSlice<T> *slices, int n, QuantisationMatrices *matrices, const SliceRDCurve *curves, SliceRunBudget *budget, int slice_size_scalar, int w, int h, int d) {
+  const int MAX_SLICE = 4 + 3*255*slice_size_scalar;
+
+  budget->spare   = 0;
+  budget->starved = 0;
+  budget->used    = 0;
+  budget->room    = 0;
+  for (int i = 0; i < n; i++) {
+    int cl = 4;
+    if (curves[i].chosen < 0) {
+      zero_slice<T>(&slices[i]);
+    } else {
+      slices[i].qindex = curves[i].qi[curves[i].chosen];
+      encode_slice_components<SW,SH,SD,CF,T>(&slices[i], matrices, w, h, d);
+      cl = slice_coded_length<T>(&slices[i], slice_size_scalar);
+      if (cl != curves[i].rate[curves[i].chosen]) {
+        writelog(LOG_ERROR, "%s:%d: Slice length does not match its rate-distortion curve\n", __FILE__, __LINE__);
+        throw VC2ENCODER_CODEROVERRUN;
       }
-      break;
     }
-    break;
-  case 3:
-    switch(d) {
-    case 2:
-      if (w == 8 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_FULLSEARCH, 3, int32_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_HALFSEARCH, 3, int32_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_QUARTERSEARCH, 3, int32_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_EIGHTHSEARCH, 3, int32_t>;
-        }
+    slices[i].padding = 0;
+
+    budget->used += cl;
+    budget->room += MAX_SLICE - cl;
+  }
+}
+
+/* Codes a run of slices at a fixed quantiser with no search, leaving in
+   budget the length of the run with nothing spare. A slice whose
+   coefficients are too large for the codewords at qindex is packed as it is
+   coded where the slices have packed buffers, and is otherwise given a
+   higher quantiser, as is one with a component too long for the slice
+   header. */
+template<int SW, int SH, int SD, int CF, class T> void code_slices_fixed(CodedSlice<T> *slices, int n, QuantisationMatrices *matrices, int qindex, SliceRunBudget *budget, int slice_size_scalar, int w, int h, int d) {
+  const int MAX_SLICE = 4 + 3*255*slice_size_scalar;
+  const QuantisationWeightingMatrix &matrix = matrices->weighting();
+  const int CW = color_diff_width(CF, SW);
+  const int CH = color_diff_height(CF, SH);
+
+  budget->spare   = 0;
+  budget->starved = 0;
+  budget->used    = 0;
+  budget->room    = 0;
+  for (int i = 0; i < n; i++) {
+    const int qi_bl = lowest_quantiser<SW,SH,SD,CF,T>(&slices[i], matrix, w, h, d);
+    const bool packed = (slices[i].packed[0] != NULL) && qi_bl > qindex;
+    int qi = (packed)?qindex:min(max(qi_bl, qindex), MAX_QI);
+    int cl;
+    for (;;) {
+      slices[i].qindex = qi;
+      slices[i].packed_coded = packed;
+      bool fits = true;
+      if (packed) {
+        fits = encode_slice_component_packed<SW,SH,SD,T>(&slices[i], 0, matrices, w, h, d) &&
+               encode_slice_component_packed<CW,CH,SD,T>(&slices[i], 1, matrices, color_diff_width(CF, w), color_diff_height(CF, h), d) &&
+               encode_slice_component_packed<CW,CH,SD,T>(&slices[i], 2, matrices, color_diff_width(CF, w), color_diff_height(CF, h), d);
+      } else {
+        encode_slice_components<SW,SH,SD,CF,T>(&slices[i], matrices, w, h, d);
       }
-      break;
-    case 3:
-      if (w == 32 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_FULLSEARCH, 3, int32_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_HALFSEARCH, 3, int32_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_QUARTERSEARCH, 3, int32_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_EIGHTHSEARCH, 3, int32_t>;
-        }
+      cl = (fits)?slice_coded_length<T>(&slices[i], slice_size_scalar):0;
+      if (fits &&
+          (int)slices[i].length[0] <= 255*slice_size_scalar &&
+          (int)slices[i].length[1] <= 255*slice_size_scalar &&
+          (int)slices[i].length[2] <= 255*slice_size_scalar)
+        break;
+      if (qi == MAX_QI) {
+        writelog(LOG_ERROR, "%s:%d:  Slice Length cannot be brought sane via quantisation, blanking slice\n", __FILE__, __LINE__);
+        zero_slice<T>(&slices[i]);
+        cl = 4;
+        break;
       }
-      break;
+      qi++;
     }
-    break;
+    slices[i].padding = 0;
+
+    budget->used += cl;
+    budget->room += MAX_SLICE - cl;
   }
+}
+
+/* Codes a run of slices losslessly at qindex 0, with the same interface and
+   budget as code_slices_fixed though qindex is not used. The slice size
+   scalar and packed buffers are chosen so that no component can be too
+   long for either, but a slice with one that is anyway is blanked. */
+template<int SW, int SH, int SD, int CF, class T> void code_slices_lossless(CodedSlice<T> *slices, int n, QuantisationMatrices *, int, SliceRunBudget *budget, int slice_size_scalar, int w, int h, int d) {
+  const int MAX_SLICE = 4 + 3*255*slice_size_scalar;
+  const int CW = color_diff_width(CF, SW);
+  const int CH = color_diff_height(CF, SH);
+
+  budget->spare   = 0;
+  budget->starved = 0;
+  budget->used    = 0;
+  budget->room    = 0;
+  for (int i = 0; i < n; i++) {
+    slices[i].qindex = 0;
+    slices[i].packed_coded = true;
+    const bool packed = encode_slice_component_lossless<SW,SH,SD,T>(&slices[i], 0, w, h, d) &&
+                        encode_slice_component_lossless<CW,CH,SD,T>(&slices[i], 1, color_diff_width(CF, w), color_diff_height(CF, h), d) &&
+                        encode_slice_component_lossless<CW,CH,SD,T>(&slices[i], 2, color_diff_width(CF, w), color_diff_height(CF, h), d);
+    int cl = (packed)?slice_coded_length<T>(&slices[i], slice_size_scalar):0;
+    if (!packed ||
+        (int)slices[i].length[0] > 255*slice_size_scalar ||
+        (int)slices[i].length[1] > 255*slice_size_scalar ||
+        (int)slices[i].length[2] > 255*slice_size_scalar) {
+      writelog(LOG_ERROR, "%s:%d:  Lossless slice too long for its buffers or the slice size scalar, blanking slice\n", __FILE__, __LINE__);
+      zero_slice<T>(&slices[i]);
+      cl = 4;
+    }
+    slices[i].padding = 0;
 
-  return encode_slices_fallback;
+    budget->used += cl;
+    budget->room += MAX_SLICE - cl;
+  }
 }
 
-SliceEncoderFunc16 get_slice_encoder16(int w, int h, int d, int QUAL, int passes) {
-  if (d > 4 || w % (1 << d) || h % (1 << d)) {
-    throw VC2ENCODER_BADPARAMS;
+/* The slice geometries, as width, height, depth and chroma format, for which
+   encoders are compiled with the geometry fixed. Any other geometry is coded
+   by the same templates with the geometry given at run time, compiled for
+   each chroma format as CHROMA_FORMATS lists. A 4:2:0 slice needs twice the
+   height of the others to keep a whole number of transform blocks in its
+   colour difference components. */
+#define SLICE_GEOMETRIES(X)                             \
+  X( 8,  8, 2, VC2ENCODER_CDS_422)                      \
+  X(32,  8, 3, VC2ENCODER_CDS_422)                      \
+  X(16, 16, 3, VC2ENCODER_CDS_422)                      \
+  X(32, 16, 4, VC2ENCODER_CDS_422)                      \
+  X(64,  8, 3, VC2ENCODER_CDS_422)                      \
+  X(32,  8, 3, VC2ENCODER_CDS_444)                      \
+  X(16, 16, 3, VC2ENCODER_CDS_444)                      \
+  X(32, 16, 3, VC2ENCODER_CDS_420)                      \
+  X(16, 16, 3, VC2ENCODER_CDS_420)
+
+#define CHROMA_FORMATS(X)                       \
+  X(VC2ENCODER_CDS_420)                         \
+  X(VC2ENCODER_CDS_422)                         \
+  X(VC2ENCODER_CDS_444)
+
+template<int SW, int SH, int SD, int CF, bool REFINED, class T, class F> F get_slice_encoder_quality(int QUAL) {
+  switch(QUAL) {
+  case QUANTISER_SELECTION_FULLSEARCH:
+    return encode_slices<SW,SH,SD,CF, QUANTISER_SELECTION_FULLSEARCH, REFINED, T>;
+  case QUANTISER_SELECTION_HALFSEARCH:
+    return encode_slices<SW,SH,SD,CF, QUANTISER_SELECTION_HALFSEARCH, REFINED, T>;
+  case QUANTISER_SELECTION_QUARTERSEARCH:
+    return encode_slices<SW,SH,SD,CF, QUANTISER_SELECTION_QUARTERSEARCH, REFINED, T>;
+  case QUANTISER_SELECTION_EIGHTHSEARCH:
+    return encode_slices<SW,SH,SD,CF, QUANTISER_SELECTION_EIGHTHSEARCH, REFINED, T>;
   }
 
+  writelog(LOG_ERROR, "%s:%d: Invalid quantiser selection quality\n", __FILE__, __LINE__);
+  throw VC2ENCODER_BADPARAMS;
+}
+
+/* The first pass is coded alone for a single pass, or ahead of the
+   picture-wide passes of refine_slices otherwise */
+template<int SW, int SH, int SD, int CF, class T, class F> F get_slice_encoder_passes(int QUAL, int passes) {
   switch (passes) {
   case 1:
-    switch(d) {
-    case 2:
-      if (w == 8 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_FULLSEARCH, 1, int16_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_HALFSEARCH, 1, int16_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_QUARTERSEARCH, 1, int16_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_EIGHTHSEARCH, 1, int16_t>;
-        }
-      }
-      break;
-    case 3:
-      if (w == 32 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_FULLSEARCH, 1, int16_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_HALFSEARCH, 1, int16_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_QUARTERSEARCH, 1, int16_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_EIGHTHSEARCH, 1, int16_t>;
-        }
-      }
-      break;
-    }
-    break;
+    return get_slice_encoder_quality<SW,SH,SD,CF, false, T, F>(QUAL);
   case 2:
-    switch(d) {
-    case 2:
-      if (w == 8 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_FULLSEARCH, 2, int16_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_HALFSEARCH, 2, int16_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_QUARTERSEARCH, 2, int16_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_EIGHTHSEARCH, 2, int16_t>;
-        }
-      }
-      break;
-    case 3:
-      if (w == 32 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_FULLSEARCH, 2, int16_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_HALFSEARCH, 2, int16_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_QUARTERSEARCH, 2, int16_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_EIGHTHSEARCH, 2, int16_t>;
-        }
-      }
-      break;
-    }
-    break;
   case 3:
-    switch(d) {
-    case 2:
-      if (w == 8 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_FULLSEARCH, 3, int16_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_HALFSEARCH, 3, int16_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_QUARTERSEARCH, 3, int16_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<8,8,2, QUANTISER_SELECTION_EIGHTHSEARCH, 3, int16_t>;
-        }
-      }
-      break;
-    case 3:
-      if (w == 32 && h == 8) {
-        switch(QUAL) {
-        case QUANTISER_SELECTION_FULLSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_FULLSEARCH, 3, int16_t>;
-        case QUANTISER_SELECTION_HALFSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_HALFSEARCH, 3, int16_t>;
-        case QUANTISER_SELECTION_QUARTERSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_QUARTERSEARCH, 3, int16_t>;
-        case QUANTISER_SELECTION_EIGHTHSEARCH:
-          return encode_slices<32,8,3, QUANTISER_SELECTION_EIGHTHSEARCH, 3, int16_t>;
-        }
-      }
-      break;
-    }
-    break;
+    return get_slice_encoder_quality<SW,SH,SD,CF, true, T, F>(QUAL);
+  }
+
+  writelog(LOG_ERROR, "%s:%d: Invalid number of passes\n", __FILE__, __LINE__);
+  throw VC2ENCODER_BADPARAMS;
+}
+
+template<int SW, int SH, int SD, int CF, class T, class F> F get_slice_refiner_quality(int QUAL) {
+  switch(QUAL) {
+  case QUANTISER_SELECTION_FULLSEARCH:
+    return refine_slices<SW,SH,SD,CF, QUANTISER_SELECTION_FULLSEARCH, T>;
+  case QUANTISER_SELECTION_HALFSEARCH:
+    return refine_slices<SW,SH,SD,CF, QUANTISER_SELECTION_HALFSEARCH, T>;
+  case QUANTISER_SELECTION_QUARTERSEARCH:
+    return refine_slices<SW,SH,SD,CF, QUANTISER_SELECTION_QUARTERSEARCH, T>;
+  case QUANTISER_SELECTION_EIGHTHSEARCH:
+    return refine_slices<SW,SH,SD,CF, QUANTISER_SELECTION_EIGHTHSEARCH, T>;
+  }
+
+  writelog(LOG_ERROR, "%s:%d: Invalid quantiser selection quality\n", __FILE__, __LINE__);
+  throw VC2ENCODER_BADPARAMS;
+}
+
+template<class T, class F> F get_slice_encoder(int w, int h, int d, int cf, int QUAL, int passes) {
+  if (d > MAX_DWT_DEPTH || color_diff_width(cf, w) % (1 << d) || color_diff_height(cf, h) % (1 << d)) {
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+#define SLICE_GEOMETRY_ENCODER(SW,SH,SD,CF)                              \
+  if (w == SW && h == SH && d == SD && cf == CF)                        \
+    return get_slice_encoder_passes<SW,SH,SD,CF, T, F>(QUAL, passes);
+  SLICE_GEOMETRIES(SLICE_GEOMETRY_ENCODER)
+#undef SLICE_GEOMETRY_ENCODER
+
+#define CHROMA_FORMAT_ENCODER(CF)                                       \
+  if (cf == CF)                                                         \
+    return get_slice_encoder_passes<0,0,0,CF, T, F>(QUAL, passes);
+  CHROMA_FORMATS(CHROMA_FORMAT_ENCODER)
+#undef CHROMA_FORMAT_ENCODER
+
+  throw VC2ENCODER_BADPARAMS;
+}
+
+template<class T, class F> F get_slice_refiner(int w, int h, int d, int cf, int QUAL) {
+  if (d > MAX_DWT_DEPTH || color_diff_width(cf, w) % (1 << d) || color_diff_height(cf, h) % (1 << d)) {
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+#define SLICE_GEOMETRY_REFINER(SW,SH,SD,CF)                              \
+  if (w == SW && h == SH && d == SD && cf == CF)                        \
+    return get_slice_refiner_quality<SW,SH,SD,CF, T, F>(QUAL);
+  SLICE_GEOMETRIES(SLICE_GEOMETRY_REFINER)
+#undef SLICE_GEOMETRY_REFINER
+
+#define CHROMA_FORMAT_REFINER(CF)                                       \
+  if (cf == CF)                                                         \
+    return get_slice_refiner_quality<0,0,0,CF, T, F>(QUAL);
+  CHROMA_FORMATS(CHROMA_FORMAT_REFINER)
+#undef CHROMA_FORMAT_REFINER
+
+  throw VC2ENCODER_BADPARAMS;
+}
+
+template<class T, class F> F get_slice_coder(int w, int h, int d, int cf) {
+  if (d > MAX_DWT_DEPTH || color_diff_width(cf, w) % (1 << d) || color_diff_height(cf, h) % (1 << d)) {
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+#define SLICE_GEOMETRY_CODER(SW,SH,SD,CF)                                \
+  if (w == SW && h == SH && d == SD && cf == CF)                        \
+    return code_slices<SW,SH,SD,CF, T>;
+  SLICE_GEOMETRIES(SLICE_GEOMETRY_CODER)
+#undef SLICE_GEOMETRY_CODER
+
+#define CHROMA_FORMAT_CODER(CF)                                         \
+  if (cf == CF)                                                         \
+    return code_slices<0,0,0,CF, T>;
+  CHROMA_FORMATS(CHROMA_FORMAT_CODER)
+#undef CHROMA_FORMAT_CODER
+
+  throw VC2ENCODER_BADPARAMS;
+}
+
+template<class T, class F> F get_fixed_slice_coder(int w, int h, int d, int cf) {
+  if (d > MAX_DWT_DEPTH || color_diff_width(cf, w) % (1 << d) || color_diff_height(cf, h) % (1 << d)) {
+    throw VC2ENCODER_BADPARAMS;
   }
 
-  return encode_slices_fallback;
+#define SLICE_GEOMETRY_FIXED_CODER(SW,SH,SD,CF)                          \
+  if (w == SW && h == SH && d == SD && cf == CF)                        \
+    return code_slices_fixed<SW,SH,SD,CF, T>;
+  SLICE_GEOMETRIES(SLICE_GEOMETRY_FIXED_CODER)
+#undef SLICE_GEOMETRY_FIXED_CODER
+
+#define CHROMA_FORMAT_FIXED_CODER(CF)                                   \
+  if (cf == CF)                                                         \
+    return code_slices_fixed<0,0,0,CF, T>;
+  CHROMA_FORMATS(CHROMA_FORMAT_FIXED_CODER)
+#undef CHROMA_FORMAT_FIXED_CODER
+
+  throw VC2ENCODER_BADPARAMS;
+}
+
+template<class T, class F> F get_lossless_slice_coder(int w, int h, int d, int cf) {
+  if (d > MAX_DWT_DEPTH || color_diff_width(cf, w) % (1 << d) || color_diff_height(cf, h) % (1 << d)) {
+    throw VC2ENCODER_BADPARAMS;
+  }
+
+#define SLICE_GEOMETRY_LOSSLESS_CODER(SW,SH,SD,CF)                       \
+  if (w == SW && h == SH && d == SD && cf == CF)                        \
+    return code_slices_lossless<SW,SH,SD,CF, T>;
+  SLICE_GEOMETRIES(SLICE_GEOMETRY_LOSSLESS_CODER)
+#undef SLICE_GEOMETRY_LOSSLESS_CODER
+
+#define CHROMA_FORMAT_LOSSLESS_CODER(CF)                                \
+  if (cf == CF)                                                         \
+    return code_slices_lossless<0,0,0,CF, T>;
+  CHROMA_FORMATS(CHROMA_FORMAT_LOSSLESS_CODER)
+#undef CHROMA_FORMAT_LOSSLESS_CODER
+
+  throw VC2ENCODER_BADPARAMS;
+}
+
+SliceEncoderFunc32 get_slice_encoder32(int w, int h, int d, int cf, int QUAL, int passes) {
+  return get_slice_encoder<int32_t, SliceEncoderFunc32>(w, h, d, cf, QUAL, passes);
+}
+
+SliceEncoderFunc16 get_slice_encoder16(int w, int h, int d, int cf, int QUAL, int passes) {
+  return get_slice_encoder<int16_t, SliceEncoderFunc16>(w, h, d, cf, QUAL, passes);
+}
+
+SliceRefinerFunc32 get_slice_refiner32(int w, int h, int d, int cf, int QUAL) {
+  return get_slice_refiner<int32_t, SliceRefinerFunc32>(w, h, d, cf, QUAL);
+}
+
+SliceRefinerFunc16 get_slice_refiner16(int w, int h, int d, int cf, int QUAL) {
+  return get_slice_refiner<int16_t, SliceRefinerFunc16>(w, h, d, cf, QUAL);
+}
+
+SliceCoderFunc32 get_slice_coder32(int w, int h, int d, int cf) {
+  return get_slice_coder<int32_t, SliceCoderFunc32>(w, h, d, cf);
+}
+
+SliceCoderFunc16 get_slice_coder16(int w, int h, int d, int cf) {
+  return get_slice_coder<int16_t, SliceCoderFunc16>(w, h, d, cf);
+}
+
+FixedSliceCoderFunc32 get_fixed_slice_coder32(int w, int h, int d, int cf) {
+  return get_fixed_slice_coder<int32_t, FixedSliceCoderFunc32>(w, h, d, cf);
+}
+
+FixedSliceCoderFunc16 get_fixed_slice_coder16(int w, int h, int d, int cf) {
+  return get_fixed_slice_coder<int16_t, FixedSliceCoderFunc16>(w, h, d, cf);
+}
+
+FixedSliceCoderFunc32 get_lossless_slice_coder32(int w, int h, int d, int cf) {
+  return get_lossless_slice_coder<int32_t, FixedSliceCoderFunc32>(w, h, d, cf);
+}
+
+FixedSliceCoderFunc16 get_lossless_slice_coder16(int w, int h, int d, int cf) {
+  return get_lossless_slice_coder<int16_t, FixedSliceCoderFunc16>(w, h, d, cf);
 }
@@ -28,6 +28,11 @@
 
 #include "datastructures.hpp"
 #include "quantise.hpp"
+#include "ratedistortion.hpp"
+
+/* The range of quantisers the slice encoders search and code with */
+#define MIN_QI 0
+#define MAX_QI 64
 
 enum {
   QUANTISER_SELECTION_FULLSEARCH = 0,
@@ -36,11 +41,98 @@ enum {
   QUANTISER_SELECTION_EIGHTHSEARCH = 3,
 };
 
-typedef void (*SliceEncoderFunc16)(CodedSlice<int16_t> *, int, QuantisationMatrices *, int olength, int wavelet_index, int slice_size_scalar, int w, int h, int d);
-typedef void (*SliceEncoderFunc32)(CodedSlice<int32_t> *, int, QuantisationMatrices *, int olength, int wavelet_index, int slice_size_scalar, int w, int h, int d);
+/* The number of quantiser searches made in coding a run of slices, counting
+   each pass, and how many of them the previous quantiser of the slice
+   predicted */
+struct QuantiserSearchStats {
+  int searches;
+  int predicted;
+};
+
+typedef void (*SliceEncoderFunc16)(CodedSlice<int16_t> *, int, QuantisationMatrices *, int olength, int slice_size_scalar, int w, int h, int d, QuantiserSearchStats *stats);
+typedef void (*SliceEncoderFunc32)(CodedSlice<int32_t> *, int, QuantisationMatrices *, int olength, int slice_size_scalar, int w, int h, int d, QuantiserSearchStats *stats);
+
+SliceEncoderFunc16 get_slice_encoder16(int w, int h, int d, int cf, int QUAL, int passes);
+SliceEncoderFunc32 get_slice_encoder32(int w, int h, int d, int cf, int QUAL, int passes);
+
+/* The state of a run of slices between the passes of picture-wide rate
+   control. The bytes the slices were given but did not use are pooled in
+   spare rather than held as padding, and a slice whose quantiser was limited
+   by its budget is marked as starved by a negative padding. used is the
+   coded length of the slices and room how much more they could take before
+   reaching the largest slice the slice header can describe. */
+struct SliceRunBudget {
+  int spare;
+  int starved;
+  int used;
+  int room;
+};
+
+typedef void (*SliceRefinerFunc16)(CodedSlice<int16_t> *, int, QuantisationMatrices *, SliceRunBudget *budget, int spare, int first, int total, int slice_size_scalar, int w, int h, int d, QuantiserSearchStats *stats);
+typedef void (*SliceRefinerFunc32)(CodedSlice<int32_t> *, int, QuantisationMatrices *, SliceRunBudget *budget, int spare, int first, int total, int slice_size_scalar, int w, int h, int d, QuantiserSearchStats *stats);
+
+SliceRefinerFunc16 get_slice_refiner16(int w, int h, int d, int cf, int QUAL);
+SliceRefinerFunc32 get_slice_refiner32(int w, int h, int d, int cf, int QUAL);
+
+void analyse_slices16(CodedSlice<int16_t> *, int, QuantisationMatrices *, SliceRDCurve *curves, int slice_size_scalar, int w, int h, int d, int cf);
+void analyse_slices32(CodedSlice<int32_t> *, int, QuantisationMatrices *, SliceRDCurve *curves, int slice_size_scalar, int w, int h, int d, int cf);
+
+typedef void (*SliceCoderFunc16)(CodedSlice<int16_t> *, int, QuantisationMatrices *, const SliceRDCurve *curves, SliceRunBudget *budget, int slice_size_scalar, int w, int h, int d);
+typedef void (*SliceCoderFunc32)(CodedSlice<int32_t> *, int, QuantisationMatrices *, const SliceRDCurve *curves, SliceRunBudget *budget, int slice_size_scalar, int w, int h, int d);
+
+SliceCoderFunc16 get_slice_coder16(int w, int h, int d, int cf);
+SliceCoderFunc32 get_slice_coder32(int w, int h, int d, int cf);
+
+typedef void (*FixedSliceCoderFunc16)(CodedSlice<int16_t> *, int, QuantisationMatrices *, int qindex, SliceRunBudget *budget, int slice_size_scalar, int w, int h, int d);
+typedef void (*FixedSliceCoderFunc32)(CodedSlice<int32_t> *, int, QuantisationMatrices *, int qindex, SliceRunBudget *budget, int slice_size_scalar, int w, int h, int d);
+
+FixedSliceCoderFunc16 get_fixed_slice_coder16(int w, int h, int d, int cf);
+FixedSliceCoderFunc32 get_fixed_slice_coder32(int w, int h, int d, int cf);
+
+/* Coders for lossless pictures, coding every slice at qindex 0 into the
+   packed buffers of its components */
+FixedSliceCoderFunc16 get_lossless_slice_coder16(int w, int h, int d, int cf);
+FixedSliceCoderFunc32 get_lossless_slice_coder32(int w, int h, int d, int cf);
+
+template<class T> inline int slice_coded_length(const CodedSlice<T> *slice, int slice_size_scalar) {
+  return 4 + ((slice->length[0] + slice_size_scalar - 1)/slice_size_scalar +
+              (slice->length[1] + slice_size_scalar - 1)/slice_size_scalar +
+              (slice->length[2] + slice_size_scalar - 1)/slice_size_scalar)*slice_size_scalar;
+}
+
+/* Takes stock of a run of slices coded in olength bytes by the first pass of
+   an encoder with further passes to come, pooling the bytes it left unused */
+template<class T> void pool_slice_padding(CodedSlice<T> *slices, int n, int olength, int slice_size_scalar, SliceRunBudget *budget) {
+  const int MAX_SLICE = 4 + 3*255*slice_size_scalar;
+
+  budget->starved = 0;
+  budget->used    = 0;
+  budget->room    = 0;
+  for (int i = 0; i < n; i++) {
+    const int cl = slice_coded_length<T>(&slices[i], slice_size_scalar);
+    if (slices[i].padding < 0)
+      budget->starved++;
+    budget->used += cl;
+    budget->room += MAX_SLICE - cl;
+  }
+  budget->spare = olength - budget->used;
+}
+
+/* Clears the starved marks of a run of slices and spreads p bytes of
+   padding over them in order, each taking as much as it has room for.
+   Returns the padding that would not fit. */
+template<class T> int place_slice_padding(CodedSlice<T> *slices, int n, int p, int slice_size_scalar) {
+  const int MAX_SLICE = 4 + 3*255*slice_size_scalar;
 
-SliceEncoderFunc16 get_slice_encoder16(int w, int h, int d, int QUAL, int passes);
-SliceEncoderFunc32 get_slice_encoder32(int w, int h, int d, int QUAL, int passes);
+  for (int i = 0; i < n; i++) {
+    int room = MAX_SLICE - slice_coded_length<T>(&slices[i], slice_size_scalar);
+    if (room > p)
+      room = p;
+    slices[i].padding = room;
+    p -= room;
+  }
+  return p;
+}
 
 uint8_t encode_uint(uint16_t x, uint32_t *output, uint8_t *lengthout);
 
@@ -0,0 +1,324 @@
+/*****************************************************************************
+ * encode_avx2.cpp : Vectorised quantisation and coding: AVX2 version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "encode_simd.hpp"
+#include "quantise.hpp"
+
+#include <string.h>
+#include <x86intrin.h>
+
+/* Quantises and codes sixteen coefficients, returning the movemask of the
+   non-zero ones (two bits per coefficient). This is the SSE4.2 kernel widened
+   to 256 bits: the conversions to and from 32-bit lanes are done per 128-bit
+   half and the packs put back in order with a cross lane permute. */
+static inline uint32_t quantise_and_code_16_avx2(const int16_t *idata,
+                                                 const uint16_t *m,
+                                                 const uint16_t *shm,
+                                                 const __m128i QSHIFT,
+                                                 uint16_t *codewords,
+                                                 uint8_t *wordlengths,
+                                                 __m256i &LENGTH) {
+  const __m256i ZERO     = _mm256_setzero_si256();
+  const __m256i ONE      = _mm256_set1_epi16(1);
+  const __m256i TWO      = _mm256_set1_epi16(2);
+  const __m256i BIAS     = _mm256_set1_epi16(127);
+  const __m256  EXPONENT = _mm256_castsi256_ps(_mm256_set1_epi32(0x7F800000));
+
+  const __m256i X = _mm256_loadu_si256((__m256i *)idata);
+  const __m256i M = _mm256_loadu_si256((__m256i *)m);
+  const __m256i S = _mm256_loadu_si256((__m256i *)shm);
+
+  const __m256i A = _mm256_abs_epi16(X);
+  const __m256i U = _mm256_add_epi16(_mm256_mulhi_epu16(A, M), A);
+  __m256i Q = _mm256_blendv_epi8(_mm256_mulhi_epu16(U, S), U, _mm256_cmpeq_epi16(S, ZERO));
+  Q = _mm256_srl_epi16(Q, QSHIFT);
+
+  const __m256i V = _mm256_add_epi16(Q, ONE);
+  const __m256  Vlo = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_castsi256_si128(V)));
+  const __m256  Vhi = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm256_extracti128_si256(V, 1)));
+
+  const __m256i K = _mm256_sub_epi16(_mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srli_epi32(_mm256_castps_si256(Vlo), 23),
+                                                                                 _mm256_srli_epi32(_mm256_castps_si256(Vhi), 23)),
+                                                              0xD8),
+                                     BIAS);
+  const __m256i MSB = _mm256_permute4x64_epi64(_mm256_packus_epi32(_mm256_cvttps_epi32(_mm256_and_ps(Vlo, EXPONENT)),
+                                                                   _mm256_cvttps_epi32(_mm256_and_ps(Vhi, EXPONENT))),
+                                               0xD8);
+
+  const __m256i QZ = _mm256_cmpeq_epi16(Q, ZERO);
+  const __m256i L  = _mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(K, K), TWO), QZ);
+
+  __m256i B = _mm256_and_si256(_mm256_sub_epi16(V, MSB), _mm256_set1_epi16(0x00FF));
+  B = _mm256_and_si256(_mm256_or_si256(B, _mm256_slli_epi16(B, 4)), _mm256_set1_epi16(0x0F0F));
+  B = _mm256_and_si256(_mm256_or_si256(B, _mm256_slli_epi16(B, 2)), _mm256_set1_epi16(0x3333));
+  B = _mm256_and_si256(_mm256_or_si256(B, _mm256_slli_epi16(B, 1)), _mm256_set1_epi16(0x5555));
+
+  __m256i CW = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(B, 2), TWO), _mm256_srli_epi16(X, 15));
+  CW = _mm256_blendv_epi8(CW, ONE, QZ);
+
+  _mm256_storeu_si256((__m256i *)codewords, CW);
+  _mm_storeu_si128((__m128i *)wordlengths, _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(L, L), 0xD8)));
+  LENGTH = _mm256_add_epi32(LENGTH, _mm256_madd_epi16(L, ONE));
+
+  return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(X, ZERO));
+}
+
+/* Quantises sixteen 16-bit coefficients as quantise_and_code_16_avx2 does and
+   adds their wordlengths to LENGTH, without forming the codewords. The order
+   of the lengths does not matter so the packs need no permute. */
+static inline void coded_length_16_avx2(const int16_t *idata,
+                                        const uint16_t *m,
+                                        const uint16_t *shm,
+                                        const __m128i QSHIFT,
+                                        __m256i &LENGTH) {
+  const __m256i ZERO = _mm256_setzero_si256();
+  const __m256i ONE  = _mm256_set1_epi16(1);
+  const __m256i BIAS = _mm256_set1_epi16(127 - 1);
+
+  const __m256i X = _mm256_loadu_si256((__m256i *)idata);
+  const __m256i M = _mm256_loadu_si256((__m256i *)m);
+  const __m256i S = _mm256_loadu_si256((__m256i *)shm);
+
+  const __m256i A = _mm256_abs_epi16(X);
+  const __m256i U = _mm256_add_epi16(_mm256_mulhi_epu16(A, M), A);
+  __m256i Q = _mm256_blendv_epi8(_mm256_mulhi_epu16(U, S), U, _mm256_cmpeq_epi16(S, ZERO));
+  Q = _mm256_srl_epi16(Q, QSHIFT);
+
+  const __m256i V = _mm256_add_epi16(Q, ONE);
+  const __m256i K = _mm256_sub_epi16(_mm256_packs_epi32(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(_mm256_unpacklo_epi16(V, ZERO))), 23),
+                                                        _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(_mm256_unpackhi_epi16(V, ZERO))), 23)),
+                                     BIAS);
+  const __m256i L = _mm256_add_epi16(_mm256_add_epi16(K, K), _mm256_cmpeq_epi16(Q, ZERO));
+
+  LENGTH = _mm256_add_epi32(LENGTH, _mm256_madd_epi16(L, ONE));
+}
+
+/* (A*B) >> 16 in each 32-bit lane, for products below 2^48 */
+static inline __m256i mulhi16_epu32_avx2(const __m256i A, const __m256i B) {
+  const __m256i E = _mm256_srli_epi64(_mm256_mul_epu32(A, B), 16);
+  const __m256i O = _mm256_slli_epi64(_mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(A, 32), _mm256_srli_epi64(B, 32)), 16), 32);
+  return _mm256_blend_epi32(E, O, 0xAA);
+}
+
+/* (A*B) >> 32 in each 32-bit lane */
+static inline __m256i mulhi_epu32_avx2(const __m256i A, const __m256i B) {
+  const __m256i E = _mm256_srli_epi64(_mm256_mul_epu32(A, B), 32);
+  const __m256i O = _mm256_mul_epu32(_mm256_srli_epi64(A, 32), _mm256_srli_epi64(B, 32));
+  return _mm256_blend_epi32(E, O, 0xAA);
+}
+
+/* As coded_length_16_avx2 for eight 32-bit coefficients, divided with the
+   32-bit multipliers as udiv<uint32_t> does and saturated at 255 as in
+   quantise_magnitude */
+static inline void coded_length_8_avx2(const int32_t *idata,
+                                       const uint32_t *m,
+                                       const uint16_t *shm,
+                                       const __m128i QSHIFT,
+                                       __m256i &LENGTH) {
+  const __m256i ZERO = _mm256_setzero_si256();
+  const __m256i ONE  = _mm256_set1_epi32(1);
+  const __m256i BIAS = _mm256_set1_epi32(127 - 1);
+
+  const __m256i X = _mm256_loadu_si256((__m256i *)idata);
+  const __m256i M = _mm256_loadu_si256((__m256i *)m);
+  const __m256i S = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i *)shm));
+
+  const __m256i A = _mm256_abs_epi32(X);
+  const __m256i U = _mm256_add_epi32(mulhi_epu32_avx2(A, M), A);
+  __m256i Q = _mm256_blendv_epi8(mulhi16_epu32_avx2(U, S), U, _mm256_cmpeq_epi32(S, ZERO));
+  Q = _mm256_min_epu32(_mm256_srl_epi32(Q, QSHIFT), _mm256_set1_epi32(255));
+
+  const __m256i V = _mm256_add_epi32(Q, ONE);
+  const __m256i K = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(V)), 23), BIAS);
+  const __m256i L = _mm256_add_epi32(_mm256_add_epi32(K, K), _mm256_cmpeq_epi32(Q, ZERO));
+
+  LENGTH = _mm256_add_epi32(LENGTH, L);
+}
+
+/* As quantise_and_code_16_avx2 for eight 32-bit coefficients, returning the
+   movemask of the non-zero ones (four bits per coefficient). The values are
+   quantised as in coded_length_8_avx2, and their saturation at 255 keeps the
+   codewords within sixteen bits. */
+static inline uint32_t quantise_and_code_8_avx2(const int32_t *idata,
+                                                const uint32_t *m,
+                                                const uint16_t *shm,
+                                                const __m128i QSHIFT,
+                                                uint16_t *codewords,
+                                                uint8_t *wordlengths,
+                                                __m256i &LENGTH) {
+  const __m256i ZERO     = _mm256_setzero_si256();
+  const __m256i ONE      = _mm256_set1_epi32(1);
+  const __m256i TWO      = _mm256_set1_epi32(2);
+  const __m256i BIAS     = _mm256_set1_epi32(127);
+  const __m256  EXPONENT = _mm256_castsi256_ps(_mm256_set1_epi32(0x7F800000));
+
+  const __m256i X = _mm256_loadu_si256((__m256i *)idata);
+  const __m256i M = _mm256_loadu_si256((__m256i *)m);
+  const __m256i S = _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i *)shm));
+
+  const __m256i A = _mm256_abs_epi32(X);
+  const __m256i U = _mm256_add_epi32(mulhi_epu32_avx2(A, M), A);
+  __m256i Q = _mm256_blendv_epi8(mulhi16_epu32_avx2(U, S), U, _mm256_cmpeq_epi32(S, ZERO));
+  Q = _mm256_min_epu32(_mm256_srl_epi32(Q, QSHIFT), _mm256_set1_epi32(255));
+
+  const __m256i V  = _mm256_add_epi32(Q, ONE);
+  const __m256  Vf = _mm256_cvtepi32_ps(V);
+
+  const __m256i K   = _mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(Vf), 23), BIAS);
+  const __m256i MSB = _mm256_cvttps_epi32(_mm256_and_ps(Vf, EXPONENT));
+
+  const __m256i QZ = _mm256_cmpeq_epi32(Q, ZERO);
+  const __m256i L  = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(K, K), TWO), QZ);
+
+  __m256i B = _mm256_sub_epi32(V, MSB);
+  B = _mm256_and_si256(_mm256_or_si256(B, _mm256_slli_epi32(B, 4)), _mm256_set1_epi32(0x0F0F));
+  B = _mm256_and_si256(_mm256_or_si256(B, _mm256_slli_epi32(B, 2)), _mm256_set1_epi32(0x3333));
+  B = _mm256_and_si256(_mm256_or_si256(B, _mm256_slli_epi32(B, 1)), _mm256_set1_epi32(0x5555));
+
+  __m256i CW = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(B, 2), TWO), _mm256_srli_epi32(X, 31));
+  CW = _mm256_blendv_epi8(CW, ONE, QZ);
+
+  const __m128i CW16 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(CW, CW), 0xD8));
+  const __m128i L16  = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(L, L), 0xD8));
+  _mm_storeu_si128((__m128i *)codewords, CW16);
+  _mm_storel_epi64((__m128i *)wordlengths, _mm_packus_epi16(L16, L16));
+  LENGTH = _mm256_add_epi32(LENGTH, L);
+
+  return ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(X, ZERO));
+}
+
+/* Codes the component in coded order, LANES coefficients at a time. A final
+   partial group is coded from zero padded copies, the padding costing one bit
+   per sample which is taken off again below. */
+template<class T, class MT, int LANES, uint32_t (*CODE)(const T *, const MT *, const uint16_t *, const __m128i, uint16_t *, uint8_t *, __m256i &)>
+static inline void quantise_and_code_avx2(const T *idata, const int istride, const int w, const int h, const int d,
+                                         const MT *m, const uint16_t *shm, const uint8_t qshift,
+                                         uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples) {
+  const int N = w*h;
+  T coefs[N];
+  slice_coded_order<T>(idata, istride, coefs, w, h, d);
+
+  const __m128i QSHIFT = _mm_cvtsi32_si128(qshift);
+  __m256i LENGTH = _mm256_setzero_si256();
+  int last = -1;
+
+  int n = 0;
+  for (; n + LANES <= N; n += LANES) {
+    uint32_t nz = CODE(&coefs[n], &m[n], &shm[n], QSHIFT, &codewords[n], &wordlengths[n], LENGTH);
+    if (nz)
+      last = n + (31 - __builtin_clz(nz))/sizeof(T);
+  }
+
+  int l = 0;
+  if (n < N) {
+    T        X[LANES] = { 0 };
+    MT       M[LANES] = { 0 };
+    uint16_t S[LANES] = { 0 };
+    uint16_t CW[LANES];
+    uint8_t  WL[LANES];
+    memcpy(X, &coefs[n], (N - n)*sizeof(T));
+    memcpy(M, &m[n],     (N - n)*sizeof(MT));
+    memcpy(S, &shm[n],   (N - n)*sizeof(uint16_t));
+    uint32_t nz = CODE(X, M, S, QSHIFT, CW, WL, LENGTH);
+    if (nz)
+      last = n + (31 - __builtin_clz(nz))/sizeof(T);
+    memcpy(&codewords[n],   CW, (N - n)*sizeof(uint16_t));
+    memcpy(&wordlengths[n], WL, (N - n)*sizeof(uint8_t));
+    l -= LANES - (N - n);
+  }
+
+  __m128i L = _mm_add_epi32(_mm256_castsi256_si128(LENGTH), _mm256_extracti128_si256(LENGTH, 1));
+  L = _mm_add_epi32(L, _mm_srli_si128(L, 8));
+  L = _mm_add_epi32(L, _mm_srli_si128(L, 4));
+  l += _mm_cvtsi128_si32(L);
+
+  l -= (N - 1) - last;
+  *length  = (l + 7)/8;
+  *samples = last + 1;
+}
+
+void quantise_and_code16_avx2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                              const uint16_t *m, const uint16_t *shm, const uint8_t qshift,
+                              uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples) {
+  quantise_and_code_avx2<int16_t, uint16_t, 16, quantise_and_code_16_avx2>(idata, istride, w, h, d, m, shm, qshift, codewords, wordlengths, length, samples);
+}
+
+void quantise_and_code32_avx2(const int32_t *idata, const int istride, const int w, const int h, const int d,
+                              const uint32_t *m, const uint16_t *shm, const uint8_t qshift,
+                              uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples) {
+  quantise_and_code_avx2<int32_t, uint32_t, 8, quantise_and_code_8_avx2>(idata, istride, w, h, d, m, shm, qshift, codewords, wordlengths, length, samples);
+}
+
+/* As coded_length_sse4_2: rows which are not a whole number of vectors are
+   packed together and a final partial group is zero padded */
+template<class T, class MT, int LANES, void (*CODE)(const T *, const MT *, const uint16_t *, const __m128i, __m256i &)>
+static inline int coded_length_avx2(const T *idata, const int istride, const int w, const int h, const int d,
+                                    const MT *m, const uint16_t *shm, const uint8_t qshift) {
+  const int N = w*h;
+  const __m128i QSHIFT = _mm_cvtsi32_si128(qshift);
+  __m256i LENGTH = _mm256_setzero_si256();
+  int l = 0;
+
+  if (w%LANES == 0) {
+    for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x += LANES)
+        CODE(&idata[y*istride + x], &m[y*w + x], &shm[y*w + x], QSHIFT, LENGTH);
+  } else {
+    T X[N + LANES];
+    for (int y = 0; y < h; y++)
+      memcpy(&X[y*w], &idata[y*istride], w*sizeof(T));
+
+    int n = 0;
+    for (; n + LANES <= N; n += LANES)
+      CODE(&X[n], &m[n], &shm[n], QSHIFT, LENGTH);
+
+    if (n < N) {
+      MT       M[LANES] = { 0 };
+      uint16_t S[LANES] = { 0 };
+      memset(&X[N], 0, LANES*sizeof(T));
+      memcpy(M, &m[n],   (N - n)*sizeof(MT));
+      memcpy(S, &shm[n], (N - n)*sizeof(uint16_t));
+      CODE(&X[n], M, S, QSHIFT, LENGTH);
+      l -= LANES - (N - n);
+    }
+  }
+
+  __m128i L = _mm_add_epi32(_mm256_castsi256_si128(LENGTH), _mm256_extracti128_si256(LENGTH, 1));
+  L = _mm_add_epi32(L, _mm_srli_si128(L, 8));
+  L = _mm_add_epi32(L, _mm_srli_si128(L, 4));
+  l += _mm_cvtsi128_si32(L);
+
+  return l - ((N - 1) - slice_coded_last<T>(idata, istride, w, h, d));
+}
+
+int coded_length16_avx2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                        const uint16_t *m, const uint16_t *shm, const uint8_t qshift) {
+  return coded_length_avx2<int16_t, uint16_t, 16, coded_length_16_avx2>(idata, istride, w, h, d, m, shm, qshift);
+}
+
+int coded_length32_avx2(const int32_t *idata, const int istride, const int w, const int h, const int d,
+                        const uint32_t *m, const uint16_t *shm, const uint8_t qshift) {
+  return coded_length_avx2<int32_t, uint32_t, 8, coded_length_8_avx2>(idata, istride, w, h, d, m, shm, qshift);
+}
@@ -0,0 +1,127 @@
+/*****************************************************************************
+ * encode_lossless.hpp : Lossless coding of slice components
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#ifndef __ENCODE_LOSSLESS_HPP__
+#define __ENCODE_LOSSLESS_HPP__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <x86intrin.h>
+
+#include "datastructures.hpp"
+#include "expgolomb.hpp"
+
+/* At qindex 0 the quantisation factor of every subband is 4, which is no
+   quantisation at all, so the coefficients are coded as they are with no
+   division. A coefficient of a lossless slice can need a codeword of well
+   over sixteen bits, so rather than going through the codeword arrays the
+   codewords of a component are packed straight into its packed buffer, in
+   coded order, as they are generated. */
+
+/* Packs the codeword of the coefficient x onto the accumulator as
+   pack_slice_component does, storing eight bytes after each. end is moved
+   on to the bit after the codeword if x is not zero. Codewords of up to 56
+   bits fit alongside the up to seven bits left over. Nothing is stored once
+   o has passed limit, the last offset with eight bytes of the buffer left,
+   though o still moves on so that the caller can tell. */
+template<class T> inline void pack_lossless_sample(const T x, uint8_t *optr, const int limit, uint64_t &accum, int &bits, int &o, int &end) {
+  const uint32_t v = abs((int32_t)x) + 1;
+  const int k = 31 - __builtin_clz(v);
+  const int l = 2*k + 2 - (x == 0);
+  const uint64_t cw = ((exp_golomb_spread_wide(v ^ (1 << k)) << 2) | 2 | (x < 0)) >> (x == 0);
+
+  accum |= cw << (64 - l - bits);
+  bits += l;
+  end = (x != 0)?(8*o + bits):end;
+
+  if (__builtin_expect(o <= limit, 1))
+    *((uint64_t *)&optr[o]) = __builtin_bswap64(accum);
+  accum <<= (bits & ~7);
+  o += (bits >> 3);
+  bits &= 7;
+}
+
+/* Codes one component of a slice at qindex 0 into slice->packed[c], walking
+   the subbands in coded order, with the geometry fixed by SW, SH and SD or
+   given by w, h and d as for encode_slice_component. The length is cut
+   short after the last non-zero coefficient, the rest of the component
+   being the ones of zero codewords and padding. The buffer needs room for
+   the longest codeword of every sample and eight bytes beyond. Returns false,
+   having written nothing past the end of the buffer, if the component did
+   not fit in it. */
+template<int SW, int SH, int SD, class T> inline bool encode_slice_component_lossless(CodedSlice<T> *slice, int c, int _w, int _h, int _d) {
+  const int w = (SW)?SW:_w;
+  const int h = (SH)?SH:_h;
+  const int d = (SD)?SD:_d;
+
+  const T *idata = slice->idata[c];
+  const int istride = slice->istride[c];
+  uint8_t *optr = slice->packed[c];
+  const int limit = slice->packed_length - 8;
+  uint64_t accum = 0;
+  int bits = 0;
+  int o = 0;
+  int end = 0;
+
+  int skip = 1 << d;
+  for (int y = 0; y < h; y += skip)
+    for (int x = 0; x < w; x += skip)
+      pack_lossless_sample<T>(idata[y*istride + x], optr, limit, accum, bits, o, end);
+
+  for (int l = 0; l < d; l++) {
+    for (int y = 0; y < h; y += skip)
+      for (int x = skip/2; x < w; x += skip)
+        pack_lossless_sample<T>(idata[y*istride + x], optr, limit, accum, bits, o, end);
+
+    for (int y = skip/2; y < h; y += skip)
+      for (int x = 0; x < w; x += skip)
+        pack_lossless_sample<T>(idata[y*istride + x], optr, limit, accum, bits, o, end);
+
+    for (int y = skip/2; y < h; y += skip)
+      for (int x = skip/2; x < w; x += skip)
+        pack_lossless_sample<T>(idata[y*istride + x], optr, limit, accum, bits, o, end);
+
+    skip /= 2;
+  }
+
+  if (o > limit)
+    return false;
+
+  if (bits)
+    optr[o] = (accum >> 56) | (0xFF >> bits);
+
+  slice->length[c]  = (end + 7)/8;
+  slice->samples[c] = 0;
+  return true;
+}
+
+/* The number of bytes a lossless component of n samples can need for
+   coefficients of magnitude no more than 2^k, not counting the eight bytes
+   the packer may store beyond it */
+inline int lossless_component_length(int n, int k) {
+  return (n*(2*k + 2) + 7)/8;
+}
+
+#endif /* __ENCODE_LOSSLESS_HPP__ */
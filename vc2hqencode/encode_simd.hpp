@@ -0,0 +1,126 @@
+/*****************************************************************************
+ * encode_simd.hpp : Vectorised quantisation and coding of slice components
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#ifndef __ENCODE_SIMD_HPP__
+#define __ENCODE_SIMD_HPP__
+
+#include <stdint.h>
+
+/* Quantises and codes one w x h component of a slice of 16-bit coefficients,
+   writing the codewords and wordlengths in coded order and returning the
+   coded length in bytes and the number of samples up to and including the
+   last non-zero one, exactly as encode_slice_component does.
+
+   m and shm are the coded order matrices from QuantisationMatrices::m_coded
+   and QuantisationMatrices::shm_coded, qshift is the additional shift applied
+   for quantisation indices above 31. The 32-bit coder takes the multipliers
+   from QuantisationMatrices::m32_coded, and saturates the quantised values at
+   255 as the scalar coder does. It is AVX2 only, as four lanes of 32-bit
+   division are slower than the scalar coder. */
+typedef void (*QuantiseAndCode16)(const int16_t *idata,
+                                  const int istride,
+                                  const int w,
+                                  const int h,
+                                  const int d,
+                                  const uint16_t *m,
+                                  const uint16_t *shm,
+                                  const uint8_t qshift,
+                                  uint16_t *codewords,
+                                  uint8_t *wordlengths,
+                                  uint32_t *length,
+                                  int *samples);
+
+typedef void (*QuantiseAndCode32)(const int32_t *idata,
+                                  const int istride,
+                                  const int w,
+                                  const int h,
+                                  const int d,
+                                  const uint32_t *m,
+                                  const uint16_t *shm,
+                                  const uint8_t qshift,
+                                  uint16_t *codewords,
+                                  uint8_t *wordlengths,
+                                  uint32_t *length,
+                                  int *samples);
+
+void quantise_and_code16_sse4_2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                                const uint16_t *m, const uint16_t *shm, const uint8_t qshift,
+                                uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples);
+
+void quantise_and_code16_avx2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                              const uint16_t *m, const uint16_t *shm, const uint8_t qshift,
+                              uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples);
+
+void quantise_and_code32_avx2(const int32_t *idata, const int istride, const int w, const int h, const int d,
+                              const uint32_t *m, const uint16_t *shm, const uint8_t qshift,
+                              uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples);
+
+/* Returns the coded length in bits of one w x h component of a slice at a
+   candidate quantiser, as used by the quantiser search, with the trailing
+   zeros that are not coded already taken off.
+
+   m and shm are the raster order matrices from QuantisationMatrices::m, or
+   QuantisationMatrices::m32 for 32-bit coefficients, and
+   QuantisationMatrices::shm. The 16-bit lengths are exact for quantised
+   values below 2^24, far above any the lower bound on the quantiser allows,
+   and the 32-bit ones saturate the quantised values at 255 as the scalar
+   coder does. */
+typedef int (*CodedLength16)(const int16_t *idata,
+                             const int istride,
+                             const int w,
+                             const int h,
+                             const int d,
+                             const uint16_t *m,
+                             const uint16_t *shm,
+                             const uint8_t qshift);
+
+typedef int (*CodedLength32)(const int32_t *idata,
+                             const int istride,
+                             const int w,
+                             const int h,
+                             const int d,
+                             const uint32_t *m,
+                             const uint16_t *shm,
+                             const uint8_t qshift);
+
+int coded_length16_sse4_2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                          const uint16_t *m, const uint16_t *shm, const uint8_t qshift);
+
+int coded_length32_sse4_2(const int32_t *idata, const int istride, const int w, const int h, const int d,
+                          const uint32_t *m, const uint16_t *shm, const uint8_t qshift);
+
+int coded_length16_avx2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                        const uint16_t *m, const uint16_t *shm, const uint8_t qshift);
+
+int coded_length32_avx2(const int32_t *idata, const int istride, const int w, const int h, const int d,
+                        const uint32_t *m, const uint16_t *shm, const uint8_t qshift);
+
+/* Set by detect_cpu_features, NULL when only the scalar coder is available */
+extern QuantiseAndCode16 quantise_and_code16;
+extern QuantiseAndCode32 quantise_and_code32;
+extern CodedLength16 coded_length16;
+extern CodedLength32 coded_length32;
+
+#endif /* __ENCODE_SIMD_HPP__ */
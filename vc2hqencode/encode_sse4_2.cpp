@@ -0,0 +1,262 @@
+/*****************************************************************************
+ * encode_sse4_2.cpp : Vectorised quantisation and coding: SSE4.2 version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "encode_simd.hpp"
+#include "quantise.hpp"
+
+#include <string.h>
+#include <x86intrin.h>
+
+/* Quantises and codes eight coefficients, returning the movemask of the
+   non-zero ones (two bits per coefficient).
+
+   The quantisation is the same as udiv<uint16_t>: a high half multiply by m,
+   an add, and a shift by sh done as a second high half multiply. The codeword
+   is the interleaved exp-Golomb code of the quantised value q, made without
+   tables: floor(log2(q + 1)) is read from the exponent of q + 1 converted to
+   float, which is exact for every 16-bit value, and gives the wordlength
+   directly. The bits of q + 1 below its leading one are then spread out to
+   every other bit, and the terminating one and sign bit are appended. As
+   with the tables only the low sixteen bits of the codeword are kept. */
+static inline int quantise_and_code_8_sse4_2(const int16_t *idata,
+                                             const uint16_t *m,
+                                             const uint16_t *shm,
+                                             const __m128i QSHIFT,
+                                             uint16_t *codewords,
+                                             uint8_t *wordlengths,
+                                             __m128i &LENGTH) {
+  const __m128i ZERO     = _mm_setzero_si128();
+  const __m128i ONE      = _mm_set1_epi16(1);
+  const __m128i TWO      = _mm_set1_epi16(2);
+  const __m128i BIAS     = _mm_set1_epi16(127);
+  const __m128  EXPONENT = _mm_castsi128_ps(_mm_set1_epi32(0x7F800000));
+
+  const __m128i X = _mm_loadu_si128((__m128i *)idata);
+  const __m128i M = _mm_loadu_si128((__m128i *)m);
+  const __m128i S = _mm_loadu_si128((__m128i *)shm);
+
+  const __m128i A = _mm_abs_epi16(X);
+  const __m128i U = _mm_add_epi16(_mm_mulhi_epu16(A, M), A);
+  __m128i Q = _mm_blendv_epi8(_mm_mulhi_epu16(U, S), U, _mm_cmpeq_epi16(S, ZERO));
+  Q = _mm_srl_epi16(Q, QSHIFT);
+
+  const __m128i V = _mm_add_epi16(Q, ONE);
+  const __m128  Vlo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(V, ZERO));
+  const __m128  Vhi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(V, ZERO));
+
+  const __m128i K = _mm_sub_epi16(_mm_packs_epi32(_mm_srli_epi32(_mm_castps_si128(Vlo), 23),
+                                                  _mm_srli_epi32(_mm_castps_si128(Vhi), 23)),
+                                  BIAS);
+  const __m128i MSB = _mm_packus_epi32(_mm_cvttps_epi32(_mm_and_ps(Vlo, EXPONENT)),
+                                       _mm_cvttps_epi32(_mm_and_ps(Vhi, EXPONENT)));
+
+  const __m128i QZ = _mm_cmpeq_epi16(Q, ZERO);
+  const __m128i L  = _mm_add_epi16(_mm_add_epi16(_mm_add_epi16(K, K), TWO), QZ);
+
+  __m128i B = _mm_and_si128(_mm_sub_epi16(V, MSB), _mm_set1_epi16(0x00FF));
+  B = _mm_and_si128(_mm_or_si128(B, _mm_slli_epi16(B, 4)), _mm_set1_epi16(0x0F0F));
+  B = _mm_and_si128(_mm_or_si128(B, _mm_slli_epi16(B, 2)), _mm_set1_epi16(0x3333));
+  B = _mm_and_si128(_mm_or_si128(B, _mm_slli_epi16(B, 1)), _mm_set1_epi16(0x5555));
+
+  __m128i CW = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(B, 2), TWO), _mm_srli_epi16(X, 15));
+  CW = _mm_blendv_epi8(CW, ONE, QZ);
+
+  _mm_storeu_si128((__m128i *)codewords, CW);
+  _mm_storel_epi64((__m128i *)wordlengths, _mm_packus_epi16(L, L));
+  LENGTH = _mm_add_epi32(LENGTH, _mm_madd_epi16(L, ONE));
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi16(X, ZERO)) ^ 0xFFFF;
+}
+
+void quantise_and_code16_sse4_2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                                const uint16_t *m, const uint16_t *shm, const uint8_t qshift,
+                                uint16_t *codewords, uint8_t *wordlengths, uint32_t *length, int *samples) {
+  const int N = w*h;
+  int16_t coefs[N];
+  slice_coded_order<int16_t>(idata, istride, coefs, w, h, d);
+
+  const __m128i QSHIFT = _mm_cvtsi32_si128(qshift);
+  __m128i LENGTH = _mm_setzero_si128();
+  int last = -1;
+
+  int n = 0;
+  for (; n + 8 <= N; n += 8) {
+    int nz = quantise_and_code_8_sse4_2(&coefs[n], &m[n], &shm[n], QSHIFT, &codewords[n], &wordlengths[n], LENGTH);
+    if (nz)
+      last = n + (31 - __builtin_clz(nz))/2;
+  }
+
+  int l = 0;
+  if (n < N) {
+    /* A final partial group is coded from zero padded copies, the padding
+       costing one bit per sample which is taken off again below */
+    int16_t  X[8] = { 0 };
+    uint16_t M[8] = { 0 };
+    uint16_t S[8] = { 0 };
+    uint16_t CW[8];
+    uint8_t  WL[8];
+    memcpy(X, &coefs[n], (N - n)*sizeof(int16_t));
+    memcpy(M, &m[n],     (N - n)*sizeof(uint16_t));
+    memcpy(S, &shm[n],   (N - n)*sizeof(uint16_t));
+    int nz = quantise_and_code_8_sse4_2(X, M, S, QSHIFT, CW, WL, LENGTH);
+    if (nz)
+      last = n + (31 - __builtin_clz(nz))/2;
+    memcpy(&codewords[n],   CW, (N - n)*sizeof(uint16_t));
+    memcpy(&wordlengths[n], WL, (N - n)*sizeof(uint8_t));
+    l -= 8 - (N - n);
+  }
+
+  LENGTH = _mm_add_epi32(LENGTH, _mm_srli_si128(LENGTH, 8));
+  LENGTH = _mm_add_epi32(LENGTH, _mm_srli_si128(LENGTH, 4));
+  l += _mm_cvtsi128_si32(LENGTH);
+
+  l -= (N - 1) - last;
+  *length  = (l + 7)/8;
+  *samples = last + 1;
+}
+
+/* Quantises eight 16-bit coefficients as quantise_and_code_8_sse4_2 does and
+   adds their wordlengths to LENGTH, without forming the codewords */
+static inline void coded_length_8_sse4_2(const int16_t *idata,
+                                         const uint16_t *m,
+                                         const uint16_t *shm,
+                                         const __m128i QSHIFT,
+                                         __m128i &LENGTH) {
+  const __m128i ZERO = _mm_setzero_si128();
+  const __m128i ONE  = _mm_set1_epi16(1);
+  const __m128i BIAS = _mm_set1_epi16(127 - 1);
+
+  const __m128i X = _mm_loadu_si128((__m128i *)idata);
+  const __m128i M = _mm_loadu_si128((__m128i *)m);
+  const __m128i S = _mm_loadu_si128((__m128i *)shm);
+
+  const __m128i A = _mm_abs_epi16(X);
+  const __m128i U = _mm_add_epi16(_mm_mulhi_epu16(A, M), A);
+  __m128i Q = _mm_blendv_epi8(_mm_mulhi_epu16(U, S), U, _mm_cmpeq_epi16(S, ZERO));
+  Q = _mm_srl_epi16(Q, QSHIFT);
+
+  const __m128i V = _mm_add_epi16(Q, ONE);
+  const __m128i K = _mm_sub_epi16(_mm_packs_epi32(_mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpacklo_epi16(V, ZERO))), 23),
+                                                  _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(_mm_unpackhi_epi16(V, ZERO))), 23)),
+                                  BIAS);
+  const __m128i L = _mm_add_epi16(_mm_add_epi16(K, K), _mm_cmpeq_epi16(Q, ZERO));
+
+  LENGTH = _mm_add_epi32(LENGTH, _mm_madd_epi16(L, ONE));
+}
+
+/* (A*B) >> 16 in each 32-bit lane, for products below 2^48 */
+static inline __m128i mulhi16_epu32_sse4_2(const __m128i A, const __m128i B) {
+  const __m128i E = _mm_srli_epi64(_mm_mul_epu32(A, B), 16);
+  const __m128i O = _mm_slli_epi64(_mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(A, 32), _mm_srli_epi64(B, 32)), 16), 32);
+  return _mm_blend_epi16(E, O, 0xCC);
+}
+
+/* (A*B) >> 32 in each 32-bit lane */
+static inline __m128i mulhi_epu32_sse4_2(const __m128i A, const __m128i B) {
+  const __m128i E = _mm_srli_epi64(_mm_mul_epu32(A, B), 32);
+  const __m128i O = _mm_mul_epu32(_mm_srli_epi64(A, 32), _mm_srli_epi64(B, 32));
+  return _mm_blend_epi16(E, O, 0xCC);
+}
+
+/* As coded_length_8_sse4_2 for four 32-bit coefficients, divided with the
+   32-bit multipliers as udiv<uint32_t> does and saturated at 255 as in
+   quantise_magnitude */
+static inline void coded_length_4_sse4_2(const int32_t *idata,
+                                         const uint32_t *m,
+                                         const uint16_t *shm,
+                                         const __m128i QSHIFT,
+                                         __m128i &LENGTH) {
+  const __m128i ZERO = _mm_setzero_si128();
+  const __m128i ONE  = _mm_set1_epi32(1);
+  const __m128i BIAS = _mm_set1_epi32(127 - 1);
+
+  const __m128i X = _mm_loadu_si128((__m128i *)idata);
+  const __m128i M = _mm_loadu_si128((__m128i *)m);
+  const __m128i S = _mm_cvtepu16_epi32(_mm_loadl_epi64((__m128i *)shm));
+
+  const __m128i A = _mm_abs_epi32(X);
+  const __m128i U = _mm_add_epi32(mulhi_epu32_sse4_2(A, M), A);
+  __m128i Q = _mm_blendv_epi8(mulhi16_epu32_sse4_2(U, S), U, _mm_cmpeq_epi32(S, ZERO));
+  Q = _mm_min_epu32(_mm_srl_epi32(Q, QSHIFT), _mm_set1_epi32(255));
+
+  const __m128i V = _mm_add_epi32(Q, ONE);
+  const __m128i K = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(V)), 23), BIAS);
+  const __m128i L = _mm_add_epi32(_mm_add_epi32(K, K), _mm_cmpeq_epi32(Q, ZERO));
+
+  LENGTH = _mm_add_epi32(LENGTH, L);
+}
+
+/* Components whose rows are a whole number of vectors are coded in place,
+   others are first packed together. A final partial group is coded from zero
+   padded copies, the padding costing one bit per sample which is taken off
+   again below. */
+template<class T, class MT, int LANES, void (*CODE)(const T *, const MT *, const uint16_t *, const __m128i, __m128i &)>
+static inline int coded_length_sse4_2(const T *idata, const int istride, const int w, const int h, const int d,
+                                      const MT *m, const uint16_t *shm, const uint8_t qshift) {
+  const int N = w*h;
+  const __m128i QSHIFT = _mm_cvtsi32_si128(qshift);
+  __m128i LENGTH = _mm_setzero_si128();
+  int l = 0;
+
+  if (w%LANES == 0) {
+    for (int y = 0; y < h; y++)
+      for (int x = 0; x < w; x += LANES)
+        CODE(&idata[y*istride + x], &m[y*w + x], &shm[y*w + x], QSHIFT, LENGTH);
+  } else {
+    T X[N + LANES];
+    for (int y = 0; y < h; y++)
+      memcpy(&X[y*w], &idata[y*istride], w*sizeof(T));
+
+    int n = 0;
+    for (; n + LANES <= N; n += LANES)
+      CODE(&X[n], &m[n], &shm[n], QSHIFT, LENGTH);
+
+    if (n < N) {
+      MT       M[LANES] = { 0 };
+      uint16_t S[LANES] = { 0 };
+      memset(&X[N], 0, LANES*sizeof(T));
+      memcpy(M, &m[n],   (N - n)*sizeof(MT));
+      memcpy(S, &shm[n], (N - n)*sizeof(uint16_t));
+      CODE(&X[n], M, S, QSHIFT, LENGTH);
+      l -= LANES - (N - n);
+    }
+  }
+
+  LENGTH = _mm_add_epi32(LENGTH, _mm_srli_si128(LENGTH, 8));
+  LENGTH = _mm_add_epi32(LENGTH, _mm_srli_si128(LENGTH, 4));
+  l += _mm_cvtsi128_si32(LENGTH);
+
+  return l - ((N - 1) - slice_coded_last<T>(idata, istride, w, h, d));
+}
+
+int coded_length16_sse4_2(const int16_t *idata, const int istride, const int w, const int h, const int d,
+                          const uint16_t *m, const uint16_t *shm, const uint8_t qshift) {
+  return coded_length_sse4_2<int16_t, uint16_t, 8, coded_length_8_sse4_2>(idata, istride, w, h, d, m, shm, qshift);
+}
+
+int coded_length32_sse4_2(const int32_t *idata, const int istride, const int w, const int h, const int d,
+                          const uint32_t *m, const uint16_t *shm, const uint8_t qshift) {
+  return coded_length_sse4_2<int32_t, uint32_t, 4, coded_length_4_sse4_2>(idata, istride, w, h, d, m, shm, qshift);
+}
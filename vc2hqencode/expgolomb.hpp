@@ -0,0 +1,93 @@
+/*****************************************************************************
+ * expgolomb.hpp : Table free interleaved exp-Golomb codes
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#ifndef __EXPGOLOMB_HPP__
+#define __EXPGOLOMB_HPP__
+
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "lut.hpp"
+
+/* The codeword for a quantised magnitude q > 0 is the bits of q + 1 below its
+   leading one, each preceded by a zero, then a terminating one and a sign
+   bit, for a wordlength of 2*floor(log2(q + 1)) + 2. Zero is the single bit
+   1. These give the same codewords and wordlengths as CWLUT and WLLUT in
+   lut.hpp (with the sign bit clear) without touching memory, and are not
+   limited to the 256 entries of the tables. */
+
+/* Spreads the low sixteen bits of b out to the even bits of the result. With
+   BMI2 this is a single pdep, otherwise the usual shift and mask ladder. */
+static inline uint32_t exp_golomb_spread(uint32_t b) {
+#ifdef __BMI2__
+  return _pdep_u32(b, 0x55555555);
+#else
+  b = (b | (b << 8)) & 0x00FF00FF;
+  b = (b | (b << 4)) & 0x0F0F0F0F;
+  b = (b | (b << 2)) & 0x33333333;
+  b = (b | (b << 1)) & 0x55555555;
+  return b;
+#endif
+}
+
+/* As exp_golomb_spread for all 32 bits of b, for codewords too long for 32
+   bits */
+static inline uint64_t exp_golomb_spread_wide(uint32_t b) {
+#ifdef __BMI2__
+  return _pdep_u64(b, 0x5555555555555555ULL);
+#else
+  return (uint64_t)exp_golomb_spread(b & 0xFFFF) | ((uint64_t)exp_golomb_spread(b >> 16) << 32);
+#endif
+}
+
+static inline int exp_golomb_length(uint32_t q) {
+  const int k = 31 - __builtin_clz(q + 1);
+  return 2*k + 2 - (q == 0);
+}
+
+/* Only valid for q below 2^16, as the bits of q + 1 below its leading one
+   must fit in the sixteen that exp_golomb_spread handles */
+static inline uint32_t exp_golomb_codeword(uint32_t q) {
+  const uint32_t v = q + 1;
+  const int k = 31 - __builtin_clz(v);
+  return ((exp_golomb_spread(v ^ (1 << k)) << 2) | 2) >> (q == 0);
+}
+
+/* When set, as it is by default, the scalar coders take the codewords and
+   wordlengths of quantised values below 256 from CWLUT and WLLUT, generating
+   only those beyond the tables. Otherwise every codeword is generated. The
+   tables are small enough to stay in L1, and vc2codewordbench compares the
+   two on a given processor. */
+extern bool codeword_tables;
+
+template<bool TABLES> inline int sample_wordlength(uint32_t q) {
+  return (TABLES && q < 256)?WLLUT[q]:exp_golomb_length(q);
+}
+
+template<bool TABLES> inline uint32_t sample_codeword(uint32_t q) {
+  return (TABLES && q < 256)?CWLUT[q]:exp_golomb_codeword(q);
+}
+
+#endif /* __EXPGOLOMB_HPP__ */
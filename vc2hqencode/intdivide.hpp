@@ -51,9 +51,9 @@ template<class T> struct Divisor {
     , sh2 (other.sh2) {}
 
   Divisor(T d) {
-    if (d == (1 << (8*sizeof(T) - 1)))
+    if (d == (((T)1) << (8*sizeof(T) - 1)))
       l = 8*sizeof(T);
-    else if ( d & (1 << (8*sizeof(T) - 1)) )
+    else if ( d & (((T)1) << (8*sizeof(T) - 1)) )
       l = 8*sizeof(T);
     else
       l = ilog2<T>(2*d - 1);
@@ -25,8 +25,11 @@
 
 #include "quantise.hpp"
 #include "internal.h"
+#include "datastructures.hpp"
 #include "logger.hpp"
 #include <stdlib.h>
+#include <mutex>
+#include <vector>
 
 #include <stdio.h>
 #include <malloc.h>
@@ -52,103 +55,112 @@ uint32_t quant_factor(const uint8_t index) {
   throw;
 }
 
-QuantisationMatrices::QuantisationMatrices(int bw, int bh, int d, int t, int q_min, int q_max) {
+/* The quantised magnitude of n as the coders find it, with the sixteen bit
+   divisor where 16-bit coefficients reach and exactly beyond that */
+static inline uint32_t threshold_magnitude(const uint32_t n, const Divisor<uint16_t> &D, const uint16_t qf) {
+  if (n < 0x10000)
+    return udiv<uint16_t>(n, D.m, D.l - 2);
+  return (uint32_t)((4*(uint64_t)n)/qf);
+}
+
+QuantisationMatrices::QuantisationMatrices(int bw, int bh, int d, int cf, const QuantisationWeightingMatrix &matrix, int q_min, int q_max) {
   mBW        = bw;
   mBH        = bh;
   mDepth     = d;
-  mTransform = t;
+  mCF        = cf;
+  mMatrix    = matrix;
   mQmin      = q_min;
   mQmax      = q_max;
 
   mMatrixYLen = bw*bh;
-  mMatrixCLen = bw*bh/2;
+  mMatrixCLen = color_diff_width(cf, bw)*color_diff_height(cf, bh);
 
   mQF = (uint16_t *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint16_t));
   mM  = (uint16_t *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint16_t));
+  mM32 = (uint32_t *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint32_t));
   mSh = (uint8_t  *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint8_t));
+  mShM  = (uint16_t *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint16_t));
+  mMC   = (uint16_t *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint16_t));
+  mShMC = (uint16_t *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint16_t));
+  mM32C = (uint32_t *)memalign(64, (q_max - q_min)*(mMatrixYLen + 2*mMatrixCLen)*sizeof(uint32_t));
 
   for (int qi = q_min; qi < q_max; qi++) {
     uint16_t *Y = &mQF[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
-    const QuantisationWeightingMatrix *QWM = &preset_quantisation_matrices[t][d];
+    const QuantisationWeightingMatrix *QWM = &mMatrix;
 
-    {
+    for (int c = 0; c < 3; c++) {
+      const int w = (c == 0)?bw:color_diff_width(cf, bw);
+      const int h = (c == 0)?bh:color_diff_height(cf, bh);
       int skip = 1 << d;
-      for (int y = 0; y < bh; y += skip)
-        for (int x = 0; x < bw; x += skip)
-          Y[y*bw + x] = quant_factor(max(qi - QWM->LL, 0));
+      for (int y = 0; y < h; y += skip)
+        for (int x = 0; x < w; x += skip)
+          Y[y*w + x] = quant_factor(max(qi - QWM->LL, 0));
 
       for (int l = 0; l < d; l++) {
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw; x += skip)
-            Y[y*bw + x + skip/2] = quant_factor(max(qi - QWM->HL[l], 0));
+        for (int y = 0; y < h; y += skip)
+          for (int x = 0; x < w; x += skip)
+            Y[y*w + x + skip/2] = quant_factor(max(qi - QWM->HL[l], 0));
 
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw; x += skip)
-            Y[(y + skip/2)*bw + x] = quant_factor(max(qi - QWM->LH[l], 0));
+        for (int y = 0; y < h; y += skip)
+          for (int x = 0; x < w; x += skip)
+            Y[(y + skip/2)*w + x] = quant_factor(max(qi - QWM->LH[l], 0));
 
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw; x += skip)
-            Y[(y + skip/2)*bw + x + skip/2] = quant_factor(max(qi - QWM->HH[l], 0));
+        for (int y = 0; y < h; y += skip)
+          for (int x = 0; x < w; x += skip)
+            Y[(y + skip/2)*w + x + skip/2] = quant_factor(max(qi - QWM->HH[l], 0));
 
         skip /= 2;
       }
+      Y += w*h;
     }
-    Y += mMatrixYLen;
-
-    {
-      int skip = 1 << d;
-      for (int y = 0; y < bh; y += skip)
-        for (int x = 0; x < bw/2; x += skip)
-          Y[y*bw/2 + x] = quant_factor(max(qi - QWM->LL, 0));
-
-      for (int l = 0; l < d; l++) {
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw/2; x += skip)
-            Y[y*bw/2 + x + skip/2] = quant_factor(max(qi - QWM->HL[l], 0));
+  }
 
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw/2; x += skip)
-            Y[(y + skip/2)*bw/2 + x] = quant_factor(max(qi - QWM->LH[l], 0));
+  for (int n = 0; n < (mQmax-mQmin)*(mMatrixYLen + 2*mMatrixCLen); n++) {
+    Divisor<uint16_t> D(mQF[n]);
+    mM[n]  = D.m;
+    mSh[n] = D.l - 2;
+    mM32[n] = Divisor<uint32_t>(mQF[n]).m;
+  }
 
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw/2; x += skip)
-            Y[(y + skip/2)*bw/2 + x + skip/2] = quant_factor(max(qi - QWM->HH[l], 0));
+  for (int n = 0; n < (mQmax-mQmin)*(mMatrixYLen + 2*mMatrixCLen); n++)
+    mShM[n] = (mSh[n] == 0)?0:(1 << (16 - mSh[n]));
 
-        skip /= 2;
-      }
+  for (int qi = q_min; qi < q_max; qi++) {
+    for (int c = 0; c < 3; c++) {
+      const int w = (c == 0)?bw:color_diff_width(cf, bw);
+      const int h = (c == 0)?bh:color_diff_height(cf, bh);
+      slice_coded_order<uint16_t>(m(qi, c), w, (uint16_t *)m_coded(qi, c), w, h, d);
+      slice_coded_order<uint16_t>(shm(qi, c), w, (uint16_t *)shm_coded(qi, c), w, h, d);
+      slice_coded_order<uint32_t>(m32(qi, c), w, (uint32_t *)m32_coded(qi, c), w, h, d);
     }
-    Y += mMatrixCLen;
-
-    {
-      int skip = 1 << d;
-      for (int y = 0; y < bh; y += skip)
-        for (int x = 0; x < bw/2; x += skip)
-          Y[y*bw/2 + x] = quant_factor(max(qi - QWM->LL, 0));
-
-      for (int l = 0; l < d; l++) {
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw/2; x += skip)
-            Y[y*bw/2 + x + skip/2] = quant_factor(max(qi - QWM->HL[l], 0));
-
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw/2; x += skip)
-            Y[(y + skip/2)*bw/2 + x] = quant_factor(max(qi - QWM->LH[l], 0));
-
-        for (int y = 0; y < bh; y += skip)
-          for (int x = 0; x < bw/2; x += skip)
-            Y[(y + skip/2)*bw/2 + x + skip/2] = quant_factor(max(qi - QWM->HH[l], 0));
+  }
 
-        skip /= 2;
+  mThresholds = (uint32_t *)memalign(64, (q_max - q_min)*(MAX_QUANTISER_SHIFT + 1)*32*sizeof(uint32_t));
+  for (int qi = q_min; qi < q_max; qi++) {
+    const uint16_t qf = quant_factor(qi);
+    Divisor<uint16_t> D(qf);
+    for (int s = 0; s <= MAX_QUANTISER_SHIFT; s++) {
+      uint32_t *X = (uint32_t *)thresholds(qi, s);
+      for (int k = 0; k < 32; k++) {
+        const uint64_t t = (((uint64_t)1) << k) - 1;
+        uint32_t lo = 0;
+        uint32_t hi = 0x80000000;
+        if ((threshold_magnitude(hi - 1, D, qf) >> s) < t) {
+          X[k] = 0xFFFFFFFF;
+          continue;
+        }
+        while (lo < hi) {
+          const uint32_t mid = lo + (hi - lo)/2;
+          if ((threshold_magnitude(mid, D, qf) >> s) >= t)
+            hi = mid;
+          else
+            lo = mid + 1;
+        }
+        X[k] = lo;
       }
     }
   }
 
-  for (int n = 0; n < (mQmax-mQmin)*(mMatrixYLen + 2*mMatrixCLen); n++) {
-    Divisor<uint16_t> D(mQF[n]);
-    mM[n]  = D.m;
-    mSh[n] = D.l - 2;
-  }
-
 #ifdef DEBUG_PRINT_QUANTISATION_MATRICES
   for (int qi = q_min; qi < q_max; qi++) {
     printf("----------------------------------------------\n");
@@ -161,21 +173,17 @@ QuantisationMatrices::QuantisationMatrices(int bw, int bh, int d, int t, int q_m
       }
       printf("\n");
     }
-    printf("\n");
-    for (int y = 0; y < bh; y++) {
-      printf("    ");
-      for (int x = 0; x < bw/2; x++) {
-        printf("%2d  ", qf(qi, 1)[y*bw/2 + x]);
-      }
+    for (int c = 1; c < 3; c++) {
+      const int w = color_diff_width(cf, bw);
+      const int h = color_diff_height(cf, bh);
       printf("\n");
-    }
-    printf("\n");
-    for (int y = 0; y < bh; y++) {
-      printf("    ");
-      for (int x = 0; x < bw/2; x++) {
-        printf("%2d  ", qf(qi, 2)[y*bw/2 + x]);
+      for (int y = 0; y < h; y++) {
+        printf("    ");
+        for (int x = 0; x < w; x++) {
+          printf("%2d  ", qf(qi, c)[y*w + x]);
+        }
+        printf("\n");
       }
-      printf("\n");
     }
     printf("----------------------------------------------\n");
   }
@@ -185,5 +193,66 @@ QuantisationMatrices::QuantisationMatrices(int bw, int bh, int d, int t, int q_m
 QuantisationMatrices::~QuantisationMatrices() {
   free(mQF);
   free(mM);
+  free(mM32);
   free(mSh);
+  free(mShM);
+  free(mMC);
+  free(mShMC);
+  free(mM32C);
+  free(mThresholds);
+}
+
+bool QuantisationMatrices::matches(int bw, int bh, int d, int cf, const QuantisationWeightingMatrix &matrix, int q_min, int q_max) const {
+  if (bw != mBW || bh != mBH || d != mDepth || cf != mCF || q_min != mQmin || q_max != mQmax)
+    return false;
+
+  if (matrix.LL != mMatrix.LL)
+    return false;
+  for (int l = 0; l < d; l++) {
+    if (matrix.HL[l] != mMatrix.HL[l] ||
+        matrix.LH[l] != mMatrix.LH[l] ||
+        matrix.HH[l] != mMatrix.HH[l])
+      return false;
+  }
+
+  return true;
+}
+
+struct SharedQuantisationMatrices {
+  QuantisationMatrices *matrices;
+  int users;
+};
+
+static std::mutex shared_quantisation_matrices_mutex;
+static std::vector<SharedQuantisationMatrices> shared_quantisation_matrices;
+
+QuantisationMatrices *acquire_quantisation_matrices(int bw, int bh, int d, int cf, const QuantisationWeightingMatrix &matrix, int q_min, int q_max) {
+  std::lock_guard<std::mutex> lock(shared_quantisation_matrices_mutex);
+
+  for (size_t i = 0; i < shared_quantisation_matrices.size(); i++) {
+    if (shared_quantisation_matrices[i].matrices->matches(bw, bh, d, cf, matrix, q_min, q_max)) {
+      shared_quantisation_matrices[i].users++;
+      return shared_quantisation_matrices[i].matrices;
+    }
+  }
+
+  SharedQuantisationMatrices S;
+  S.matrices = new QuantisationMatrices(bw, bh, d, cf, matrix, q_min, q_max);
+  S.users    = 1;
+  shared_quantisation_matrices.push_back(S);
+  return S.matrices;
+}
+
+void release_quantisation_matrices(QuantisationMatrices *matrices) {
+  std::lock_guard<std::mutex> lock(shared_quantisation_matrices_mutex);
+
+  for (size_t i = 0; i < shared_quantisation_matrices.size(); i++) {
+    if (shared_quantisation_matrices[i].matrices == matrices) {
+      if (--shared_quantisation_matrices[i].users == 0) {
+        delete matrices;
+        shared_quantisation_matrices.erase(shared_quantisation_matrices.begin() + i);
+      }
+      return;
+    }
+  }
 }
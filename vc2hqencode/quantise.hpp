@@ -27,13 +27,14 @@
 #define __QUANTISE_HPP__
 
 #include <stdint.h>
+#include "vc2hqencode.h"
 #include "intdivide.hpp"
 
 struct QuantisationWeightingMatrix {
   uint8_t LL;
-  uint8_t HL[4];
-  uint8_t LH[4];
-  uint8_t HH[4];
+  uint8_t HL[MAX_DWT_DEPTH];
+  uint8_t LH[MAX_DWT_DEPTH];
+  uint8_t HH[MAX_DWT_DEPTH];
 };
 
 const QuantisationWeightingMatrix preset_quantisation_matrices[][5] = {
@@ -305,12 +306,173 @@ const QuantisationWeightingMatrix preset_quantisation_matrices[][5] = {
   },
 };
 
+/* VC-2 only defines default matrices for transforms of up to four levels, so
+   a deeper transform is coded with a matrix of its own, which the picture
+   header has to signal. It keeps the four finest levels of the depth four
+   matrix. Each further level scales the coarser subbands by the same filter
+   gains again, so in the levels above those every band steps by the same
+   amount a level, which the rounded steps of the four level matrix only
+   approximate: LeGall steps its bands by 2, 1 and 2, and Daubechies steps HL
+   by 3, 2 and 3 where it steps HH by 2, 3 and 2. The coarser levels step by
+   the mean of those steps over all the bands, rounded, and keep the offsets
+   between the bands of the coarsest level of the four level matrix, so that
+   no band overtakes another. LL is kept the same distance above the coarsest
+   HL. Every entry is then raised by the same amount so that the smallest is
+   zero, which only moves the qindex each slice is coded at. */
+inline QuantisationWeightingMatrix default_quantisation_matrix(int wavelet_index, int depth) {
+  if (depth <= 4)
+    return preset_quantisation_matrices[wavelet_index][depth];
+
+  const QuantisationWeightingMatrix &P = preset_quantisation_matrices[wavelet_index][4];
+  const int extra = depth - 4;
+  /* Nine times the mean step a level, over the three steps of three bands */
+  const int rise = (P.HL[3] - P.HL[0]) + (P.LH[3] - P.LH[0]) + (P.HH[3] - P.HH[0]);
+  int HL[MAX_DWT_DEPTH], LH[MAX_DWT_DEPTH], HH[MAX_DWT_DEPTH];
+  for (int l = 0; l < MAX_DWT_DEPTH; l++) {
+    if (l >= extra) {
+      const int p = (l < depth)?(l - extra):3;
+      HL[l] = P.HL[p];
+      LH[l] = P.LH[p];
+      HH[l] = P.HH[p];
+    } else {
+      const int drop = (2*(extra - l)*rise + ((rise < 0)?-9:9))/18;
+      HL[l] = P.HL[0] - drop;
+      LH[l] = P.LH[0] - drop;
+      HH[l] = P.HH[0] - drop;
+    }
+  }
+  const int LL = HL[0] + P.LL - P.HL[0];
+
+  int lowest = LL;
+  for (int l = 0; l < depth && l < MAX_DWT_DEPTH; l++) {
+    lowest = (HL[l] < lowest)?HL[l]:lowest;
+    lowest = (LH[l] < lowest)?LH[l]:lowest;
+    lowest = (HH[l] < lowest)?HH[l]:lowest;
+  }
+
+  QuantisationWeightingMatrix matrix;
+  matrix.LL = LL - lowest;
+  for (int l = 0; l < MAX_DWT_DEPTH; l++) {
+    matrix.HL[l] = (l < depth)?(HL[l] - lowest):0;
+    matrix.LH[l] = (l < depth)?(LH[l] - lowest):0;
+    matrix.HH[l] = (l < depth)?(HH[l] - lowest):0;
+  }
+  return matrix;
+}
+
+/* Copies the samples of a w x h slice component, held in raster order with the
+   given stride, into the order in which they are coded: the LL band first and
+   then the HL, LH and HH bands of each level from the coarsest to the finest.
+   This is static so that every translation unit, whatever instruction set it
+   is built for, has its own copy. */
+template<class T> static inline void slice_coded_order(const T *idata, const int istride, T *odata, const int w, const int h, const int d) {
+  int skip = 1 << d;
+  int n = 0;
+  for (int y = 0; y < h; y += skip)
+    for (int x = 0; x < w; x += skip)
+      odata[n++] = idata[y*istride + x];
+
+  for (int l = 0; l < d; l++) {
+    for (int y = 0; y < h; y += skip)
+      for (int x = 0; x < w; x += skip)
+        odata[n++] = idata[y*istride + x + skip/2];
+
+    for (int y = 0; y < h; y += skip)
+      for (int x = 0; x < w; x += skip)
+        odata[n++] = idata[(y + skip/2)*istride + x];
+
+    for (int y = 0; y < h; y += skip)
+      for (int x = 0; x < w; x += skip)
+        odata[n++] = idata[(y + skip/2)*istride + x + skip/2];
+
+    skip /= 2;
+  }
+}
+
+/* The coded order index of each sample of a w x h slice component, indexed by
+   its raster position, for the slice geometries fixed at compile time */
+template<int w, int h, int d> struct SliceCodedIndex {
+  SliceCodedIndex() {
+    int skip = 1 << d;
+    int i = 0;
+    for (int y = 0; y < h; y += skip)
+      for (int x = 0; x < w; x += skip)
+        n[y*w + x] = i++;
+
+    for (int l = 0; l < d; l++) {
+      for (int y = 0; y < h; y += skip)
+        for (int x = 0; x < w; x += skip)
+          n[y*w + x + skip/2] = i++;
+
+      for (int y = 0; y < h; y += skip)
+        for (int x = 0; x < w; x += skip)
+          n[(y + skip/2)*w + x] = i++;
+
+      for (int y = 0; y < h; y += skip)
+        for (int x = 0; x < w; x += skip)
+          n[(y + skip/2)*w + x + skip/2] = i++;
+
+      skip /= 2;
+    }
+  }
+
+  uint16_t n[(w*h > 0)?(w*h):1];
+};
+
+template<int w, int h, int d> static inline const uint16_t *slice_coded_index() {
+  static const SliceCodedIndex<w,h,d> I;
+  return I.n;
+}
+
+/* Returns the coded order index of the last non-zero sample of a w x h slice
+   component, or -1 if there is none, searching backwards from the finest HH
+   band so that it usually stops early. */
+template<class T> static inline int slice_coded_last(const T *idata, const int istride, const int w, const int h, const int d) {
+  int skip = 2;
+  int n = w*h;
+  for (int l = d - 1; l >= 0; l--) {
+    const int size = (w/skip)*(h/skip);
+    for (int b = 3; b > 0; b--) {
+      const int ox = (b&1)?(skip/2):0;
+      const int oy = (b&2)?(skip/2):0;
+      n -= size;
+      for (int y = h - skip; y >= 0; y -= skip)
+        for (int x = w - skip; x >= 0; x -= skip)
+          if (idata[(y + oy)*istride + x + ox] != 0)
+            return n + (y/skip)*(w/skip) + x/skip;
+    }
+    skip *= 2;
+  }
+
+  skip /= 2;
+  for (int y = h - skip; y >= 0; y -= skip)
+    for (int x = w - skip; x >= 0; x -= skip)
+      if (idata[y*istride + x] != 0)
+        return (y/skip)*(w/skip) + x/skip;
+
+  return -1;
+}
+
+/* The largest additional shift applied for quantisation indices above 31 for
+   which the quantiser thresholds are tabulated */
+const int MAX_QUANTISER_SHIFT = 16;
+
+/* The quantisation factors and divisors for every coefficient of a slice at
+   each quantisation index, generated from a quantisation weighting matrix,
+   which may be a preset or a custom one */
 class QuantisationMatrices {
 public:
-  QuantisationMatrices(int bw, int bh, int d, int t, int q_min, int q_max);
+  /* The matrices for slices of bw by bh luma samples in chroma format cf */
+  QuantisationMatrices(int bw, int bh, int d, int cf, const QuantisationWeightingMatrix &matrix, int q_min, int q_max);
 
   ~QuantisationMatrices();
 
+  /* Whether these matrices are the ones the constructor would generate from
+     the same parameters */
+  bool matches(int bw, int bh, int d, int cf, const QuantisationWeightingMatrix &matrix, int q_min, int q_max) const;
+
+  const QuantisationWeightingMatrix &weighting() const { return mMatrix; }
+
   const uint16_t *qf(int qi, int c) {
     if (c == 0)
       return &mQF[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
@@ -329,6 +491,17 @@ public:
       return &mM[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen + mMatrixCLen];
   }
 
+  /* The multipliers for 32-bit coefficients, which with sh divide exactly
+     over the whole range those coefficients reach */
+  const uint32_t *m32(int qi, int c) {
+    if (c == 0)
+      return &mM32[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
+    else if (c == 1)
+      return &mM32[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen];
+    else
+      return &mM32[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen + mMatrixCLen];
+  }
+
   const uint8_t *sh(int qi, int c) {
     if (c == 0)
       return &mSh[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
@@ -338,15 +511,70 @@ public:
       return &mSh[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen + mMatrixCLen];
   }
 
+  /* The shifts expressed as the multiplier 1 << (16 - sh) so that a high
+     half multiply performs the shift, or 0 where sh is 0 */
+  const uint16_t *shm(int qi, int c) {
+    if (c == 0)
+      return &mShM[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
+    else if (c == 1)
+      return &mShM[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen];
+    else
+      return &mShM[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen + mMatrixCLen];
+  }
+
+  /* The multipliers in coded order, for the vectorised quantisers */
+  const uint16_t *m_coded(int qi, int c) {
+    if (c == 0)
+      return &mMC[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
+    else if (c == 1)
+      return &mMC[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen];
+    else
+      return &mMC[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen + mMatrixCLen];
+  }
+
+  /* The 32-bit multipliers in coded order, as for m32 */
+  const uint32_t *m32_coded(int qi, int c) {
+    if (c == 0)
+      return &mM32C[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
+    else if (c == 1)
+      return &mM32C[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen];
+    else
+      return &mM32C[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen + mMatrixCLen];
+  }
+
+  /* The shifts in coded order, as for shm */
+  const uint16_t *shm_coded(int qi, int c) {
+    if (c == 0)
+      return &mShMC[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen)];
+    else if (c == 1)
+      return &mShMC[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen];
+    else
+      return &mShMC[(qi-mQmin)*(mMatrixYLen + 2*mMatrixCLen) + mMatrixYLen + mMatrixCLen];
+  }
+
+  /* The smallest magnitudes which quantise to at least 2^k - 1 with the
+     quantisation factor for index qi followed by a further right shift s,
+     indexed by k for k up to 31, or UINT32_MAX where no magnitude does */
+  const uint32_t *thresholds(int qi, int s) {
+    return &mThresholds[((qi - mQmin)*(MAX_QUANTISER_SHIFT + 1) + s)*32];
+  }
+
 protected:
   uint16_t *mQF;
   uint16_t *mM;
+  uint32_t *mM32;
   uint8_t  *mSh;
+  uint16_t *mShM;
+  uint16_t *mMC;
+  uint16_t *mShMC;
+  uint32_t *mM32C;
+  uint32_t *mThresholds;
 
   int mBW;
   int mBH;
   int mDepth;
-  int mTransform;
+  int mCF;
+  QuantisationWeightingMatrix mMatrix;
 
   int mQmin;
   int mQmax;
@@ -355,4 +583,23 @@ protected:
   int mMatrixCLen;
 };
 
+/* The multipliers for coefficients of type T, with type the type of each,
+   QuantisationMatrices::m for 16-bit coefficients and
+   QuantisationMatrices::m32 for 32-bit ones */
+template<class T> struct QuantiserMultipliers {
+  typedef uint16_t type;
+  static const uint16_t *get(QuantisationMatrices *matrices, int qi, int c) { return matrices->m(qi, c); }
+};
+
+template<> struct QuantiserMultipliers<int32_t> {
+  typedef uint32_t type;
+  static const uint32_t *get(QuantisationMatrices *matrices, int qi, int c) { return matrices->m32(qi, c); }
+};
+
+/* Generating the matrices takes a while, so those generated for identical
+   parameters are shared between encoders. Each set acquired must be released,
+   and is freed once the last holder releases it. */
+QuantisationMatrices *acquire_quantisation_matrices(int bw, int bh, int d, int cf, const QuantisationWeightingMatrix &matrix, int q_min, int q_max);
+void release_quantisation_matrices(QuantisationMatrices *matrices);
+
 #endif /* __QUANTISE_HPP__ */
@@ -0,0 +1,178 @@
+/*****************************************************************************
+ * ratecontrol.hpp : Sequence rate control
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#ifndef __RATECONTROL_HPP__
+#define __RATECONTROL_HPP__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "datastructures.hpp"
+#include "quantise.hpp"
+
+/* The activity of a picture for sequence rate control is a histogram of its
+   transform coefficients by the qindex up to which each survives
+   quantisation: four steps of qindex for each bit of magnitude, offset by the
+   weighting of its subband, with zero coefficients in the first bin. It
+   gives an estimate of the coded length of the picture at any qindex, and as
+   it is a count over the coefficients the histograms of runs of slices add
+   up to that of the picture. */
+const int ACTIVITY_BINS = 256;
+
+/* The weighting of the subband of each position in a square of 2^depth
+   coefficients of the in-place transform. A position lies in the subbands of
+   the level given by its lowest set bit of either coordinate, and in HL, LH
+   or HH as that bit is set in x only, in y only, or in both. */
+inline void activity_weights(const QuantisationWeightingMatrix &matrix, uint8_t *weights, int depth) {
+  const int n = 1 << depth;
+  for (int y = 0; y < n; y++) {
+    for (int x = 0; x < n; x++) {
+      const int tz = __builtin_ctz(x | y | n);
+      const int l  = depth - 1 - tz;
+      if (tz == depth)
+        weights[y*n + x] = matrix.LL;
+      else if (!((y >> tz)&1))
+        weights[y*n + x] = matrix.HL[l];
+      else if (!((x >> tz)&1))
+        weights[y*n + x] = matrix.LH[l];
+      else
+        weights[y*n + x] = matrix.HH[l];
+    }
+  }
+}
+
+/* Adds the coefficients of a slice to a histogram of activity, taking them
+   in memory order and the subband of each from the weights of
+   activity_weights */
+template<class T> inline void accumulate_slice_activity(const CodedSlice<T> *slice, const uint8_t *weights, uint32_t *count, int W, int H, int depth, int cf) {
+  const int mask = (1 << depth) - 1;
+  for (int c = 0; c < 3; c++) {
+    const int w = (c==0)?W:color_diff_width(cf, W);
+    const int h = (c==0)?H:color_diff_height(cf, H);
+    for (int y = 0; y < h; y++) {
+      const T *row = &slice->idata[c][y*slice->istride[c]];
+      const uint8_t *wrow = &weights[(y & mask) << depth];
+      for (int x = 0; x < w; x++) {
+        const uint32_t a = abs(row[x]);
+        const int k = (a)?(4*(32 - __builtin_clz(a)) + wrow[x & mask]):0;
+        count[(k < ACTIVITY_BINS)?k:(ACTIVITY_BINS - 1)]++;
+      }
+    }
+  }
+}
+
+/* The estimated bits to code at qindex qi the coefficients counted in a
+   histogram: one for a coefficient which quantises to zero, otherwise two for
+   its sign and the end of its codeword and two for each bit it keeps */
+template<class C> inline double activity_coded_bits(const C *count, int qi) {
+  double bits = 0;
+  for (int k = 0; k < ACTIVITY_BINS; k++)
+    bits += count[k]*((k > qi)?(2 + (k - qi)/2.0):1.0);
+  return bits;
+}
+
+/* Sizes the pictures of a sequence coded at a mean of data_length bytes each
+   through a virtual buffer of buffer_size bytes, such as that of a decoder fed
+   at a constant rate. The buffer starts half full, and each picture adds its
+   length to it while the channel takes out data_length.
+
+   Each picture is given the share of data_length that its estimated length
+   bears to that of the mean picture, both at the qindex at which the mean
+   picture fits in data_length, so that bytes go to the pictures which need
+   them rather than being padding in those which do not. The mean picture is
+   a running average of the activity of recent pictures. A fraction of the
+   distance of the buffer from half full is taken off, and the length is then
+   kept to what the buffer can take without overflowing or running dry.
+   Lengths are min_length and a whole number of granularity bytes, up to
+   max_length. */
+class SequenceRateController {
+public:
+  SequenceRateController() {
+    reset(0, 0, 0, 1);
+  }
+
+  void reset(int buffer_size, int min_length, int max_length, int granularity) {
+    mBufferSize  = buffer_size;
+    mMinLength   = min_length;
+    mMaxLength   = max_length;
+    mGranularity = granularity;
+    mLevel       = buffer_size/2;
+    mPictures    = 0;
+  }
+
+  int pictureLength(const uint32_t *count, int data_length) {
+    for (int k = 0; k < ACTIVITY_BINS; k++) {
+      if (mPictures == 0)
+        mMean[k] = count[k];
+      else
+        mMean[k] += (count[k] - mMean[k])/AVERAGE_PICTURES;
+    }
+    mPictures++;
+
+    int qi = 0;
+    while (qi < ACTIVITY_BINS - 1 && mMinLength + activity_coded_bits<double>(mMean, qi)/8 > data_length)
+      qi++;
+
+    const double mean = activity_coded_bits<double>(mMean, qi);
+    int64_t length = data_length;
+    if (mean > 0)
+      length = (int64_t)(data_length*activity_coded_bits<uint32_t>(count, qi)/mean);
+    length -= (mLevel - mBufferSize/2)/RECOVERY_PICTURES;
+
+    int64_t lo = data_length - mLevel;
+    int64_t hi = data_length + mBufferSize - mLevel;
+    if (lo < mMinLength)
+      lo = mMinLength;
+    if (hi > mMaxLength)
+      hi = mMaxLength;
+    if (length > hi)
+      length = hi;
+    if (length < lo)
+      length = lo;
+
+    length = mMinLength + (length - mMinLength)/mGranularity*mGranularity;
+    if (length < lo && length + mGranularity <= hi)
+      length += mGranularity;
+
+    mLevel += length - data_length;
+    return length;
+  }
+
+  int64_t level() const { return mLevel; }
+
+protected:
+  static const int AVERAGE_PICTURES  = 8;
+  static const int RECOVERY_PICTURES = 8;
+
+  int mBufferSize;
+  int mMinLength;
+  int mMaxLength;
+  int mGranularity;
+  int64_t mLevel;
+  int mPictures;
+  double mMean[ACTIVITY_BINS];
+};
+
+#endif /* __RATECONTROL_HPP__ */
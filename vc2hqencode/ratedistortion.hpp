@@ -0,0 +1,136 @@
+/*****************************************************************************
+ * ratedistortion.hpp : Picture-wide rate-distortion allocation
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#ifndef __RATEDISTORTION_HPP__
+#define __RATEDISTORTION_HPP__
+
+#include <stdint.h>
+#include <math.h>
+
+/* The rate-distortion curve of a slice for the rate-distortion optimised
+   speed, as the points of the lower convex hull of its rates and estimated
+   distortions over the quantisers it can use, from the cheapest up. rate is
+   the coded length of the slice in bytes at quantiser qi, and slope the
+   distortion saved per byte in moving to a point from the one before it,
+   which falls along the curve. chosen is the point allocated to the slice,
+   or -1 for a slice which cannot be coded and is left blank. */
+const int MAX_RD_POINTS = 65;
+
+struct SliceRDCurve {
+  int n;
+  int chosen;
+  uint8_t qi[MAX_RD_POINTS];
+  int rate[MAX_RD_POINTS];
+  double slope[MAX_RD_POINTS];
+};
+
+/* Takes each curve as far along as the distortion it saves per byte is at
+   least lambda, returning the bytes used, and records the points reached as
+   chosen if set */
+inline int rate_at_multiplier(SliceRDCurve *curves, int n, double lambda, bool set) {
+  int rate = 0;
+  for (int i = 0; i < n; i++) {
+    if (curves[i].chosen < 0) {
+      rate += 4;
+      continue;
+    }
+    int j = 0;
+    while (j + 1 < curves[i].n && curves[i].slope[j + 1] >= lambda)
+      j++;
+    if (set)
+      curves[i].chosen = j;
+    rate += curves[i].rate[j];
+  }
+  return rate;
+}
+
+/* Chooses a point on each of n curves to minimise the total distortion with
+   the slices coded in at most length bytes, returning the bytes used.
+
+   The Lagrange multiplier is found by bisection between the smallest and
+   largest slopes of the curves, on a logarithmic scale as they span many
+   orders of magnitude. Whatever the multiplier leaves unused is then offered
+   to the slices in turn, each moving on a point at a time while the next
+   fits, before what remains becomes padding. Should even the cheapest points
+   not fit, slices are blanked from the end of the picture until they do,
+   their chosen points being left at -1. */
+inline int allocate_slice_rates(SliceRDCurve *curves, int n, int length) {
+  double lo = HUGE_VAL;
+  double hi = 0;
+  int used = 0;
+  for (int i = 0; i < n; i++) {
+    curves[i].chosen = (curves[i].n > 0)?0:-1;
+    if (curves[i].chosen < 0) {
+      used += 4;
+      continue;
+    }
+    used += curves[i].rate[0];
+    for (int j = 1; j < curves[i].n; j++) {
+      if (curves[i].slope[j] < lo)
+        lo = curves[i].slope[j];
+      if (curves[i].slope[j] > hi)
+        hi = curves[i].slope[j];
+    }
+  }
+
+  for (int i = n - 1; i >= 0 && used > length; i--) {
+    if (curves[i].chosen < 0)
+      continue;
+    used -= curves[i].rate[0] - 4;
+    curves[i].chosen = -1;
+  }
+
+  if (hi > 0) {
+    double lambda = lo;
+    if (rate_at_multiplier(curves, n, lo, false) > length) {
+      hi *= 2;
+      for (int it = 0; it < 64 && hi > lo*(1 + 1e-9); it++) {
+        const double mid = sqrt(lo*hi);
+        if (rate_at_multiplier(curves, n, mid, false) <= length)
+          hi = mid;
+        else
+          lo = mid;
+      }
+      lambda = hi;
+    }
+    used = rate_at_multiplier(curves, n, lambda, true);
+  }
+
+  for (bool moved = true; moved; ) {
+    moved = false;
+    for (int i = 0; i < n; i++) {
+      const int j = curves[i].chosen;
+      if (j >= 0 && j + 1 < curves[i].n && used + curves[i].rate[j + 1] - curves[i].rate[j] <= length) {
+        used += curves[i].rate[j + 1] - curves[i].rate[j];
+        curves[i].chosen = j + 1;
+        moved = true;
+      }
+    }
+  }
+
+  return used;
+}
+
+#endif /* __RATEDISTORTION_HPP__ */
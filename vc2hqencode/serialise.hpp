@@ -32,13 +32,95 @@
 #include "debug.hpp"
 
 #include <x86intrin.h>
+#include <string.h>
+
+/* Packs the codewords of a slice component most significant bit first into a
+   64-bit accumulator, storing eight bytes at a time after every three words,
+   and returns the number of bytes written with the last padded out with ones.
+   No codeword is longer than 18 bits, so three of them always fit alongside
+   the up to seven bits left over from the previous store. Each store may run
+   up to seven bytes beyond the returned length. */
+static inline int pack_slice_component(const uint16_t *codewords, const uint8_t *wordlengths, const int samples, uint8_t *optr) {
+  uint64_t accum = 0;
+  int bits = 0;
+  int o = 0;
+  int n = 0;
+
+  for (; n + 3 <= samples; n += 3) {
+    accum |= ((uint64_t)codewords[n + 0]) << (64 - wordlengths[n + 0] - bits);
+    bits += wordlengths[n + 0];
+    accum |= ((uint64_t)codewords[n + 1]) << (64 - wordlengths[n + 1] - bits);
+    bits += wordlengths[n + 1];
+    accum |= ((uint64_t)codewords[n + 2]) << (64 - wordlengths[n + 2] - bits);
+    bits += wordlengths[n + 2];
+
+    *((uint64_t *)&optr[o]) = __builtin_bswap64(accum);
+    accum <<= (bits & ~7);
+    o += (bits >> 3);
+    bits &= 7;
+  }
+
+  for (; n < samples; n++) {
+    accum |= ((uint64_t)codewords[n]) << (64 - wordlengths[n] - bits);
+    bits += wordlengths[n];
+
+    *((uint64_t *)&optr[o]) = __builtin_bswap64(accum);
+    accum <<= (bits & ~7);
+    o += (bits >> 3);
+    bits &= 7;
+  }
+
+  if (bits)
+    optr[o++] = (accum >> 56) | (0xFF >> bits);
+
+  return o;
+}
+
+/* Writes a slice component of length bytes followed by p bytes of padding at
+   ocounter, never touching anything at or beyond oend, and returns the new
+   output position. Components that end too close to oend for the whole word
+   stores of the packer are packed into a copy first. */
+static inline int serialise_slice_component(const uint16_t *codewords, const uint8_t *wordlengths, const int samples, const int length, const int p,
+                                            uint8_t *optr, int ocounter, const int oend) {
+  if (ocounter + length + p > oend) {
+    writelog(LOG_ERROR, "%s:%d:  coder overrun", __FILE__, __LINE__);
+    throw VC2ENCODER_CODEROVERRUN;
+  }
+
+  if (ocounter + length + 8 <= oend) {
+    ocounter += pack_slice_component(codewords, wordlengths, samples, &optr[ocounter]);
+  } else {
+    uint8_t tmp[length + 8];
+    const int l = pack_slice_component(codewords, wordlengths, samples, tmp);
+    memcpy(&optr[ocounter], tmp, l);
+    ocounter += l;
+  }
+
+  memset(&optr[ocounter], 0xFF, p);
+  return ocounter + p;
+}
+
+/* As serialise_slice_component for a component already packed as it was
+   coded */
+static inline int serialise_packed_slice_component(const uint8_t *packed, const int length, const int p,
+                                                   uint8_t *optr, int ocounter, const int oend) {
+  if (ocounter + length + p > oend) {
+    writelog(LOG_ERROR, "%s:%d:  coder overrun", __FILE__, __LINE__);
+    throw VC2ENCODER_CODEROVERRUN;
+  }
+
+  memcpy(&optr[ocounter], packed, length);
+  memset(&optr[ocounter + length], 0xFF, p);
+  return ocounter + length + p;
+}
 
 template<class T> void serialise_slices(CodedSlice<T> *slices, int n_slices, char *odata, int olength, int n_samples, int slice_size_scalar, int slices_per_frag, uint32_t picnum, uint32_t *final_offset, int sx, int sy, int slices_per_line) {
   int ocounter = 0;
-  int bits = 0;
-  uint32_t accum = 0x00;
   uint8_t *optr = (uint8_t *)odata;
 
+  /* The fragment headers come on top of the slice data in the output */
+  const int oend = olength + (slices_per_frag?((n_slices + slices_per_frag - 1)/slices_per_frag)*25:0);
+
   uint16_t *codewords   = slices[0].codewords[0];
   uint8_t  *wordlengths = slices[0].wordlengths[0];
 
@@ -136,35 +218,13 @@ template<class T> void serialise_slices(CodedSlice<T> *slices, int n_slices, cha
 #endif
       }
 
-      accum = 0;
-      for (int n = 0; n < slices[N].samples[c]; n++) {
-        int l = wordlengths[n];
-        accum |= (((uint32_t)codewords[n]) << (32 - l - bits));
-        bits += l;
-
-        *((uint32_t *)&optr[ocounter]) = __builtin_bswap32(accum);
-        accum <<= (bits/8)*8;
-        ocounter += (bits/8);
-        bits%=8;
-      }
-
-      if (bits)
-        optr[ocounter++] = (accum >> 24) | (0xFF >> bits);
-      bits = 0;
-
-      for (int n = 0; n < p; n++) {
-        optr[ocounter++] = 0xFF;
-      }
+      if (slices[N].packed_coded)
+        ocounter = serialise_packed_slice_component(slices[N].packed[c], slices[N].length[c], p, optr, ocounter, oend);
+      else
+        ocounter = serialise_slice_component(codewords, wordlengths, slices[N].samples[c], slices[N].length[c], p, optr, ocounter, oend);
 
       codewords += n_samples;
       wordlengths += n_samples;
-
-#ifdef DEBUG
-      if (ocounter > olength) {
-        writelog(LOG_ERROR, "%s:%d:  coder overrun", __FILE__, __LINE__);
-        throw VC2ENCODER_CODEROVERRUN;
-      }
-#endif /* DEBUG */
     }
     remaining_length -= remaining_length/(n_slices - N);
   }
@@ -235,58 +295,19 @@ template<class T> void serialise_slices(CodedSlice<T> *slices, int n_slices, cha
         optr[ocounter++] = (uint8_t)((l + p)/slice_size_scalar);
       }
 
-      accum = 0;
-      for (int n = 0; n < slices[N].samples[c]; n++) {
-        int l = wordlengths[n];
-        accum |= (((uint32_t)codewords[n]) << (32 - l - bits));
-        bits += l;
-
-        if (bits >= 8) {
-          optr[ocounter++] = accum >> 24;
-          accum <<= 8;
-          bits -= 8;
-
-          if (bits >= 8) {
-            optr[ocounter++] = accum >> 24;
-            accum <<= 8;
-            bits -= 8;
-
-            if (bits >= 8) {
-              optr[ocounter++] = accum >> 24;
-              accum <<= 8;
-              bits -= 8;
-
-              if (bits >= 8) {
-                optr[ocounter++] = accum >> 24;
-                accum <<= 8;
-                bits -= 8;
-              }
-            }
-          }
-        }
-      }
-
-      if (bits)
-        optr[ocounter++] = (accum >> 24) | (0xFF >> bits);
-      bits = 0;
-
-      for (int n = 0; n < p; n++) {
-        optr[ocounter++] = 0xFF;
-      }
+      if (slices[N].packed_coded)
+        ocounter = serialise_packed_slice_component(slices[N].packed[c], slices[N].length[c], p, optr, ocounter, oend);
+      else
+        ocounter = serialise_slice_component(codewords, wordlengths, slices[N].samples[c], slices[N].length[c], p, optr, ocounter, oend);
 
       codewords += n_samples;
       wordlengths += n_samples;
-
-#ifdef DEBUG
-      if (ocounter > olength) {
-        writelog(LOG_ERROR, "%s:%d:  coder overrun", __FILE__, __LINE__);
-        throw VC2ENCODER_CODEROVERRUN;
-      }
-#endif /* DEBUG */
     }
   }
-  for (; ocounter < olength;)
-    optr[ocounter++] = 0xFF;
+  if (ocounter < olength) {
+    memset(&optr[ocounter], 0xFF, olength - ocounter);
+    ocounter = olength;
+  }
 
   if (slices_per_frag) {
     if (last_frag_start >= 0) {
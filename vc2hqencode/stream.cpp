@@ -231,6 +231,12 @@ SequenceHeader::SequenceHeader(VC2EncoderParams &params) {
   if (params.video_format.custom_signal_range_flag) {
     l += encode_bool(1, cw++, wl++);
     l += encode_uint(params.video_format.signal_range_index,  cw++, wl++);
+    if (params.video_format.signal_range_index == 0) {
+      l += encode_uint(params.video_format.luma_offset,          cw++, wl++);
+      l += encode_uint(params.video_format.luma_excursion,       cw++, wl++);
+      l += encode_uint(params.video_format.color_diff_offset,    cw++, wl++);
+      l += encode_uint(params.video_format.color_diff_excursion, cw++, wl++);
+    }
   } else {
     l += encode_bool(0, cw++, wl++);
   }
@@ -367,7 +373,7 @@ PictureHeader::PictureHeader(VC2EncoderParams &params, int slices_x, int slices_
   if (params.transform_params.custom_quant_matrix_flag) {
     l += encode_bool(1, cw++, wl++);
     l += encode_uint(params.transform_params.quant_matrix_LL, cw++, wl++);
-    for (int i = 0; i < (int)params.transform_params.wavelet_depth - 1; i++) {
+    for (int i = 0; i < (int)params.transform_params.wavelet_depth; i++) {
       l += encode_uint(params.transform_params.quant_matrix_HL[i], cw++, wl++);
       l += encode_uint(params.transform_params.quant_matrix_LH[i], cw++, wl++);
       l += encode_uint(params.transform_params.quant_matrix_HH[i], cw++, wl++);
@@ -46,21 +46,111 @@ typedef void (*InplaceTransformInitial)(const char *idata,
                                         const int owidth,
                                         const int oheight);
 
-typedef InplaceTransformInitial (*GetHTransformInitial)(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt);
+typedef InplaceTransformInitial (*GetHTransformInitial)(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix);
 typedef InplaceTransform (*GetVTransform)(int wavelet_index, int level, int coef_size, VC2EncoderInputFormat fmt);
 typedef InplaceTransform (*GetHTransform)(int wavelet_index, int level, int coef_size);
 
 /*
-   The needed overlap in job data to keep from getting artifacts for each transform and level
+   The coefficient from which the initial horizontal transforms pad position x >= iwidth of a row out to owidth, for coefficients skip apart. The low and
+   high pass coefficients of a row are mirrored about its last sample, as in the transform of the row extended symmetrically about that sample, so that the
+   padding does not change how the row decodes. Padding wider than the row folds back again from its start.
  */
-const int TRANSFORM_OVERLAP[][4] = {
-  {  4, 12, 28, 60 }, // VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7
-  {  2,  6, 14, 30 }, // VC2ENCODER_WFT_LEGALL_5_3
-  {  6, 18, 42, 90 }, // VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7
-  {  0,  0,  0,  0 }, // VC2ENCODER_WFT_HAAR_NO_SHIFT
-  {  0,  0,  0,  0 }, // VC2ENCODER_WFT_HAAR_SINGLE_SHIFT
-  {  0,  0,  0,  0 }, // VC2ENCODER_WFT_FIDELITY
-  {  0,  0,  0,  0 }, // VC2ENCODER_WFT_DAUBECHIES_9_7
+inline int transform_pad_source(int x, int iwidth, int skip) {
+  const int period = 2*(iwidth - skip);
+  const int r = x%period;
+  return (r < iwidth)?r:(period - r);
+}
+
+/*
+   The line from which the initial transforms pad line y >= iheight of a job out to oheight, for groups of lines skip high. The lines are mirrored about
+   the bottom edge of the picture, and padding taller than the picture, as in the last job of a deep transform, folds back again from its top rather than
+   reading above it.
+ */
+inline int transform_pad_line(int y, int iheight, int skip) {
+  const int period = 2*iheight;
+  const int r = y%period;
+  return (r < iheight)?r:(period - r - skip);
+}
+
+/*
+   The most active bits for which each transform and depth keeps sixteen bit coefficients. These come from the worst case growth of the transform: the
+   largest magnitude a coefficient, or a sum formed within a lifting stage, can reach is the sample magnitude 2^(active_bits - 1) times the sum of the
+   magnitudes of the weights by which it depends on the samples, including the shift of one bit a level. Sixteen bits suffice when that product stays below
+   2^15. The worst case comes only from pictures built to match the filters, but such pictures must not wrap. Fidelity has no transform and takes no entry.
+ */
+const int TRANSFORM_MAX_16BIT_ACTIVE_BITS[][MAX_DWT_DEPTH] = {
+  { 12, 11,  9,  8,  7,  6,  5,  4 }, // VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7
+  { 11, 10,  9,  8,  7,  6,  5,  4 }, // VC2ENCODER_WFT_LEGALL_5_3
+  { 12, 10,  9,  8,  7,  6,  5,  4 }, // VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7
+  { 13, 13, 13, 13, 13, 13, 13, 13 }, // VC2ENCODER_WFT_HAAR_NO_SHIFT
+  { 12, 11, 10,  9,  8,  7,  6,  5 }, // VC2ENCODER_WFT_HAAR_SINGLE_SHIFT
+  {  0,  0,  0,  0,  0,  0,  0,  0 }, // VC2ENCODER_WFT_FIDELITY
+  { 10,  9,  7,  6,  4,  2,  1,  0 }, // VC2ENCODER_WFT_DAUBECHIES_9_7
+};
+
+/*
+   The coefficient size, in bytes, for transforming samples of the given number of active bits to the given depth: sixteen bits wherever the worst case
+   above fits in them, and thirty-two bits otherwise.
+ */
+inline int transform_coef_size(int wavelet_index, int active_bits, int depth) {
+  if (depth == 0)
+    return 2;
+  return (active_bits <= TRANSFORM_MAX_16BIT_ACTIVE_BITS[wavelet_index][depth - 1])?2:4;
+}
+
+/*
+   The number of bits k for which every coefficient of the transform of samples of the given number of active bits has a magnitude below 2^k, from the
+   same worst case as the table above. An entry of T means that the worst case growth is less than 2^(16 - T), so samples of magnitude up to
+   2^(active_bits - 1) give coefficients below 2^(active_bits + 15 - T).
+ */
+inline int transform_coef_bits(int wavelet_index, int active_bits, int depth) {
+  if (depth == 0)
+    return active_bits;
+  return active_bits + 15 - TRANSFORM_MAX_16BIT_ACTIVE_BITS[wavelet_index][depth - 1];
+}
+
+/*
+   The matrix from full range R'G'B' samples of ACTIVE_BITS to video range Y'CbCr samples of the same depth, for the HDTV (Rec. 709) or SDTV (Rec. 601)
+   colour matrix, with the offset of 2^(ACTIVE_BITS - 1) that the encoder removes from every sample already taken off. The coefficients are fixed point
+   with RGB_MATRIX_SHIFT fractional bits and small enough to multiply sixteen bit samples pairwise. Each colour difference row sums to zero so that greys
+   have no colour.
+ */
+#define RGB_MATRIX_SHIFT 15
+
+template<int MATRIX, int ACTIVE_BITS> struct RGB_matrix {
+  static constexpr double KR = (MATRIX == VC2ENCODER_CMA_HDTV)?0.2126:0.299;
+  static constexpr double KB = (MATRIX == VC2ENCODER_CMA_HDTV)?0.0722:0.114;
+  static constexpr double KG = 1.0 - KR - KB;
+  static constexpr double SCALE = (double)(1 << RGB_MATRIX_SHIFT)/((1 << ACTIVE_BITS) - 1);
+  static constexpr double LUMA_EXCURSION       = 219 << (ACTIVE_BITS - 8);
+  static constexpr double COLOR_DIFF_EXCURSION = 224 << (ACTIVE_BITS - 8);
+
+  static const int32_t YR = (int32_t)(KR*LUMA_EXCURSION*SCALE + 0.5);
+  static const int32_t YB = (int32_t)(KB*LUMA_EXCURSION*SCALE + 0.5);
+  static const int32_t YG = (int32_t)(LUMA_EXCURSION*SCALE + 0.5) - YR - YB;
+  static const int32_t YK = ((16 << (ACTIVE_BITS - 8)) - (1 << (ACTIVE_BITS - 1)))*(1 << RGB_MATRIX_SHIFT) + (1 << (RGB_MATRIX_SHIFT - 1));
+
+  static const int32_t UR = -(int32_t)(KR/(2*(1 - KB))*COLOR_DIFF_EXCURSION*SCALE + 0.5);
+  static const int32_t UG = -(int32_t)(KG/(2*(1 - KB))*COLOR_DIFF_EXCURSION*SCALE + 0.5);
+  static const int32_t UB = -UR - UG;
+
+  static const int32_t VG = -(int32_t)(KG/(2*(1 - KR))*COLOR_DIFF_EXCURSION*SCALE + 0.5);
+  static const int32_t VB = -(int32_t)(KB/(2*(1 - KR))*COLOR_DIFF_EXCURSION*SCALE + 0.5);
+  static const int32_t VR = -VG - VB;
+};
+
+/*
+   The needed overlap in job data to keep from getting artifacts for each transform and level, which doubles with each level as the
+   support of the filter spans twice as many lines
+ */
+const int TRANSFORM_OVERLAP[][MAX_DWT_DEPTH] = {
+  {  4, 12, 28, 60, 124, 252, 508, 1020 }, // VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7
+  {  2,  6, 14, 30,  62, 126, 254,  510 }, // VC2ENCODER_WFT_LEGALL_5_3
+  {  6, 18, 42, 90, 186, 378, 762, 1530 }, // VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7
+  {  0,  0,  0,  0,   0,   0,   0,    0 }, // VC2ENCODER_WFT_HAAR_NO_SHIFT
+  {  0,  0,  0,  0,   0,   0,   0,    0 }, // VC2ENCODER_WFT_HAAR_SINGLE_SHIFT
+  {  0,  0,  0,  0,   0,   0,   0,    0 }, // VC2ENCODER_WFT_FIDELITY
+  {  4, 12, 28, 60, 124, 252, 508, 1020 }, // VC2ENCODER_WFT_DAUBECHIES_9_7
 };
 
 #endif /* __TRANSFORM_HPP__ */
@@ -143,6 +143,42 @@ VC2EncoderResult vc2encode_encode_fragmented_data(VC2EncoderHandle handle, char
   VC2ENCODER_END
 }
 
+VC2EncoderResult vc2encode_get_max_fixed_qindex_picture_size(VC2EncoderHandle handle, uint32_t *size) {
+  VC2ENCODER_BEGIN
+
+  *size = encoder->getMaxFixedQindexPictureSize();
+  return VC2ENCODER_OK;
+
+  VC2ENCODER_END
+}
+
+VC2EncoderResult vc2encode_encode_fixed_qindex_picture(VC2EncoderHandle handle, char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, uint32_t *length, uint32_t *next_parse_offset) {
+  VC2ENCODER_BEGIN
+
+  *length = encoder->encodeFixedQindexPicture(idata, istride, odata, prev_parse_offset, picture_number, next_parse_offset);
+  return VC2ENCODER_OK;
+
+  VC2ENCODER_END
+}
+
+VC2EncoderResult vc2encode_get_max_rate_controlled_picture_size(VC2EncoderHandle handle, int data_length, uint32_t *size) {
+  VC2ENCODER_BEGIN
+
+  *size = encoder->getMaxRateControlledPictureSize(data_length);
+  return VC2ENCODER_OK;
+
+  VC2ENCODER_END
+}
+
+VC2EncoderResult vc2encode_encode_rate_controlled_picture(VC2EncoderHandle handle, char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, int data_length, uint32_t *length, uint32_t *next_parse_offset) {
+  VC2ENCODER_BEGIN
+
+  *length = encoder->encodeRateControlledPicture(idata, istride, odata, prev_parse_offset, picture_number, data_length, next_parse_offset);
+  return VC2ENCODER_OK;
+
+  VC2ENCODER_END
+}
+
 VC2EncoderResult vc2encode_get_auxiliary_data_start_size(VC2EncoderHandle handle, uint32_t *size) {
    VC2ENCODER_BEGIN
 
@@ -66,9 +66,26 @@ extern "C" {
 
 typedef void * VC2EncoderHandle;
 
+/*
+ Planar and semi-planar input is given as a pointer and a stride in 16 bit words for each plane (the Cb Cr plane of
+ P210 and P010 as the second, and 8 bit planar strides in bytes), packed input as a single pointer and a stride in bytes.
+ The 8 bit formats signal the 8 bit video signal range unless a custom signal range is given.
+ RGB input is coded as RGB when the colour matrix is VC2ENCODER_CMA_RGB (4:4:4 only), and otherwise converted to video range
+ Y'CbCr with the HDTV or SDTV matrix, and filtered to 4:2:2 if that is the chroma format, as it is loaded.
+ */
 typedef enum _VC2EncoderInputFormat {
-  VC2ENCODER_INPUT_10P2 = 0,
-  VC2ENCODER_INPUT_V210 = 1
+  VC2ENCODER_INPUT_10P2   = 0, /* Planar, each sample in the low bits of a 16 bit word: 8, 10, 12 or 16 active bits as given by the signal range */
+  VC2ENCODER_INPUT_V210   = 1, /* 10 bit 4:2:2 packed as V210 */
+  VC2ENCODER_INPUT_UYVY10 = 2, /* 10 bit 4:2:2 as 16 bit words of Cb Y Cr Y, each sample in the low bits */
+  VC2ENCODER_INPUT_P210   = 3, /* 4:2:2 as a Y plane and an interleaved Cb Cr plane, each sample in the high bits of a 16 bit word: 10, 12 or 16 active bits */
+  VC2ENCODER_INPUT_P010   = 4, /* 4:2:0 laid out as P210 */
+  VC2ENCODER_INPUT_V410   = 5, /* 10 bit 4:4:4 packed as v410, Cb Y Cr in the top 30 bits of a 32 bit word */
+  VC2ENCODER_INPUT_Y416   = 6, /* 4:4:4 packed as Y416, 16 bit words of Cb Y Cr A, each sample in the high bits: 10, 12 or 16 active bits */
+  VC2ENCODER_INPUT_8P2    = 7, /* 8 bit planar, a byte for each sample */
+  VC2ENCODER_INPUT_UYVY   = 8, /* 8 bit 4:2:2 as bytes of Cb Y Cr Y */
+  VC2ENCODER_INPUT_YUY2   = 9, /* 8 bit 4:2:2 as bytes of Y Cb Y Cr */
+  VC2ENCODER_INPUT_X2RGB10 = 10, /* 10 bit full range RGB as x2rgb10, B G R from the low bits of a 32 bit word */
+  VC2ENCODER_INPUT_BGRA    = 11  /* 8 bit full range RGB as bytes of B G R A */
 } VC2EncoderInputFormat;
 
 enum _VC2EncoderBaseVideoFormat {
@@ -224,8 +241,19 @@ typedef struct _VC2EncoderVideoFormat {
 
   int custom_transfer_function_flag;
   uint32_t transfer_function_index;
+
+  uint32_t luma_offset;          /* The custom signal range, used when signal_range_index is VC2ENCODER_PSR_CUSTOM */
+  uint32_t luma_excursion;
+  uint32_t color_diff_offset;
+  uint32_t color_diff_excursion;
 } VC2EncoderVideoFormat;
 
+/*
+   The slices of a VC-2 picture divide it evenly, so when slice_width and slice_height do not divide the picture (padded to a multiple of 2^wavelet_depth) the
+   encoder codes a larger frame: the frame dimensions in the sequence header are enlarged to a whole number of slices across and down, and the picture becomes
+   its clean area, unless a clean area was given, which is kept. The input is still the size of the original picture, and the extra samples are filled in
+   from its edges. Decoders which ignore the clean area show the enlarged frame. vc2encode_get_parameters returns the enlarged dimensions and the clean area.
+ */
 typedef struct _VC2EncoderTransformParams {
   uint32_t wavelet_index;
   uint32_t wavelet_depth;
@@ -246,7 +274,8 @@ enum _VC2EncoderSpeed {
   VC2ENCODER_SPEED_MEDIUM  = 3,
   VC2ENCODER_SPEED_FAST    = 4,
   VC2ENCODER_SPEED_FASTER  = 5,
-  VC2ENCODER_SPEED_FASTEST = 6
+  VC2ENCODER_SPEED_FASTEST = 6,
+  VC2ENCODER_SPEED_RDO     = 7  /* Picture-wide rate-distortion optimised quantisers */
 };
 
 typedef struct _VC2EncoderParams {
@@ -261,6 +290,14 @@ typedef struct _VC2EncoderParams {
   int fragment_size;
 
   VC2EncoderInputFormat input_format;
+
+  int fixed_qindex_flag;
+  int fixed_qindex;
+
+  int lossless_flag;
+
+  int rate_control_flag;
+  int rate_control_buffer_size;
 } VC2EncoderParams;
 
 enum _VC2EncoderEndianness {
@@ -319,6 +356,32 @@ VC2HQENCODE_API VC2EncoderResult vc2encode_start_picture(VC2EncoderHandle handle
 VC2HQENCODE_API VC2EncoderResult vc2encode_get_fragment_headers_for_picture_size(VC2EncoderHandle, uint32_t length, uint32_t *size);
 VC2HQENCODE_API VC2EncoderResult vc2encode_encode_data(VC2EncoderHandle, char **idata, int *istride, char **odata, int length);
 VC2HQENCODE_API VC2EncoderResult vc2encode_encode_fragmented_data(VC2EncoderHandle, char **idata, int *istride, char **odata, int length, uint32_t prev_parse_offset, uint32_t *next_parse_offset);
+
+/*
+   With fixed_qindex_flag set in the parameters every slice is coded at fixed_qindex, which must be from 0 to 64, with no search for quantisers, and pictures are of
+   whatever length that gives. The slice size scalar is chosen to be large enough for any slice. Such pictures are coded by vc2encode_encode_fixed_qindex_picture in
+   place of vc2encode_start_picture and vc2encode_encode_data, which writes the picture header and data together and returns the length written. The output must
+   have room for the size given by vc2encode_get_max_fixed_qindex_picture_size.
+ */
+VC2HQENCODE_API VC2EncoderResult vc2encode_get_max_fixed_qindex_picture_size(VC2EncoderHandle, uint32_t *size);
+VC2HQENCODE_API VC2EncoderResult vc2encode_encode_fixed_qindex_picture(VC2EncoderHandle, char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, uint32_t *length, uint32_t *next_parse_offset);
+
+/*
+   With lossless_flag set in the parameters pictures are coded mathematically losslessly, every slice at qindex 0 with no quantisation, and the encoder acts as
+   though fixed_qindex_flag were set with a fixed_qindex of 0, so pictures are coded by vc2encode_encode_fixed_qindex_picture. Only the LeGall and Haar wavelets
+   are supported, and the slice size scalar is chosen to be large enough for any slice, so the maximum picture size can be well above that of other pictures.
+ */
+
+/*
+   With rate_control_flag set in the parameters the lengths of pictures vary with their content about a mean of data_length, as allowed by a virtual buffer of
+   rate_control_buffer_size bytes drained by data_length bytes each picture, such as a decoder fed at a constant rate would need. The buffer is taken to start half
+   full, and no picture makes it overflow or run dry. Such pictures are coded by vc2encode_encode_rate_controlled_picture in place of vc2encode_start_picture and
+   vc2encode_encode_data, which writes the picture header and data together and returns the length written. The output must have room for the size given by
+   vc2encode_get_max_rate_controlled_picture_size.
+ */
+VC2HQENCODE_API VC2EncoderResult vc2encode_get_max_rate_controlled_picture_size(VC2EncoderHandle, int data_length, uint32_t *size);
+VC2HQENCODE_API VC2EncoderResult vc2encode_encode_rate_controlled_picture(VC2EncoderHandle, char **idata, int *istride, char **odata, uint32_t prev_parse_offset, uint32_t picture_number, int data_length, uint32_t *length, uint32_t *next_parse_offset);
+
 VC2HQENCODE_API VC2EncoderResult vc2encode_get_auxiliary_data_start_size(VC2EncoderHandle, uint32_t *size);
 VC2HQENCODE_API VC2EncoderResult vc2encode_start_auxiliary_data(VC2EncoderHandle handle, char **data, uint32_t prev_parse_offset, int data_length, uint32_t *next_parse_offset);
 VC2HQENCODE_API VC2EncoderResult vc2encode_get_sequence_end_size(VC2EncoderHandle, uint32_t *size);
@@ -31,30 +31,65 @@
 #include "transform_avx.hpp"
 #include "transform_kernels.hpp"
 
-InplaceTransformInitial get_htransforminitial_avx(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt) {
+template<int ACTIVE_BITS> static InplaceTransformInitial get_htransforminitial_10P2_avx_int16_t(int wavelet_index) {
+  switch (wavelet_index) {
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    return LeGall_5_3_transform_H_inplace_10P2_sse4_2_avx<ACTIVE_BITS>;
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2_avx<ACTIVE_BITS, 0, int16_t>;
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2_avx<ACTIVE_BITS, 1, int16_t>;
+  }
+  return NULL;
+}
+
+template<int ACTIVE_BITS> static InplaceTransformInitial get_htransforminitial_10P2_avx_int32_t(int wavelet_index) {
+  switch (wavelet_index) {
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    return LeGall_5_3_transform_H_inplace_10P2_sse4_2_avx_int32_t<ACTIVE_BITS>;
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2_avx<ACTIVE_BITS, 0, int32_t>;
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2_avx<ACTIVE_BITS, 1, int32_t>;
+  }
+  return NULL;
+}
+
+InplaceTransformInitial get_htransforminitial_avx(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix) {
   (void) c;
   if (fmt == VC2ENCODER_INPUT_10P2) {
-    if (active_bits != 10) {
-      writelog(LOG_ERROR, "%s:%d:  invalid bit depth", __FILE__, __LINE__);
-      throw VC2ENCODER_NOTIMPLEMENTED;
-    }
-
+    InplaceTransformInitial r = NULL;
     if (coef_size == 2) {
-      switch (wavelet_index) {
-      case VC2ENCODER_WFT_LEGALL_5_3:
-        return LeGall_5_3_transform_H_inplace_10P2_sse4_2_avx;
-      case VC2ENCODER_WFT_HAAR_NO_SHIFT:
-        return Haar_transform_H_inplace_10P2_sse4_2_avx<0, int16_t>;
-      case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
-        return Haar_transform_H_inplace_10P2_sse4_2_avx<1, int16_t>;
+      switch (active_bits) {
+      case 8:
+        r = get_htransforminitial_10P2_avx_int16_t<8>(wavelet_index);
+        break;
+      case 10:
+        r = get_htransforminitial_10P2_avx_int16_t<10>(wavelet_index);
+        break;
+      case 12:
+        r = get_htransforminitial_10P2_avx_int16_t<12>(wavelet_index);
+        break;
       }
     } else if (coef_size == 4) {
-      switch (wavelet_index) {
-      case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
-        return Haar_transform_H_inplace_10P2_sse4_2_avx<1, int32_t>;
+      switch (active_bits) {
+      case 8:
+        r = get_htransforminitial_10P2_avx_int32_t<8>(wavelet_index);
+        break;
+      case 10:
+        r = get_htransforminitial_10P2_avx_int32_t<10>(wavelet_index);
+        break;
+      case 12:
+        r = get_htransforminitial_10P2_avx_int32_t<12>(wavelet_index);
+        break;
+      case 16:
+        r = get_htransforminitial_10P2_avx_int32_t<16>(wavelet_index);
+        break;
       }
     }
-  } else if (fmt == VC2ENCODER_INPUT_V210) {
+    if (r)
+      return r;
+  } else if (fmt == VC2ENCODER_INPUT_V210 && active_bits == 10) {
     if (c != 0)
       return NULL;
 
@@ -70,7 +105,7 @@ InplaceTransformInitial get_htransforminitial_avx(int wavelet_index, int active_
     }
   }
 
-  return get_htransforminitial_sse4_2(wavelet_index, active_bits, coef_size, c, fmt);
+  return get_htransforminitial_sse4_2(wavelet_index, active_bits, coef_size, c, fmt, color_diff_format, color_matrix);
 }
 
 InplaceTransform get_htransform_avx(int wavelet_index, int level, int coef_size) {
@@ -95,6 +130,55 @@ InplaceTransform get_htransform_avx(int wavelet_index, int level, int coef_size)
       }
       break;
     }
+  } else if (coef_size == 4) {
+    switch (wavelet_index) {
+    case VC2ENCODER_WFT_LEGALL_5_3:
+      switch (level) {
+      case 0:
+        return LeGall_5_3_transform_H_inplace_sse4_2_avx_int32_t<1>;
+      }
+      break;
+    case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+      switch (level) {
+      case 0:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<1,0>;
+      case 1:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<2,0>;
+      case 2:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<4,0>;
+      case 3:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<8,0>;
+      case 4:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<16,0>;
+      case 5:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<32,0>;
+      case 6:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<64,0>;
+      case 7:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<128,0>;
+      }
+      break;
+    case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+      switch (level) {
+      case 0:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<1,1>;
+      case 1:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<2,1>;
+      case 2:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<4,1>;
+      case 3:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<8,1>;
+      case 4:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<16,1>;
+      case 5:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<32,1>;
+      case 6:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<64,1>;
+      case 7:
+        return Haar_transform_H_inplace_sse4_2_avx_int32_t<128,1>;
+      }
+      break;
+    }
   }
 
   return get_htransform_sse4_2(wavelet_index, level, coef_size);
@@ -130,6 +214,26 @@ InplaceTransform get_vtransform_avx(int wavelet_index, int level, int coef_size,
     }
   } else if (coef_size == 4) {
     switch (wavelet_index) {
+    case VC2ENCODER_WFT_LEGALL_5_3:
+      switch (level) {
+      case 0:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<1>;
+      case 1:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<2>;
+      case 2:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<4>;
+      case 3:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<8>;
+      case 4:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<16>;
+      case 5:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<32>;
+      case 6:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<64>;
+      case 7:
+        return LeGall_5_3_transform_V_inplace_sse4_2_avx_int32_t<128>;
+      }
+      break;
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
     case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
       switch (level) {
@@ -138,6 +242,12 @@ InplaceTransform get_vtransform_avx(int wavelet_index, int level, int coef_size,
           return NULL;
         else
           return Haar_transform_V_inplace_sse4_2_avx<1, int32_t>;
+      case 1:
+        return Haar_transform_V_inplace_sse4_2_avx<2, int32_t>;
+      case 2:
+        return Haar_transform_V_inplace_sse4_2_avx<4, int32_t>;
+      case 3:
+        return Haar_transform_V_inplace_sse4_2_avx<8, int32_t>;
       }
       break;
     }
@@ -0,0 +1,197 @@
+/*****************************************************************************
+ * daubechies_9_7_transform.hpp : Daubechies 9,7 transform: AVX2 version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+#include <x86intrin.h>
+
+/* A 256-bit version of Daubechies_9_7_transform_V_inplace_sse4_2, see there
+   for the lifting arithmetic. Any columns left over after the last full
+   256-bit block are handed to the 128-bit version. */
+template<int skip> void Daubechies_9_7_transform_V_inplace_avx2(void *_idata,
+                                                                const int istride,
+                                                                const int width,
+                                                                const int height,
+                                                                const int) {
+  int16_t *idata = (int16_t *)_idata;
+  const __m256i W6497 = _mm256_set1_epi16(2401*8);
+  const __m256i W217  = _mm256_set1_epi16( 217*8);
+  const __m256i W3616 = _mm256_set1_epi16(3616*8);
+  const __m256i W1817 = _mm256_set1_epi16(1817*8);
+  const int BLENDMASK = (skip == 1)?0x00:((skip == 2)?0xAA:((skip == 4)?0xEE:0xFE));
+  const int xskip = (skip > 16)?skip:16;
+  const int vwidth = width/xskip*xskip;
+
+#define BLEND_FOR_WRITE(A,B) ((skip == 1)?(A):_mm256_blend_epi16(A,B,BLENDMASK))
+#define ROW(K,P) (idata + (2*(K) + (P))*skip*istride)
+
+  const int N = height/(2*skip);
+
+  for (int k = 0; k <= N; k++) {
+    const int16_t *Ep1 = ROW((k + 1 < N)?(k + 1):(N - 1), 0);
+    int16_t *E0  = ROW((k < N)?k:(N - 1), 0);
+    int16_t *O0  = ROW((k < N)?k:(N - 1), 1);
+    int16_t *Om1 = ROW((k > 0)?(k - 1):0, 1);
+    int16_t *Em1 = ROW((k > 0)?(k - 1):0, 0);
+    int16_t *Om2 = ROW((k > 1)?(k - 2):0, 1);
+
+    for (int x = 0; x < vwidth; x += xskip) {
+      __m256i E, Ep, O, Om, Eo, Oo, Omm, S;
+
+      Om  = _mm256_loadu_si256((__m256i *)&Om1[x]);
+      if (k < N) {
+        E   = _mm256_loadu_si256((__m256i *)&E0[x]);
+        Ep  = _mm256_loadu_si256((__m256i *)&Ep1[x]);
+        O   = _mm256_loadu_si256((__m256i *)&O0[x]);
+        Eo  = E;
+        Oo  = O;
+
+        S   = _mm256_add_epi16(E, Ep);
+        S   = _mm256_add_epi16(S, _mm256_mulhrs_epi16(S, W6497));
+        O   = _mm256_sub_epi16(O, S);
+
+        if (k == 0)
+          Om = O;
+        S   = _mm256_add_epi16(Om, O);
+        E   = _mm256_sub_epi16(E, _mm256_mulhrs_epi16(S, W217));
+
+        _mm256_storeu_si256((__m256i *)&O0[x], BLEND_FOR_WRITE(O, Oo));
+        _mm256_storeu_si256((__m256i *)&E0[x], BLEND_FOR_WRITE(E, Eo));
+      } else {
+        E   = _mm256_loadu_si256((__m256i *)&Em1[x]);
+      }
+
+      if (k > 0) {
+        __m256i Em = _mm256_loadu_si256((__m256i *)&Em1[x]);
+        Eo  = Em;
+        Oo  = Om;
+
+        S   = _mm256_add_epi16(Em, E);
+        Om  = _mm256_add_epi16(Om, _mm256_mulhrs_epi16(S, W3616));
+
+        Omm = (k > 1)?_mm256_loadu_si256((__m256i *)&Om2[x]):Om;
+        S   = _mm256_add_epi16(Omm, Om);
+        Em  = _mm256_add_epi16(Em, _mm256_mulhrs_epi16(S, W1817));
+
+        _mm256_storeu_si256((__m256i *)&Om1[x], BLEND_FOR_WRITE(Om, Oo));
+        _mm256_storeu_si256((__m256i *)&Em1[x], BLEND_FOR_WRITE(Em, Eo));
+      }
+    }
+  }
+
+#undef ROW
+#undef BLEND_FOR_WRITE
+
+  if (vwidth < width)
+    Daubechies_9_7_transform_V_inplace_sse4_2_avx2<skip>(idata + vwidth, istride, width - vwidth, height, 0);
+}
+
+/* A 256-bit version of Daubechies_9_7_product_sse4_2_int32_t */
+static inline __m256i Daubechies_9_7_product_avx2_int32_t(const __m256i S, const __m256i W) {
+  const __m256i ROUND = _mm256_set1_epi64x(2048);
+  const __m256i Pe = _mm256_add_epi64(_mm256_mul_epi32(S, W), ROUND);
+  const __m256i Po = _mm256_add_epi64(_mm256_mul_epi32(_mm256_srli_epi64(S, 32), W), ROUND);
+  return _mm256_blend_epi32(_mm256_srli_epi64(Pe, 12), _mm256_slli_epi64(Po, 20), 0xAA);
+}
+
+/* A 256-bit version of Daubechies_9_7_transform_V_inplace_sse4_2_int32_t. Any
+   columns left over after the last full 256-bit block are handed to the
+   128-bit version. */
+template<int skip> void Daubechies_9_7_transform_V_inplace_avx2_int32_t(void *_idata,
+                                                                        const int istride,
+                                                                        const int width,
+                                                                        const int height,
+                                                                        const int) {
+  int32_t *idata = (int32_t *)_idata;
+  const __m256i W6497 = _mm256_set1_epi32(6497);
+  const __m256i W217  = _mm256_set1_epi32( 217);
+  const __m256i W3616 = _mm256_set1_epi32(3616);
+  const __m256i W1817 = _mm256_set1_epi32(1817);
+  const int BLENDMASK = (skip == 1)?0x00:((skip == 2)?0xAA:((skip == 4)?0xEE:0xFE));
+  const int xskip = (skip > 8)?skip:8;
+  const int vwidth = width/xskip*xskip;
+
+#define BLEND_FOR_WRITE(A,B) ((skip == 1)?(A):_mm256_blend_epi32(A,B,BLENDMASK))
+#define ROW(K,P) (idata + (2*(K) + (P))*skip*istride)
+
+  const int N = height/(2*skip);
+
+  for (int k = 0; k <= N; k++) {
+    const int32_t *Ep1 = ROW((k + 1 < N)?(k + 1):(N - 1), 0);
+    int32_t *E0  = ROW((k < N)?k:(N - 1), 0);
+    int32_t *O0  = ROW((k < N)?k:(N - 1), 1);
+    int32_t *Om1 = ROW((k > 0)?(k - 1):0, 1);
+    int32_t *Em1 = ROW((k > 0)?(k - 1):0, 0);
+    int32_t *Om2 = ROW((k > 1)?(k - 2):0, 1);
+
+    for (int x = 0; x < vwidth; x += xskip) {
+      __m256i E, Ep, O, Om, Eo, Oo, Omm, S;
+
+      Om  = _mm256_loadu_si256((__m256i *)&Om1[x]);
+      if (k < N) {
+        E   = _mm256_loadu_si256((__m256i *)&E0[x]);
+        Ep  = _mm256_loadu_si256((__m256i *)&Ep1[x]);
+        O   = _mm256_loadu_si256((__m256i *)&O0[x]);
+        Eo  = E;
+        Oo  = O;
+
+        S   = _mm256_add_epi32(E, Ep);
+        O   = _mm256_sub_epi32(O, Daubechies_9_7_product_avx2_int32_t(S, W6497));
+
+        if (k == 0)
+          Om = O;
+        S   = _mm256_add_epi32(Om, O);
+        E   = _mm256_sub_epi32(E, Daubechies_9_7_product_avx2_int32_t(S, W217));
+
+        _mm256_storeu_si256((__m256i *)&O0[x], BLEND_FOR_WRITE(O, Oo));
+        _mm256_storeu_si256((__m256i *)&E0[x], BLEND_FOR_WRITE(E, Eo));
+      } else {
+        E   = _mm256_loadu_si256((__m256i *)&Em1[x]);
+      }
+
+      if (k > 0) {
+        __m256i Em = _mm256_loadu_si256((__m256i *)&Em1[x]);
+        Eo  = Em;
+        Oo  = Om;
+
+        S   = _mm256_add_epi32(Em, E);
+        Om  = _mm256_add_epi32(Om, Daubechies_9_7_product_avx2_int32_t(S, W3616));
+
+        Omm = (k > 1)?_mm256_loadu_si256((__m256i *)&Om2[x]):Om;
+        S   = _mm256_add_epi32(Omm, Om);
+        Em  = _mm256_add_epi32(Em, Daubechies_9_7_product_avx2_int32_t(S, W1817));
+
+        _mm256_storeu_si256((__m256i *)&Om1[x], BLEND_FOR_WRITE(Om, Oo));
+        _mm256_storeu_si256((__m256i *)&Em1[x], BLEND_FOR_WRITE(Em, Eo));
+      }
+    }
+  }
+
+#undef ROW
+#undef BLEND_FOR_WRITE
+
+  if (vwidth < width)
+    Daubechies_9_7_transform_V_inplace_sse4_2_avx2_int32_t<skip>(idata + vwidth, istride, width - vwidth, height, 0);
+}
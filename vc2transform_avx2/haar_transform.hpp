@@ -27,28 +27,19 @@
 #include <string.h>
 #include <x86intrin.h>
 
-template<int shift, class T> void Haar_transform_H_inplace_10P2_avx2(const char *_idata,
-                                                                      const int istride,
-                                                                      void **_odata,
-                                                                      const int ostride,
-                                                                      const int iwidth,
-                                                                      const int iheight,
-                                                                      const int owidth,
-                                                                      const int oheight);
-
-template<> void Haar_transform_H_inplace_10P2_avx2<0,int16_t>(const char *_idata,
-                                                               const int istride,
-                                                               void **_odata,
-                                                               const int ostride,
-                                                               const int iwidth,
-                                                               const int iheight,
-                                                               const int owidth,
-                                                               const int oheight){
+template<int ACTIVE_BITS, int shift> void Haar_transform_H_inplace_10P2_avx2(const char *_idata,
+                                                                              const int istride,
+                                                                              void **_odata,
+                                                                              const int ostride,
+                                                                              const int iwidth,
+                                                                              const int iheight,
+                                                                              const int owidth,
+                                                                              const int oheight){
   int16_t *odata = *((int16_t **)_odata);
   const int skip = 1;
 
   const uint16_t *idata = (const uint16_t *)_idata;
-  const __m256i OFFSET = _mm256_set1_epi16(1 << 9);
+  const __m256i OFFSET = _mm256_set1_epi16((int16_t)(1 << (ACTIVE_BITS - 1)));
   const __m256i ONE    = _mm256_set1_epi16(1);
   const __m256i SHUF   = _mm256_set_epi8(31, 30, 27, 26, 23, 22, 19, 18,
                                          29, 28, 25, 24, 21, 20, 17, 16,
@@ -58,7 +49,7 @@ template<> void Haar_transform_H_inplace_10P2_avx2<0,int16_t>(const char *_idata
   int y = 0;
   for (; y < iheight; y+=2*skip) {
     int x = 0;
-    for (; x < iwidth; x += 32) {
+    for (; x + 32 <= iwidth; x += 32) {
       __m256i ZA0, ZA8, ZB0, ZB8;
       {
         __m256i D0  = _mm256_loadu_si256((__m256i *)&idata[y*istride + x +  0]);
@@ -67,6 +58,9 @@ template<> void Haar_transform_H_inplace_10P2_avx2<0,int16_t>(const char *_idata
         D0  = _mm256_sub_epi16(D0, OFFSET);
         D16 = _mm256_sub_epi16(D16, OFFSET);
 
+        D0  = _mm256_slli_epi16(D0, shift);
+        D16 = _mm256_slli_epi16(D16, shift);
+
         D0  = _mm256_shuffle_epi8(D0,  SHUF);
         D16 = _mm256_shuffle_epi8(D16, SHUF);
 
@@ -93,6 +87,9 @@ template<> void Haar_transform_H_inplace_10P2_avx2<0,int16_t>(const char *_idata
         D0  = _mm256_sub_epi16(D0, OFFSET);
         D16 = _mm256_sub_epi16(D16, OFFSET);
 
+        D0  = _mm256_slli_epi16(D0, shift);
+        D16 = _mm256_slli_epi16(D16, shift);
+
         D0  = _mm256_shuffle_epi8(D0,  SHUF);
         D16 = _mm256_shuffle_epi8(D16, SHUF);
 
@@ -128,15 +125,32 @@ template<> void Haar_transform_H_inplace_10P2_avx2<0,int16_t>(const char *_idata
         _mm256_store_si256((__m256i *)&odata[(y + 1)*ostride + x + 16], X1);
       }
     }
+    /* Widths which are not a multiple of thirty-two finish the pair of lines a pair of samples at a time */
+    for (; x < iwidth; x += 2) {
+      const int32_t A0 = (((int32_t)idata[(y + 0)*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t A1 = (((int32_t)idata[(y + 0)*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t B0 = (((int32_t)idata[(y + 1)*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t B1 = (((int32_t)idata[(y + 1)*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << shift;
+
+      const int32_t AH = A1 - A0;
+      const int32_t AL = A0 + ((AH + 1) >> 1);
+      const int32_t BH = B1 - B0;
+      const int32_t BL = B0 + ((BH + 1) >> 1);
+
+      odata[(y + 0)*ostride + x + 0] = AL + ((BL - AL + 1) >> 1);
+      odata[(y + 0)*ostride + x + 1] = AH + ((BH - AH + 1) >> 1);
+      odata[(y + 1)*ostride + x + 0] = BL - AL;
+      odata[(y + 1)*ostride + x + 1] = BH - AH;
+    }
     for (; x < owidth; x += 2*skip) {
-      odata[(y + 0)*ostride + x + 0*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 0)*ostride + x + 1*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
-      odata[(y + 1)*ostride + x + 0*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 1)*ostride + x + 1*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata[(y + 0)*ostride + x + 0*skip] = odata[(y + 0)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[(y + 0)*ostride + x + 1*skip] = odata[(y + 0)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+      odata[(y + 1)*ostride + x + 0*skip] = odata[(y + 1)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[(y + 1)*ostride + x + 1*skip] = odata[(y + 1)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
     }
   }
   for (; y < oheight; y+=2*skip) {
-    memcpy(&odata[(y + 0)*ostride], &odata[(2*iheight - y - 2*skip)*ostride], owidth);
-    memcpy(&odata[(y + 1)*ostride], &odata[(2*iheight - y - 1*skip)*ostride], owidth);
+    memcpy(&odata[(y + 0)*ostride], &odata[transform_pad_line(y, iheight, 2*skip)*ostride], owidth*2);
+    memcpy(&odata[(y + 1)*ostride], &odata[(transform_pad_line(y, iheight, 2*skip) + skip)*ostride], owidth*2);
   }
 }
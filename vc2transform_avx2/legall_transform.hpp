@@ -0,0 +1,98 @@
+/*****************************************************************************
+ * legall_transform.hpp : LeGall 5,3 transform: AVX2 version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+#include <x86intrin.h>
+
+/* A 256-bit version of LeGall_5_3_transform_V_inplace_sse4_2_int32_t. Any
+   columns left over after the last full 256-bit block are handed to the
+   128-bit version. */
+template<int skip> void LeGall_5_3_transform_V_inplace_avx2_int32_t(void *_idata,
+                                                                  const int istride,
+                                                                  const int width,
+                                                                  const int height,
+                                                                  const int) {
+  int32_t *idata = (int32_t *)_idata;
+  const __m256i ONE = _mm256_set1_epi32(1);
+  const __m256i TWO = _mm256_set1_epi32(2);
+  const int BLENDMASK = (skip == 1)?0x00:((skip == 2)?0xAA:((skip == 4)?0xEE:0xFE));
+  const int xskip = (skip > 8)?skip:8;
+  const int vwidth = width/xskip*xskip;
+
+#define BLEND_FOR_WRITE(A,B) ((skip == 1)?(A):_mm256_blend_epi32(A,B,BLENDMASK))
+
+  __m256i D, Dp1, Dp2;
+  int y = 0;
+  int x = 0;
+  __m256i Xm1, X, Xp1;
+
+  for (int XX = 0; XX < vwidth; XX += 512) {
+    y = 0;
+    for (x = XX; x < vwidth && x < XX + 512; x+=xskip) {
+      D   = _mm256_loadu_si256((__m256i *)&idata[(y + 0*skip)*istride + x]);
+      Dp1 = _mm256_loadu_si256((__m256i *)&idata[(y + 1*skip)*istride + x]);
+      Dp2 = _mm256_loadu_si256((__m256i *)&idata[(y + 2*skip)*istride + x]);
+
+      Xp1 = _mm256_sub_epi32(Dp1, _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(D,   Dp2), ONE), 1));
+      Xm1 = Xp1;
+      X   = _mm256_add_epi32(D,   _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(Xm1, Xp1) ,TWO), 2));
+      _mm256_storeu_si256((__m256i*)&idata[(y + 0*skip)*istride + x], BLEND_FOR_WRITE(X,   D));
+      _mm256_storeu_si256((__m256i*)&idata[(y + 1*skip)*istride + x], BLEND_FOR_WRITE(Xp1, Dp1));
+    }
+    y += 2*skip;
+
+    for (; y < height - 2*skip; y += 2*skip) {
+      for (x = XX; x < vwidth && x < XX + 512; x+=xskip) {
+        D   = _mm256_loadu_si256((__m256i *)&idata[(y + 0*skip)*istride + x]);
+        Dp1 = _mm256_loadu_si256((__m256i *)&idata[(y + 1*skip)*istride + x]);
+        Dp2 = _mm256_loadu_si256((__m256i *)&idata[(y + 2*skip)*istride + x]);
+
+        Xp1 = _mm256_sub_epi32(Dp1, _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(D,   Dp2), ONE), 1));
+        Xm1 = _mm256_loadu_si256((__m256i *)&idata[(y - 1*skip)*istride + x]);
+        X   = _mm256_add_epi32(D,   _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(Xm1, Xp1) ,TWO), 2));
+        _mm256_storeu_si256((__m256i*)&idata[(y + 0*skip)*istride + x], BLEND_FOR_WRITE(X,   D));
+        _mm256_storeu_si256((__m256i*)&idata[(y + 1*skip)*istride + x], BLEND_FOR_WRITE(Xp1, Dp1));
+      }
+    }
+
+    for (x = XX; x < vwidth && x < XX + 512; x+=xskip) {
+      D   = _mm256_loadu_si256((__m256i *)&idata[(y + 0*skip)*istride + x]);
+      Dp1 = _mm256_loadu_si256((__m256i *)&idata[(y + 1*skip)*istride + x]);
+      Dp2 = D;
+
+      Xp1 = _mm256_sub_epi32(Dp1, _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(D,   Dp2), ONE), 1));
+      Xm1 = _mm256_loadu_si256((__m256i *)&idata[(y - 1*skip)*istride + x]);
+      X   = _mm256_add_epi32(D,   _mm256_srai_epi32(_mm256_add_epi32(_mm256_add_epi32(Xm1, Xp1) ,TWO), 2));
+      _mm256_storeu_si256((__m256i*)&idata[(y + 0*skip)*istride + x], BLEND_FOR_WRITE(X,   D));
+      _mm256_storeu_si256((__m256i*)&idata[(y + 1*skip)*istride + x], BLEND_FOR_WRITE(Xp1, Dp1));
+    }
+  }
+
+#undef BLEND_FOR_WRITE
+
+  if (vwidth < width)
+    LeGall_5_3_transform_V_inplace_sse4_2_avx2_int32_t<skip>(idata + vwidth, istride, width - vwidth, height, 0);
+}
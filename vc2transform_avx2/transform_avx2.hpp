@@ -28,7 +28,7 @@
 
 #include "transform.hpp"
 
-InplaceTransformInitial get_htransforminitial_avx2(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt);
+InplaceTransformInitial get_htransforminitial_avx2(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix);
 InplaceTransform get_vtransform_avx2(int wavelet_index, int level, int coef_size, VC2EncoderInputFormat fmt);
 InplaceTransform get_htransform_avx2(int wavelet_index, int level, int coef_size);
 
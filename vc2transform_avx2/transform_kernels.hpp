@@ -30,6 +30,9 @@
 
 #include "legall_transform_sse4_2.hpp"
 #include "haar_transform_sse4_2.hpp"
+#include "daubechies_9_7_transform_sse4_2.hpp"
 #include "haar_transform.hpp"
+#include "legall_transform.hpp"
+#include "daubechies_9_7_transform.hpp"
 
 #endif /* __AVX_TRANSFORM_KERNELS_HPP__ */
@@ -0,0 +1,133 @@
+/*****************************************************************************
+ * daubechies_9_7_transform.hpp : Daubechies 9,7 transform: Plain C++ version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+
+/* The analysis filter is the inverse of the four lifting stages given in the
+   specification for synthesis, all of which have two equal taps and a
+   rounding shift of 12 bits:
+
+     odd  -= (6497*(even[n] + even[n+1]) + 2048) >> 12
+     even -= ( 217*( odd[n-1] +  odd[n]) + 2048) >> 12
+     odd  += (3616*(even[n] + even[n+1]) + 2048) >> 12
+     even += (1817*( odd[n-1] +  odd[n]) + 2048) >> 12
+
+   Edges are extended symmetrically, so the missing even sample at the end of
+   a line is the last even sample and the missing odd sample at the start of a
+   line is the first odd sample. The products are formed in 64 bits, since the
+   coefficients of deep or high bit depth transforms pass 2^31/6497. */
+#define DAUBECHIES_9_7_LIFT(W,A,B) ((int32_t)(((int64_t)(W)*((int64_t)(A) + (int64_t)(B)) + 2048) >> 12))
+
+template<class T> inline void Daubechies_9_7_lift_H(T *idata, const int width, const int skip) {
+  const int last = width - 2*skip;
+
+  for (int x = skip; x < width; x += 2*skip)
+    idata[x] -= DAUBECHIES_9_7_LIFT(6497, idata[x - skip], idata[(x + skip < width)?(x + skip):last]);
+  for (int x = 0; x < width; x += 2*skip)
+    idata[x] -= DAUBECHIES_9_7_LIFT( 217, idata[(x > 0)?(x - skip):skip], idata[x + skip]);
+  for (int x = skip; x < width; x += 2*skip)
+    idata[x] += DAUBECHIES_9_7_LIFT(3616, idata[x - skip], idata[(x + skip < width)?(x + skip):last]);
+  for (int x = 0; x < width; x += 2*skip)
+    idata[x] += DAUBECHIES_9_7_LIFT(1817, idata[(x > 0)?(x - skip):skip], idata[x + skip]);
+}
+
+template<int ACTIVE_BITS, class T> void Daubechies_9_7_transform_H_inplace_10P2(const char *_idata,
+                                                                                const int istride,
+                                                                                void **_odata,
+                                                                                const int ostride,
+                                                                                const int iwidth,
+                                                                                const int iheight,
+                                                                                const int owidth,
+                                                                                const int oheight) {
+  T *odata = *((T **)_odata);
+  const int skip = 1;
+
+  const uint16_t *idata = (const uint16_t *)_idata;
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
+
+  int y;
+  for (y = 0; y < iheight; y+=skip) {
+    int x;
+    for (x = 0; x < iwidth; x += skip)
+      odata[y*ostride + x] = (((int32_t)idata[y*istride + x]) - offset) << 1;
+
+    Daubechies_9_7_lift_H<T>(&odata[y*ostride], iwidth, skip);
+
+    for (; x < owidth; x += 2*skip) {
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+    }
+  }
+  for (; y < oheight; y+=skip) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], owidth*sizeof(T));
+  }
+}
+
+template<int skip, class T> void Daubechies_9_7_transform_H_inplace(void *_idata,
+                                                                    const int istride,
+                                                                    const int width,
+                                                                    const int height,
+                                                                    const int) {
+  T *idata = (T *)_idata;
+  for (int y = 0; y < height; y+=skip) {
+    for (int x = 0; x < width; x += skip)
+      idata[y*istride + x] <<= 1;
+
+    Daubechies_9_7_lift_H<T>(&idata[y*istride], width, skip);
+  }
+}
+
+template<int skip, class T> void Daubechies_9_7_transform_V_inplace(void *_idata,
+                                                                    const int istride,
+                                                                    const int width,
+                                                                    const int height,
+                                                                    const int) {
+  T *idata = (T *)_idata;
+  const int last = height - 2*skip;
+
+  for (int y = skip; y < height; y += 2*skip) {
+    const int yp1 = (y + skip < height)?(y + skip):last;
+    for (int x = 0; x < width; x += skip)
+      idata[y*istride + x] -= DAUBECHIES_9_7_LIFT(6497, idata[(y - skip)*istride + x], idata[yp1*istride + x]);
+  }
+  for (int y = 0; y < height; y += 2*skip) {
+    const int ym1 = (y > 0)?(y - skip):skip;
+    for (int x = 0; x < width; x += skip)
+      idata[y*istride + x] -= DAUBECHIES_9_7_LIFT( 217, idata[ym1*istride + x], idata[(y + skip)*istride + x]);
+  }
+  for (int y = skip; y < height; y += 2*skip) {
+    const int yp1 = (y + skip < height)?(y + skip):last;
+    for (int x = 0; x < width; x += skip)
+      idata[y*istride + x] += DAUBECHIES_9_7_LIFT(3616, idata[(y - skip)*istride + x], idata[yp1*istride + x]);
+  }
+  for (int y = 0; y < height; y += 2*skip) {
+    const int ym1 = (y > 0)?(y - skip):skip;
+    for (int x = 0; x < width; x += skip)
+      idata[y*istride + x] += DAUBECHIES_9_7_LIFT(1817, idata[ym1*istride + x], idata[(y + skip)*istride + x]);
+  }
+}
+
+#undef DAUBECHIES_9_7_LIFT
@@ -27,19 +27,19 @@
 #include <string.h>
 #include <x86intrin.h>
 
-template<class T> void Deslauriers_Dubuc_9_7_transform_H_inplace_10P2(const char *_idata,
-                                                                       const int istride,
-                                                                       void **_odata,
-                                                                       const int ostride,
-                                                                       const int iwidth,
-                                                                       const int iheight,
-                                                                       const int owidth,
-                                                                       const int oheight) {
+template<int ACTIVE_BITS, class T> void Deslauriers_Dubuc_9_7_transform_H_inplace_10P2(const char *_idata,
+                                                                                        const int istride,
+                                                                                        void **_odata,
+                                                                                        const int ostride,
+                                                                                        const int iwidth,
+                                                                                        const int iheight,
+                                                                                        const int owidth,
+                                                                                        const int oheight) {
   const int skip = 1;
 
   const uint16_t *idata = (const uint16_t *)_idata;
   T *odata = *((T **)_odata);
-  const T offset = 1 << 9;
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
 
   (void)iwidth;
   (void)iheight;
@@ -138,13 +138,13 @@ template<class T> void Deslauriers_Dubuc_9_7_transform_H_inplace_10P2(const char
     x += 2*skip;
 
     for (; x < owidth; x += 2*skip) {
-      odata[y*ostride + x + 0*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[y*ostride + x + 1*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
     }
   }
 
   for (; y < oheight; y+=skip) {
-    memcpy(&odata[y*ostride], &odata[(2*iheight - y - skip)*ostride], owidth);
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], owidth*sizeof(T));
   }
 }
 
@@ -111,40 +111,40 @@ template<int shift, class T> void Haar_transform_H_inplace_V210(const char *_ida
 #undef TRANSFORM_WRITE
     }
     for (x = iwidth; x < owidth; x += 4*skip) {
-      odata_y[y*ostride + x + 0*skip] = odata_y[y*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata_y[y*ostride + x + 1*skip] = odata_y[y*ostride + (2*iwidth - x - 2*skip) + 1*skip];
-      odata_y[y*ostride + x + 2*skip] = odata_y[y*ostride + (2*iwidth - x - 4*skip) + 0*skip];
-      odata_y[y*ostride + x + 3*skip] = odata_y[y*ostride + (2*iwidth - x - 4*skip) + 1*skip];
+      odata_y[y*ostride + x + 0*skip] = odata_y[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata_y[y*ostride + x + 1*skip] = odata_y[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+      odata_y[y*ostride + x + 2*skip] = odata_y[y*ostride + transform_pad_source(x + 2*skip, iwidth, skip)];
+      odata_y[y*ostride + x + 3*skip] = odata_y[y*ostride + transform_pad_source(x + 3*skip, iwidth, skip)];
 
-      odata_u[y*ostride/2 + x/2 + 0*skip] = odata_u[y*ostride/2 + (2*iwidth - x - 2*skip)/2 + 0*skip];
-      odata_u[y*ostride/2 + x/2 + 1*skip] = odata_u[y*ostride/2 + (2*iwidth - x - 2*skip)/2 + 1*skip];
+      odata_u[y*ostride/2 + x/2 + 0*skip] = odata_u[y*ostride/2 + transform_pad_source(x/2 + 0*skip, iwidth/2, skip)];
+      odata_u[y*ostride/2 + x/2 + 1*skip] = odata_u[y*ostride/2 + transform_pad_source(x/2 + 1*skip, iwidth/2, skip)];
 
-      odata_v[y*ostride/2 + x/2 + 0*skip] = odata_v[y*ostride/2 + (2*iwidth - x - 2*skip)/2 + 0*skip];
-      odata_v[y*ostride/2 + x/2 + 1*skip] = odata_v[y*ostride/2 + (2*iwidth - x - 2*skip)/2 + 1*skip];
+      odata_v[y*ostride/2 + x/2 + 0*skip] = odata_v[y*ostride/2 + transform_pad_source(x/2 + 0*skip, iwidth/2, skip)];
+      odata_v[y*ostride/2 + x/2 + 1*skip] = odata_v[y*ostride/2 + transform_pad_source(x/2 + 1*skip, iwidth/2, skip)];
     }
   }
   for (; y < oheight; y+=skip) {
-    memcpy(&odata_y[y*ostride], &odata_y[(2*iheight - y - skip)*ostride], owidth*2);
-    memcpy(&odata_u[y*ostride/2], &odata_u[(2*iheight - y - skip)*ostride/2], owidth);
-    memcpy(&odata_v[y*ostride/2], &odata_v[(2*iheight - y - skip)*ostride/2], owidth);
+    memcpy(&odata_y[y*ostride], &odata_y[transform_pad_line(y, iheight, skip)*ostride], owidth*2);
+    memcpy(&odata_u[y*ostride/2], &odata_u[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
+    memcpy(&odata_v[y*ostride/2], &odata_v[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
   }
 }
 
-template<int shift, class T> void Haar_transform_H_inplace_10P2(const char *_idata,
-                                                                 const int istride,
-                                                                 void **_odata,
-                                                                 const int ostride,
-                                                                 const int iwidth,
-                                                                 const int iheight,
-                                                                 const int owidth,
-                                                                 const int oheight) {
+template<int ACTIVE_BITS, int shift, class T> void Haar_transform_H_inplace_10P2(const char *_idata,
+                                                                                  const int istride,
+                                                                                  void **_odata,
+                                                                                  const int ostride,
+                                                                                  const int iwidth,
+                                                                                  const int iheight,
+                                                                                  const int owidth,
+                                                                                  const int oheight) {
   (void)iwidth;
   (void)iheight;
   T *odata = *((T **)_odata);
   const int skip = 1;
 
   const uint16_t *idata = (const uint16_t *)_idata;
-  const int32_t offset = 1 << 9;
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
 
   int y = 0;
   for (; y < iheight; y+=skip) {
@@ -160,12 +160,12 @@ template<int shift, class T> void Haar_transform_H_inplace_10P2(const char *_ida
       odata[y*ostride + x + 1*skip] = Xp1;
     }
     for (; x < owidth; x += 2*skip) {
-      odata[y*ostride + x + 0*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[y*ostride + x + 1*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
     }
   }
   for (; y < oheight; y+=skip) {
-    memcpy(&odata[y*ostride], &odata[(2*iheight - y - skip)*ostride], owidth*2);
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], owidth*sizeof(T));
   }
 }
 
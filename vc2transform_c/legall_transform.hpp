@@ -202,23 +202,23 @@ template<class T> void LeGall_5_3_transform_H_inplace_V210(const char *_idata,
     }
   }
   for (; y < oheight; y+=skip) {
-    memcpy(&odata_y[y*ostride], &odata_y[(2*iheight - y - skip)*ostride], owidth*2);
-    memcpy(&odata_u[y*ostride/2], &odata_u[(2*iheight - y - skip)*ostride/2], owidth);
-    memcpy(&odata_v[y*ostride/2], &odata_v[(2*iheight - y - skip)*ostride/2], owidth);
+    memcpy(&odata_y[y*ostride], &odata_y[transform_pad_line(y, iheight, skip)*ostride], owidth*2);
+    memcpy(&odata_u[y*ostride/2], &odata_u[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
+    memcpy(&odata_v[y*ostride/2], &odata_v[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
   }
 
 #undef LOAD_SAMPLES
 #undef TRANSFORM_WRITE
 }
 
-template<class T> void LeGall_5_3_transform_H_inplace_10P2(const char *_idata,
-                                                            const int istride,
-                                                            void **_odata,
-                                                            const int ostride,
-                                                            const int iwidth,
-                                                            const int iheight,
-                                                            const int owidth,
-                                                            const int oheight) {
+template<int ACTIVE_BITS, class T> void LeGall_5_3_transform_H_inplace_10P2(const char *_idata,
+                                                                             const int istride,
+                                                                             void **_odata,
+                                                                             const int ostride,
+                                                                             const int iwidth,
+                                                                             const int iheight,
+                                                                             const int owidth,
+                                                                             const int oheight) {
   T *odata = *((T **)_odata);
   const int skip = 1;
 
@@ -226,7 +226,7 @@ template<class T> void LeGall_5_3_transform_H_inplace_10P2(const char *_idata,
   (void)iheight;
 
   const uint16_t *idata = (const uint16_t *)_idata;
-  const int16_t offset = 1 << 9;
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
 
   int y;
   for (y = 0; y < iheight; y+=skip) {
@@ -287,12 +287,12 @@ template<class T> void LeGall_5_3_transform_H_inplace_10P2(const char *_idata,
     x += 2*skip;
 
     for (; x < owidth; x += 2*skip) {
-      odata[y*ostride + x + 0*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[y*ostride + x + 1*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
     }
   }
   for (y = iheight; y < oheight; y+=skip) {
-    memcpy(&odata[y*ostride], &odata[(2*iheight - y - skip)*ostride], owidth*2);
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], owidth*sizeof(T));
   }
   (void)oheight;
 }
@@ -0,0 +1,237 @@
+/*****************************************************************************
+ * packed_transform.hpp : Unpacking of the packed and semi-planar input formats
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+
+/* Unpacks one line of UYVY10, 16-bit words of Cb Y Cr Y with the samples in
+   the low ten bits, into the Y, U and V output lines with the offset removed */
+template<class T> inline void UYVY10_unpack_line(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  const int32_t offset = 1 << 9;
+  const uint16_t *D = (const uint16_t *)idata;
+
+  for (int x = 0; x < width; x += 2, D += 4) {
+    odata_u[x/2    ] = ((int32_t)D[0]) - offset;
+    odata_y[x   + 0] = ((int32_t)D[1]) - offset;
+    odata_v[x/2    ] = ((int32_t)D[2]) - offset;
+    odata_y[x   + 1] = ((int32_t)D[3]) - offset;
+  }
+}
+
+/* Unpacks one line of 8-bit UYVY, bytes of Cb Y Cr Y, into the Y, U and V
+   output lines, widening each sample and removing the offset */
+template<class T> inline void UYVY_unpack_line(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  const int32_t offset = 1 << 7;
+  const uint8_t *D = idata;
+
+  for (int x = 0; x < width; x += 2, D += 4) {
+    odata_u[x/2    ] = ((int32_t)D[0]) - offset;
+    odata_y[x   + 0] = ((int32_t)D[1]) - offset;
+    odata_v[x/2    ] = ((int32_t)D[2]) - offset;
+    odata_y[x   + 1] = ((int32_t)D[3]) - offset;
+  }
+}
+
+/* Unpacks one line of YUY2, bytes of Y Cb Y Cr, as for UYVY */
+template<class T> inline void YUY2_unpack_line(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  const int32_t offset = 1 << 7;
+  const uint8_t *D = idata;
+
+  for (int x = 0; x < width; x += 2, D += 4) {
+    odata_y[x   + 0] = ((int32_t)D[0]) - offset;
+    odata_u[x/2    ] = ((int32_t)D[1]) - offset;
+    odata_y[x   + 1] = ((int32_t)D[2]) - offset;
+    odata_v[x/2    ] = ((int32_t)D[3]) - offset;
+  }
+}
+
+/* Unpacks one line of v410, a 32-bit word for each pixel holding Cb, Y and
+   Cr in bits 2 to 31, into the Y, U and V output lines */
+template<class T> inline void V410_unpack_line(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  const int32_t offset = 1 << 9;
+  const uint32_t *D = (const uint32_t *)idata;
+
+  for (int x = 0; x < width; x++) {
+    odata_u[x] = ((int32_t)((D[x] >>  2)&0x3ff)) - offset;
+    odata_y[x] = ((int32_t)((D[x] >> 12)&0x3ff)) - offset;
+    odata_v[x] = ((int32_t)((D[x] >> 22)&0x3ff)) - offset;
+  }
+}
+
+/* Unpacks one line of Y416, 64 bits for each pixel of Cb, Y, Cr and alpha
+   in 16-bit words with the samples in the high bits, into the Y, U and V
+   output lines. The alpha is dropped. */
+template<int ACTIVE_BITS, class T> inline void Y416_unpack_line(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
+  const uint16_t *D = (const uint16_t *)idata;
+
+  for (int x = 0; x < width; x++, D += 4) {
+    odata_u[x] = ((int32_t)(D[0] >> (16 - ACTIVE_BITS))) - offset;
+    odata_y[x] = ((int32_t)(D[1] >> (16 - ACTIVE_BITS))) - offset;
+    odata_v[x] = ((int32_t)(D[2] >> (16 - ACTIVE_BITS))) - offset;
+  }
+}
+
+/* 4:4:4 packed input for any filter: as for V210 each line is unpacked
+   straight into the three output planes, which here are all the same width,
+   and transformed while it is still in cache. */
+template<class T, void (*UNPACK)(const uint8_t *, T *, T *, T *, const int), InplaceTransform TRANSFORM>
+void Packed444_transform_H_inplace(const char *_idata,
+                                   const int istride,
+                                   void **_odata,
+                                   const int ostride,
+                                   const int iwidth,
+                                   const int iheight,
+                                   const int owidth,
+                                   const int oheight) {
+  T *odata_y = ((T **)_odata)[0];
+  T *odata_u = ((T **)_odata)[1];
+  T *odata_v = ((T **)_odata)[2];
+
+  const uint8_t *idata = (const uint8_t *)_idata;
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    T *line_y = &odata_y[y*ostride];
+    T *line_u = &odata_u[y*ostride];
+    T *line_v = &odata_v[y*ostride];
+
+    UNPACK(&idata[y*istride], line_y, line_u, line_v, iwidth);
+
+    TRANSFORM(line_y, ostride, iwidth, 1, 1);
+    TRANSFORM(line_u, ostride, iwidth, 1, 1);
+    TRANSFORM(line_v, ostride, iwidth, 1, 1);
+
+    V210_extend_line<T>(line_y, iwidth, owidth);
+    V210_extend_line<T>(line_u, iwidth, owidth);
+    V210_extend_line<T>(line_v, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata_y[y*ostride], &odata_y[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(T));
+    memcpy(&odata_u[y*ostride], &odata_u[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(T));
+    memcpy(&odata_v[y*ostride], &odata_v[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(T));
+  }
+}
+
+/* The luma plane of P210 and P010, 16-bit words with the samples in the high
+   bits. The input stride is in words, as for planar input. */
+template<int ACTIVE_BITS, class T, InplaceTransform TRANSFORM>
+void P2_transform_H_inplace_luma(const char *_idata,
+                                 const int istride,
+                                 void **_odata,
+                                 const int ostride,
+                                 const int iwidth,
+                                 const int iheight,
+                                 const int owidth,
+                                 const int oheight) {
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
+  const uint16_t *idata = (const uint16_t *)_idata;
+  T *odata = ((T **)_odata)[0];
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    T *line = &odata[y*ostride];
+
+    for (int x = 0; x < iwidth; x++)
+      line[x] = ((int32_t)(idata[y*istride + x] >> (16 - ACTIVE_BITS))) - offset;
+
+    TRANSFORM(line, ostride, iwidth, 1, 1);
+
+    V210_extend_line<T>(line, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(T));
+  }
+}
+
+/* The interleaved Cb Cr plane of P210 and P010, split into both colour
+   difference planes in one pass over the input. The planes are given as the
+   first two output pointers, and iwidth is the width of each of them. */
+template<int ACTIVE_BITS, class T, InplaceTransform TRANSFORM>
+void P2_transform_H_inplace_chroma(const char *_idata,
+                                   const int istride,
+                                   void **_odata,
+                                   const int ostride,
+                                   const int iwidth,
+                                   const int iheight,
+                                   const int owidth,
+                                   const int oheight) {
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
+  const uint16_t *idata = (const uint16_t *)_idata;
+  T *odata_u = ((T **)_odata)[0];
+  T *odata_v = ((T **)_odata)[1];
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    T *line_u = &odata_u[y*ostride];
+    T *line_v = &odata_v[y*ostride];
+
+    for (int x = 0; x < iwidth; x++) {
+      line_u[x] = ((int32_t)(idata[y*istride + 2*x + 0] >> (16 - ACTIVE_BITS))) - offset;
+      line_v[x] = ((int32_t)(idata[y*istride + 2*x + 1] >> (16 - ACTIVE_BITS))) - offset;
+    }
+
+    TRANSFORM(line_u, ostride, iwidth, 1, 1);
+    TRANSFORM(line_v, ostride, iwidth, 1, 1);
+
+    V210_extend_line<T>(line_u, iwidth, owidth);
+    V210_extend_line<T>(line_v, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata_u[y*ostride], &odata_u[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(T));
+    memcpy(&odata_v[y*ostride], &odata_v[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(T));
+  }
+}
+
+/* One plane of 8-bit planar input, a byte for each sample and the input
+   stride in bytes: each line is widened into the output and transformed */
+template<class T, InplaceTransform TRANSFORM>
+void Planar8_transform_H_inplace(const char *_idata,
+                                 const int istride,
+                                 void **_odata,
+                                 const int ostride,
+                                 const int iwidth,
+                                 const int iheight,
+                                 const int owidth,
+                                 const int oheight) {
+  const int32_t offset = 1 << 7;
+  const uint8_t *idata = (const uint8_t *)_idata;
+  T *odata = ((T **)_odata)[0];
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    T *line = &odata[y*ostride];
+
+    for (int x = 0; x < iwidth; x++)
+      line[x] = ((int32_t)idata[y*istride + x]) - offset;
+
+    TRANSFORM(line, ostride, iwidth, 1, 1);
+
+    V210_extend_line<T>(line, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(T));
+  }
+}
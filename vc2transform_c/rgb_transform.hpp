@@ -0,0 +1,102 @@
+/*****************************************************************************
+ * rgb_transform.hpp : Colour conversion of RGB input formats
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+
+/* Loads pixel x of a line of x2rgb10, a 32-bit word for each pixel holding
+   B, G and R from the lowest bits up */
+inline void X2RGB10_load_pixel(const uint8_t *idata, const int x, int32_t &r, int32_t &g, int32_t &b) {
+  const uint32_t D = ((const uint32_t *)idata)[x];
+  b = (D >>  0)&0x3ff;
+  g = (D >> 10)&0x3ff;
+  r = (D >> 20)&0x3ff;
+}
+
+/* Loads pixel x of a line of BGRA, bytes of B, G, R and alpha */
+inline void BGRA_load_pixel(const uint8_t *idata, const int x, int32_t &r, int32_t &g, int32_t &b) {
+  b = idata[4*x + 0];
+  g = idata[4*x + 1];
+  r = idata[4*x + 2];
+}
+
+/* Unpacks one line of RGB to be coded as RGB: the G, B and R samples become
+   the Y, C1 and C2 components as the colour matrix specifies */
+template<int ACTIVE_BITS, void (*LOAD)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &), class T>
+inline void RGB_unpack_line(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  const int32_t offset = 1 << (ACTIVE_BITS - 1);
+
+  for (int x = 0; x < width; x++) {
+    int32_t r, g, b;
+    LOAD(idata, x, r, g, b);
+    odata_y[x] = g - offset;
+    odata_u[x] = b - offset;
+    odata_v[x] = r - offset;
+  }
+}
+
+/* Unpacks one line of RGB and matrixes it to 4:4:4 Y'CbCr */
+template<int MATRIX, int ACTIVE_BITS, void (*LOAD)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &), class T>
+inline void RGB_unpack_line_444(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  typedef RGB_matrix<MATRIX, ACTIVE_BITS> M;
+
+  for (int x = 0; x < width; x++) {
+    int32_t r, g, b;
+    LOAD(idata, x, r, g, b);
+    odata_y[x] = (M::YR*r + M::YG*g + M::YB*b + M::YK) >> RGB_MATRIX_SHIFT;
+    odata_u[x] = (M::UR*r + M::UG*g + M::UB*b + (1 << (RGB_MATRIX_SHIFT - 1))) >> RGB_MATRIX_SHIFT;
+    odata_v[x] = (M::VR*r + M::VG*g + M::VB*b + (1 << (RGB_MATRIX_SHIFT - 1))) >> RGB_MATRIX_SHIFT;
+  }
+}
+
+/* Unpacks one line of RGB and matrixes it to 4:2:2 Y'CbCr. The colour
+   difference samples are cosited with the even luma samples and filtered
+   [1 2 1]/4 before they are rounded, the edge mirrored. */
+template<int MATRIX, int ACTIVE_BITS, void (*LOAD)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &), class T>
+inline void RGB_unpack_line_422(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  typedef RGB_matrix<MATRIX, ACTIVE_BITS> M;
+  int32_t prev_u = 0;
+  int32_t prev_v = 0;
+
+  for (int x = 0; x < width; x += 2) {
+    int32_t r0, g0, b0, r1, g1, b1;
+    LOAD(idata, x + 0, r0, g0, b0);
+    LOAD(idata, x + 1, r1, g1, b1);
+    odata_y[x + 0] = (M::YR*r0 + M::YG*g0 + M::YB*b0 + M::YK) >> RGB_MATRIX_SHIFT;
+    odata_y[x + 1] = (M::YR*r1 + M::YG*g1 + M::YB*b1 + M::YK) >> RGB_MATRIX_SHIFT;
+
+    const int32_t u0 = M::UR*r0 + M::UG*g0 + M::UB*b0;
+    const int32_t u1 = M::UR*r1 + M::UG*g1 + M::UB*b1;
+    const int32_t v0 = M::VR*r0 + M::VG*g0 + M::VB*b0;
+    const int32_t v1 = M::VR*r1 + M::VG*g1 + M::VB*b1;
+    if (x == 0) {
+      prev_u = u1;
+      prev_v = v1;
+    }
+    odata_u[x/2] = (prev_u + 2*u0 + u1 + (1 << (RGB_MATRIX_SHIFT + 1))) >> (RGB_MATRIX_SHIFT + 2);
+    odata_v[x/2] = (prev_v + 2*v0 + v1 + (1 << (RGB_MATRIX_SHIFT + 1))) >> (RGB_MATRIX_SHIFT + 2);
+    prev_u = u1;
+    prev_v = v1;
+  }
+}
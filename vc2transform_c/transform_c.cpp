@@ -27,50 +27,176 @@
 #include "transform.hpp"
 #include "transform_kernels.hpp"
 
-InplaceTransformInitial get_htransforminitial_c(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt) {
-  (void)c;
-  if (fmt == VC2ENCODER_INPUT_10P2) {
-    if (active_bits != 10) {
-      writelog(LOG_ERROR, "%s:%d:  invalid bit depth", __FILE__, __LINE__);
-      throw VC2ENCODER_NOTIMPLEMENTED;
+template<int ACTIVE_BITS, class T> static InplaceTransformInitial get_htransforminitial_10P2_c(int wavelet_index) {
+  switch (wavelet_index) {
+    /*  case VC2ENCODER_WFT_FIDELITY:
+        return Fidelity_transform_H_inplace_10P2;*/
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
+    return Deslauriers_Dubuc_9_7_transform_H_inplace_10P2<ACTIVE_BITS, T>;
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
+    return Deslauriers_Dubuc_13_7_transform_H_inplace_10P2<ACTIVE_BITS, T>;
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    return LeGall_5_3_transform_H_inplace_10P2<ACTIVE_BITS, T>;
+  case VC2ENCODER_WFT_DAUBECHIES_9_7:
+    return Daubechies_9_7_transform_H_inplace_10P2<ACTIVE_BITS, T>;
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+    return Haar_transform_H_inplace_10P2<ACTIVE_BITS, 0, T>;
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    return Haar_transform_H_inplace_10P2<ACTIVE_BITS, 1, T>;
+  default:
+    writelog(LOG_ERROR, "%s:%d:  invalid wavelet kernel", __FILE__, __LINE__);
+    throw VC2ENCODER_NOTIMPLEMENTED;
+  }
+}
+
+/* RGB input is unpacked and, unless it is to be coded as RGB, matrixed to
+   Y'CbCr and decimated to 4:2:2 as each line is loaded */
+template<class T, InplaceTransform TRANSFORM, int ACTIVE_BITS, void (*LOAD)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &)>
+static InplaceTransformInitial get_htransforminitial_rgb_c(int color_diff_format, int color_matrix) {
+  switch (color_matrix) {
+  case VC2ENCODER_CMA_RGB:
+    if (color_diff_format == VC2ENCODER_CDS_444)
+      return Packed444_transform_H_inplace<T, RGB_unpack_line<ACTIVE_BITS, LOAD, T>, TRANSFORM>;
+    break;
+  case VC2ENCODER_CMA_HDTV:
+    if (color_diff_format == VC2ENCODER_CDS_444)
+      return Packed444_transform_H_inplace<T, RGB_unpack_line_444<VC2ENCODER_CMA_HDTV, ACTIVE_BITS, LOAD, T>, TRANSFORM>;
+    if (color_diff_format == VC2ENCODER_CDS_422)
+      return V210_transform_H_inplace<T, RGB_unpack_line_422<VC2ENCODER_CMA_HDTV, ACTIVE_BITS, LOAD, T>, TRANSFORM>;
+    break;
+  case VC2ENCODER_CMA_SDTV:
+    if (color_diff_format == VC2ENCODER_CDS_444)
+      return Packed444_transform_H_inplace<T, RGB_unpack_line_444<VC2ENCODER_CMA_SDTV, ACTIVE_BITS, LOAD, T>, TRANSFORM>;
+    if (color_diff_format == VC2ENCODER_CDS_422)
+      return V210_transform_H_inplace<T, RGB_unpack_line_422<VC2ENCODER_CMA_SDTV, ACTIVE_BITS, LOAD, T>, TRANSFORM>;
+    break;
+  }
+
+  writelog(LOG_ERROR, "%s:%d:  RGB input is not supported for this colour matrix and chroma format", __FILE__, __LINE__);
+  throw VC2ENCODER_NOTIMPLEMENTED;
+}
+
+/* The packed and semi-planar formats unpack each line and give it the level
+   zero horizontal transform while it is still in cache. Formats which pack
+   all three components together are transformed whole with component 0. */
+template<class T, InplaceTransform TRANSFORM> static InplaceTransformInitial get_htransforminitial_packed_c(int active_bits, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix) {
+  switch (fmt) {
+  case VC2ENCODER_INPUT_UYVY10:
+    if (active_bits != 10)
+      break;
+    return (c == 0)?V210_transform_H_inplace<T, UYVY10_unpack_line<T>, TRANSFORM>:NULL;
+  case VC2ENCODER_INPUT_V410:
+    if (active_bits != 10)
+      break;
+    return (c == 0)?Packed444_transform_H_inplace<T, V410_unpack_line<T>, TRANSFORM>:NULL;
+  case VC2ENCODER_INPUT_Y416:
+    if (c != 0)
+      return NULL;
+    switch (active_bits) {
+    case 10:
+      return Packed444_transform_H_inplace<T, Y416_unpack_line<10, T>, TRANSFORM>;
+    case 12:
+      return Packed444_transform_H_inplace<T, Y416_unpack_line<12, T>, TRANSFORM>;
+    case 16:
+      return Packed444_transform_H_inplace<T, Y416_unpack_line<16, T>, TRANSFORM>;
+    }
+    break;
+  case VC2ENCODER_INPUT_P210:
+  case VC2ENCODER_INPUT_P010:
+    if (c == 2)
+      return NULL;
+    switch (active_bits) {
+    case 10:
+      return (c == 0)?P2_transform_H_inplace_luma<10, T, TRANSFORM>:P2_transform_H_inplace_chroma<10, T, TRANSFORM>;
+    case 12:
+      return (c == 0)?P2_transform_H_inplace_luma<12, T, TRANSFORM>:P2_transform_H_inplace_chroma<12, T, TRANSFORM>;
+    case 16:
+      return (c == 0)?P2_transform_H_inplace_luma<16, T, TRANSFORM>:P2_transform_H_inplace_chroma<16, T, TRANSFORM>;
     }
+    break;
+  case VC2ENCODER_INPUT_8P2:
+    if (active_bits != 8)
+      break;
+    return Planar8_transform_H_inplace<T, TRANSFORM>;
+  case VC2ENCODER_INPUT_UYVY:
+    if (active_bits != 8)
+      break;
+    return (c == 0)?V210_transform_H_inplace<T, UYVY_unpack_line<T>, TRANSFORM>:NULL;
+  case VC2ENCODER_INPUT_YUY2:
+    if (active_bits != 8)
+      break;
+    return (c == 0)?V210_transform_H_inplace<T, YUY2_unpack_line<T>, TRANSFORM>:NULL;
+  case VC2ENCODER_INPUT_X2RGB10:
+    if (active_bits != 10)
+      break;
+    return (c == 0)?get_htransforminitial_rgb_c<T, TRANSFORM, 10, X2RGB10_load_pixel>(color_diff_format, color_matrix):NULL;
+  case VC2ENCODER_INPUT_BGRA:
+    if (active_bits != 8)
+      break;
+    return (c == 0)?get_htransforminitial_rgb_c<T, TRANSFORM, 8, BGRA_load_pixel>(color_diff_format, color_matrix):NULL;
+  default:
+    writelog(LOG_ERROR, "%s:%d:  invalid input format", __FILE__, __LINE__);
+    throw VC2ENCODER_NOTIMPLEMENTED;
+  }
+
+  writelog(LOG_ERROR, "%s:%d:  invalid bit depth for input format", __FILE__, __LINE__);
+  throw VC2ENCODER_NOTIMPLEMENTED;
+}
 
+template<class T> static InplaceTransformInitial get_htransforminitial_packed_c(int wavelet_index, int active_bits, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix) {
+  switch (wavelet_index) {
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
+    return get_htransforminitial_packed_c<T, Deslauriers_Dubuc_9_7_transform_H_inplace<1, T> >(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
+    return get_htransforminitial_packed_c<T, Deslauriers_Dubuc_13_7_transform_H_inplace<1, T> >(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    return get_htransforminitial_packed_c<T, LeGall_5_3_transform_H_inplace<1, T> >(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_DAUBECHIES_9_7:
+    return get_htransforminitial_packed_c<T, Daubechies_9_7_transform_H_inplace<1, T> >(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+    return get_htransforminitial_packed_c<T, Haar_transform_H_inplace<1, 0, T> >(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    return get_htransforminitial_packed_c<T, Haar_transform_H_inplace<1, 1, T> >(active_bits, c, fmt, color_diff_format, color_matrix);
+  default:
+    writelog(LOG_ERROR, "%s:%d:  invalid wavelet kernel", __FILE__, __LINE__);
+    throw VC2ENCODER_NOTIMPLEMENTED;
+  }
+}
+
+InplaceTransformInitial get_htransforminitial_c(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix) {
+  (void)c;
+  if (fmt == VC2ENCODER_INPUT_10P2) {
+    /* Sixteen bit samples only fit thirty-two bit coefficients */
     if (coef_size == 2) {
-      switch (wavelet_index) {
-      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
-        return Deslauriers_Dubuc_9_7_transform_H_inplace_10P2<int16_t>;
-      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
-        return Deslauriers_Dubuc_13_7_transform_H_inplace_10P2<int16_t>;
-      case VC2ENCODER_WFT_LEGALL_5_3:
-        return LeGall_5_3_transform_H_inplace_10P2<int16_t>;
-      case VC2ENCODER_WFT_HAAR_NO_SHIFT:
-        return Haar_transform_H_inplace_10P2<0, int16_t>;
-      case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
-        return Haar_transform_H_inplace_10P2<1, int16_t>;
-      default:
-        writelog(LOG_ERROR, "%s:%d:  invalid wavelet kernel", __FILE__, __LINE__);
-        throw VC2ENCODER_NOTIMPLEMENTED;
+      switch (active_bits) {
+      case 8:
+        return get_htransforminitial_10P2_c<8, int16_t>(wavelet_index);
+      case 10:
+        return get_htransforminitial_10P2_c<10, int16_t>(wavelet_index);
+      case 12:
+        return get_htransforminitial_10P2_c<12, int16_t>(wavelet_index);
       }
     } else if (coef_size == 4) {
-      switch (wavelet_index) {
-        /*  case VC2ENCODER_WFT_FIDELITY:
-            return Fidelity_transform_H_inplace_10P2;*/
-      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
-        return Deslauriers_Dubuc_9_7_transform_H_inplace_10P2<int32_t>;
-      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
-        return Deslauriers_Dubuc_13_7_transform_H_inplace_10P2<int32_t>;
-      case VC2ENCODER_WFT_LEGALL_5_3:
-        return LeGall_5_3_transform_H_inplace_10P2<int32_t>;
-      case VC2ENCODER_WFT_HAAR_NO_SHIFT:
-        return Haar_transform_H_inplace_10P2<0, int32_t>;
-      case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
-        return Haar_transform_H_inplace_10P2<1, int32_t>;
-      default:
-        writelog(LOG_ERROR, "%s:%d:  invalid wavelet kernel", __FILE__, __LINE__);
-        throw VC2ENCODER_NOTIMPLEMENTED;
+      switch (active_bits) {
+      case 8:
+        return get_htransforminitial_10P2_c<8, int32_t>(wavelet_index);
+      case 10:
+        return get_htransforminitial_10P2_c<10, int32_t>(wavelet_index);
+      case 12:
+        return get_htransforminitial_10P2_c<12, int32_t>(wavelet_index);
+      case 16:
+        return get_htransforminitial_10P2_c<16, int32_t>(wavelet_index);
       }
     }
+
+    writelog(LOG_ERROR, "%s:%d:  invalid bit depth", __FILE__, __LINE__);
+    throw VC2ENCODER_NOTIMPLEMENTED;
   } else if (fmt == VC2ENCODER_INPUT_V210) {
+    if (active_bits != 10) {
+      writelog(LOG_ERROR, "%s:%d:  invalid bit depth", __FILE__, __LINE__);
+      throw VC2ENCODER_NOTIMPLEMENTED;
+    }
+
     if (c != 0)
       return NULL;
 
@@ -82,8 +208,14 @@ InplaceTransformInitial get_htransforminitial_c(int wavelet_index, int active_bi
         return Haar_transform_H_inplace_V210<0, uint16_t>;
       case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
         return Haar_transform_H_inplace_V210<1, uint16_t>;
+      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
+        return V210_transform_H_inplace<int16_t, V210_unpack_line<int16_t>, Deslauriers_Dubuc_9_7_transform_H_inplace<1, int16_t> >;
+      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
+        return V210_transform_H_inplace<int16_t, V210_unpack_line<int16_t>, Deslauriers_Dubuc_13_7_transform_H_inplace<1, int16_t> >;
+      case VC2ENCODER_WFT_DAUBECHIES_9_7:
+        return V210_transform_H_inplace<int16_t, V210_unpack_line<int16_t>, Daubechies_9_7_transform_H_inplace<1, int16_t> >;
       default:
-        writelog(LOG_ERROR, "%s:%d:  V210 input is only supported for LeGall and Haar wavelet", __FILE__, __LINE__);
+        writelog(LOG_ERROR, "%s:%d:  V210 input is not supported for this wavelet", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
       }
     } else if (coef_size == 4) {
@@ -94,13 +226,25 @@ InplaceTransformInitial get_htransforminitial_c(int wavelet_index, int active_bi
         return Haar_transform_H_inplace_V210<0, uint32_t>;
       case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
         return Haar_transform_H_inplace_V210<1, uint32_t>;
+      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
+        return V210_transform_H_inplace<int32_t, V210_unpack_line<int32_t>, Deslauriers_Dubuc_9_7_transform_H_inplace<1, int32_t> >;
+      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
+        return V210_transform_H_inplace<int32_t, V210_unpack_line<int32_t>, Deslauriers_Dubuc_13_7_transform_H_inplace<1, int32_t> >;
+      case VC2ENCODER_WFT_DAUBECHIES_9_7:
+        return V210_transform_H_inplace<int32_t, V210_unpack_line<int32_t>, Daubechies_9_7_transform_H_inplace<1, int32_t> >;
       default:
-        writelog(LOG_ERROR, "%s:%d:  V210 input is only supported for LeGall and Haar wavelet", __FILE__, __LINE__);
+        writelog(LOG_ERROR, "%s:%d:  V210 input is not supported for this wavelet", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
       }
     }
   } else {
-    writelog(LOG_ERROR, "%s:%d:  invalid input format", __FILE__, __LINE__);
+    /* Sixteen bit samples only fit thirty-two bit coefficients */
+    if (coef_size == 2 && active_bits <= 12)
+      return get_htransforminitial_packed_c<int16_t>(wavelet_index, active_bits, c, fmt, color_diff_format, color_matrix);
+    else if (coef_size == 4)
+      return get_htransforminitial_packed_c<int32_t>(wavelet_index, active_bits, c, fmt, color_diff_format, color_matrix);
+
+    writelog(LOG_ERROR, "%s:%d:  invalid bit depth", __FILE__, __LINE__);
     throw VC2ENCODER_NOTIMPLEMENTED;
   }
 
@@ -135,6 +279,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Deslauriers_Dubuc_9_7_transform_H_inplace<4, int16_t>;
       case 3:
         return Deslauriers_Dubuc_9_7_transform_H_inplace<8, int16_t>;
+      case 4:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<16, int16_t>;
+      case 5:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<32, int16_t>;
+      case 6:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<64, int16_t>;
+      case 7:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<128, int16_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -149,6 +301,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Deslauriers_Dubuc_13_7_transform_H_inplace<4, int16_t>;
       case 3:
         return Deslauriers_Dubuc_13_7_transform_H_inplace<8, int16_t>;
+      case 4:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<16, int16_t>;
+      case 5:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<32, int16_t>;
+      case 6:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<64, int16_t>;
+      case 7:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<128, int16_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -163,10 +323,40 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return LeGall_5_3_transform_H_inplace<4, int16_t>;
       case 3:
         return LeGall_5_3_transform_H_inplace<8, int16_t>;
+      case 4:
+        return LeGall_5_3_transform_H_inplace<16, int16_t>;
+      case 5:
+        return LeGall_5_3_transform_H_inplace<32, int16_t>;
+      case 6:
+        return LeGall_5_3_transform_H_inplace<64, int16_t>;
+      case 7:
+        return LeGall_5_3_transform_H_inplace<128, int16_t>;
       default:
-        writelog(LOG_WARN, "%s:%d:  Falling back to slow path for non-optimised transform depth", __FILE__, __LINE__);
+        /* Same single pass lifting as the fixed skip versions above */
         return LeGall_5_3_transform_H_inplace_dynamic<int16_t>;
       }
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_H_inplace<1, int16_t>;
+      case 1:
+        return Daubechies_9_7_transform_H_inplace<2, int16_t>;
+      case 2:
+        return Daubechies_9_7_transform_H_inplace<4, int16_t>;
+      case 3:
+        return Daubechies_9_7_transform_H_inplace<8, int16_t>;
+      case 4:
+        return Daubechies_9_7_transform_H_inplace<16, int16_t>;
+      case 5:
+        return Daubechies_9_7_transform_H_inplace<32, int16_t>;
+      case 6:
+        return Daubechies_9_7_transform_H_inplace<64, int16_t>;
+      case 7:
+        return Daubechies_9_7_transform_H_inplace<128, int16_t>;
+      default:
+        writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
+        throw VC2ENCODER_NOTIMPLEMENTED;
+      }
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
       switch (level) {
       case 0:
@@ -177,6 +367,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Haar_transform_H_inplace<4,0, int16_t>;
       case 3:
         return Haar_transform_H_inplace<8,0, int16_t>;
+      case 4:
+        return Haar_transform_H_inplace<16,0, int16_t>;
+      case 5:
+        return Haar_transform_H_inplace<32,0, int16_t>;
+      case 6:
+        return Haar_transform_H_inplace<64,0, int16_t>;
+      case 7:
+        return Haar_transform_H_inplace<128,0, int16_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -191,6 +389,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Haar_transform_H_inplace<4,1, int16_t>;
       case 3:
         return Haar_transform_H_inplace<8,1, int16_t>;
+      case 4:
+        return Haar_transform_H_inplace<16,1, int16_t>;
+      case 5:
+        return Haar_transform_H_inplace<32,1, int16_t>;
+      case 6:
+        return Haar_transform_H_inplace<64,1, int16_t>;
+      case 7:
+        return Haar_transform_H_inplace<128,1, int16_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -225,6 +431,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Deslauriers_Dubuc_9_7_transform_H_inplace<4, int32_t>;
       case 3:
         return Deslauriers_Dubuc_9_7_transform_H_inplace<8, int32_t>;
+      case 4:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<16, int32_t>;
+      case 5:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<32, int32_t>;
+      case 6:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<64, int32_t>;
+      case 7:
+        return Deslauriers_Dubuc_9_7_transform_H_inplace<128, int32_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -239,6 +453,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Deslauriers_Dubuc_13_7_transform_H_inplace<4, int32_t>;
       case 3:
         return Deslauriers_Dubuc_13_7_transform_H_inplace<8, int32_t>;
+      case 4:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<16, int32_t>;
+      case 5:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<32, int32_t>;
+      case 6:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<64, int32_t>;
+      case 7:
+        return Deslauriers_Dubuc_13_7_transform_H_inplace<128, int32_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -253,10 +475,40 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return LeGall_5_3_transform_H_inplace<4, int32_t>;
       case 3:
         return LeGall_5_3_transform_H_inplace<8, int32_t>;
+      case 4:
+        return LeGall_5_3_transform_H_inplace<16, int32_t>;
+      case 5:
+        return LeGall_5_3_transform_H_inplace<32, int32_t>;
+      case 6:
+        return LeGall_5_3_transform_H_inplace<64, int32_t>;
+      case 7:
+        return LeGall_5_3_transform_H_inplace<128, int32_t>;
       default:
-        writelog(LOG_WARN, "%s:%d:  Falling back to slow path for non-optimised transform depth", __FILE__, __LINE__);
+        /* Same single pass lifting as the fixed skip versions above */
         return LeGall_5_3_transform_H_inplace_dynamic<int32_t>;
       }
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_H_inplace<1, int32_t>;
+      case 1:
+        return Daubechies_9_7_transform_H_inplace<2, int32_t>;
+      case 2:
+        return Daubechies_9_7_transform_H_inplace<4, int32_t>;
+      case 3:
+        return Daubechies_9_7_transform_H_inplace<8, int32_t>;
+      case 4:
+        return Daubechies_9_7_transform_H_inplace<16, int32_t>;
+      case 5:
+        return Daubechies_9_7_transform_H_inplace<32, int32_t>;
+      case 6:
+        return Daubechies_9_7_transform_H_inplace<64, int32_t>;
+      case 7:
+        return Daubechies_9_7_transform_H_inplace<128, int32_t>;
+      default:
+        writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
+        throw VC2ENCODER_NOTIMPLEMENTED;
+      }
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
       switch (level) {
       case 0:
@@ -267,6 +519,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Haar_transform_H_inplace<4,0, int32_t>;
       case 3:
         return Haar_transform_H_inplace<8,0, int32_t>;
+      case 4:
+        return Haar_transform_H_inplace<16,0, int32_t>;
+      case 5:
+        return Haar_transform_H_inplace<32,0, int32_t>;
+      case 6:
+        return Haar_transform_H_inplace<64,0, int32_t>;
+      case 7:
+        return Haar_transform_H_inplace<128,0, int32_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -281,6 +541,14 @@ InplaceTransform get_htransform_c(int wavelet_index, int level, int coef_size) {
         return Haar_transform_H_inplace<4,1, int32_t>;
       case 3:
         return Haar_transform_H_inplace<8,1, int32_t>;
+      case 4:
+        return Haar_transform_H_inplace<16,1, int32_t>;
+      case 5:
+        return Haar_transform_H_inplace<32,1, int32_t>;
+      case 6:
+        return Haar_transform_H_inplace<64,1, int32_t>;
+      case 7:
+        return Haar_transform_H_inplace<128,1, int32_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -321,6 +589,14 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return Deslauriers_Dubuc_9_7_transform_V_inplace<4, int16_t>;
       case 3:
         return Deslauriers_Dubuc_9_7_transform_V_inplace<8, int16_t>;
+      case 4:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<16, int16_t>;
+      case 5:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<32, int16_t>;
+      case 6:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<64, int16_t>;
+      case 7:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<128, int16_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -335,6 +611,14 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return Deslauriers_Dubuc_13_7_transform_V_inplace<4, int16_t>;
       case 3:
         return Deslauriers_Dubuc_13_7_transform_V_inplace<8, int16_t>;
+      case 4:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<16, int16_t>;
+      case 5:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<32, int16_t>;
+      case 6:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<64, int16_t>;
+      case 7:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<128, int16_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -349,10 +633,40 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return LeGall_5_3_transform_V_inplace<4, int16_t>;
       case 3:
         return LeGall_5_3_transform_V_inplace<8, int16_t>;
+      case 4:
+        return LeGall_5_3_transform_V_inplace<16, int16_t>;
+      case 5:
+        return LeGall_5_3_transform_V_inplace<32, int16_t>;
+      case 6:
+        return LeGall_5_3_transform_V_inplace<64, int16_t>;
+      case 7:
+        return LeGall_5_3_transform_V_inplace<128, int16_t>;
       default:
         writelog(LOG_WARN, "%s:%d:  Falling back to slow path for non-optimised transform depth", __FILE__, __LINE__);
         return LeGall_5_3_transform_V_inplace_dynamic<int16_t>;
       }
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_V_inplace<1, int16_t>;
+      case 1:
+        return Daubechies_9_7_transform_V_inplace<2, int16_t>;
+      case 2:
+        return Daubechies_9_7_transform_V_inplace<4, int16_t>;
+      case 3:
+        return Daubechies_9_7_transform_V_inplace<8, int16_t>;
+      case 4:
+        return Daubechies_9_7_transform_V_inplace<16, int16_t>;
+      case 5:
+        return Daubechies_9_7_transform_V_inplace<32, int16_t>;
+      case 6:
+        return Daubechies_9_7_transform_V_inplace<64, int16_t>;
+      case 7:
+        return Daubechies_9_7_transform_V_inplace<128, int16_t>;
+      default:
+        writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
+        throw VC2ENCODER_NOTIMPLEMENTED;
+      }
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
     case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
       switch (level) {
@@ -364,6 +678,14 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return Haar_transform_V_inplace<4, int16_t>;
       case 3:
         return Haar_transform_V_inplace<8, int16_t>;
+      case 4:
+        return Haar_transform_V_inplace<16, int16_t>;
+      case 5:
+        return Haar_transform_V_inplace<32, int16_t>;
+      case 6:
+        return Haar_transform_V_inplace<64, int16_t>;
+      case 7:
+        return Haar_transform_V_inplace<128, int16_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -398,6 +720,14 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return Deslauriers_Dubuc_9_7_transform_V_inplace<4, int32_t>;
       case 3:
         return Deslauriers_Dubuc_9_7_transform_V_inplace<8, int32_t>;
+      case 4:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<16, int32_t>;
+      case 5:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<32, int32_t>;
+      case 6:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<64, int32_t>;
+      case 7:
+        return Deslauriers_Dubuc_9_7_transform_V_inplace<128, int32_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -412,6 +742,14 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return Deslauriers_Dubuc_13_7_transform_V_inplace<4, int32_t>;
       case 3:
         return Deslauriers_Dubuc_13_7_transform_V_inplace<8, int32_t>;
+      case 4:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<16, int32_t>;
+      case 5:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<32, int32_t>;
+      case 6:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<64, int32_t>;
+      case 7:
+        return Deslauriers_Dubuc_13_7_transform_V_inplace<128, int32_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -426,10 +764,40 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return LeGall_5_3_transform_V_inplace<4, int32_t>;
       case 3:
         return LeGall_5_3_transform_V_inplace<8, int32_t>;
+      case 4:
+        return LeGall_5_3_transform_V_inplace<16, int32_t>;
+      case 5:
+        return LeGall_5_3_transform_V_inplace<32, int32_t>;
+      case 6:
+        return LeGall_5_3_transform_V_inplace<64, int32_t>;
+      case 7:
+        return LeGall_5_3_transform_V_inplace<128, int32_t>;
       default:
         writelog(LOG_WARN, "%s:%d:  Falling back to slow path for non-optimised transform depth", __FILE__, __LINE__);
         return LeGall_5_3_transform_V_inplace_dynamic<int32_t>;
       }
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_V_inplace<1, int32_t>;
+      case 1:
+        return Daubechies_9_7_transform_V_inplace<2, int32_t>;
+      case 2:
+        return Daubechies_9_7_transform_V_inplace<4, int32_t>;
+      case 3:
+        return Daubechies_9_7_transform_V_inplace<8, int32_t>;
+      case 4:
+        return Daubechies_9_7_transform_V_inplace<16, int32_t>;
+      case 5:
+        return Daubechies_9_7_transform_V_inplace<32, int32_t>;
+      case 6:
+        return Daubechies_9_7_transform_V_inplace<64, int32_t>;
+      case 7:
+        return Daubechies_9_7_transform_V_inplace<128, int32_t>;
+      default:
+        writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
+        throw VC2ENCODER_NOTIMPLEMENTED;
+      }
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
     case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
       switch (level) {
@@ -441,6 +809,14 @@ InplaceTransform get_vtransform_c(int wavelet_index, int level, int coef_size, V
         return Haar_transform_V_inplace<4, int32_t>;
       case 3:
         return Haar_transform_V_inplace<8, int32_t>;
+      case 4:
+        return Haar_transform_V_inplace<16, int32_t>;
+      case 5:
+        return Haar_transform_V_inplace<32, int32_t>;
+      case 6:
+        return Haar_transform_V_inplace<64, int32_t>;
+      case 7:
+        return Haar_transform_V_inplace<128, int32_t>;
       default:
         writelog(LOG_ERROR, "%s:%d:  invalid depth", __FILE__, __LINE__);
         throw VC2ENCODER_NOTIMPLEMENTED;
@@ -32,6 +32,10 @@
 #include "haar_transform.hpp"
 #include "deslauriers_dubuc_9_7_transform.hpp"
 #include "deslauriers_dubuc_13_7_transform.hpp"
+#include "daubechies_9_7_transform.hpp"
+#include "v210_transform.hpp"
+#include "packed_transform.hpp"
+#include "rgb_transform.hpp"
 //#include "fidelity_transform.hpp"
 
 #endif /* __C_TRANSFORM_KERNELS_HPP__ */
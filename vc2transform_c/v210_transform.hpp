@@ -0,0 +1,118 @@
+/*****************************************************************************
+ * v210_transform.hpp : V210 unpacking for the filters without a fused kernel
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+
+/* Unpacks one line of V210 into the Y, U and V output lines with the offset
+   removed but otherwise unscaled, ready for a level zero in-place transform.
+   V210 lines are padded to a multiple of 48 pixels so whole words can always
+   be read, but only width luma samples are written. */
+template<class T> inline void V210_unpack_line(const uint8_t *idata, T *odata_y, T *odata_u, T *odata_v, const int width) {
+  const int32_t offset = 1 << 9;
+  const uint32_t *D = (const uint32_t *)idata;
+
+#define SAMPLE(W,S) (((int32_t)((D[W] >> (S))&0x3ff)) - offset)
+
+  int x = 0;
+  for (; x + 6 <= width; x += 6, D += 4) {
+    odata_u[x/2 + 0] = SAMPLE(0,  0);
+    odata_y[x   + 0] = SAMPLE(0, 10);
+    odata_v[x/2 + 0] = SAMPLE(0, 20);
+    odata_y[x   + 1] = SAMPLE(1,  0);
+    odata_u[x/2 + 1] = SAMPLE(1, 10);
+    odata_y[x   + 2] = SAMPLE(1, 20);
+    odata_v[x/2 + 1] = SAMPLE(2,  0);
+    odata_y[x   + 3] = SAMPLE(2, 10);
+    odata_u[x/2 + 2] = SAMPLE(2, 20);
+    odata_y[x   + 4] = SAMPLE(3,  0);
+    odata_v[x/2 + 2] = SAMPLE(3, 10);
+    odata_y[x   + 5] = SAMPLE(3, 20);
+  }
+  if (x < width) {
+    /* A line width of 2 or 4 modulo 6 leaves a partial group */
+    odata_u[x/2 + 0] = SAMPLE(0,  0);
+    odata_y[x   + 0] = SAMPLE(0, 10);
+    odata_v[x/2 + 0] = SAMPLE(0, 20);
+    odata_y[x   + 1] = SAMPLE(1,  0);
+    if (x + 2 < width) {
+      odata_u[x/2 + 1] = SAMPLE(1, 10);
+      odata_y[x   + 2] = SAMPLE(1, 20);
+      odata_v[x/2 + 1] = SAMPLE(2,  0);
+      odata_y[x   + 3] = SAMPLE(2, 10);
+    }
+  }
+
+#undef SAMPLE
+}
+
+/* Mirrors a transformed line about its last sample out to the padded width */
+template<class T> inline void V210_extend_line(T *odata, const int iwidth, const int owidth) {
+  for (int x = iwidth; x < owidth; x += 2) {
+    odata[x + 0] = odata[transform_pad_source(x + 0, iwidth, 1)];
+    odata[x + 1] = odata[transform_pad_source(x + 1, iwidth, 1)];
+  }
+}
+
+/* V210 input for any filter with an in-place level zero horizontal transform:
+   each line is unpacked straight into the three output planes and transformed
+   while it is still in cache, so no planar copy of the picture is needed. */
+template<class T, void (*UNPACK)(const uint8_t *, T *, T *, T *, const int), InplaceTransform TRANSFORM>
+void V210_transform_H_inplace(const char *_idata,
+                              const int istride,
+                              void **_odata,
+                              const int ostride,
+                              const int iwidth,
+                              const int iheight,
+                              const int owidth,
+                              const int oheight) {
+  T *odata_y = ((T **)_odata)[0];
+  T *odata_u = ((T **)_odata)[1];
+  T *odata_v = ((T **)_odata)[2];
+
+  const uint8_t *idata = (const uint8_t *)_idata;
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    T *line_y = &odata_y[y*ostride];
+    T *line_u = &odata_u[y*ostride/2];
+    T *line_v = &odata_v[y*ostride/2];
+
+    UNPACK(&idata[y*istride], line_y, line_u, line_v, iwidth);
+
+    TRANSFORM(line_y, ostride,   iwidth,   1, 1);
+    TRANSFORM(line_u, ostride/2, iwidth/2, 1, 1);
+    TRANSFORM(line_v, ostride/2, iwidth/2, 1, 1);
+
+    V210_extend_line<T>(line_y, iwidth,   owidth);
+    V210_extend_line<T>(line_u, iwidth/2, owidth/2);
+    V210_extend_line<T>(line_v, iwidth/2, owidth/2);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata_y[y*ostride],   &odata_y[transform_pad_line(y, iheight, 1)*ostride],   owidth*sizeof(T));
+    memcpy(&odata_u[y*ostride/2], &odata_u[transform_pad_line(y, iheight, 1)*ostride/2], owidth/2*sizeof(T));
+    memcpy(&odata_v[y*ostride/2], &odata_v[transform_pad_line(y, iheight, 1)*ostride/2], owidth/2*sizeof(T));
+  }
+}
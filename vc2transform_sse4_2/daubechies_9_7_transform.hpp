@@ -0,0 +1,485 @@
+/*****************************************************************************
+ * daubechies_9_7_transform.hpp : Daubechies 9,7 transform: SSE4.2 version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+#include <malloc.h>
+#include <x86intrin.h>
+
+/* Each lifting stage computes (W*(A + B) + 2048) >> 12. With the sum held in
+   16 bits this is exactly _mm_mulhrs_epi16(A + B, 8*W), which fits for the
+   weights 217, 1817 and 3616. The weight 6497 is too large, so that stage is
+   computed as S + ((2401*S + 2048) >> 12) instead. */
+#define DAUBECHIES_9_7_W6497_SSE4_2 _mm_set1_epi16(2401*8)
+#define DAUBECHIES_9_7_W217_SSE4_2  _mm_set1_epi16( 217*8)
+#define DAUBECHIES_9_7_W3616_SSE4_2 _mm_set1_epi16(3616*8)
+#define DAUBECHIES_9_7_W1817_SSE4_2 _mm_set1_epi16(1817*8)
+
+/* Performs the four lifting stages on a line that has already been split into
+   its even samples E[0..n-1] and odd samples O[0..n-1]. Both arrays must be
+   16-byte aligned with one writable element before the start and at least
+   eight after the end. */
+static inline void Daubechies_9_7_lift_sse4_2(int16_t *E, int16_t *O, const int n) {
+  const __m128i W6497 = DAUBECHIES_9_7_W6497_SSE4_2;
+  const __m128i W217  = DAUBECHIES_9_7_W217_SSE4_2;
+  const __m128i W3616 = DAUBECHIES_9_7_W3616_SSE4_2;
+  const __m128i W1817 = DAUBECHIES_9_7_W1817_SSE4_2;
+
+  E[n] = E[n - 1];
+  for (int i = 0; i < n; i += 8) {
+    __m128i S = _mm_add_epi16(_mm_load_si128((__m128i *)&E[i]), _mm_loadu_si128((__m128i *)&E[i + 1]));
+    S = _mm_add_epi16(S, _mm_mulhrs_epi16(S, W6497));
+    _mm_store_si128((__m128i *)&O[i], _mm_sub_epi16(_mm_load_si128((__m128i *)&O[i]), S));
+  }
+
+  O[-1] = O[0];
+  for (int i = 0; i < n; i += 8) {
+    __m128i S = _mm_add_epi16(_mm_loadu_si128((__m128i *)&O[i - 1]), _mm_load_si128((__m128i *)&O[i]));
+    _mm_store_si128((__m128i *)&E[i], _mm_sub_epi16(_mm_load_si128((__m128i *)&E[i]), _mm_mulhrs_epi16(S, W217)));
+  }
+
+  E[n] = E[n - 1];
+  for (int i = 0; i < n; i += 8) {
+    __m128i S = _mm_add_epi16(_mm_load_si128((__m128i *)&E[i]), _mm_loadu_si128((__m128i *)&E[i + 1]));
+    _mm_store_si128((__m128i *)&O[i], _mm_add_epi16(_mm_load_si128((__m128i *)&O[i]), _mm_mulhrs_epi16(S, W3616)));
+  }
+
+  O[-1] = O[0];
+  for (int i = 0; i < n; i += 8) {
+    __m128i S = _mm_add_epi16(_mm_loadu_si128((__m128i *)&O[i - 1]), _mm_load_si128((__m128i *)&O[i]));
+    _mm_store_si128((__m128i *)&E[i], _mm_add_epi16(_mm_load_si128((__m128i *)&E[i]), _mm_mulhrs_epi16(S, W1817)));
+  }
+}
+
+template<int ACTIVE_BITS> void Daubechies_9_7_transform_H_inplace_10P2_sse4_2(const char *_idata,
+                                                                              const int istride,
+                                                                              void **_odata,
+                                                                              const int ostride,
+                                                                              const int iwidth,
+                                                                              const int iheight,
+                                                                              const int owidth,
+                                                                              const int oheight) {
+  int16_t *odata = *((int16_t **)_odata);
+  const int skip = 1;
+
+  const uint16_t *idata = (const uint16_t *)_idata;
+  const __m128i OFFSET = _mm_set1_epi16((int16_t)(1 << (ACTIVE_BITS - 1)));
+
+  const int n = iwidth/2;
+  const int blen = (n + 7)/8*8 + 16;
+  int16_t *buf = (int16_t *)memalign(16, 2*blen*sizeof(int16_t));
+  int16_t *E = buf + 8;
+  int16_t *O = buf + blen + 8;
+
+  int y = 0;
+  for (; y < iheight; y+=skip) {
+    int x = 0;
+    for (; x + 16 <= iwidth; x += 16) {
+      __m128i D0, D8, A0, A4, B0, B2;
+      D0 = _mm_slli_epi16(_mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[y*istride + x + 0]), OFFSET), 1); // [  0  1  2  3  4  5  6  7 ]
+      D8 = _mm_slli_epi16(_mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[y*istride + x + 8]), OFFSET), 1); // [  8  9 10 11 12 13 14 15 ]
+      _mm_prefetch(&idata[y*istride + x + 16], _MM_HINT_T0);
+
+      A0 = _mm_unpacklo_epi16(D0, D8); // [  0  8  1  9  2 10  3 11 ]
+      A4 = _mm_unpackhi_epi16(D0, D8); // [  4 12  5 13  6 14  7 15 ]
+      B0 = _mm_unpacklo_epi16(A0, A4); // [  0  4  8 12  1  5  9 13 ]
+      B2 = _mm_unpackhi_epi16(A0, A4); // [  2  6 10 14  3  7 11 15 ]
+      _mm_store_si128((__m128i *)&E[x/2], _mm_unpacklo_epi16(B0, B2)); // [  0  2  4  6  8 10 12 14 ]
+      _mm_store_si128((__m128i *)&O[x/2], _mm_unpackhi_epi16(B0, B2)); // [  1  3  5  7  9 11 13 15 ]
+    }
+    for (; x < iwidth; x += 2) {
+      E[x/2] = (((int32_t)idata[y*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << 1;
+      O[x/2] = (((int32_t)idata[y*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << 1;
+    }
+
+    Daubechies_9_7_lift_sse4_2(E, O, n);
+
+    x = 0;
+    for (; x + 16 <= iwidth; x += 16) {
+      __m128i X0 = _mm_load_si128((__m128i *)&E[x/2]);
+      __m128i X1 = _mm_load_si128((__m128i *)&O[x/2]);
+      _mm_storeu_si128((__m128i *)&odata[y*ostride + x + 0], _mm_unpacklo_epi16(X0, X1)); // {  0  1  2  3  4  5  6  7 }
+      _mm_storeu_si128((__m128i *)&odata[y*ostride + x + 8], _mm_unpackhi_epi16(X0, X1)); // {  8  9 10 11 12 13 14 15 }
+    }
+    for (; x < iwidth; x += 2) {
+      odata[y*ostride + x + 0] = E[x/2];
+      odata[y*ostride + x + 1] = O[x/2];
+    }
+
+    for (; x < owidth; x += 2*skip) {
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+    }
+  }
+  for (; y < oheight; y+=skip) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], 2*owidth);
+  }
+
+  free(buf);
+}
+
+template<int skip> void Daubechies_9_7_transform_H_inplace_sse4_2(void *_idata,
+                                                                  const int istride,
+                                                                  const int width,
+                                                                  const int height,
+                                                                  const int) {
+  int16_t *idata = (int16_t *)_idata;
+
+  const int n = width/(2*skip);
+  const int blen = (n + 7)/8*8 + 16;
+  int16_t *buf = (int16_t *)memalign(16, 2*blen*sizeof(int16_t));
+  int16_t *E = buf + 8;
+  int16_t *O = buf + blen + 8;
+
+  for (int y = 0; y < height; y+=skip) {
+    for (int i = 0; i < n; i++) {
+      E[i] = idata[y*istride + (2*i + 0)*skip] << 1;
+      O[i] = idata[y*istride + (2*i + 1)*skip] << 1;
+    }
+
+    Daubechies_9_7_lift_sse4_2(E, O, n);
+
+    for (int i = 0; i < n; i++) {
+      idata[y*istride + (2*i + 0)*skip] = E[i];
+      idata[y*istride + (2*i + 1)*skip] = O[i];
+    }
+  }
+
+  free(buf);
+}
+
+/* The vertical transform runs all four lifting stages in a single pass down
+   the picture: whilst the first two stages are applied to row pair k the
+   last two are applied to row pair k - 1, so only a handful of rows are live
+   at any one time. */
+template<int skip> void Daubechies_9_7_transform_V_inplace_sse4_2(void *_idata,
+                                                                  const int istride,
+                                                                  const int width,
+                                                                  const int height,
+                                                                  const int) {
+  int16_t *idata = (int16_t *)_idata;
+  const __m128i W6497 = DAUBECHIES_9_7_W6497_SSE4_2;
+  const __m128i W217  = DAUBECHIES_9_7_W217_SSE4_2;
+  const __m128i W3616 = DAUBECHIES_9_7_W3616_SSE4_2;
+  const __m128i W1817 = DAUBECHIES_9_7_W1817_SSE4_2;
+  const int BLENDMASK = (skip == 1)?0x00:((skip == 2)?0xAA:((skip == 4)?0xEE:0xFE));
+  const int xskip = (skip > 8)?skip:8;
+
+#define BLEND_FOR_WRITE(A,B) ((skip == 1)?(A):_mm_blend_epi16(A,B,BLENDMASK))
+#define ROW(K,P) (idata + (2*(K) + (P))*skip*istride)
+
+  const int N = height/(2*skip);
+
+  for (int k = 0; k <= N; k++) {
+    const int16_t *Ep1 = ROW((k + 1 < N)?(k + 1):(N - 1), 0);
+    int16_t *E0  = ROW((k < N)?k:(N - 1), 0);
+    int16_t *O0  = ROW((k < N)?k:(N - 1), 1);
+    int16_t *Om1 = ROW((k > 0)?(k - 1):0, 1);
+    int16_t *Em1 = ROW((k > 0)?(k - 1):0, 0);
+    int16_t *Om2 = ROW((k > 1)?(k - 2):0, 1);
+
+    for (int x = 0; x < width; x += xskip) {
+      __m128i E, Ep, O, Om, Eo, Oo, Omm, S;
+
+      Om  = _mm_load_si128((__m128i *)&Om1[x]);
+      if (k < N) {
+        E   = _mm_load_si128((__m128i *)&E0[x]);
+        Ep  = _mm_load_si128((__m128i *)&Ep1[x]);
+        O   = _mm_load_si128((__m128i *)&O0[x]);
+        Eo  = E;
+        Oo  = O;
+
+        S   = _mm_add_epi16(E, Ep);
+        S   = _mm_add_epi16(S, _mm_mulhrs_epi16(S, W6497));
+        O   = _mm_sub_epi16(O, S);
+
+        if (k == 0)
+          Om = O;
+        S   = _mm_add_epi16(Om, O);
+        E   = _mm_sub_epi16(E, _mm_mulhrs_epi16(S, W217));
+
+        _mm_store_si128((__m128i *)&O0[x], BLEND_FOR_WRITE(O, Oo));
+        _mm_store_si128((__m128i *)&E0[x], BLEND_FOR_WRITE(E, Eo));
+      } else {
+        E   = _mm_load_si128((__m128i *)&Em1[x]);
+      }
+
+      if (k > 0) {
+        __m128i Em = _mm_load_si128((__m128i *)&Em1[x]);
+        Eo  = Em;
+        Oo  = Om;
+
+        S   = _mm_add_epi16(Em, E);
+        Om  = _mm_add_epi16(Om, _mm_mulhrs_epi16(S, W3616));
+
+        Omm = (k > 1)?_mm_load_si128((__m128i *)&Om2[x]):Om;
+        S   = _mm_add_epi16(Omm, Om);
+        Em  = _mm_add_epi16(Em, _mm_mulhrs_epi16(S, W1817));
+
+        _mm_store_si128((__m128i *)&Om1[x], BLEND_FOR_WRITE(Om, Oo));
+        _mm_store_si128((__m128i *)&Em1[x], BLEND_FOR_WRITE(Em, Eo));
+      }
+    }
+  }
+
+#undef ROW
+#undef BLEND_FOR_WRITE
+}
+
+/* The 32-bit coefficient versions form each product W*(A + B) in 64 bits,
+   as the C version does, since deep or high bit depth coefficients pass
+   2^31/6497. _mm_mul_epi32 multiplies the even lanes, and the odd lanes
+   after shifting them down. Only bits 12 to 43 of each rounded product are
+   kept, which a logical shift gives as well as an arithmetic one. The sums
+   A + B are formed in 32 bits, which holds them for any coefficients whose
+   lifted values themselves fit 32 bits. */
+static inline __m128i Daubechies_9_7_product_sse4_2_int32_t(const __m128i S, const __m128i W) {
+  const __m128i ROUND = _mm_set1_epi64x(2048);
+  const __m128i Pe = _mm_add_epi64(_mm_mul_epi32(S, W), ROUND);
+  const __m128i Po = _mm_add_epi64(_mm_mul_epi32(_mm_srli_epi64(S, 32), W), ROUND);
+  return _mm_blend_epi16(_mm_srli_epi64(Pe, 12), _mm_slli_epi64(Po, 20), 0xCC);
+}
+
+/* Performs the four lifting stages on a line split into its even samples
+   E[0..n-1] and odd samples O[0..n-1], as Daubechies_9_7_lift_sse4_2 does
+   for 16-bit coefficients. Both arrays must be 16-byte aligned with one
+   writable element before the start and at least four after the end. */
+static inline void Daubechies_9_7_lift_sse4_2_int32_t(int32_t *E, int32_t *O, const int n) {
+  const __m128i W6497 = _mm_set1_epi32(6497);
+  const __m128i W217  = _mm_set1_epi32( 217);
+  const __m128i W3616 = _mm_set1_epi32(3616);
+  const __m128i W1817 = _mm_set1_epi32(1817);
+
+  E[n] = E[n - 1];
+  for (int i = 0; i < n; i += 4) {
+    __m128i S = _mm_add_epi32(_mm_load_si128((__m128i *)&E[i]), _mm_loadu_si128((__m128i *)&E[i + 1]));
+    _mm_store_si128((__m128i *)&O[i], _mm_sub_epi32(_mm_load_si128((__m128i *)&O[i]), Daubechies_9_7_product_sse4_2_int32_t(S, W6497)));
+  }
+
+  O[-1] = O[0];
+  for (int i = 0; i < n; i += 4) {
+    __m128i S = _mm_add_epi32(_mm_loadu_si128((__m128i *)&O[i - 1]), _mm_load_si128((__m128i *)&O[i]));
+    _mm_store_si128((__m128i *)&E[i], _mm_sub_epi32(_mm_load_si128((__m128i *)&E[i]), Daubechies_9_7_product_sse4_2_int32_t(S, W217)));
+  }
+
+  E[n] = E[n - 1];
+  for (int i = 0; i < n; i += 4) {
+    __m128i S = _mm_add_epi32(_mm_load_si128((__m128i *)&E[i]), _mm_loadu_si128((__m128i *)&E[i + 1]));
+    _mm_store_si128((__m128i *)&O[i], _mm_add_epi32(_mm_load_si128((__m128i *)&O[i]), Daubechies_9_7_product_sse4_2_int32_t(S, W3616)));
+  }
+
+  O[-1] = O[0];
+  for (int i = 0; i < n; i += 4) {
+    __m128i S = _mm_add_epi32(_mm_loadu_si128((__m128i *)&O[i - 1]), _mm_load_si128((__m128i *)&O[i]));
+    _mm_store_si128((__m128i *)&E[i], _mm_add_epi32(_mm_load_si128((__m128i *)&E[i]), Daubechies_9_7_product_sse4_2_int32_t(S, W1817)));
+  }
+}
+
+template<int ACTIVE_BITS> void Daubechies_9_7_transform_H_inplace_10P2_sse4_2_int32_t(const char *_idata,
+                                                                                      const int istride,
+                                                                                      void **_odata,
+                                                                                      const int ostride,
+                                                                                      const int iwidth,
+                                                                                      const int iheight,
+                                                                                      const int owidth,
+                                                                                      const int oheight) {
+  int32_t *odata = *((int32_t **)_odata);
+  const int skip = 1;
+
+  const uint16_t *idata = (const uint16_t *)_idata;
+  const __m128i OFFSET = _mm_set1_epi16((int16_t)(1 << (ACTIVE_BITS - 1)));
+
+  const int n = iwidth/2;
+  const int blen = (n + 3)/4*4 + 8;
+  int32_t *buf = (int32_t *)memalign(16, 2*blen*sizeof(int32_t));
+  int32_t *E = buf + 4;
+  int32_t *O = buf + blen + 4;
+
+  int y = 0;
+  for (; y < iheight; y+=skip) {
+    int x = 0;
+    for (; x + 8 <= iwidth; x += 8) {
+      __m128i D0 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[y*istride + x]), OFFSET); // [  0  1  2  3  4  5  6  7 ]
+      _mm_prefetch(&idata[y*istride + x + 32], _MM_HINT_T0);
+
+      __m128 A0 = _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtepi16_epi32(D0), 1));                    // [  0  1  2  3 ]
+      __m128 A4 = _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(D0, 8)), 1)); // [  4  5  6  7 ]
+
+      _mm_store_si128((__m128i *)&E[x/2], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(2, 0, 2, 0)))); // [  0  2  4  6 ]
+      _mm_store_si128((__m128i *)&O[x/2], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(3, 1, 3, 1)))); // [  1  3  5  7 ]
+    }
+    for (; x < iwidth; x += 2) {
+      E[x/2] = (((int32_t)idata[y*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << 1;
+      O[x/2] = (((int32_t)idata[y*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << 1;
+    }
+
+    Daubechies_9_7_lift_sse4_2_int32_t(E, O, n);
+
+    x = 0;
+    for (; x + 8 <= iwidth; x += 8) {
+      __m128i X0 = _mm_load_si128((__m128i *)&E[x/2]);
+      __m128i X1 = _mm_load_si128((__m128i *)&O[x/2]);
+      _mm_storeu_si128((__m128i *)&odata[y*ostride + x + 0], _mm_unpacklo_epi32(X0, X1)); // {  0  1  2  3 }
+      _mm_storeu_si128((__m128i *)&odata[y*ostride + x + 4], _mm_unpackhi_epi32(X0, X1)); // {  4  5  6  7 }
+    }
+    for (; x < iwidth; x += 2) {
+      odata[y*ostride + x + 0] = E[x/2];
+      odata[y*ostride + x + 1] = O[x/2];
+    }
+
+    for (; x < owidth; x += 2*skip) {
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+    }
+  }
+  for (; y < oheight; y+=skip) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], 4*owidth);
+  }
+
+  free(buf);
+}
+
+template<int skip> void Daubechies_9_7_transform_H_inplace_sse4_2_int32_t(void *_idata,
+                                                                          const int istride,
+                                                                          const int width,
+                                                                          const int height,
+                                                                          const int) {
+  int32_t *idata = (int32_t *)_idata;
+
+  const int n = width/(2*skip);
+  const int blen = (n + 3)/4*4 + 8;
+  int32_t *buf = (int32_t *)memalign(16, 2*blen*sizeof(int32_t));
+  int32_t *E = buf + 4;
+  int32_t *O = buf + blen + 4;
+
+  for (int y = 0; y < height; y+=skip) {
+    int i = 0;
+    if (skip == 1) {
+      for (; i + 4 <= n; i += 4) {
+        __m128 A0 = _mm_castsi128_ps(_mm_slli_epi32(_mm_loadu_si128((__m128i *)&idata[y*istride + 2*i + 0]), 1)); // [  0  1  2  3 ]
+        __m128 A4 = _mm_castsi128_ps(_mm_slli_epi32(_mm_loadu_si128((__m128i *)&idata[y*istride + 2*i + 4]), 1)); // [  4  5  6  7 ]
+        _mm_store_si128((__m128i *)&E[i], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(2, 0, 2, 0)))); // [  0  2  4  6 ]
+        _mm_store_si128((__m128i *)&O[i], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(3, 1, 3, 1)))); // [  1  3  5  7 ]
+      }
+    }
+    for (; i < n; i++) {
+      E[i] = idata[y*istride + (2*i + 0)*skip] << 1;
+      O[i] = idata[y*istride + (2*i + 1)*skip] << 1;
+    }
+
+    Daubechies_9_7_lift_sse4_2_int32_t(E, O, n);
+
+    i = 0;
+    if (skip == 1) {
+      for (; i + 4 <= n; i += 4) {
+        __m128i X0 = _mm_load_si128((__m128i *)&E[i]);
+        __m128i X1 = _mm_load_si128((__m128i *)&O[i]);
+        _mm_storeu_si128((__m128i *)&idata[y*istride + 2*i + 0], _mm_unpacklo_epi32(X0, X1)); // {  0  1  2  3 }
+        _mm_storeu_si128((__m128i *)&idata[y*istride + 2*i + 4], _mm_unpackhi_epi32(X0, X1)); // {  4  5  6  7 }
+      }
+    }
+    for (; i < n; i++) {
+      idata[y*istride + (2*i + 0)*skip] = E[i];
+      idata[y*istride + (2*i + 1)*skip] = O[i];
+    }
+  }
+
+  free(buf);
+}
+
+/* The single pass of Daubechies_9_7_transform_V_inplace_sse4_2 for 32-bit
+   coefficients, four to a register */
+template<int skip> void Daubechies_9_7_transform_V_inplace_sse4_2_int32_t(void *_idata,
+                                                                          const int istride,
+                                                                          const int width,
+                                                                          const int height,
+                                                                          const int) {
+  int32_t *idata = (int32_t *)_idata;
+  const __m128i W6497 = _mm_set1_epi32(6497);
+  const __m128i W217  = _mm_set1_epi32( 217);
+  const __m128i W3616 = _mm_set1_epi32(3616);
+  const __m128i W1817 = _mm_set1_epi32(1817);
+  const int BLENDMASK = (skip == 1)?0x00:((skip == 2)?0xCC:0xFC);
+  const int xskip = (skip > 4)?skip:4;
+
+#define BLEND_FOR_WRITE(A,B) ((skip == 1)?(A):_mm_blend_epi16(A,B,BLENDMASK))
+#define ROW(K,P) (idata + (2*(K) + (P))*skip*istride)
+
+  const int N = height/(2*skip);
+
+  for (int k = 0; k <= N; k++) {
+    const int32_t *Ep1 = ROW((k + 1 < N)?(k + 1):(N - 1), 0);
+    int32_t *E0  = ROW((k < N)?k:(N - 1), 0);
+    int32_t *O0  = ROW((k < N)?k:(N - 1), 1);
+    int32_t *Om1 = ROW((k > 0)?(k - 1):0, 1);
+    int32_t *Em1 = ROW((k > 0)?(k - 1):0, 0);
+    int32_t *Om2 = ROW((k > 1)?(k - 2):0, 1);
+
+    for (int x = 0; x < width; x += xskip) {
+      __m128i E, Ep, O, Om, Eo, Oo, Omm, S;
+
+      Om  = _mm_load_si128((__m128i *)&Om1[x]);
+      if (k < N) {
+        E   = _mm_load_si128((__m128i *)&E0[x]);
+        Ep  = _mm_load_si128((__m128i *)&Ep1[x]);
+        O   = _mm_load_si128((__m128i *)&O0[x]);
+        Eo  = E;
+        Oo  = O;
+
+        S   = _mm_add_epi32(E, Ep);
+        O   = _mm_sub_epi32(O, Daubechies_9_7_product_sse4_2_int32_t(S, W6497));
+
+        if (k == 0)
+          Om = O;
+        S   = _mm_add_epi32(Om, O);
+        E   = _mm_sub_epi32(E, Daubechies_9_7_product_sse4_2_int32_t(S, W217));
+
+        _mm_store_si128((__m128i *)&O0[x], BLEND_FOR_WRITE(O, Oo));
+        _mm_store_si128((__m128i *)&E0[x], BLEND_FOR_WRITE(E, Eo));
+      } else {
+        E   = _mm_load_si128((__m128i *)&Em1[x]);
+      }
+
+      if (k > 0) {
+        __m128i Em = _mm_load_si128((__m128i *)&Em1[x]);
+        Eo  = Em;
+        Oo  = Om;
+
+        S   = _mm_add_epi32(Em, E);
+        Om  = _mm_add_epi32(Om, Daubechies_9_7_product_sse4_2_int32_t(S, W3616));
+
+        Omm = (k > 1)?_mm_load_si128((__m128i *)&Om2[x]):Om;
+        S   = _mm_add_epi32(Omm, Om);
+        Em  = _mm_add_epi32(Em, Daubechies_9_7_product_sse4_2_int32_t(S, W1817));
+
+        _mm_store_si128((__m128i *)&Om1[x], BLEND_FOR_WRITE(Om, Oo));
+        _mm_store_si128((__m128i *)&Em1[x], BLEND_FOR_WRITE(Em, Eo));
+      }
+    }
+  }
+
+#undef ROW
+#undef BLEND_FOR_WRITE
+}
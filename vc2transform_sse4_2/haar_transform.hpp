@@ -125,12 +125,16 @@ template<> void Haar_transform_H_inplace_V210_sse4_2<0, int16_t>(const char *_id
       }
     }
     for (x = iwidth; x < owidth; x += 2*skip) {
-      odata_y[(y + 0)*ostride + x + 0*skip] = odata_y[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata_y[(y + 0)*ostride + x + 1*skip] = odata_y[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata_y[(y + 0)*ostride + x + 0*skip] = odata_y[(y + 0)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata_y[(y + 0)*ostride + x + 1*skip] = odata_y[(y + 0)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+      odata_u[(y + 0)*ostride/2 + x/2] = odata_u[(y + 0)*ostride/2 + transform_pad_source(x/2, iwidth/2, skip)];
+      odata_v[(y + 0)*ostride/2 + x/2] = odata_v[(y + 0)*ostride/2 + transform_pad_source(x/2, iwidth/2, skip)];
     }
   }
   for (; y < oheight; y+=skip) {
-    memcpy(&odata_y[(y + 0)*ostride], &odata_y[(2*iheight - y - skip)*ostride], owidth*2);
+    memcpy(&odata_y[(y + 0)*ostride], &odata_y[transform_pad_line(y, iheight, skip)*ostride], owidth*2);
+    memcpy(&odata_u[(y + 0)*ostride/2], &odata_u[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
+    memcpy(&odata_v[(y + 0)*ostride/2], &odata_v[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
   }
 }
 
@@ -229,136 +233,38 @@ template<> void Haar_transform_H_inplace_V210_sse4_2<1, int16_t>(const char *_id
       }
     }
     for (x = iwidth; x < owidth; x += 2*skip) {
-      odata_y[(y + 0)*ostride + x + 0*skip] = odata_y[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata_y[(y + 0)*ostride + x + 1*skip] = odata_y[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata_y[(y + 0)*ostride + x + 0*skip] = odata_y[(y + 0)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata_y[(y + 0)*ostride + x + 1*skip] = odata_y[(y + 0)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+      odata_u[(y + 0)*ostride/2 + x/2] = odata_u[(y + 0)*ostride/2 + transform_pad_source(x/2, iwidth/2, skip)];
+      odata_v[(y + 0)*ostride/2 + x/2] = odata_v[(y + 0)*ostride/2 + transform_pad_source(x/2, iwidth/2, skip)];
     }
   }
   for (; y < oheight; y+=skip) {
-    memcpy(&odata_y[(y + 0)*ostride], &odata_y[(2*iheight - y - skip)*ostride], owidth*2);
+    memcpy(&odata_y[(y + 0)*ostride], &odata_y[transform_pad_line(y, iheight, skip)*ostride], owidth*2);
+    memcpy(&odata_u[(y + 0)*ostride/2], &odata_u[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
+    memcpy(&odata_v[(y + 0)*ostride/2], &odata_v[transform_pad_line(y, iheight, skip)*ostride/2], owidth);
   }
 }
 
-template<int shift, class T> void Haar_transform_H_inplace_10P2_sse4_2(const char *_idata,
-                                                                        const int istride,
-                                                                        void **_odata,
-                                                                        const int ostride,
-                                                                        const int iwidth,
-                                                                        const int iheight,
-                                                                        const int owidth,
-                                                                        const int oheight);
-
-template<> void Haar_transform_H_inplace_10P2_sse4_2<0,int16_t>(const char *_idata,
-                                                                 const int istride,
-                                                                 void **_odata,
-                                                                 const int ostride,
-                                                                 const int iwidth,
-                                                                 const int iheight,
-                                                                 const int owidth,
-                                                                 const int oheight){
+template<int ACTIVE_BITS, int shift> void Haar_transform_H_inplace_10P2_sse4_2_int16_t(const char *_idata,
+                                                                                        const int istride,
+                                                                                        void **_odata,
+                                                                                        const int ostride,
+                                                                                        const int iwidth,
+                                                                                        const int iheight,
+                                                                                        const int owidth,
+                                                                                        const int oheight){
   int16_t *odata = *((int16_t **)_odata);
   const int skip = 1;
 
   const uint16_t *idata = (const uint16_t *)_idata;
-  const __m128i OFFSET = _mm_set1_epi16(1 << 9);
+  const __m128i OFFSET = _mm_set1_epi16((int16_t)(1 << (ACTIVE_BITS - 1)));
   const __m128i ONE    = _mm_set1_epi16(1);
 
   int y = 0;
   for (; y < iheight; y+=2*skip) {
     int x = 0;
-    for (; x < iwidth; x += 16) {
-      __m128i ZA0, ZA8, ZB0, ZB8;
-      {
-        __m128i D0 = _mm_loadu_si128((__m128i *)&idata[y*istride + x + 0]); // [  0  1  2  3  4  5  6  7 ]
-        __m128i D8 = _mm_loadu_si128((__m128i *)&idata[y*istride + x + 8]); // [  8  9 10 11 12 13 14 15 ]
-
-        D0 = _mm_sub_epi16(D0, OFFSET);
-        D8 = _mm_sub_epi16(D8, OFFSET);
-
-        __m128i A0 = _mm_unpacklo_epi16(D0, D8); // [  0  8  1  9  2 10  3 11 ]
-        __m128i A4 = _mm_unpackhi_epi16(D0, D8); // [  4 12  5 13  6 14  7 15 ]
-        __m128i B0 = _mm_unpacklo_epi16(A0, A4); // [  0  4  8 12  1  5  9 13 ]
-        __m128i B2 = _mm_unpackhi_epi16(A0, A4); // [  2  6 10 14  3  7 11 15 ]
-
-        __m128i E0 = _mm_unpacklo_epi16(B0, B2); // [  0  2  4  6  8 10 12 14 ]
-        __m128i O1 = _mm_unpackhi_epi16(B0, B2); // [  1  3  5  7  9 11 13 15 ]
-
-        __m128i X1 = _mm_sub_epi16(O1, E0);                                        // {  1  3  5  7  9 11 13 15 }
-        __m128i X0 = _mm_add_epi16(E0, _mm_srai_epi16(_mm_add_epi16(X1, ONE), 1)); // {  0  2  4  6  8 10 12 14 }
-
-        ZA0 = _mm_unpacklo_epi16(X0, X1); // {  0  1  2  3  4  5  6  7 }
-        ZA8 = _mm_unpackhi_epi16(X0, X1); // {  8  9 10 11 12 13 14 15 }
-      }
-
-      {
-        __m128i D0 = _mm_loadu_si128((__m128i *)&idata[(y + 1)*istride + x + 0]); // [  0  1  2  3  4  5  6  7 ]
-        __m128i D8 = _mm_loadu_si128((__m128i *)&idata[(y + 1)*istride + x + 8]); // [  8  9 10 11 12 13 14 15 ]
-
-        D0 = _mm_sub_epi16(D0, OFFSET);
-        D8 = _mm_sub_epi16(D8, OFFSET);
-
-        __m128i A0 = _mm_unpacklo_epi16(D0, D8); // [  0  8  1  9  2 10  3 11 ]
-        __m128i A4 = _mm_unpackhi_epi16(D0, D8); // [  4 12  5 13  6 14  7 15 ]
-        __m128i B0 = _mm_unpacklo_epi16(A0, A4); // [  0  4  8 12  1  5  9 13 ]
-        __m128i B2 = _mm_unpackhi_epi16(A0, A4); // [  2  6 10 14  3  7 11 15 ]
-
-        __m128i E0 = _mm_unpacklo_epi16(B0, B2); // [  0  2  4  6  8 10 12 14 ]
-        __m128i O1 = _mm_unpackhi_epi16(B0, B2); // [  1  3  5  7  9 11 13 15 ]
-
-        __m128i X1 = _mm_sub_epi16(O1, E0);                                        // {  1  3  5  7  9 11 13 15 }
-        __m128i X0 = _mm_add_epi16(E0, _mm_srai_epi16(_mm_add_epi16(X1, ONE), 1)); // {  0  2  4  6  8 10 12 14 }
-
-        ZB0 = _mm_unpacklo_epi16(X0, X1); // {  0  1  2  3  4  5  6  7 }
-        ZB8 = _mm_unpackhi_epi16(X0, X1); // {  8  9 10 11 12 13 14 15 }
-      }
-
-      {
-        __m128i X1 = _mm_sub_epi16(ZB0, ZA0);
-        __m128i X0 = _mm_add_epi16(ZA0, _mm_srai_epi16(_mm_add_epi16(X1, ONE), 1));
-
-        _mm_store_si128((__m128i *)&odata[(y + 0)*ostride + x + 0], X0);
-        _mm_store_si128((__m128i *)&odata[(y + 1)*ostride + x + 0], X1);
-      }
-
-      {
-        __m128i X1 = _mm_sub_epi16(ZB8, ZA8);
-        __m128i X0 = _mm_add_epi16(ZA8, _mm_srai_epi16(_mm_add_epi16(X1, ONE), 1));
-
-        _mm_store_si128((__m128i *)&odata[(y + 0)*ostride + x + 8], X0);
-        _mm_store_si128((__m128i *)&odata[(y + 1)*ostride + x + 8], X1);
-      }
-    }
-    for (; x < owidth; x += 2*skip) {
-      odata[(y + 0)*ostride + x + 0*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 0)*ostride + x + 1*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
-      odata[(y + 1)*ostride + x + 0*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 1)*ostride + x + 1*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
-    }
-  }
-  for (; y < oheight; y+=2*skip) {
-    memcpy(&odata[(y + 0)*ostride], &odata[(2*iheight - y - 2*skip)*ostride], owidth*2);
-    memcpy(&odata[(y + 1)*ostride], &odata[(2*iheight - y - 1*skip)*ostride], owidth*2);
-  }
-}
-
-template<> void Haar_transform_H_inplace_10P2_sse4_2<1,int16_t>(const char *_idata,
-                                                                 const int istride,
-                                                                 void **_odata,
-                                                                 const int ostride,
-                                                                 const int iwidth,
-                                                                 const int iheight,
-                                                                 const int owidth,
-                                                                 const int oheight){
-  int16_t *odata = *((int16_t **)_odata);
-  const int skip = 1;
-
-  const uint16_t *idata = (const uint16_t *)_idata;
-  const __m128i OFFSET = _mm_set1_epi16(1 << 9);
-  const __m128i ONE    = _mm_set1_epi16(1);
-
-  int y = 0;
-  for (; y < iheight; y+=2*skip) {
-    int x = 0;
-    for (; x < iwidth; x += 16) {
+    for (; x + 16 <= iwidth; x += 16) {
       __m128i ZA0, ZA8, ZB0, ZB8;
 
       {
@@ -368,8 +274,8 @@ template<> void Haar_transform_H_inplace_10P2_sse4_2<1,int16_t>(const char *_ida
         D0 = _mm_sub_epi16(D0, OFFSET);
         D8 = _mm_sub_epi16(D8, OFFSET);
 
-        D0 = _mm_slli_epi16(D0, 1);
-        D8 = _mm_slli_epi16(D8, 1);
+        D0 = _mm_slli_epi16(D0, shift);
+        D8 = _mm_slli_epi16(D8, shift);
 
         __m128i A0 = _mm_unpacklo_epi16(D0, D8); // [  0  8  1  9  2 10  3 11 ]
         __m128i A4 = _mm_unpackhi_epi16(D0, D8); // [  4 12  5 13  6 14  7 15 ]
@@ -393,8 +299,8 @@ template<> void Haar_transform_H_inplace_10P2_sse4_2<1,int16_t>(const char *_ida
         D0 = _mm_sub_epi16(D0, OFFSET);
         D8 = _mm_sub_epi16(D8, OFFSET);
 
-        D0 = _mm_slli_epi16(D0, 1);
-        D8 = _mm_slli_epi16(D8, 1);
+        D0 = _mm_slli_epi16(D0, shift);
+        D8 = _mm_slli_epi16(D8, shift);
 
         __m128i A0 = _mm_unpacklo_epi16(D0, D8); // [  0  8  1  9  2 10  3 11 ]
         __m128i A4 = _mm_unpackhi_epi16(D0, D8); // [  4 12  5 13  6 14  7 15 ]
@@ -427,39 +333,56 @@ template<> void Haar_transform_H_inplace_10P2_sse4_2<1,int16_t>(const char *_ida
         _mm_store_si128((__m128i *)&odata[(y + 1)*ostride + x + 8], X1);
       }
     }
+    /* Widths which are not a multiple of sixteen finish the pair of lines a pair of samples at a time */
+    for (; x < iwidth; x += 2) {
+      const int32_t A0 = (((int32_t)idata[(y + 0)*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t A1 = (((int32_t)idata[(y + 0)*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t B0 = (((int32_t)idata[(y + 1)*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t B1 = (((int32_t)idata[(y + 1)*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << shift;
+
+      const int32_t AH = A1 - A0;
+      const int32_t AL = A0 + ((AH + 1) >> 1);
+      const int32_t BH = B1 - B0;
+      const int32_t BL = B0 + ((BH + 1) >> 1);
+
+      odata[(y + 0)*ostride + x + 0] = AL + ((BL - AL + 1) >> 1);
+      odata[(y + 0)*ostride + x + 1] = AH + ((BH - AH + 1) >> 1);
+      odata[(y + 1)*ostride + x + 0] = BL - AL;
+      odata[(y + 1)*ostride + x + 1] = BH - AH;
+    }
     for (; x < owidth; x += 2*skip) {
-      odata[(y + 0)*ostride + x + 0*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 0)*ostride + x + 1*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
-      odata[(y + 1)*ostride + x + 0*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 1)*ostride + x + 1*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata[(y + 0)*ostride + x + 0*skip] = odata[(y + 0)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[(y + 0)*ostride + x + 1*skip] = odata[(y + 0)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+      odata[(y + 1)*ostride + x + 0*skip] = odata[(y + 1)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[(y + 1)*ostride + x + 1*skip] = odata[(y + 1)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
     }
   }
   for (; y < oheight; y+=2*skip) {
-    memcpy(&odata[(y + 0)*ostride], &odata[(2*iheight - y - 2*skip)*ostride], owidth*2);
-    memcpy(&odata[(y + 1)*ostride], &odata[(2*iheight - y - 1*skip)*ostride], owidth*2);
+    memcpy(&odata[(y + 0)*ostride], &odata[transform_pad_line(y, iheight, 2*skip)*ostride], owidth*2);
+    memcpy(&odata[(y + 1)*ostride], &odata[(transform_pad_line(y, iheight, 2*skip) + skip)*ostride], owidth*2);
   }
 }
 
-template<int shift> inline void Haar_transform_H_inplace_10P2_sse4_2_int32_t(const char *_idata,
-                                                                             const int istride,
-                                                                             void **_odata,
-                                                                             const int ostride,
-                                                                             const int iwidth,
-                                                                             const int iheight,
-                                                                             const int owidth,
-                                                                             const int oheight){
+template<int ACTIVE_BITS, int shift> inline void Haar_transform_H_inplace_10P2_sse4_2_int32_t(const char *_idata,
+                                                                                              const int istride,
+                                                                                              void **_odata,
+                                                                                              const int ostride,
+                                                                                              const int iwidth,
+                                                                                              const int iheight,
+                                                                                              const int owidth,
+                                                                                              const int oheight){
   int32_t *odata = *((int32_t **)_odata);
   const int skip = 1;
 
   const uint16_t *idata = (const uint16_t *)_idata;
-  const __m128i OFFSET = _mm_set1_epi16(1 << 9);
+  const __m128i OFFSET = _mm_set1_epi16((int16_t)(1 << (ACTIVE_BITS - 1)));
   const __m128i ONE    = _mm_set1_epi32(1);
   const __m128i ZERO   = _mm_set1_epi32(0);
 
   int y = 0;
   for (; y < iheight; y+=2*skip) {
     int x = 0;
-    for (; x < iwidth; x += 8) {
+    for (; x + 8 <= iwidth; x += 8) {
       __m128i ZA0, ZA4, ZB0, ZB4;
       {
         __m128i D0 = _mm_loadu_si128((__m128i *)&idata[y*istride + x + 0]); // [  0  1  2  3  4  5  6  7 ]
@@ -525,55 +448,63 @@ template<int shift> inline void Haar_transform_H_inplace_10P2_sse4_2_int32_t(con
         _mm_store_si128((__m128i *)&odata[(y + 1)*ostride + x + 4], X1);
       }
     }
+    /* Widths which are not a multiple of eight finish the pair of lines a pair of samples at a time */
+    for (; x < iwidth; x += 2) {
+      const int32_t A0 = (((int32_t)idata[(y + 0)*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t A1 = (((int32_t)idata[(y + 0)*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t B0 = (((int32_t)idata[(y + 1)*istride + x + 0]) - (1 << (ACTIVE_BITS - 1))) << shift;
+      const int32_t B1 = (((int32_t)idata[(y + 1)*istride + x + 1]) - (1 << (ACTIVE_BITS - 1))) << shift;
+
+      const int32_t AH = A1 - A0;
+      const int32_t AL = A0 + ((AH + 1) >> 1);
+      const int32_t BH = B1 - B0;
+      const int32_t BL = B0 + ((BH + 1) >> 1);
+
+      odata[(y + 0)*ostride + x + 0] = AL + ((BL - AL + 1) >> 1);
+      odata[(y + 0)*ostride + x + 1] = AH + ((BH - AH + 1) >> 1);
+      odata[(y + 1)*ostride + x + 0] = BL - AL;
+      odata[(y + 1)*ostride + x + 1] = BH - AH;
+    }
     for (; x < owidth; x += 2*skip) {
-      odata[(y + 0)*ostride + x + 0*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 0)*ostride + x + 1*skip] = odata[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
-      odata[(y + 1)*ostride + x + 0*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[(y + 1)*ostride + x + 1*skip] = odata[(y + 1)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata[(y + 0)*ostride + x + 0*skip] = odata[(y + 0)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[(y + 0)*ostride + x + 1*skip] = odata[(y + 0)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+      odata[(y + 1)*ostride + x + 0*skip] = odata[(y + 1)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[(y + 1)*ostride + x + 1*skip] = odata[(y + 1)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
     }
   }
   for (; y < oheight; y+=2*skip) {
-    memcpy(&odata[(y + 0)*ostride], &odata[(2*iheight - y - 2*skip)*ostride], owidth*4);
-    memcpy(&odata[(y + 1)*ostride], &odata[(2*iheight - y - 1*skip)*ostride], owidth*4);
+    memcpy(&odata[(y + 0)*ostride], &odata[transform_pad_line(y, iheight, 2*skip)*ostride], owidth*4);
+    memcpy(&odata[(y + 1)*ostride], &odata[(transform_pad_line(y, iheight, 2*skip) + skip)*ostride], owidth*4);
   }
 }
 
-template<> void Haar_transform_H_inplace_10P2_sse4_2<1,int32_t>(const char *_idata,
-                                                                const int istride,
-                                                                void **_odata,
-                                                                const int ostride,
-                                                                const int iwidth,
-                                                                const int iheight,
-                                                                const int owidth,
-                                                                const int oheight)
-{
-  Haar_transform_H_inplace_10P2_sse4_2_int32_t<1>(_idata,
-                                                  istride,
-                                                  _odata,
-                                                  ostride,
-                                                  iwidth,
-                                                  iheight,
-                                                  owidth,
-                                                  oheight);
-}
-
-template<> void Haar_transform_H_inplace_10P2_sse4_2<0,int32_t>(const char *_idata,
-                                                                const int istride,
-                                                                void **_odata,
-                                                                const int ostride,
-                                                                const int iwidth,
-                                                                const int iheight,
-                                                                const int owidth,
-                                                                const int oheight)
+template<int ACTIVE_BITS, int shift, class T> void Haar_transform_H_inplace_10P2_sse4_2(const char *_idata,
+                                                                                         const int istride,
+                                                                                         void **_odata,
+                                                                                         const int ostride,
+                                                                                         const int iwidth,
+                                                                                         const int iheight,
+                                                                                         const int owidth,
+                                                                                         const int oheight)
 {
-  Haar_transform_H_inplace_10P2_sse4_2_int32_t<0>(_idata,
-                                                  istride,
-                                                  _odata,
-                                                  ostride,
-                                                  iwidth,
-                                                  iheight,
-                                                  owidth,
-                                                  oheight);
+  if (sizeof(T) == 2)
+    Haar_transform_H_inplace_10P2_sse4_2_int16_t<ACTIVE_BITS, shift>(_idata,
+                                                                     istride,
+                                                                     _odata,
+                                                                     ostride,
+                                                                     iwidth,
+                                                                     iheight,
+                                                                     owidth,
+                                                                     oheight);
+  else
+    Haar_transform_H_inplace_10P2_sse4_2_int32_t<ACTIVE_BITS, shift>(_idata,
+                                                                     istride,
+                                                                     _odata,
+                                                                     ostride,
+                                                                     iwidth,
+                                                                     iheight,
+                                                                     owidth,
+                                                                     oheight);
 }
 
 template<int skip, int shift> void Haar_transform_H_inplace_sse4_2(void *_idata,
@@ -690,6 +621,66 @@ template<> void Haar_transform_H_inplace_sse4_2<2, 1>(void *_idata,
 }
 
 
+/* With four 32-bit samples per register the pairs at the coarser levels are
+   a register or more apart, so from skip 4 upwards each pair is transformed
+   in lane zero of two registers and blended back over the original data. */
+template<int skip, int shift> void Haar_transform_H_inplace_sse4_2_int32_t(void *_idata,
+                                                                         const int istride,
+                                                                         const int width,
+                                                                         const int height,
+                                                                         const int) {
+  int32_t *idata = (int32_t *)_idata;
+
+  const __m128i ONE = _mm_set1_epi32(1);
+
+  for (int y = 0; y < height; y+=skip) {
+    if (skip == 1) {
+      for (int x = 0; x < width; x += 8) {
+        __m128 D0 = _mm_castsi128_ps(_mm_load_si128((__m128i *)&idata[y*istride + x + 0])); // [  0  1  2  3 ]
+        __m128 D4 = _mm_castsi128_ps(_mm_load_si128((__m128i *)&idata[y*istride + x + 4])); // [  4  5  6  7 ]
+
+        __m128i E0 = _mm_slli_epi32(_mm_castps_si128(_mm_shuffle_ps(D0, D4, _MM_SHUFFLE(2, 0, 2, 0))), shift); // [  0  2  4  6 ]
+        __m128i O1 = _mm_slli_epi32(_mm_castps_si128(_mm_shuffle_ps(D0, D4, _MM_SHUFFLE(3, 1, 3, 1))), shift); // [  1  3  5  7 ]
+
+        __m128i X1 = _mm_sub_epi32(O1, E0);                                        // {  1  3  5  7 }
+        __m128i X0 = _mm_add_epi32(E0, _mm_srai_epi32(_mm_add_epi32(X1, ONE), 1)); // {  0  2  4  6 }
+
+        _mm_store_si128((__m128i *)&idata[y*istride + x + 0], _mm_unpacklo_epi32(X0, X1)); // {  0  1  2  3 }
+        _mm_store_si128((__m128i *)&idata[y*istride + x + 4], _mm_unpackhi_epi32(X0, X1)); // {  4  5  6  7 }
+      }
+    } else if (skip == 2) {
+      for (int x = 0; x < width; x += 4) {
+        __m128i D0 = _mm_load_si128((__m128i *)&idata[y*istride + x]); // [  0  X  1  X ]
+
+        __m128i E0 = _mm_slli_epi32(D0, shift);                                       // [  0  X  1  X ]
+        __m128i O1 = _mm_shuffle_epi32(E0, _MM_SHUFFLE(1, 0, 3, 2));                  // [  1  X  0  X ]
+
+        __m128i X1 = _mm_sub_epi32(O1, E0);                                           // {  1  X  X  X }
+        __m128i X0 = _mm_add_epi32(E0, _mm_srai_epi32(_mm_add_epi32(X1, ONE), 1));    // {  0  X  X  X }
+
+        __m128i Z0 = _mm_blend_epi16(D0, X0, 0x03);                                   // {  0  X  1  X }
+        Z0 = _mm_blend_epi16(Z0, _mm_shuffle_epi32(X1, _MM_SHUFFLE(1, 0, 3, 2)), 0x30); // {  0  X  1  X }
+
+        _mm_store_si128((__m128i *)&idata[y*istride + x], Z0);
+      }
+    } else {
+      for (int x = 0; x < width; x += 2*skip) {
+        __m128i D0 = _mm_load_si128((__m128i *)&idata[y*istride + x + 0*skip]); // [  0  X  X  X ]
+        __m128i D1 = _mm_load_si128((__m128i *)&idata[y*istride + x + 1*skip]); // [  1  X  X  X ]
+
+        __m128i E0 = _mm_slli_epi32(D0, shift);
+        __m128i O1 = _mm_slli_epi32(D1, shift);
+
+        __m128i X1 = _mm_sub_epi32(O1, E0);                                        // {  1  X  X  X }
+        __m128i X0 = _mm_add_epi32(E0, _mm_srai_epi32(_mm_add_epi32(X1, ONE), 1)); // {  0  X  X  X }
+
+        _mm_store_si128((__m128i *)&idata[y*istride + x + 0*skip], _mm_blend_epi16(D0, X0, 0x03));
+        _mm_store_si128((__m128i *)&idata[y*istride + x + 1*skip], _mm_blend_epi16(D1, X1, 0x03));
+      }
+    }
+  }
+}
+
 template<int skip, class T>void Haar_transform_V_inplace_sse4_2(void *_idata,
                                                               const int istride,
                                                               const int width,
@@ -822,3 +813,84 @@ template<>void Haar_transform_V_inplace_sse4_2<8, int16_t>(void *_idata,
     }
   }
 }
+
+template<>void Haar_transform_V_inplace_sse4_2<2, int32_t>(void *_idata,
+                                                         const int istride,
+                                                         const int width,
+                                                         const int height,
+                                                         const int) {
+  int32_t *idata = (int32_t *)_idata;
+  const __m128i ONE = _mm_set1_epi32(1);
+  const uint8_t BLENDMASK = 0x33;
+  const int skip = 2;
+
+  for (int y = 0; y < height; y += 2*skip) {
+    for (int x = 0; x < width; x+= 4) {
+      __m128i D0 = _mm_load_si128((__m128i *)&idata[(y + 0*skip)*istride + x]);
+      __m128i D1 = _mm_load_si128((__m128i *)&idata[(y + 1*skip)*istride + x]);
+
+      __m128i X1 = _mm_sub_epi32(D1, D0);
+      __m128i X0 = _mm_add_epi32(D0, _mm_srai_epi32(_mm_add_epi32(X1, ONE), 1));
+
+      __m128i Z0 = _mm_blend_epi16(D0, X0, BLENDMASK);
+      __m128i Z1 = _mm_blend_epi16(D1, X1, BLENDMASK);
+
+      _mm_store_si128((__m128i *)&idata[(y + 0*skip)*istride + x], Z0);
+      _mm_store_si128((__m128i *)&idata[(y + 1*skip)*istride + x], Z1);
+    }
+  }
+}
+
+template<>void Haar_transform_V_inplace_sse4_2<4, int32_t>(void *_idata,
+                                                         const int istride,
+                                                         const int width,
+                                                         const int height,
+                                                         const int) {
+  int32_t *idata = (int32_t *)_idata;
+  const __m128i ONE = _mm_set1_epi32(1);
+  const uint8_t BLENDMASK = 0x03;
+  const int skip = 4;
+
+  for (int y = 0; y < height; y += 2*skip) {
+    for (int x = 0; x < width; x+= 4) {
+      __m128i D0 = _mm_load_si128((__m128i *)&idata[(y + 0*skip)*istride + x]);
+      __m128i D1 = _mm_load_si128((__m128i *)&idata[(y + 1*skip)*istride + x]);
+
+      __m128i X1 = _mm_sub_epi32(D1, D0);
+      __m128i X0 = _mm_add_epi32(D0, _mm_srai_epi32(_mm_add_epi32(X1, ONE), 1));
+
+      __m128i Z0 = _mm_blend_epi16(D0, X0, BLENDMASK);
+      __m128i Z1 = _mm_blend_epi16(D1, X1, BLENDMASK);
+
+      _mm_store_si128((__m128i *)&idata[(y + 0*skip)*istride + x], Z0);
+      _mm_store_si128((__m128i *)&idata[(y + 1*skip)*istride + x], Z1);
+    }
+  }
+}
+
+template<>void Haar_transform_V_inplace_sse4_2<8, int32_t>(void *_idata,
+                                                         const int istride,
+                                                         const int width,
+                                                         const int height,
+                                                         const int) {
+  int32_t *idata = (int32_t *)_idata;
+  const __m128i ONE = _mm_set1_epi32(1);
+  const uint8_t BLENDMASK = 0x03;
+  const int skip = 8;
+
+  for (int y = 0; y < height; y += 2*skip) {
+    for (int x = 0; x < width; x+= 8) {
+      __m128i D0 = _mm_load_si128((__m128i *)&idata[(y + 0*skip)*istride + x]);
+      __m128i D1 = _mm_load_si128((__m128i *)&idata[(y + 1*skip)*istride + x]);
+
+      __m128i X1 = _mm_sub_epi32(D1, D0);
+      __m128i X0 = _mm_add_epi32(D0, _mm_srai_epi32(_mm_add_epi32(X1, ONE), 1));
+
+      __m128i Z0 = _mm_blend_epi16(D0, X0, BLENDMASK);
+      __m128i Z1 = _mm_blend_epi16(D1, X1, BLENDMASK);
+
+      _mm_store_si128((__m128i *)&idata[(y + 0*skip)*istride + x], Z0);
+      _mm_store_si128((__m128i *)&idata[(y + 1*skip)*istride + x], Z1);
+    }
+  }
+}
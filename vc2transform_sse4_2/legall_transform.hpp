@@ -25,6 +25,7 @@
 
 #include "transform.hpp"
 #include <string.h>
+#include <malloc.h>
 #include <x86intrin.h>
 
 void LeGall_5_3_transform_H_inplace_V210_sse4_2(const char *_idata,
@@ -195,8 +196,8 @@ void LeGall_5_3_transform_H_inplace_V210_sse4_2(const char *_idata,
         }
       }
       for (x = iwidth; x < owidth; x += 2*skip) {
-        odata_y[(y + 0)*ostride + x + 0*skip] = odata_y[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-        odata_y[(y + 0)*ostride + x + 1*skip] = odata_y[(y + 0)*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+        odata_y[(y + 0)*ostride + x + 0*skip] = odata_y[(y + 0)*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+        odata_y[(y + 0)*ostride + x + 1*skip] = odata_y[(y + 0)*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
       }
     }
 
@@ -336,31 +337,31 @@ void LeGall_5_3_transform_H_inplace_V210_sse4_2(const char *_idata,
         }
       }
       for (x = iwidth; x < owidth; x += 2*skip) {
-        odata_u[(y + 0)*ostride/2 + x/2] = odata_u[(y + 0)*ostride/2 + (2*iwidth/2 - x/2 - 2*skip)];
-        odata_v[(y + 0)*ostride/2 + x/2] = odata_v[(y + 0)*ostride/2 + (2*iwidth/2 - x/2 - 2*skip)];
+        odata_u[(y + 0)*ostride/2 + x/2] = odata_u[(y + 0)*ostride/2 + transform_pad_source(x/2, iwidth/2, skip)];
+        odata_v[(y + 0)*ostride/2 + x/2] = odata_v[(y + 0)*ostride/2 + transform_pad_source(x/2, iwidth/2, skip)];
       }
     }
   }
   for (; y < oheight; y+=skip) {
-    memcpy(&odata_y[(y + 0)*ostride],   &odata_y[(2*iheight - y - skip)*ostride],   2*owidth);
-    memcpy(&odata_u[(y + 0)*ostride/2], &odata_u[(2*iheight - y - skip)*ostride/2],   owidth);
-    memcpy(&odata_v[(y + 0)*ostride/2], &odata_v[(2*iheight - y - skip)*ostride/2],   owidth);
+    memcpy(&odata_y[(y + 0)*ostride],   &odata_y[transform_pad_line(y, iheight, skip)*ostride],   2*owidth);
+    memcpy(&odata_u[(y + 0)*ostride/2], &odata_u[transform_pad_line(y, iheight, skip)*ostride/2],   owidth);
+    memcpy(&odata_v[(y + 0)*ostride/2], &odata_v[transform_pad_line(y, iheight, skip)*ostride/2],   owidth);
   }
 }
 
 
-void LeGall_5_3_transform_H_inplace_10P2_sse4_2(const char *idata,
-                                                 const int istride,
-                                                 void **_odata,
-                                                 const int ostride,
-                                                 const int iwidth,
-                                                 const int iheight,
-                                                 const int owidth,
-                                                 const int oheight) {
+template<int ACTIVE_BITS> void LeGall_5_3_transform_H_inplace_10P2_sse4_2(const char *idata,
+                                                                           const int istride,
+                                                                           void **_odata,
+                                                                           const int ostride,
+                                                                           const int iwidth,
+                                                                           const int iheight,
+                                                                           const int owidth,
+                                                                           const int oheight) {
   int16_t *odata = *((int16_t **)_odata);
   const int skip = 1;
 
-  const __m128i offset = _mm_set1_epi16(1 << 9);
+  const __m128i offset = _mm_set1_epi16((int16_t)(1 << (ACTIVE_BITS - 1)));
   const __m128i ONE = _mm_set1_epi16(1);
   const __m128i TWO = _mm_set1_epi16(2);
 
@@ -376,98 +377,118 @@ void LeGall_5_3_transform_H_inplace_10P2_sse4_2(const char *idata,
       E0, E2, E16,
       O1, O17;
 
-    D0 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 0)*2]), offset); // [  0  1  2  3  4  5  6  7 ]
-    D8 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 8)*2]), offset); // [  8  9 10 11 12 13 14 15 ]
-    _mm_prefetch(&idata[(y*istride + x + 16)*2], _MM_HINT_T0);
+    if (iwidth >= 32) {
+      D0 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 0)*2]), offset); // [  0  1  2  3  4  5  6  7 ]
+      D8 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 8)*2]), offset); // [  8  9 10 11 12 13 14 15 ]
+      _mm_prefetch(&idata[(y*istride + x + 16)*2], _MM_HINT_T0);
 
-    A0 = _mm_unpacklo_epi16(D0, D8); // [  0  8  1  9  2 10  3 11 ]
-    A4 = _mm_unpackhi_epi16(D0, D8); // [  4 12  5 13  6 14  7 15 ]
-    B0 = _mm_unpacklo_epi16(A0, A4); // [  0  4  8 12  1  5  9 13 ]
-    B2 = _mm_unpackhi_epi16(A0, A4); // [  2  6 10 14  3  7 11 15 ]
-    E0 = _mm_unpacklo_epi16(B0, B2); // [  0  2  4  6  8 10 12 14 ]
-    O1 = _mm_unpackhi_epi16(B0, B2); // [  1  3  5  7  9 11 13 15 ]
+      A0 = _mm_unpacklo_epi16(D0, D8); // [  0  8  1  9  2 10  3 11 ]
+      A4 = _mm_unpackhi_epi16(D0, D8); // [  4 12  5 13  6 14  7 15 ]
+      B0 = _mm_unpacklo_epi16(A0, A4); // [  0  4  8 12  1  5  9 13 ]
+      B2 = _mm_unpackhi_epi16(A0, A4); // [  2  6 10 14  3  7 11 15 ]
+      E0 = _mm_unpacklo_epi16(B0, B2); // [  0  2  4  6  8 10 12 14 ]
+      O1 = _mm_unpackhi_epi16(B0, B2); // [  1  3  5  7  9 11 13 15 ]
 
-    {
-      D16 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 16)*2]), offset); // [ 16 17 18 19 20 21 22 23 ]
-      D24 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 24)*2]), offset); // [ 24 25 26 27 28 29 30 31 ]
-      _mm_prefetch(&idata[(y*istride + x + 32)*2], _MM_HINT_T0);
+      {
+        D16 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 16)*2]), offset); // [ 16 17 18 19 20 21 22 23 ]
+        D24 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 24)*2]), offset); // [ 24 25 26 27 28 29 30 31 ]
+        _mm_prefetch(&idata[(y*istride + x + 32)*2], _MM_HINT_T0);
 
-      A16 = _mm_unpacklo_epi16(D16, D24); // [ 16 24 17 25 18 26 19 27 ]
-      A20 = _mm_unpackhi_epi16(D16, D24); // [ 20 28 21 29 22 30 23 31 ]
-      B16 = _mm_unpacklo_epi16(A16, A20); // [ 16 20 24 28 17 21 25 29 ]
-      B22 = _mm_unpackhi_epi16(A16, A20); // [ 18 22 26 30 19 23 27 31 ]
+        A16 = _mm_unpacklo_epi16(D16, D24); // [ 16 24 17 25 18 26 19 27 ]
+        A20 = _mm_unpackhi_epi16(D16, D24); // [ 20 28 21 29 22 30 23 31 ]
+        B16 = _mm_unpacklo_epi16(A16, A20); // [ 16 20 24 28 17 21 25 29 ]
+        B22 = _mm_unpackhi_epi16(A16, A20); // [ 18 22 26 30 19 23 27 31 ]
 
-      E16 = _mm_unpacklo_epi16(B16, B22); // [ 16 18 20 22 24 26 28 30 ]
-      O17 = _mm_unpackhi_epi16(B16, B22); // [ 17 19 21 23 25 27 29 31 ]
+        E16 = _mm_unpacklo_epi16(B16, B22); // [ 16 18 20 22 24 26 28 30 ]
+        O17 = _mm_unpackhi_epi16(B16, B22); // [ 17 19 21 23 25 27 29 31 ]
 
-      E2 = _mm_alignr_epi8(E16, E0, 2); // [  2  4  6  8 10 12 14 16 ]
+        E2 = _mm_alignr_epi8(E16, E0, 2); // [  2  4  6  8 10 12 14 16 ]
 
-      Y1 = _mm_sub_epi16(_mm_slli_epi16(O1, 1), _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(E0, E2), 1), ONE), 1)); // {  1  3  5  7  9 11 13 15 }
-      Ym = _mm_insert_epi16(_mm_slli_si128(Y1, 2), _mm_extract_epi16(Y1, 0), 0); // {  1  1  3  5  7  9 11 13 }
-      Y0 = _mm_add_epi16(_mm_slli_epi16(E0, 1), _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(Ym, Y1), TWO), 2)); // {  0  2  4  6  8 10 12 14 }
+        Y1 = _mm_sub_epi16(_mm_slli_epi16(O1, 1), _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(E0, E2), 1), ONE), 1)); // {  1  3  5  7  9 11 13 15 }
+        Ym = _mm_insert_epi16(_mm_slli_si128(Y1, 2), _mm_extract_epi16(Y1, 0), 0); // {  1  1  3  5  7  9 11 13 }
+        Y0 = _mm_add_epi16(_mm_slli_epi16(E0, 1), _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(Ym, Y1), TWO), 2)); // {  0  2  4  6  8 10 12 14 }
 
-      Z0 = _mm_unpacklo_epi16(Y0, Y1); // {  0  1  2  3  4  5  6  7 }
-      _mm_store_si128((__m128i *)&odata[y*ostride + x +  0], Z0);
-      Z4 = _mm_unpackhi_epi16(Y0, Y1); // {  8  9 10 11 12 13 14 15 }
-      _mm_store_si128((__m128i *)&odata[y*ostride + x +  8], Z4);
+        Z0 = _mm_unpacklo_epi16(Y0, Y1); // {  0  1  2  3  4  5  6  7 }
+        _mm_store_si128((__m128i *)&odata[y*ostride + x +  0], Z0);
+        Z4 = _mm_unpackhi_epi16(Y0, Y1); // {  8  9 10 11 12 13 14 15 }
+        _mm_store_si128((__m128i *)&odata[y*ostride + x +  8], Z4);
 
-      E0 = E16;
-      O1 = O17;
-      Yz = Y1;
-    }
+        E0 = E16;
+        O1 = O17;
+        Yz = Y1;
+      }
 
-    x += 16;
+      x += 16;
 
-    for (; x < iwidth - 16; x += 16) {
-      D16 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 16)*2]), offset); // [ 16 17 18 19 20 21 22 23 ]
-      D24 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 24)*2]), offset); // [ 24 25 26 27 28 29 30 31 ]
-      _mm_prefetch(&idata[(y*istride + x + 32)*2], _MM_HINT_T0);
+      for (; x + 32 <= iwidth; x += 16) {
+        D16 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 16)*2]), offset); // [ 16 17 18 19 20 21 22 23 ]
+        D24 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[(y*istride + x + 24)*2]), offset); // [ 24 25 26 27 28 29 30 31 ]
+        _mm_prefetch(&idata[(y*istride + x + 32)*2], _MM_HINT_T0);
 
-      A16 = _mm_unpacklo_epi16(D16, D24); // [ 16 24 17 25 18 26 19 27 ]
-      A20 = _mm_unpackhi_epi16(D16, D24); // [ 20 28 21 29 22 30 23 31 ]
-      B16 = _mm_unpacklo_epi16(A16, A20); // [ 16 20 24 28 17 21 25 29 ]
-      B22 = _mm_unpackhi_epi16(A16, A20); // [ 18 22 26 30 19 23 27 31 ]
+        A16 = _mm_unpacklo_epi16(D16, D24); // [ 16 24 17 25 18 26 19 27 ]
+        A20 = _mm_unpackhi_epi16(D16, D24); // [ 20 28 21 29 22 30 23 31 ]
+        B16 = _mm_unpacklo_epi16(A16, A20); // [ 16 20 24 28 17 21 25 29 ]
+        B22 = _mm_unpackhi_epi16(A16, A20); // [ 18 22 26 30 19 23 27 31 ]
 
-      E16 = _mm_unpacklo_epi16(B16, B22); // [ 16 18 20 22 24 26 28 30 ]
-      O17 = _mm_unpackhi_epi16(B16, B22); // [ 17 19 21 23 25 27 29 31 ]
+        E16 = _mm_unpacklo_epi16(B16, B22); // [ 16 18 20 22 24 26 28 30 ]
+        O17 = _mm_unpackhi_epi16(B16, B22); // [ 17 19 21 23 25 27 29 31 ]
 
-      E2 = _mm_alignr_epi8(E16, E0, 2); // [  2  4  6  8 10 12 14 16 ]
+        E2 = _mm_alignr_epi8(E16, E0, 2); // [  2  4  6  8 10 12 14 16 ]
 
-      Y1 = _mm_sub_epi16(_mm_slli_epi16(O1, 1), _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(E0, E2), 1), ONE), 1)); // {  1  3  5  7  9 11 13 15 }
-      Ym = _mm_alignr_epi8(Y1, Yz, 14); // { -1  1  3  5  7  9 11 13 }
-      Y0 = _mm_add_epi16(_mm_slli_epi16(E0, 1), _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(Ym, Y1), TWO), 2)); // {  0  2  4  6  8 10 12 14 }
+        Y1 = _mm_sub_epi16(_mm_slli_epi16(O1, 1), _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(E0, E2), 1), ONE), 1)); // {  1  3  5  7  9 11 13 15 }
+        Ym = _mm_alignr_epi8(Y1, Yz, 14); // { -1  1  3  5  7  9 11 13 }
+        Y0 = _mm_add_epi16(_mm_slli_epi16(E0, 1), _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(Ym, Y1), TWO), 2)); // {  0  2  4  6  8 10 12 14 }
 
-      Z0 = _mm_unpacklo_epi16(Y0, Y1); // {  0  1  2  3  4  5  6  7 }
-      _mm_store_si128((__m128i *)&odata[y*ostride + x +  0], Z0);
-      Z4 = _mm_unpackhi_epi16(Y0, Y1); // {  8  9 10 11 12 13 14 15 }
-      _mm_store_si128((__m128i *)&odata[y*ostride + x +  8], Z4);
+        Z0 = _mm_unpacklo_epi16(Y0, Y1); // {  0  1  2  3  4  5  6  7 }
+        _mm_store_si128((__m128i *)&odata[y*ostride + x +  0], Z0);
+        Z4 = _mm_unpackhi_epi16(Y0, Y1); // {  8  9 10 11 12 13 14 15 }
+        _mm_store_si128((__m128i *)&odata[y*ostride + x +  8], Z4);
 
-      E0 = E16;
-      O1 = O17;
-      Yz = Y1;
-    }
+        E0 = E16;
+        O1 = O17;
+        Yz = Y1;
+      }
 
-    {
-      E2 = _mm_insert_epi16(_mm_srli_si128(E0, 2), _mm_extract_epi16(E0, 7), 7); // [  2  4  6  8 10 12 14 14 ]
+      if (x + 16 == iwidth) {
+        E2 = _mm_insert_epi16(_mm_srli_si128(E0, 2), _mm_extract_epi16(E0, 7), 7); // [  2  4  6  8 10 12 14 14 ]
 
-      Y1 = _mm_sub_epi16(_mm_slli_epi16(O1, 1), _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(E0, E2), 1), ONE), 1)); // {  1  3  5  7  9 11 13 15 }
-      Ym = _mm_alignr_epi8(Y1, Yz, 14); // { -1  1  3  5  7  9 11 13 }
-      Y0 = _mm_add_epi16(_mm_slli_epi16(E0, 1), _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(Ym, Y1), TWO), 2)); // {  0  2  4  6  8 10 12 14 }
+        Y1 = _mm_sub_epi16(_mm_slli_epi16(O1, 1), _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(_mm_add_epi16(E0, E2), 1), ONE), 1)); // {  1  3  5  7  9 11 13 15 }
+        Ym = _mm_alignr_epi8(Y1, Yz, 14); // { -1  1  3  5  7  9 11 13 }
+        Y0 = _mm_add_epi16(_mm_slli_epi16(E0, 1), _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(Ym, Y1), TWO), 2)); // {  0  2  4  6  8 10 12 14 }
 
-      Z0 = _mm_unpacklo_epi16(Y0, Y1); // {  0  1  2  3  4  5  6  7 }
-      _mm_store_si128((__m128i *)&odata[y*ostride + x +  0], Z0);
-      Z4 = _mm_unpackhi_epi16(Y0, Y1); // {  8  9 10 11 12 13 14 15 }
-      _mm_store_si128((__m128i *)&odata[y*ostride + x +  8], Z4);
+        Z0 = _mm_unpacklo_epi16(Y0, Y1); // {  0  1  2  3  4  5  6  7 }
+        _mm_store_si128((__m128i *)&odata[y*ostride + x +  0], Z0);
+        Z4 = _mm_unpackhi_epi16(Y0, Y1); // {  8  9 10 11 12 13 14 15 }
+        _mm_store_si128((__m128i *)&odata[y*ostride + x +  8], Z4);
+        x += 16;
+      }
+    }
+
+    /* Widths which are not a multiple of sixteen finish the line a pair of samples at a time */
+    if (x < iwidth) {
+      const uint16_t *D = (const uint16_t *)&idata[y*istride*2];
+      int32_t Xm1 = (x > 0)?odata[y*ostride + x - 1]:0;
+      for (; x < iwidth; x += 2) {
+        const int32_t E   = (((int32_t)D[x + 0]) - (1 << (ACTIVE_BITS - 1))) << 1;
+        const int32_t O   = (((int32_t)D[x + 1]) - (1 << (ACTIVE_BITS - 1))) << 1;
+        const int32_t Ep2 = (x + 2 < iwidth)?((((int32_t)D[x + 2]) - (1 << (ACTIVE_BITS - 1))) << 1):E;
+
+        const int32_t Xp1 = O - ((E + Ep2 + 1) >> 1);
+        if (x == 0)
+          Xm1 = Xp1;
+        odata[y*ostride + x + 0] = E + ((Xm1 + Xp1 + 2) >> 2);
+        odata[y*ostride + x + 1] = Xp1;
+        Xm1 = Xp1;
+      }
     }
-    x += 16;
 
     for (; x < owidth; x += 2*skip) {
-      odata[y*ostride + x + 0*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 0*skip];
-      odata[y*ostride + x + 1*skip] = odata[y*ostride + (2*iwidth - x - 2*skip) + 1*skip];
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
     }
   }
   for (; y < oheight; y+=skip) {
-    memcpy(&odata[y*ostride], &odata[(2*iheight - y - skip)*ostride], 2*owidth);
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], 2*owidth);
   }
 }
 
@@ -660,3 +681,201 @@ template<int skip> void LeGall_5_3_transform_V_inplace_sse4_2(void *_idata,
 
 #undef BLEND_FOR_WRITE
 }
+
+/* The 32-bit coefficient versions hold four samples per register, too few
+   to keep a whole lifting step in registers as the 16-bit versions do, so
+   each line is split into its even samples E[0..n-1] and odd samples
+   O[0..n-1], lifted in place and then recombined. Since both samples are
+   doubled before lifting the first step is exactly 2*O[i] - (E[i] + E[i+1]).
+   Both arrays must be 16-byte aligned with one writable element before the
+   start and at least four after the end. */
+static inline void LeGall_5_3_lift_sse4_2_int32_t(int32_t *E, int32_t *O, const int n) {
+  const __m128i TWO = _mm_set1_epi32(2);
+
+  E[n] = E[n - 1];
+  for (int i = 0; i < n; i += 4) {
+    __m128i S = _mm_add_epi32(_mm_load_si128((__m128i *)&E[i]), _mm_loadu_si128((__m128i *)&E[i + 1]));
+    _mm_store_si128((__m128i *)&O[i], _mm_sub_epi32(_mm_slli_epi32(_mm_load_si128((__m128i *)&O[i]), 1), S));
+  }
+
+  O[-1] = O[0];
+  for (int i = 0; i < n; i += 4) {
+    __m128i S = _mm_add_epi32(_mm_add_epi32(_mm_loadu_si128((__m128i *)&O[i - 1]), _mm_load_si128((__m128i *)&O[i])), TWO);
+    _mm_store_si128((__m128i *)&E[i], _mm_add_epi32(_mm_slli_epi32(_mm_load_si128((__m128i *)&E[i]), 1), _mm_srai_epi32(S, 2)));
+  }
+}
+
+template<int ACTIVE_BITS> void LeGall_5_3_transform_H_inplace_10P2_sse4_2_int32_t(const char *_idata,
+                                                                                  const int istride,
+                                                                                  void **_odata,
+                                                                                  const int ostride,
+                                                                                  const int iwidth,
+                                                                                  const int iheight,
+                                                                                  const int owidth,
+                                                                                  const int oheight) {
+  int32_t *odata = *((int32_t **)_odata);
+  const int skip = 1;
+
+  const uint16_t *idata = (const uint16_t *)_idata;
+  const __m128i OFFSET = _mm_set1_epi16((int16_t)(1 << (ACTIVE_BITS - 1)));
+
+  const int n = iwidth/2;
+  const int blen = (n + 3)/4*4 + 8;
+  int32_t *buf = (int32_t *)memalign(16, 2*blen*sizeof(int32_t));
+  int32_t *E = buf + 4;
+  int32_t *O = buf + blen + 4;
+
+  int y = 0;
+  for (; y < iheight; y+=skip) {
+    int x = 0;
+    for (; x + 8 <= iwidth; x += 8) {
+      __m128i D0 = _mm_sub_epi16(_mm_loadu_si128((__m128i *)&idata[y*istride + x]), OFFSET); // [  0  1  2  3  4  5  6  7 ]
+      _mm_prefetch(&idata[y*istride + x + 32], _MM_HINT_T0);
+
+      __m128 A0 = _mm_castsi128_ps(_mm_cvtepi16_epi32(D0));                    // [  0  1  2  3 ]
+      __m128 A4 = _mm_castsi128_ps(_mm_cvtepi16_epi32(_mm_srli_si128(D0, 8))); // [  4  5  6  7 ]
+
+      _mm_store_si128((__m128i *)&E[x/2], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(2, 0, 2, 0)))); // [  0  2  4  6 ]
+      _mm_store_si128((__m128i *)&O[x/2], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(3, 1, 3, 1)))); // [  1  3  5  7 ]
+    }
+    for (; x < iwidth; x += 2) {
+      E[x/2] = ((int32_t)idata[y*istride + x + 0]) - (1 << (ACTIVE_BITS - 1));
+      O[x/2] = ((int32_t)idata[y*istride + x + 1]) - (1 << (ACTIVE_BITS - 1));
+    }
+
+    LeGall_5_3_lift_sse4_2_int32_t(E, O, n);
+
+    x = 0;
+    for (; x + 8 <= iwidth; x += 8) {
+      __m128i X0 = _mm_load_si128((__m128i *)&E[x/2]);
+      __m128i X1 = _mm_load_si128((__m128i *)&O[x/2]);
+      _mm_storeu_si128((__m128i *)&odata[y*ostride + x + 0], _mm_unpacklo_epi32(X0, X1)); // {  0  1  2  3 }
+      _mm_storeu_si128((__m128i *)&odata[y*ostride + x + 4], _mm_unpackhi_epi32(X0, X1)); // {  4  5  6  7 }
+    }
+    for (; x < iwidth; x += 2) {
+      odata[y*ostride + x + 0] = E[x/2];
+      odata[y*ostride + x + 1] = O[x/2];
+    }
+
+    for (; x < owidth; x += 2*skip) {
+      odata[y*ostride + x + 0*skip] = odata[y*ostride + transform_pad_source(x + 0*skip, iwidth, skip)];
+      odata[y*ostride + x + 1*skip] = odata[y*ostride + transform_pad_source(x + 1*skip, iwidth, skip)];
+    }
+  }
+  for (; y < oheight; y+=skip) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, skip)*ostride], 4*owidth);
+  }
+
+  free(buf);
+}
+
+template<int skip> void LeGall_5_3_transform_H_inplace_sse4_2_int32_t(void *_idata,
+                                                                    const int istride,
+                                                                    const int width,
+                                                                    const int height,
+                                                                    const int) {
+  int32_t *idata = (int32_t *)_idata;
+
+  const int n = width/(2*skip);
+  const int blen = (n + 3)/4*4 + 8;
+  int32_t *buf = (int32_t *)memalign(16, 2*blen*sizeof(int32_t));
+  int32_t *E = buf + 4;
+  int32_t *O = buf + blen + 4;
+
+  for (int y = 0; y < height; y+=skip) {
+    int i = 0;
+    if (skip == 1) {
+      for (; i + 4 <= n; i += 4) {
+        __m128 A0 = _mm_castsi128_ps(_mm_loadu_si128((__m128i *)&idata[y*istride + 2*i + 0])); // [  0  1  2  3 ]
+        __m128 A4 = _mm_castsi128_ps(_mm_loadu_si128((__m128i *)&idata[y*istride + 2*i + 4])); // [  4  5  6  7 ]
+        _mm_store_si128((__m128i *)&E[i], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(2, 0, 2, 0)))); // [  0  2  4  6 ]
+        _mm_store_si128((__m128i *)&O[i], _mm_castps_si128(_mm_shuffle_ps(A0, A4, _MM_SHUFFLE(3, 1, 3, 1)))); // [  1  3  5  7 ]
+      }
+    }
+    for (; i < n; i++) {
+      E[i] = idata[y*istride + (2*i + 0)*skip];
+      O[i] = idata[y*istride + (2*i + 1)*skip];
+    }
+
+    LeGall_5_3_lift_sse4_2_int32_t(E, O, n);
+
+    i = 0;
+    if (skip == 1) {
+      for (; i + 4 <= n; i += 4) {
+        __m128i X0 = _mm_load_si128((__m128i *)&E[i]);
+        __m128i X1 = _mm_load_si128((__m128i *)&O[i]);
+        _mm_storeu_si128((__m128i *)&idata[y*istride + 2*i + 0], _mm_unpacklo_epi32(X0, X1)); // {  0  1  2  3 }
+        _mm_storeu_si128((__m128i *)&idata[y*istride + 2*i + 4], _mm_unpackhi_epi32(X0, X1)); // {  4  5  6  7 }
+      }
+    }
+    for (; i < n; i++) {
+      idata[y*istride + (2*i + 0)*skip] = E[i];
+      idata[y*istride + (2*i + 1)*skip] = O[i];
+    }
+  }
+
+  free(buf);
+}
+
+template<int skip> void LeGall_5_3_transform_V_inplace_sse4_2_int32_t(void *_idata,
+                                                                    const int istride,
+                                                                    const int width,
+                                                                    const int height,
+                                                                    const int) {
+  int32_t *idata = (int32_t *)_idata;
+  const __m128i ONE = _mm_set1_epi32(1);
+  const __m128i TWO = _mm_set1_epi32(2);
+  const int BLENDMASK = (skip == 1)?0x00:((skip == 2)?0xCC:0xFC);
+  const int xskip = (skip > 4)?skip:4;
+
+#define BLEND_FOR_WRITE(A,B) ((skip == 1)?(A):_mm_blend_epi16(A,B,BLENDMASK))
+
+  __m128i D, Dp1, Dp2;
+  int y = 0;
+  int x = 0;
+  __m128i Xm1, X, Xp1;
+
+  for (int XX = 0; XX < width; XX += 512) {
+    y = 0;
+    for (x = XX; x < width && x < XX + 512; x+=xskip) {
+      D   = _mm_load_si128((__m128i *)&idata[(y + 0*skip)*istride + x]);
+      Dp1 = _mm_load_si128((__m128i *)&idata[(y + 1*skip)*istride + x]);
+      Dp2 = _mm_load_si128((__m128i *)&idata[(y + 2*skip)*istride + x]);
+
+      Xp1 = _mm_sub_epi32(Dp1, _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(D,   Dp2), ONE), 1));
+      Xm1 = Xp1;
+      X   = _mm_add_epi32(D,   _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(Xm1, Xp1) ,TWO), 2));
+      _mm_store_si128((__m128i*)&idata[(y + 0*skip)*istride + x], BLEND_FOR_WRITE(X,   D));
+      _mm_store_si128((__m128i*)&idata[(y + 1*skip)*istride + x], BLEND_FOR_WRITE(Xp1, Dp1));
+    }
+    y += 2*skip;
+
+    for (; y < height - 2*skip; y += 2*skip) {
+      for (x = XX; x < width && x < XX + 512; x+=xskip) {
+        D   = _mm_load_si128((__m128i *)&idata[(y + 0*skip)*istride + x]);
+        Dp1 = _mm_load_si128((__m128i *)&idata[(y + 1*skip)*istride + x]);
+        Dp2 = _mm_load_si128((__m128i *)&idata[(y + 2*skip)*istride + x]);
+
+        Xp1 = _mm_sub_epi32(Dp1, _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(D,   Dp2), ONE), 1));
+        Xm1 = _mm_load_si128((__m128i *)&idata[(y - 1*skip)*istride + x]);
+        X   = _mm_add_epi32(D,   _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(Xm1, Xp1) ,TWO), 2));
+        _mm_store_si128((__m128i*)&idata[(y + 0*skip)*istride + x], BLEND_FOR_WRITE(X,   D));
+        _mm_store_si128((__m128i*)&idata[(y + 1*skip)*istride + x], BLEND_FOR_WRITE(Xp1, Dp1));
+      }
+    }
+
+    for (x = XX; x < width && x < XX + 512; x+=xskip) {
+      D   = _mm_load_si128((__m128i *)&idata[(y + 0*skip)*istride + x]);
+      Dp1 = _mm_load_si128((__m128i *)&idata[(y + 1*skip)*istride + x]);
+      Dp2 = D;
+
+      Xp1 = _mm_sub_epi32(Dp1, _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(D,   Dp2), ONE), 1));
+      Xm1 = _mm_load_si128((__m128i *)&idata[(y - 1*skip)*istride + x]);
+      X   = _mm_add_epi32(D,   _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(Xm1, Xp1) ,TWO), 2));
+      _mm_store_si128((__m128i*)&idata[(y + 0*skip)*istride + x], BLEND_FOR_WRITE(X,   D));
+      _mm_store_si128((__m128i*)&idata[(y + 1*skip)*istride + x], BLEND_FOR_WRITE(Xp1, Dp1));
+    }
+  }
+
+#undef BLEND_FOR_WRITE
+}
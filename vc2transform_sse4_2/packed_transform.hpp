@@ -0,0 +1,334 @@
+/*****************************************************************************
+ * packed_transform.hpp : Unpacking of the packed and semi-planar input formats
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+#include <x86intrin.h>
+
+/* Unpacks one line of UYVY10 into the Y, U and V output lines with the offset
+   removed, eight pixels at a time */
+static inline void UYVY10_unpack_line_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << 9);
+  const __m128i SHUF   = _mm_setr_epi8(2, 3, 6, 7, 10, 11, 14, 15, 0, 1, 8, 9, 4, 5, 12, 13);
+  const uint16_t *D = (const uint16_t *)idata;
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i A = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[2*x + 0]), SHUF); // [ Y0 Y1 Y2 Y3 U0 U1 V0 V1 ]
+    __m128i B = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[2*x + 8]), SHUF); // [ Y4 Y5 Y6 Y7 U2 U3 V2 V3 ]
+
+    __m128i Y  = _mm_sub_epi16(_mm_unpacklo_epi64(A, B), OFFSET);
+    __m128i UV = _mm_sub_epi16(_mm_unpackhi_epi32(A, B), OFFSET);                // [ U0 U1 U2 U3 V0 V1 V2 V3 ]
+
+    _mm_storeu_si128((__m128i *)&odata_y[x], Y);
+    _mm_storel_epi64((__m128i *)&odata_u[x/2], UV);
+    _mm_storel_epi64((__m128i *)&odata_v[x/2], _mm_unpackhi_epi64(UV, UV));
+  }
+  for (; x < width; x += 2) {
+    odata_u[x/2    ] = ((int32_t)D[2*x + 0]) - (1 << 9);
+    odata_y[x   + 0] = ((int32_t)D[2*x + 1]) - (1 << 9);
+    odata_v[x/2    ] = ((int32_t)D[2*x + 2]) - (1 << 9);
+    odata_y[x   + 1] = ((int32_t)D[2*x + 3]) - (1 << 9);
+  }
+}
+
+/* Unpacks one line of 8-bit UYVY into the Y, U and V output lines, eight
+   pixels at a time: the bytes are gathered by component and then widened */
+static inline void UYVY_unpack_line_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << 7);
+  const __m128i SHUF   = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15, 0, 4, 8, 12, 2, 6, 10, 14);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i A = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&idata[2*x]), SHUF);  // [ Y0 .. Y7 U0 .. U3 V0 .. V3 ]
+
+    __m128i Y  = _mm_sub_epi16(_mm_cvtepu8_epi16(A), OFFSET);
+    __m128i UV = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(A, 8)), OFFSET);  // [ U0 U1 U2 U3 V0 V1 V2 V3 ]
+
+    _mm_storeu_si128((__m128i *)&odata_y[x], Y);
+    _mm_storel_epi64((__m128i *)&odata_u[x/2], UV);
+    _mm_storel_epi64((__m128i *)&odata_v[x/2], _mm_unpackhi_epi64(UV, UV));
+  }
+  for (; x < width; x += 2) {
+    odata_u[x/2    ] = ((int32_t)idata[2*x + 0]) - (1 << 7);
+    odata_y[x   + 0] = ((int32_t)idata[2*x + 1]) - (1 << 7);
+    odata_v[x/2    ] = ((int32_t)idata[2*x + 2]) - (1 << 7);
+    odata_y[x   + 1] = ((int32_t)idata[2*x + 3]) - (1 << 7);
+  }
+}
+
+/* Unpacks one line of YUY2 as for UYVY */
+static inline void YUY2_unpack_line_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << 7);
+  const __m128i SHUF   = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 5, 9, 13, 3, 7, 11, 15);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i A = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&idata[2*x]), SHUF);  // [ Y0 .. Y7 U0 .. U3 V0 .. V3 ]
+
+    __m128i Y  = _mm_sub_epi16(_mm_cvtepu8_epi16(A), OFFSET);
+    __m128i UV = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(A, 8)), OFFSET);  // [ U0 U1 U2 U3 V0 V1 V2 V3 ]
+
+    _mm_storeu_si128((__m128i *)&odata_y[x], Y);
+    _mm_storel_epi64((__m128i *)&odata_u[x/2], UV);
+    _mm_storel_epi64((__m128i *)&odata_v[x/2], _mm_unpackhi_epi64(UV, UV));
+  }
+  for (; x < width; x += 2) {
+    odata_y[x   + 0] = ((int32_t)idata[2*x + 0]) - (1 << 7);
+    odata_u[x/2    ] = ((int32_t)idata[2*x + 1]) - (1 << 7);
+    odata_y[x   + 1] = ((int32_t)idata[2*x + 2]) - (1 << 7);
+    odata_v[x/2    ] = ((int32_t)idata[2*x + 3]) - (1 << 7);
+  }
+}
+
+/* Unpacks one line of v410 into the Y, U and V output lines, eight pixels at
+   a time: each field is shifted down and masked in 32 bits and then packed */
+static inline void V410_unpack_line_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  const __m128i MASK   = _mm_set1_epi32(0x3FF);
+  const __m128i OFFSET = _mm_set1_epi16(1 << 9);
+  const uint32_t *D = (const uint32_t *)idata;
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i A = _mm_loadu_si128((__m128i *)&D[x + 0]);
+    __m128i B = _mm_loadu_si128((__m128i *)&D[x + 4]);
+
+    __m128i U = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(A,  2), MASK),
+                                 _mm_and_si128(_mm_srli_epi32(B,  2), MASK));
+    __m128i Y = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(A, 12), MASK),
+                                 _mm_and_si128(_mm_srli_epi32(B, 12), MASK));
+    __m128i V = _mm_packus_epi32(_mm_srli_epi32(A, 22),
+                                 _mm_srli_epi32(B, 22));
+
+    _mm_storeu_si128((__m128i *)&odata_y[x], _mm_sub_epi16(Y, OFFSET));
+    _mm_storeu_si128((__m128i *)&odata_u[x], _mm_sub_epi16(U, OFFSET));
+    _mm_storeu_si128((__m128i *)&odata_v[x], _mm_sub_epi16(V, OFFSET));
+  }
+  for (; x < width; x++) {
+    odata_u[x] = ((int32_t)((D[x] >>  2)&0x3ff)) - (1 << 9);
+    odata_y[x] = ((int32_t)((D[x] >> 12)&0x3ff)) - (1 << 9);
+    odata_v[x] = ((int32_t)((D[x] >> 22)&0x3ff)) - (1 << 9);
+  }
+}
+
+/* Unpacks one line of Y416 into the Y, U and V output lines, eight pixels at
+   a time. Each register of two pixels is shuffled to pair up its samples by
+   component, and the pairs are then gathered with unpacks. */
+template<int ACTIVE_BITS> static inline void Y416_unpack_line_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << (ACTIVE_BITS - 1));
+  const __m128i SHUF   = _mm_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+  const uint16_t *D = (const uint16_t *)idata;
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i P0 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[4*x +  0]), SHUF); // [ U0 U1 Y0 Y1 V0 V1 A0 A1 ]
+    __m128i P1 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[4*x +  8]), SHUF);
+    __m128i P2 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[4*x + 16]), SHUF);
+    __m128i P3 = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[4*x + 24]), SHUF);
+
+    __m128i L01 = _mm_unpacklo_epi32(P0, P1);                                        // [ U0 U1 U2 U3 Y0 Y1 Y2 Y3 ]
+    __m128i L23 = _mm_unpacklo_epi32(P2, P3);
+    __m128i H01 = _mm_unpackhi_epi32(P0, P1);                                        // [ V0 V1 V2 V3 A0 A1 A2 A3 ]
+    __m128i H23 = _mm_unpackhi_epi32(P2, P3);
+
+    __m128i U = _mm_srli_epi16(_mm_unpacklo_epi64(L01, L23), 16 - ACTIVE_BITS);
+    __m128i Y = _mm_srli_epi16(_mm_unpackhi_epi64(L01, L23), 16 - ACTIVE_BITS);
+    __m128i V = _mm_srli_epi16(_mm_unpacklo_epi64(H01, H23), 16 - ACTIVE_BITS);
+
+    _mm_storeu_si128((__m128i *)&odata_y[x], _mm_sub_epi16(Y, OFFSET));
+    _mm_storeu_si128((__m128i *)&odata_u[x], _mm_sub_epi16(U, OFFSET));
+    _mm_storeu_si128((__m128i *)&odata_v[x], _mm_sub_epi16(V, OFFSET));
+  }
+  for (; x < width; x++) {
+    odata_u[x] = ((int32_t)(D[4*x + 0] >> (16 - ACTIVE_BITS))) - (1 << (ACTIVE_BITS - 1));
+    odata_y[x] = ((int32_t)(D[4*x + 1] >> (16 - ACTIVE_BITS))) - (1 << (ACTIVE_BITS - 1));
+    odata_v[x] = ((int32_t)(D[4*x + 2] >> (16 - ACTIVE_BITS))) - (1 << (ACTIVE_BITS - 1));
+  }
+}
+
+/* 4:4:4 packed input for any filter, each line unpacked into the three
+   output planes and given the level zero horizontal transform */
+template<int wavelet_index, void (*UNPACK)(const uint8_t *, int16_t *, int16_t *, int16_t *, const int)>
+void Packed444_transform_H_inplace_sse4_2(const char *_idata,
+                                          const int istride,
+                                          void **_odata,
+                                          const int ostride,
+                                          const int iwidth,
+                                          const int iheight,
+                                          const int owidth,
+                                          const int oheight) {
+  int16_t *odata_y = ((int16_t **)_odata)[0];
+  int16_t *odata_u = ((int16_t **)_odata)[1];
+  int16_t *odata_v = ((int16_t **)_odata)[2];
+  const InplaceTransform transform = get_htransform_sse4_2(wavelet_index, 0, 2);
+
+  const uint8_t *idata = (const uint8_t *)_idata;
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    int16_t *line_y = &odata_y[y*ostride];
+    int16_t *line_u = &odata_u[y*ostride];
+    int16_t *line_v = &odata_v[y*ostride];
+
+    UNPACK(&idata[y*istride], line_y, line_u, line_v, iwidth);
+
+    transform(line_y, ostride, iwidth, 1, 1);
+    transform(line_u, ostride, iwidth, 1, 1);
+    transform(line_v, ostride, iwidth, 1, 1);
+
+    V210_extend_line_sse4_2(line_y, iwidth, owidth);
+    V210_extend_line_sse4_2(line_u, iwidth, owidth);
+    V210_extend_line_sse4_2(line_v, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata_y[y*ostride], &odata_y[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(int16_t));
+    memcpy(&odata_u[y*ostride], &odata_u[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(int16_t));
+    memcpy(&odata_v[y*ostride], &odata_v[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(int16_t));
+  }
+}
+
+/* The luma plane of P210 and P010, eight samples at a time */
+template<int wavelet_index, int ACTIVE_BITS>
+void P2_transform_H_inplace_luma_sse4_2(const char *_idata,
+                                        const int istride,
+                                        void **_odata,
+                                        const int ostride,
+                                        const int iwidth,
+                                        const int iheight,
+                                        const int owidth,
+                                        const int oheight) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << (ACTIVE_BITS - 1));
+  const uint16_t *idata = (const uint16_t *)_idata;
+  int16_t *odata = ((int16_t **)_odata)[0];
+  const InplaceTransform transform = get_htransform_sse4_2(wavelet_index, 0, 2);
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    const uint16_t *D = &idata[y*istride];
+    int16_t *line = &odata[y*ostride];
+
+    int x = 0;
+    for (; x + 8 <= iwidth; x += 8) {
+      __m128i X = _mm_srli_epi16(_mm_loadu_si128((__m128i *)&D[x]), 16 - ACTIVE_BITS);
+      _mm_storeu_si128((__m128i *)&line[x], _mm_sub_epi16(X, OFFSET));
+    }
+    for (; x < iwidth; x++)
+      line[x] = ((int32_t)(D[x] >> (16 - ACTIVE_BITS))) - (1 << (ACTIVE_BITS - 1));
+
+    transform(line, ostride, iwidth, 1, 1);
+
+    V210_extend_line_sse4_2(line, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(int16_t));
+  }
+}
+
+/* The interleaved Cb Cr plane of P210 and P010, split into both colour
+   difference planes eight pairs at a time */
+template<int wavelet_index, int ACTIVE_BITS>
+void P2_transform_H_inplace_chroma_sse4_2(const char *_idata,
+                                          const int istride,
+                                          void **_odata,
+                                          const int ostride,
+                                          const int iwidth,
+                                          const int iheight,
+                                          const int owidth,
+                                          const int oheight) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << (ACTIVE_BITS - 1));
+  const __m128i SHUF   = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+  const uint16_t *idata = (const uint16_t *)_idata;
+  int16_t *odata_u = ((int16_t **)_odata)[0];
+  int16_t *odata_v = ((int16_t **)_odata)[1];
+  const InplaceTransform transform = get_htransform_sse4_2(wavelet_index, 0, 2);
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    const uint16_t *D = &idata[y*istride];
+    int16_t *line_u = &odata_u[y*ostride];
+    int16_t *line_v = &odata_v[y*ostride];
+
+    int x = 0;
+    for (; x + 8 <= iwidth; x += 8) {
+      __m128i A = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[2*x + 0]), SHUF); // [ U0 U1 U2 U3 V0 V1 V2 V3 ]
+      __m128i B = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)&D[2*x + 8]), SHUF); // [ U4 U5 U6 U7 V4 V5 V6 V7 ]
+      __m128i U = _mm_srli_epi16(_mm_unpacklo_epi64(A, B), 16 - ACTIVE_BITS);
+      __m128i V = _mm_srli_epi16(_mm_unpackhi_epi64(A, B), 16 - ACTIVE_BITS);
+      _mm_storeu_si128((__m128i *)&line_u[x], _mm_sub_epi16(U, OFFSET));
+      _mm_storeu_si128((__m128i *)&line_v[x], _mm_sub_epi16(V, OFFSET));
+    }
+    for (; x < iwidth; x++) {
+      line_u[x] = ((int32_t)(D[2*x + 0] >> (16 - ACTIVE_BITS))) - (1 << (ACTIVE_BITS - 1));
+      line_v[x] = ((int32_t)(D[2*x + 1] >> (16 - ACTIVE_BITS))) - (1 << (ACTIVE_BITS - 1));
+    }
+
+    transform(line_u, ostride, iwidth, 1, 1);
+    transform(line_v, ostride, iwidth, 1, 1);
+
+    V210_extend_line_sse4_2(line_u, iwidth, owidth);
+    V210_extend_line_sse4_2(line_v, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata_u[y*ostride], &odata_u[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(int16_t));
+    memcpy(&odata_v[y*ostride], &odata_v[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(int16_t));
+  }
+}
+
+/* One plane of 8-bit planar input, widened eight samples at a time */
+template<int wavelet_index>
+void Planar8_transform_H_inplace_sse4_2(const char *_idata,
+                                        const int istride,
+                                        void **_odata,
+                                        const int ostride,
+                                        const int iwidth,
+                                        const int iheight,
+                                        const int owidth,
+                                        const int oheight) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << 7);
+  const uint8_t *idata = (const uint8_t *)_idata;
+  int16_t *odata = ((int16_t **)_odata)[0];
+  const InplaceTransform transform = get_htransform_sse4_2(wavelet_index, 0, 2);
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    const uint8_t *D = &idata[y*istride];
+    int16_t *line = &odata[y*ostride];
+
+    int x = 0;
+    for (; x + 8 <= iwidth; x += 8) {
+      __m128i X = _mm_cvtepu8_epi16(_mm_loadl_epi64((__m128i *)&D[x]));
+      _mm_storeu_si128((__m128i *)&line[x], _mm_sub_epi16(X, OFFSET));
+    }
+    for (; x < iwidth; x++)
+      line[x] = ((int32_t)D[x]) - (1 << 7);
+
+    transform(line, ostride, iwidth, 1, 1);
+
+    V210_extend_line_sse4_2(line, iwidth, owidth);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata[y*ostride], &odata[transform_pad_line(y, iheight, 1)*ostride], owidth*sizeof(int16_t));
+  }
+}
@@ -0,0 +1,223 @@
+/*****************************************************************************
+ * rgb_transform.hpp : Colour conversion of RGB input formats: SSE4.2 version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <x86intrin.h>
+
+/* The loaders give four pixels at a time as R and G paired in the halves of
+   each 32-bit lane, and B alone in the low half, so that every row of the
+   matrix is two pmaddwd on the registers the samples were loaded into. The
+   scalar loaders are for the ends of lines. */
+static inline void X2RGB10_load4_sse4_2(const uint8_t *idata, const int x, __m128i &RG, __m128i &B) {
+  const __m128i MASK = _mm_set1_epi32(0x3FF);
+  const __m128i W = _mm_loadu_si128((__m128i *)&idata[4*x]);
+
+  B  = _mm_and_si128(W, MASK);
+  RG = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(W, 20), MASK),
+                    _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(W, 10), MASK), 16));
+}
+
+static inline void X2RGB10_load1_sse4_2(const uint8_t *idata, const int x, int32_t &r, int32_t &g, int32_t &b) {
+  const uint32_t D = ((const uint32_t *)idata)[x];
+  b = (D >>  0)&0x3ff;
+  g = (D >> 10)&0x3ff;
+  r = (D >> 20)&0x3ff;
+}
+
+static inline void BGRA_load4_sse4_2(const uint8_t *idata, const int x, __m128i &RG, __m128i &B) {
+  const __m128i SHUF_RG = _mm_setr_epi8(2, -1, 1, -1, 6, -1, 5, -1, 10, -1,  9, -1, 14, -1, 13, -1);
+  const __m128i SHUF_B  = _mm_setr_epi8(0, -1, -1, -1, 4, -1, -1, -1, 8, -1, -1, -1, 12, -1, -1, -1);
+  const __m128i W = _mm_loadu_si128((__m128i *)&idata[4*x]);
+
+  RG = _mm_shuffle_epi8(W, SHUF_RG);
+  B  = _mm_shuffle_epi8(W, SHUF_B);
+}
+
+static inline void BGRA_load1_sse4_2(const uint8_t *idata, const int x, int32_t &r, int32_t &g, int32_t &b) {
+  b = idata[4*x + 0];
+  g = idata[4*x + 1];
+  r = idata[4*x + 2];
+}
+
+/* One row of the matrix for four pixels, before it is shifted down */
+static inline __m128i RGB_matrix_row_sse4_2(const __m128i &RG, const __m128i &B, const __m128i &CRG, const __m128i &CB) {
+  return _mm_add_epi32(_mm_madd_epi16(RG, CRG), _mm_madd_epi16(B, CB));
+}
+
+/* Unpacks one line of RGB to be coded as RGB, eight pixels at a time */
+template<int ACTIVE_BITS,
+         void (*LOAD4)(const uint8_t *, const int, __m128i &, __m128i &),
+         void (*LOAD1)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &)>
+static inline void RGB_unpack_line_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  const __m128i OFFSET = _mm_set1_epi16(1 << (ACTIVE_BITS - 1));
+  const __m128i MASK   = _mm_set1_epi32(0xFFFF);
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i RG0, B0, RG1, B1;
+    LOAD4(idata, x + 0, RG0, B0);
+    LOAD4(idata, x + 4, RG1, B1);
+
+    __m128i G = _mm_packus_epi32(_mm_srli_epi32(RG0, 16), _mm_srli_epi32(RG1, 16));
+    __m128i R = _mm_packus_epi32(_mm_and_si128(RG0, MASK), _mm_and_si128(RG1, MASK));
+    __m128i B = _mm_packus_epi32(B0, B1);
+
+    _mm_storeu_si128((__m128i *)&odata_y[x], _mm_sub_epi16(G, OFFSET));
+    _mm_storeu_si128((__m128i *)&odata_u[x], _mm_sub_epi16(B, OFFSET));
+    _mm_storeu_si128((__m128i *)&odata_v[x], _mm_sub_epi16(R, OFFSET));
+  }
+  for (; x < width; x++) {
+    int32_t r, g, b;
+    LOAD1(idata, x, r, g, b);
+    odata_y[x] = g - (1 << (ACTIVE_BITS - 1));
+    odata_u[x] = b - (1 << (ACTIVE_BITS - 1));
+    odata_v[x] = r - (1 << (ACTIVE_BITS - 1));
+  }
+}
+
+/* Unpacks one line of RGB and matrixes it to 4:4:4 Y'CbCr, eight pixels at
+   a time */
+template<int MATRIX, int ACTIVE_BITS,
+         void (*LOAD4)(const uint8_t *, const int, __m128i &, __m128i &),
+         void (*LOAD1)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &)>
+static inline void RGB_unpack_line_444_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  typedef RGB_matrix<MATRIX, ACTIVE_BITS> M;
+  const __m128i YRG = _mm_setr_epi16(M::YR, M::YG, M::YR, M::YG, M::YR, M::YG, M::YR, M::YG);
+  const __m128i YB  = _mm_setr_epi16(M::YB, 0, M::YB, 0, M::YB, 0, M::YB, 0);
+  const __m128i URG = _mm_setr_epi16(M::UR, M::UG, M::UR, M::UG, M::UR, M::UG, M::UR, M::UG);
+  const __m128i UB  = _mm_setr_epi16(M::UB, 0, M::UB, 0, M::UB, 0, M::UB, 0);
+  const __m128i VRG = _mm_setr_epi16(M::VR, M::VG, M::VR, M::VG, M::VR, M::VG, M::VR, M::VG);
+  const __m128i VB  = _mm_setr_epi16(M::VB, 0, M::VB, 0, M::VB, 0, M::VB, 0);
+  const __m128i YK  = _mm_set1_epi32(M::YK);
+  const __m128i RND = _mm_set1_epi32(1 << (RGB_MATRIX_SHIFT - 1));
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i RG0, B0, RG1, B1;
+    LOAD4(idata, x + 0, RG0, B0);
+    LOAD4(idata, x + 4, RG1, B1);
+
+    __m128i Y = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG0, B0, YRG, YB), YK), RGB_MATRIX_SHIFT),
+                                _mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG1, B1, YRG, YB), YK), RGB_MATRIX_SHIFT));
+    __m128i U = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG0, B0, URG, UB), RND), RGB_MATRIX_SHIFT),
+                                _mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG1, B1, URG, UB), RND), RGB_MATRIX_SHIFT));
+    __m128i V = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG0, B0, VRG, VB), RND), RGB_MATRIX_SHIFT),
+                                _mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG1, B1, VRG, VB), RND), RGB_MATRIX_SHIFT));
+
+    _mm_storeu_si128((__m128i *)&odata_y[x], Y);
+    _mm_storeu_si128((__m128i *)&odata_u[x], U);
+    _mm_storeu_si128((__m128i *)&odata_v[x], V);
+  }
+  for (; x < width; x++) {
+    int32_t r, g, b;
+    LOAD1(idata, x, r, g, b);
+    odata_y[x] = (M::YR*r + M::YG*g + M::YB*b + M::YK) >> RGB_MATRIX_SHIFT;
+    odata_u[x] = (M::UR*r + M::UG*g + M::UB*b + (1 << (RGB_MATRIX_SHIFT - 1))) >> RGB_MATRIX_SHIFT;
+    odata_v[x] = (M::VR*r + M::VG*g + M::VB*b + (1 << (RGB_MATRIX_SHIFT - 1))) >> RGB_MATRIX_SHIFT;
+  }
+}
+
+/* Unpacks one line of RGB and matrixes it to 4:2:2 Y'CbCr, eight pixels at
+   a time. The colour difference sums are split into even and odd pixels and
+   filtered [1 2 1]/4 about the even ones, carrying the last odd sum across
+   to the next eight. */
+template<int MATRIX, int ACTIVE_BITS,
+         void (*LOAD4)(const uint8_t *, const int, __m128i &, __m128i &),
+         void (*LOAD1)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &)>
+static inline void RGB_unpack_line_422_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  typedef RGB_matrix<MATRIX, ACTIVE_BITS> M;
+  const __m128i YRG = _mm_setr_epi16(M::YR, M::YG, M::YR, M::YG, M::YR, M::YG, M::YR, M::YG);
+  const __m128i YB  = _mm_setr_epi16(M::YB, 0, M::YB, 0, M::YB, 0, M::YB, 0);
+  const __m128i URG = _mm_setr_epi16(M::UR, M::UG, M::UR, M::UG, M::UR, M::UG, M::UR, M::UG);
+  const __m128i UB  = _mm_setr_epi16(M::UB, 0, M::UB, 0, M::UB, 0, M::UB, 0);
+  const __m128i VRG = _mm_setr_epi16(M::VR, M::VG, M::VR, M::VG, M::VR, M::VG, M::VR, M::VG);
+  const __m128i VB  = _mm_setr_epi16(M::VB, 0, M::VB, 0, M::VB, 0, M::VB, 0);
+  const __m128i YK  = _mm_set1_epi32(M::YK);
+  const __m128i RND = _mm_set1_epi32(1 << (RGB_MATRIX_SHIFT + 1));
+
+  __m128i prev_u = _mm_setzero_si128();
+  __m128i prev_v = _mm_setzero_si128();
+
+  int x = 0;
+  for (; x + 8 <= width; x += 8) {
+    __m128i RG0, B0, RG1, B1;
+    LOAD4(idata, x + 0, RG0, B0);
+    LOAD4(idata, x + 4, RG1, B1);
+
+    __m128i Y = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG0, B0, YRG, YB), YK), RGB_MATRIX_SHIFT),
+                                _mm_srai_epi32(_mm_add_epi32(RGB_matrix_row_sse4_2(RG1, B1, YRG, YB), YK), RGB_MATRIX_SHIFT));
+    _mm_storeu_si128((__m128i *)&odata_y[x], Y);
+
+    __m128 U0 = _mm_castsi128_ps(RGB_matrix_row_sse4_2(RG0, B0, URG, UB));
+    __m128 U1 = _mm_castsi128_ps(RGB_matrix_row_sse4_2(RG1, B1, URG, UB));
+    __m128 V0 = _mm_castsi128_ps(RGB_matrix_row_sse4_2(RG0, B0, VRG, VB));
+    __m128 V1 = _mm_castsi128_ps(RGB_matrix_row_sse4_2(RG1, B1, VRG, VB));
+
+    __m128i UE = _mm_castps_si128(_mm_shuffle_ps(U0, U1, _MM_SHUFFLE(2, 0, 2, 0)));  // [ u0 u2 u4 u6 ]
+    __m128i UO = _mm_castps_si128(_mm_shuffle_ps(U0, U1, _MM_SHUFFLE(3, 1, 3, 1)));  // [ u1 u3 u5 u7 ]
+    __m128i VE = _mm_castps_si128(_mm_shuffle_ps(V0, V1, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i VO = _mm_castps_si128(_mm_shuffle_ps(V0, V1, _MM_SHUFFLE(3, 1, 3, 1)));
+
+    if (x == 0) {
+      prev_u = _mm_shuffle_epi32(UO, 0);
+      prev_v = _mm_shuffle_epi32(VO, 0);
+    }
+    __m128i UP = _mm_alignr_epi8(UO, prev_u, 12);                                    // [ u-1 u1 u3 u5 ]
+    __m128i VP = _mm_alignr_epi8(VO, prev_v, 12);
+
+    __m128i U = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(UP, UO), _mm_add_epi32(_mm_slli_epi32(UE, 1), RND)), RGB_MATRIX_SHIFT + 2);
+    __m128i V = _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(VP, VO), _mm_add_epi32(_mm_slli_epi32(VE, 1), RND)), RGB_MATRIX_SHIFT + 2);
+    __m128i UV = _mm_packs_epi32(U, V);
+
+    _mm_storel_epi64((__m128i *)&odata_u[x/2], UV);
+    _mm_storel_epi64((__m128i *)&odata_v[x/2], _mm_unpackhi_epi64(UV, UV));
+
+    prev_u = UO;
+    prev_v = VO;
+  }
+
+  int32_t pu = _mm_extract_epi32(prev_u, 3);
+  int32_t pv = _mm_extract_epi32(prev_v, 3);
+  for (; x < width; x += 2) {
+    int32_t r0, g0, b0, r1, g1, b1;
+    LOAD1(idata, x + 0, r0, g0, b0);
+    LOAD1(idata, x + 1, r1, g1, b1);
+    odata_y[x + 0] = (M::YR*r0 + M::YG*g0 + M::YB*b0 + M::YK) >> RGB_MATRIX_SHIFT;
+    odata_y[x + 1] = (M::YR*r1 + M::YG*g1 + M::YB*b1 + M::YK) >> RGB_MATRIX_SHIFT;
+
+    const int32_t u0 = M::UR*r0 + M::UG*g0 + M::UB*b0;
+    const int32_t u1 = M::UR*r1 + M::UG*g1 + M::UB*b1;
+    const int32_t v0 = M::VR*r0 + M::VG*g0 + M::VB*b0;
+    const int32_t v1 = M::VR*r1 + M::VG*g1 + M::VB*b1;
+    if (x == 0) {
+      pu = u1;
+      pv = v1;
+    }
+    odata_u[x/2] = (pu + 2*u0 + u1 + (1 << (RGB_MATRIX_SHIFT + 1))) >> (RGB_MATRIX_SHIFT + 2);
+    odata_v[x/2] = (pv + 2*v0 + v1 + (1 << (RGB_MATRIX_SHIFT + 1))) >> (RGB_MATRIX_SHIFT + 2);
+    pu = u1;
+    pv = v1;
+  }
+}
@@ -30,5 +30,9 @@
 
 #include "legall_transform.hpp"
 #include "haar_transform.hpp"
+#include "daubechies_9_7_transform.hpp"
+#include "v210_transform.hpp"
+#include "packed_transform.hpp"
+#include "rgb_transform.hpp"
 
 #endif /* __SSE4_2_TRANSFORM_KERNELS_HPP__ */
@@ -31,33 +31,172 @@
 #include "transform_sse4_2.hpp"
 #include "transform_kernels.hpp"
 
-InplaceTransformInitial get_htransforminitial_sse4_2(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt) {
+template<int ACTIVE_BITS> static InplaceTransformInitial get_htransforminitial_10P2_sse4_2_int16_t(int wavelet_index) {
+  switch (wavelet_index) {
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    return LeGall_5_3_transform_H_inplace_10P2_sse4_2<ACTIVE_BITS>;
+  case VC2ENCODER_WFT_DAUBECHIES_9_7:
+    /* The lifting sums only fit sixteen bits for samples of up to ten bits */
+    if (ACTIVE_BITS <= 10)
+      return Daubechies_9_7_transform_H_inplace_10P2_sse4_2<ACTIVE_BITS>;
+    break;
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2<ACTIVE_BITS, 0, int16_t>;
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2<ACTIVE_BITS, 1, int16_t>;
+  }
+  return NULL;
+}
+
+template<int ACTIVE_BITS> static InplaceTransformInitial get_htransforminitial_10P2_sse4_2_int32_t(int wavelet_index) {
+  switch (wavelet_index) {
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    return LeGall_5_3_transform_H_inplace_10P2_sse4_2_int32_t<ACTIVE_BITS>;
+  case VC2ENCODER_WFT_DAUBECHIES_9_7:
+    return Daubechies_9_7_transform_H_inplace_10P2_sse4_2_int32_t<ACTIVE_BITS>;
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2<ACTIVE_BITS, 0, int32_t>;
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    return Haar_transform_H_inplace_10P2_sse4_2<ACTIVE_BITS, 1, int32_t>;
+  }
+  return NULL;
+}
+
+template<int wavelet_index, int ACTIVE_BITS,
+         void (*LOAD4)(const uint8_t *, const int, __m128i &, __m128i &),
+         void (*LOAD1)(const uint8_t *, const int, int32_t &, int32_t &, int32_t &)>
+static InplaceTransformInitial get_htransforminitial_rgb_sse4_2(int color_diff_format, int color_matrix) {
+  switch (color_matrix) {
+  case VC2ENCODER_CMA_RGB:
+    if (color_diff_format == VC2ENCODER_CDS_444)
+      return Packed444_transform_H_inplace_sse4_2<wavelet_index, RGB_unpack_line_sse4_2<ACTIVE_BITS, LOAD4, LOAD1> >;
+    break;
+  case VC2ENCODER_CMA_HDTV:
+    if (color_diff_format == VC2ENCODER_CDS_444)
+      return Packed444_transform_H_inplace_sse4_2<wavelet_index, RGB_unpack_line_444_sse4_2<VC2ENCODER_CMA_HDTV, ACTIVE_BITS, LOAD4, LOAD1> >;
+    if (color_diff_format == VC2ENCODER_CDS_422)
+      return V210_transform_H_inplace_sse4_2<wavelet_index, RGB_unpack_line_422_sse4_2<VC2ENCODER_CMA_HDTV, ACTIVE_BITS, LOAD4, LOAD1> >;
+    break;
+  case VC2ENCODER_CMA_SDTV:
+    if (color_diff_format == VC2ENCODER_CDS_444)
+      return Packed444_transform_H_inplace_sse4_2<wavelet_index, RGB_unpack_line_444_sse4_2<VC2ENCODER_CMA_SDTV, ACTIVE_BITS, LOAD4, LOAD1> >;
+    if (color_diff_format == VC2ENCODER_CDS_422)
+      return V210_transform_H_inplace_sse4_2<wavelet_index, RGB_unpack_line_422_sse4_2<VC2ENCODER_CMA_SDTV, ACTIVE_BITS, LOAD4, LOAD1> >;
+    break;
+  }
+  return NULL;
+}
+
+template<int wavelet_index> static InplaceTransformInitial get_htransforminitial_packed_sse4_2(int active_bits, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix) {
+  switch (fmt) {
+  case VC2ENCODER_INPUT_UYVY10:
+    if (c == 0 && active_bits == 10)
+      return V210_transform_H_inplace_sse4_2<wavelet_index, UYVY10_unpack_line_sse4_2>;
+    break;
+  case VC2ENCODER_INPUT_V410:
+    if (c == 0 && active_bits == 10)
+      return Packed444_transform_H_inplace_sse4_2<wavelet_index, V410_unpack_line_sse4_2>;
+    break;
+  case VC2ENCODER_INPUT_Y416:
+    if (c == 0 && active_bits == 10)
+      return Packed444_transform_H_inplace_sse4_2<wavelet_index, Y416_unpack_line_sse4_2<10> >;
+    if (c == 0 && active_bits == 12)
+      return Packed444_transform_H_inplace_sse4_2<wavelet_index, Y416_unpack_line_sse4_2<12> >;
+    break;
+  case VC2ENCODER_INPUT_P210:
+  case VC2ENCODER_INPUT_P010:
+    if (c == 0 && active_bits == 10)
+      return P2_transform_H_inplace_luma_sse4_2<wavelet_index, 10>;
+    if (c == 0 && active_bits == 12)
+      return P2_transform_H_inplace_luma_sse4_2<wavelet_index, 12>;
+    if (c == 1 && active_bits == 10)
+      return P2_transform_H_inplace_chroma_sse4_2<wavelet_index, 10>;
+    if (c == 1 && active_bits == 12)
+      return P2_transform_H_inplace_chroma_sse4_2<wavelet_index, 12>;
+    break;
+  case VC2ENCODER_INPUT_8P2:
+    if (active_bits == 8)
+      return Planar8_transform_H_inplace_sse4_2<wavelet_index>;
+    break;
+  case VC2ENCODER_INPUT_UYVY:
+    if (c == 0 && active_bits == 8)
+      return V210_transform_H_inplace_sse4_2<wavelet_index, UYVY_unpack_line_sse4_2>;
+    break;
+  case VC2ENCODER_INPUT_YUY2:
+    if (c == 0 && active_bits == 8)
+      return V210_transform_H_inplace_sse4_2<wavelet_index, YUY2_unpack_line_sse4_2>;
+    break;
+  case VC2ENCODER_INPUT_X2RGB10:
+    if (c == 0 && active_bits == 10)
+      return get_htransforminitial_rgb_sse4_2<wavelet_index, 10, X2RGB10_load4_sse4_2, X2RGB10_load1_sse4_2>(color_diff_format, color_matrix);
+    break;
+  case VC2ENCODER_INPUT_BGRA:
+    if (c == 0 && active_bits == 8)
+      return get_htransforminitial_rgb_sse4_2<wavelet_index, 8, BGRA_load4_sse4_2, BGRA_load1_sse4_2>(color_diff_format, color_matrix);
+    break;
+  default:
+    break;
+  }
+  return NULL;
+}
+
+/* The packed and semi-planar formats with sixteen bit coefficients. Any
+   component without a kernel here has either been unpacked with component 0
+   or is left to the C version. */
+static InplaceTransformInitial get_htransforminitial_packed_sse4_2(int wavelet_index, int active_bits, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix) {
+  switch (wavelet_index) {
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
+    return get_htransforminitial_packed_sse4_2<VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7>(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
+    return get_htransforminitial_packed_sse4_2<VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7>(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_LEGALL_5_3:
+    return get_htransforminitial_packed_sse4_2<VC2ENCODER_WFT_LEGALL_5_3>(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_DAUBECHIES_9_7:
+    return get_htransforminitial_packed_sse4_2<VC2ENCODER_WFT_DAUBECHIES_9_7>(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+    return get_htransforminitial_packed_sse4_2<VC2ENCODER_WFT_HAAR_NO_SHIFT>(active_bits, c, fmt, color_diff_format, color_matrix);
+  case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+    return get_htransforminitial_packed_sse4_2<VC2ENCODER_WFT_HAAR_SINGLE_SHIFT>(active_bits, c, fmt, color_diff_format, color_matrix);
+  }
+  return NULL;
+}
+
+InplaceTransformInitial get_htransforminitial_sse4_2(int wavelet_index, int active_bits, int coef_size, int c, VC2EncoderInputFormat fmt, int color_diff_format, int color_matrix) {
   (void)c;
 
   if (fmt == VC2ENCODER_INPUT_10P2) {
-    if (active_bits != 10) {
-      writelog(LOG_ERROR, "%s:%d:  invalid bit depth", __FILE__, __LINE__);
-      throw VC2ENCODER_NOTIMPLEMENTED;
-    }
-
+    InplaceTransformInitial r = NULL;
     if (coef_size == 2) {
-      switch (wavelet_index) {
-      case VC2ENCODER_WFT_LEGALL_5_3:
-        return LeGall_5_3_transform_H_inplace_10P2_sse4_2;
-      case VC2ENCODER_WFT_HAAR_NO_SHIFT:
-        return Haar_transform_H_inplace_10P2_sse4_2<0, int16_t>;
-      case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
-        return Haar_transform_H_inplace_10P2_sse4_2<1, int16_t>;
+      switch (active_bits) {
+      case 8:
+        r = get_htransforminitial_10P2_sse4_2_int16_t<8>(wavelet_index);
+        break;
+      case 10:
+        r = get_htransforminitial_10P2_sse4_2_int16_t<10>(wavelet_index);
+        break;
+      case 12:
+        r = get_htransforminitial_10P2_sse4_2_int16_t<12>(wavelet_index);
+        break;
       }
     } else if (coef_size == 4) {
-      switch (wavelet_index) {
-      case VC2ENCODER_WFT_HAAR_NO_SHIFT:
-        return Haar_transform_H_inplace_10P2_sse4_2<0, int32_t>;
-      case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
-        return Haar_transform_H_inplace_10P2_sse4_2<1, int32_t>;
+      switch (active_bits) {
+      case 8:
+        r = get_htransforminitial_10P2_sse4_2_int32_t<8>(wavelet_index);
+        break;
+      case 10:
+        r = get_htransforminitial_10P2_sse4_2_int32_t<10>(wavelet_index);
+        break;
+      case 12:
+        r = get_htransforminitial_10P2_sse4_2_int32_t<12>(wavelet_index);
+        break;
+      case 16:
+        r = get_htransforminitial_10P2_sse4_2_int32_t<16>(wavelet_index);
+        break;
       }
     }
-  } else if (fmt == VC2ENCODER_INPUT_V210) {
+    if (r)
+      return r;
+  } else if (fmt == VC2ENCODER_INPUT_V210 && active_bits == 10) {
     if (c != 0)
       return NULL;
 
@@ -69,11 +208,21 @@ InplaceTransformInitial get_htransforminitial_sse4_2(int wavelet_index, int acti
         return Haar_transform_H_inplace_V210_sse4_2<0, int16_t>;
       case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
         return Haar_transform_H_inplace_V210_sse4_2<1, int16_t>;
+      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7:
+        return V210_transform_H_inplace_sse4_2<VC2ENCODER_WFT_DESLAURIERS_DUBUC_9_7, V210_unpack_line_sse4_2>;
+      case VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7:
+        return V210_transform_H_inplace_sse4_2<VC2ENCODER_WFT_DESLAURIERS_DUBUC_13_7, V210_unpack_line_sse4_2>;
+      case VC2ENCODER_WFT_DAUBECHIES_9_7:
+        return V210_transform_H_inplace_sse4_2<VC2ENCODER_WFT_DAUBECHIES_9_7, V210_unpack_line_sse4_2>;
       }
     }
+  } else if (fmt != VC2ENCODER_INPUT_V210 && coef_size == 2) {
+    InplaceTransformInitial r = get_htransforminitial_packed_sse4_2(wavelet_index, active_bits, c, fmt, color_diff_format, color_matrix);
+    if (r)
+      return r;
   }
 
-  return get_htransforminitial_c(wavelet_index, active_bits, coef_size, c, fmt);
+  return get_htransforminitial_c(wavelet_index, active_bits, coef_size, c, fmt, color_diff_format, color_matrix);
 }
 
 InplaceTransform get_htransform_sse4_2(int wavelet_index, int level, int coef_size) {
@@ -85,6 +234,18 @@ InplaceTransform get_htransform_sse4_2(int wavelet_index, int level, int coef_si
         return LeGall_5_3_transform_H_inplace_sse4_2<2>;
       }
       break;
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_H_inplace_sse4_2<1>;
+      case 1:
+        return Daubechies_9_7_transform_H_inplace_sse4_2<2>;
+      case 2:
+        return Daubechies_9_7_transform_H_inplace_sse4_2<4>;
+      case 3:
+        return Daubechies_9_7_transform_H_inplace_sse4_2<8>;
+      }
+      break;
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
       switch (level) {
       case 1:
@@ -98,6 +259,70 @@ InplaceTransform get_htransform_sse4_2(int wavelet_index, int level, int coef_si
       }
       break;
     }
+  } else if (coef_size == 4) {
+    switch (wavelet_index) {
+    case VC2ENCODER_WFT_LEGALL_5_3:
+      switch (level) {
+      case 0:
+        return LeGall_5_3_transform_H_inplace_sse4_2_int32_t<1>;
+      }
+      break;
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      /* Measured no faster than the C version beyond level 4 */
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_H_inplace_sse4_2_int32_t<1>;
+      case 1:
+        return Daubechies_9_7_transform_H_inplace_sse4_2_int32_t<2>;
+      case 2:
+        return Daubechies_9_7_transform_H_inplace_sse4_2_int32_t<4>;
+      case 3:
+        return Daubechies_9_7_transform_H_inplace_sse4_2_int32_t<8>;
+      case 4:
+        return Daubechies_9_7_transform_H_inplace_sse4_2_int32_t<16>;
+      }
+      break;
+    case VC2ENCODER_WFT_HAAR_NO_SHIFT:
+      switch (level) {
+      case 0:
+        return Haar_transform_H_inplace_sse4_2_int32_t<1,0>;
+      case 1:
+        return Haar_transform_H_inplace_sse4_2_int32_t<2,0>;
+      case 2:
+        return Haar_transform_H_inplace_sse4_2_int32_t<4,0>;
+      case 3:
+        return Haar_transform_H_inplace_sse4_2_int32_t<8,0>;
+      case 4:
+        return Haar_transform_H_inplace_sse4_2_int32_t<16,0>;
+      case 5:
+        return Haar_transform_H_inplace_sse4_2_int32_t<32,0>;
+      case 6:
+        return Haar_transform_H_inplace_sse4_2_int32_t<64,0>;
+      case 7:
+        return Haar_transform_H_inplace_sse4_2_int32_t<128,0>;
+      }
+      break;
+    case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
+      switch (level) {
+      case 0:
+        return Haar_transform_H_inplace_sse4_2_int32_t<1,1>;
+      case 1:
+        return Haar_transform_H_inplace_sse4_2_int32_t<2,1>;
+      case 2:
+        return Haar_transform_H_inplace_sse4_2_int32_t<4,1>;
+      case 3:
+        return Haar_transform_H_inplace_sse4_2_int32_t<8,1>;
+      case 4:
+        return Haar_transform_H_inplace_sse4_2_int32_t<16,1>;
+      case 5:
+        return Haar_transform_H_inplace_sse4_2_int32_t<32,1>;
+      case 6:
+        return Haar_transform_H_inplace_sse4_2_int32_t<64,1>;
+      case 7:
+        return Haar_transform_H_inplace_sse4_2_int32_t<128,1>;
+      }
+      break;
+    }
   }
 
   return get_htransform_c(wavelet_index, level, coef_size);
@@ -114,15 +339,26 @@ InplaceTransform get_vtransform_sse4_2(int wavelet_index, int level, int coef_si
         return LeGall_5_3_transform_V_inplace_sse4_2<2>;
       }
       break;
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_V_inplace_sse4_2<1>;
+      case 1:
+        return Daubechies_9_7_transform_V_inplace_sse4_2<2>;
+      case 2:
+        return Daubechies_9_7_transform_V_inplace_sse4_2<4>;
+      case 3:
+        return Daubechies_9_7_transform_V_inplace_sse4_2<8>;
+      }
+      break;
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
     case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
       switch (level) {
       case 0:
         if (fmt == VC2ENCODER_INPUT_10P2)
           return NULL;
-        else if (fmt == VC2ENCODER_INPUT_V210)
+        else
           return Haar_transform_V_inplace_sse4_2<1, int16_t>;
-        break;
       case 1:
         return Haar_transform_V_inplace_sse4_2<2, int16_t>;
       case 2:
@@ -134,14 +370,57 @@ InplaceTransform get_vtransform_sse4_2(int wavelet_index, int level, int coef_si
     }
   } else if (coef_size == 4) {
     switch (wavelet_index) {
+    case VC2ENCODER_WFT_LEGALL_5_3:
+      switch (level) {
+      case 0:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<1>;
+      case 1:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<2>;
+      case 2:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<4>;
+      case 3:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<8>;
+      case 4:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<16>;
+      case 5:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<32>;
+      case 6:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<64>;
+      case 7:
+        return LeGall_5_3_transform_V_inplace_sse4_2_int32_t<128>;
+      }
+      break;
+    case VC2ENCODER_WFT_DAUBECHIES_9_7:
+      /* Measured slower than the C version at levels 2 and 3 */
+      switch (level) {
+      case 0:
+        return Daubechies_9_7_transform_V_inplace_sse4_2_int32_t<1>;
+      case 1:
+        return Daubechies_9_7_transform_V_inplace_sse4_2_int32_t<2>;
+      case 4:
+        return Daubechies_9_7_transform_V_inplace_sse4_2_int32_t<16>;
+      case 5:
+        return Daubechies_9_7_transform_V_inplace_sse4_2_int32_t<32>;
+      case 6:
+        return Daubechies_9_7_transform_V_inplace_sse4_2_int32_t<64>;
+      case 7:
+        return Daubechies_9_7_transform_V_inplace_sse4_2_int32_t<128>;
+      }
+      break;
     case VC2ENCODER_WFT_HAAR_NO_SHIFT:
     case VC2ENCODER_WFT_HAAR_SINGLE_SHIFT:
       switch (level) {
       case 0:
         if (fmt == VC2ENCODER_INPUT_10P2)
           return NULL;
-        else if (fmt == VC2ENCODER_INPUT_V210)
+        else
           return Haar_transform_V_inplace_sse4_2<1, int32_t>;
+      case 1:
+        return Haar_transform_V_inplace_sse4_2<2, int32_t>;
+      case 2:
+        return Haar_transform_V_inplace_sse4_2<4, int32_t>;
+      case 3:
+        return Haar_transform_V_inplace_sse4_2<8, int32_t>;
       }
       break;
     }
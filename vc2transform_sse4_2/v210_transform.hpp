@@ -0,0 +1,155 @@
+/*****************************************************************************
+ * v210_transform.hpp : V210 unpacking for the filters without a fused kernel:
+ *                      SSE4.2 version
+ *****************************************************************************
+ * Copyright (C) 2014-2015 BBC
+ *
+ * Authors: James P. Weaver <james.barrett@bbc.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at ipstudio@bbc.co.uk.
+ *****************************************************************************/
+
+#include "transform.hpp"
+#include <string.h>
+#include <x86intrin.h>
+
+/* Unpacks one line of V210 into the Y, U and V output lines with the offset
+   removed, twelve pixels at a time. Each 32-bit word holds three samples, so
+   the three fields of eight words are packed into P0, P1 and P2 and the
+   samples are then picked out of those with blends and byte shuffles. */
+static inline void V210_unpack_line_sse4_2(const uint8_t *idata, int16_t *odata_y, int16_t *odata_u, int16_t *odata_v, const int width) {
+  const __m128i MASK   = _mm_set1_epi32(0x3FF);
+  const __m128i OFFSET = _mm_set1_epi16(1 << 9);
+  const char Z = (char)0x80;
+  const __m128i Y_LO_A = _mm_setr_epi8( 0,  1,  2,  3,  Z,  Z,  4,  5,  6,  7,  Z,  Z,  8,  9, 10, 11);
+  const __m128i Y_LO_B = _mm_setr_epi8( Z,  Z,  Z,  Z,  2,  3,  Z,  Z,  Z,  Z,  6,  7,  Z,  Z,  Z,  Z);
+  const __m128i Y_HI_A = _mm_setr_epi8( Z,  Z, 12, 13, 14, 15,  Z,  Z,  Z,  Z,  Z,  Z,  Z,  Z,  Z,  Z);
+  const __m128i Y_HI_B = _mm_setr_epi8(10, 11,  Z,  Z,  Z,  Z, 14, 15,  Z,  Z,  Z,  Z,  Z,  Z,  Z,  Z);
+  const __m128i U_SHUF = _mm_setr_epi8( 0,  1,  2,  3,  4,  5,  8,  9, 10, 11, 12, 13,  Z,  Z,  Z,  Z);
+  const __m128i V_SHUF = _mm_setr_epi8( 0,  1,  4,  5,  6,  7,  8,  9, 12, 13, 14, 15,  Z,  Z,  Z,  Z);
+
+  int x = 0;
+  for (; x + 12 <= width; x += 12) {
+    __m128i A = _mm_loadu_si128((__m128i *)&idata[x/12*32 +  0]);
+    __m128i B = _mm_loadu_si128((__m128i *)&idata[x/12*32 + 16]);
+
+    __m128i P0 = _mm_packus_epi32(_mm_and_si128(A, MASK),
+                                  _mm_and_si128(B, MASK));                     // [ U0 Y1 V1 Y4 U3 Y7 V4 Y10 ]
+    __m128i P1 = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(A, 10), MASK),
+                                  _mm_and_si128(_mm_srli_epi32(B, 10), MASK)); // [ Y0 U1 Y3 V2 Y6 U4 Y9  V5 ]
+    __m128i P2 = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(A, 20), MASK),
+                                  _mm_and_si128(_mm_srli_epi32(B, 20), MASK)); // [ V0 Y2 U2 Y5 V3 Y8 U5 Y11 ]
+    P0 = _mm_sub_epi16(P0, OFFSET);
+    P1 = _mm_sub_epi16(P1, OFFSET);
+    P2 = _mm_sub_epi16(P2, OFFSET);
+
+    __m128i YA = _mm_blend_epi16(P1, P0, 0xAA);                                // [ Y0 Y1 Y3 Y4 Y6 Y7 Y9 Y10 ]
+    __m128i Y0 = _mm_or_si128(_mm_shuffle_epi8(YA, Y_LO_A), _mm_shuffle_epi8(P2, Y_LO_B));
+    __m128i Y8 = _mm_or_si128(_mm_shuffle_epi8(YA, Y_HI_A), _mm_shuffle_epi8(P2, Y_HI_B));
+    __m128i U  = _mm_shuffle_epi8(_mm_blend_epi16(_mm_blend_epi16(P0, P1, 0x22), P2, 0x44), U_SHUF);
+    __m128i V  = _mm_shuffle_epi8(_mm_blend_epi16(_mm_blend_epi16(P2, P0, 0x44), P1, 0x88), V_SHUF);
+
+    _mm_storeu_si128((__m128i *)&odata_y[x + 0], Y0);
+    _mm_storel_epi64((__m128i *)&odata_y[x + 8], Y8);
+    _mm_storel_epi64((__m128i *)&odata_u[x/2], U);
+    *((int32_t *)&odata_u[x/2 + 4]) = _mm_extract_epi32(U, 2);
+    _mm_storel_epi64((__m128i *)&odata_v[x/2], V);
+    *((int32_t *)&odata_v[x/2 + 4]) = _mm_extract_epi32(V, 2);
+  }
+
+  if (x == width)
+    return;
+
+  /* The line is padded to 48 pixels in the input so the last group of twelve
+     can be unpacked in full, but only its first samples are written out */
+  const uint32_t *D = (const uint32_t *)&idata[x/12*32];
+  int16_t Y[12], U[6], V[6];
+  for (int i = 0; i < 2; i++) {
+#define SAMPLE(W,S) (((int32_t)((D[4*i + (W)] >> (S))&0x3ff)) - (1 << 9))
+    U[3*i + 0] = SAMPLE(0,  0);
+    Y[6*i + 0] = SAMPLE(0, 10);
+    V[3*i + 0] = SAMPLE(0, 20);
+    Y[6*i + 1] = SAMPLE(1,  0);
+    U[3*i + 1] = SAMPLE(1, 10);
+    Y[6*i + 2] = SAMPLE(1, 20);
+    V[3*i + 1] = SAMPLE(2,  0);
+    Y[6*i + 3] = SAMPLE(2, 10);
+    U[3*i + 2] = SAMPLE(2, 20);
+    Y[6*i + 4] = SAMPLE(3,  0);
+    V[3*i + 2] = SAMPLE(3, 10);
+    Y[6*i + 5] = SAMPLE(3, 20);
+#undef SAMPLE
+  }
+  for (int i = 0; x + i < width; i++)
+    odata_y[x + i] = Y[i];
+  for (int i = 0; x + 2*i < width; i++) {
+    odata_u[x/2 + i] = U[i];
+    odata_v[x/2 + i] = V[i];
+  }
+}
+
+static inline void V210_extend_line_sse4_2(int16_t *odata, const int iwidth, const int owidth) {
+  for (int x = iwidth; x < owidth; x += 2) {
+    odata[x + 0] = odata[transform_pad_source(x + 0, iwidth, 1)];
+    odata[x + 1] = odata[transform_pad_source(x + 1, iwidth, 1)];
+  }
+}
+
+/* V210 input for the filters which have no fused unpack and transform kernel:
+   each line is unpacked straight into the three output planes and then given
+   the best level zero horizontal transform available at this level of
+   instruction set, while it is still in cache. The other 4:2:2 packings use
+   the same loop with their own unpack. */
+template<int wavelet_index, void (*UNPACK)(const uint8_t *, int16_t *, int16_t *, int16_t *, const int)>
+void V210_transform_H_inplace_sse4_2(const char *_idata,
+                                     const int istride,
+                                     void **_odata,
+                                     const int ostride,
+                                     const int iwidth,
+                                     const int iheight,
+                                     const int owidth,
+                                     const int oheight) {
+  int16_t *odata_y = ((int16_t **)_odata)[0];
+  int16_t *odata_u = ((int16_t **)_odata)[1];
+  int16_t *odata_v = ((int16_t **)_odata)[2];
+  const InplaceTransform transform = get_htransform_sse4_2(wavelet_index, 0, 2);
+
+  const uint8_t *idata = (const uint8_t *)_idata;
+
+  int y = 0;
+  for (; y < iheight; y++) {
+    int16_t *line_y = &odata_y[y*ostride];
+    int16_t *line_u = &odata_u[y*ostride/2];
+    int16_t *line_v = &odata_v[y*ostride/2];
+
+    UNPACK(&idata[y*istride], line_y, line_u, line_v, iwidth);
+
+    transform(line_y, ostride,   iwidth,   1, 1);
+    transform(line_u, ostride/2, iwidth/2, 1, 1);
+    transform(line_v, ostride/2, iwidth/2, 1, 1);
+
+    V210_extend_line_sse4_2(line_y, iwidth,   owidth);
+    V210_extend_line_sse4_2(line_u, iwidth/2, owidth/2);
+    V210_extend_line_sse4_2(line_v, iwidth/2, owidth/2);
+  }
+  for (; y < oheight; y++) {
+    memcpy(&odata_y[y*ostride],   &odata_y[transform_pad_line(y, iheight, 1)*ostride],   owidth*sizeof(int16_t));
+    memcpy(&odata_u[y*ostride/2], &odata_u[transform_pad_line(y, iheight, 1)*ostride/2], owidth/2*sizeof(int16_t));
+    memcpy(&odata_v[y*ostride/2], &odata_v[transform_pad_line(y, iheight, 1)*ostride/2], owidth/2*sizeof(int16_t));
+  }
+}